@@ -0,0 +1,96 @@
+#include "anemometer_health.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Reed bounce settles well within this.
+constexpr uint32_t kDebounceUs = 500;
+// Longer than this between closures is a lull, not a revolution.
+constexpr uint32_t kMaxPeriodUs = 2'000'000;
+constexpr float kAlpha = 1.0f / 256;
+
+float Ewma(float average, float x, bool first) {
+  return first ? x : average + kAlpha * (x - average);
+}
+
+}  // namespace
+
+void AnemometerHealth::OnEdge(uint32_t t_us, bool closed) {
+  // Repeats of the current state are the tail of a bounce, as are edges too
+  // soon after the last one we took.
+  if (closed == closed_ || t_us - last_edge_us_ < kDebounceUs) return;
+  closed_ = closed;
+  last_edge_us_ = t_us;
+  if (!closed) {
+    last_open_us_ = t_us;
+    return;
+  }
+  // A closure has ended when the reed opened after it closed; the wrapping
+  // subtraction compares the two within the last 71 minutes.
+  if (last_close_us_ && last_open_us_ &&
+      *last_open_us_ - *last_close_us_ < t_us - *last_close_us_) {
+    AddClosure(t_us - *last_close_us_, *last_open_us_ - *last_close_us_);
+  }
+  last_close_us_ = t_us;
+}
+
+void AnemometerHealth::AddClosure(uint32_t period_us, uint32_t closed_us) {
+  const uint32_t index = closure_index_++;
+  const float mph = reference_.mph_per_hz * 1e6f / period_us;
+  int band = -1;
+  for (int i = 0; i < kBands; ++i) {
+    if (mph >= kBandEdgesMph[i] && mph < kBandEdgesMph[i + 1]) band = i;
+  }
+  if (period_us > kMaxPeriodUs || band < 0) {
+    last_period_us_ = 0;
+    return;
+  }
+
+  Band& b = bands_[band];
+  Accumulators& acc = acc_[band];
+  const float duty = static_cast<float>(closed_us) / period_us;
+  ++b.closures;
+  b.duty = Ewma(b.duty, duty, b.closures == 1);
+
+  const int phases =
+      std::clamp(reference_.closures_per_revolution, 1, kMaxPhases);
+  const int phase = index % phases;
+  acc.phase_duty[phase] =
+      Ewma(acc.phase_duty[phase], duty, acc.phase_closures[phase]++ == 0);
+  if (phases > 1 && *std::min_element(
+                        acc.phase_closures.begin(),
+                        acc.phase_closures.begin() + phases) > 0) {
+    const auto [lo, hi] = std::minmax_element(
+        acc.phase_duty.begin(), acc.phase_duty.begin() + phases);
+    b.asymmetry = *hi - *lo;
+  }
+
+  // Only compare neighbouring periods within one band, so a gust's
+  // acceleration doesn't read as jitter.
+  if (last_period_us_ != 0 && band == last_band_) {
+    const float jitter = (static_cast<float>(period_us) - last_period_us_) /
+                         (0.5f * (period_us + last_period_us_));
+    acc.jitter_sq =
+        Ewma(acc.jitter_sq, jitter * jitter, acc.jitter_samples++ == 0);
+    b.jitter_rms = std::sqrt(acc.jitter_sq);
+  }
+  last_period_us_ = period_us;
+  last_band_ = band;
+}
+
+std::optional<float> AnemometerHealth::HealthPercent() const {
+  std::optional<float> worst;
+  for (const Band& b : bands_) {
+    if (b.closures < kMinClosures) continue;
+    // Each metric as a fraction of its tolerance.
+    const float deviation = std::max(
+        {std::abs(b.duty - reference_.nominal_duty) / reference_.duty_tolerance,
+         b.jitter_rms / reference_.max_jitter,
+         b.asymmetry / reference_.max_asymmetry});
+    worst = std::max(worst.value_or(0), deviation);
+  }
+  if (!worst) return std::nullopt;
+  return 100 * std::clamp(1 - *worst / 2, 0.0f, 1.0f);
+}
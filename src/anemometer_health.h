@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+// What a healthy anemometer of a given model looks like.
+struct AnemometerReference {
+  float mph_per_hz;  // Per reed closure per second.
+  // Magnet passes per revolution, up to kMaxPhases. Asymmetry compares the
+  // closures within a revolution, so it needs at least two.
+  int closures_per_revolution;
+  // Fraction of each closure-to-closure period the reed is closed.
+  float nominal_duty;
+  float duty_tolerance;
+  // Limits on rms relative change between consecutive periods, and on the
+  // duty difference between alternate closures.
+  float max_jitter;
+  float max_asymmetry;
+};
+
+// SparkFun SEN-15901 cups. The limits are provisional until a baseline is
+// recorded from a new unit.
+inline constexpr AnemometerReference kSen15901Anemometer = {
+    .mph_per_hz = 1.73,
+    .closures_per_revolution = 2,
+    .nominal_duty = 0.35,
+    .duty_tolerance = 0.15,
+    .max_jitter = 0.10,
+    .max_asymmetry = 0.10,
+};
+
+// Bearing and magnet health from both edges of the anemometer's reed
+// switch. A weakening magnet closes the reed over a shorter arc, so the duty
+// cycle drifts down. Worn bearings make the cups speed up and slow down
+// within a revolution, which shows as period jitter and as a duty
+// difference between alternate closures. Statistics are kept per speed band
+// because all three depend on speed. Each edge costs O(1).
+class AnemometerHealth {
+ public:
+  // Band i covers kBandEdgesMph[i] to kBandEdgesMph[i + 1]. Below the first
+  // edge the cups turn too unevenly to say anything.
+  static constexpr std::array<float, 5> kBandEdgesMph = {2, 5, 10, 20, 200};
+  static constexpr int kBands = kBandEdgesMph.size() - 1;
+  // A band needs this many closures before it counts towards HealthPercent.
+  static constexpr uint32_t kMinClosures = 500;
+
+  struct Band {
+    uint32_t closures = 0;
+    // Exponentially weighted over the last few hundred closures.
+    float duty = 0;
+    float jitter_rms = 0;
+    // Spread of the duty between the closures within a revolution.
+    float asymmetry = 0;
+  };
+
+  explicit AnemometerHealth(AnemometerReference reference)
+      : reference_(reference) {}
+
+  // `closed` is the reed state after the edge (the pin reads low when
+  // closed). Edges must come in time order.
+  void OnEdge(uint32_t t_us, bool closed);
+
+  const std::array<Band, kBands>& bands() const { return bands_; }
+
+  // 100 when every band with enough closures is at the reference, 50 when
+  // the worst metric reaches its tolerance, 0 at twice it. Nullopt until a
+  // band has kMinClosures.
+  std::optional<float> HealthPercent() const;
+
+ private:
+  static constexpr int kMaxPhases = 4;
+
+  struct Accumulators {
+    // Duty by position within the revolution. Phases are counted across
+    // contiguous closures; a lull can shift them, which the averages ride
+    // out.
+    std::array<float, kMaxPhases> phase_duty{};
+    std::array<uint32_t, kMaxPhases> phase_closures{};
+    float jitter_sq = 0;
+    uint32_t jitter_samples = 0;
+  };
+
+  void AddClosure(uint32_t period_us, uint32_t closed_us);
+
+  AnemometerReference reference_;
+  bool closed_ = false;
+  uint32_t last_edge_us_ = 0;
+  std::optional<uint32_t> last_close_us_;
+  std::optional<uint32_t> last_open_us_;
+  uint32_t last_period_us_ = 0;  // Zero after a gap or a band change.
+  int last_band_ = -1;
+  uint32_t closure_index_ = 0;
+  std::array<Band, kBands> bands_;
+  std::array<Accumulators, kBands> acc_;
+};
@@ -0,0 +1,146 @@
+#include "bme280.h"
+
+#include <algorithm>
+
+namespace {
+
+uint16_t U16(const uint8_t* p) { return p[0] | p[1] << 8; }
+int16_t S16(const uint8_t* p) { return static_cast<int16_t>(U16(p)); }
+
+}  // namespace
+
+Bme280::Calibration Bme280::ParseCalibration(
+    std::span<const uint8_t, 26> b1, std::span<const uint8_t, 7> b2) {
+  const uint8_t* p = b1.data();
+  const uint8_t* h = b2.data();
+  return {
+      .t1 = U16(p),
+      .t2 = S16(p + 2),
+      .t3 = S16(p + 4),
+      .p1 = U16(p + 6),
+      .p2 = S16(p + 8),
+      .p3 = S16(p + 10),
+      .p4 = S16(p + 12),
+      .p5 = S16(p + 14),
+      .p6 = S16(p + 16),
+      .p7 = S16(p + 18),
+      .p8 = S16(p + 20),
+      .p9 = S16(p + 22),
+      .h1 = p[25],
+      .h2 = S16(h),
+      .h3 = h[2],
+      // Two signed 12-bit values sharing the nibbles of 0xe5.
+      .h4 = static_cast<int16_t>(
+          static_cast<int8_t>(h[3]) * 16 | (h[4] & 0x0f)),
+      .h5 = static_cast<int16_t>(static_cast<int8_t>(h[5]) * 16 | h[4] >> 4),
+      .h6 = static_cast<int8_t>(h[6]),
+  };
+}
+
+Bme280::Reading Bme280::Compensate(
+    const Calibration& c, int32_t adc_t, int32_t adc_p, int32_t adc_h) {
+  // Temperature in 0.01 C, and t_fine, which the others depend on.
+  const int32_t t1 = c.t1;
+  const int32_t var1 = (((adc_t >> 3) - (t1 << 1)) * c.t2) >> 11;
+  const int32_t var2 =
+      (((((adc_t >> 4) - t1) * ((adc_t >> 4) - t1)) >> 12) * c.t3) >> 14;
+  const int32_t t_fine = var1 + var2;
+  const int32_t centi_c = (t_fine * 5 + 128) >> 8;
+
+  // Pressure in Pa as Q24.8.
+  int64_t p1 = int64_t(t_fine) - 128000;
+  int64_t p2 = p1 * p1 * c.p6;
+  p2 += (p1 * c.p5) << 17;
+  p2 += int64_t(c.p4) << 35;
+  p1 = ((p1 * p1 * c.p3) >> 8) + ((p1 * c.p2) << 12);
+  p1 = ((int64_t(1) << 47) + p1) * c.p1 >> 33;
+  uint32_t q24_8_pa = 0;
+  if (p1 != 0) {
+    int64_t p = 1048576 - adc_p;
+    p = (((p << 31) - p2) * 3125) / p1;
+    const int64_t p9 = (int64_t(c.p9) * (p >> 13) * (p >> 13)) >> 25;
+    const int64_t p8 = (int64_t(c.p8) * p) >> 19;
+    q24_8_pa = ((p + p9 + p8) >> 8) + (int64_t(c.p7) << 4);
+  }
+
+  // Humidity in %RH as Q22.10.
+  int32_t h = t_fine - 76800;
+  const int32_t scaled =
+      ((adc_h << 14) - (int32_t(c.h4) << 20) - (int32_t(c.h5) * h) + 16384) >>
+      15;
+  h = scaled *
+      (((((((h * c.h6) >> 10) * (((h * int32_t(c.h3)) >> 11) + 32768)) >> 10) +
+         2097152) *
+            c.h2 +
+        8192) >>
+       14);
+  h -= ((((h >> 15) * (h >> 15)) >> 7) * int32_t(c.h1)) >> 4;
+  h = std::clamp<int32_t>(h, 0, 419430400);
+
+  return {
+      .temperature_c = centi_c / 100.0f,
+      .humidity_percent = (h >> 12) / 1024.0f,
+      .pressure_hpa = q24_8_pa / 256.0f / 100.0f,
+  };
+}
+
+I2cDevice::Action Bme280::StartMeasurement(I2cTransfer& next) {
+  // Humidity oversampling only takes effect after a ctrl_meas write, so
+  // both go in one transfer: 1x humidity, then 1x temperature and pressure
+  // in forced mode.
+  const uint8_t command[] = {kRegCtrlHum, 0x01, kRegCtrlMeas, 0x25};
+  next = I2cTransfer::Write(address_, command);
+  step_ = Step::kMeasure;
+  return Action::Transfer();
+}
+
+I2cDevice::Action Bme280::Start(I2cTransfer& next) {
+  if (calibration_) return StartMeasurement(next);
+  next = I2cTransfer::ReadRegister(address_, kRegChipId, 1);
+  step_ = Step::kChipId;
+  return Action::Transfer();
+}
+
+I2cDevice::Action Bme280::Continue(I2cStatus status, I2cTransfer& transfer) {
+  if (status != I2cStatus::kOk) {
+    calibration_.reset();
+    return Action::Done(false);
+  }
+  switch (step_) {
+    case Step::kChipId:
+      if (transfer.read[0] != kChipId) return Action::Done(false);
+      transfer = I2cTransfer::ReadRegister(address_, kRegCalibration1, 26);
+      step_ = Step::kCalibration1;
+      return Action::Transfer();
+    case Step::kCalibration1:
+      std::copy_n(
+          transfer.read.begin(), calibration1_.size(), calibration1_.begin());
+      transfer = I2cTransfer::ReadRegister(address_, kRegCalibration2, 7);
+      step_ = Step::kCalibration2;
+      return Action::Transfer();
+    case Step::kCalibration2:
+      calibration_ = ParseCalibration(
+          calibration1_, std::span<const uint8_t, 7>(transfer.read.data(), 7));
+      return StartMeasurement(transfer);
+    case Step::kMeasure:
+      step_ = Step::kConvert;
+      return Action::Wait(kConversionMs);
+    case Step::kConvert:
+      transfer = I2cTransfer::ReadRegister(address_, kRegData, 8);
+      step_ = Step::kRead;
+      return Action::Transfer();
+    case Step::kRead:
+      break;
+  }
+
+  const uint8_t* d = transfer.read.data();
+  const int32_t adc_p = d[0] << 12 | d[1] << 4 | d[2] >> 4;
+  const int32_t adc_t = d[3] << 12 | d[4] << 4 | d[5] >> 4;
+  const int32_t adc_h = d[6] << 8 | d[7];
+  // The reset values, left when a measurement didn't run.
+  if (adc_t == 0x80000 || adc_p == 0x80000 || adc_h == 0x8000) {
+    return Action::Done(false);
+  }
+  reading_ = Compensate(*calibration_, adc_t, adc_p, adc_h);
+  return Action::Done(true);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#include "i2c_bus.h"
+
+// Bosch BME280 pressure, temperature and humidity sensor in forced mode at
+// 1x oversampling: each cycle starts one conversion, waits it out with the
+// bus free and reads the result. The chip id and trimming parameters are
+// read on the first cycle, and again after any failure in case the sensor
+// was swapped or lost power.
+class Bme280 : public I2cDevice {
+ public:
+  static constexpr uint8_t kAddress = 0x76;
+  static constexpr uint8_t kChipId = 0x60;
+  static constexpr uint8_t kRegChipId = 0xd0;
+  static constexpr uint8_t kRegCalibration1 = 0x88;  // 26 bytes.
+  static constexpr uint8_t kRegCalibration2 = 0xe1;  // 7 bytes.
+  static constexpr uint8_t kRegCtrlHum = 0xf2;
+  static constexpr uint8_t kRegCtrlMeas = 0xf4;
+  static constexpr uint8_t kRegData = 0xf7;  // 8 bytes, pressure first.
+  // Typical conversion at 1x oversampling of all three is 8 ms, at most 9.3.
+  static constexpr uint32_t kConversionMs = 10;
+
+  struct Calibration {
+    uint16_t t1;
+    int16_t t2, t3;
+    uint16_t p1;
+    int16_t p2, p3, p4, p5, p6, p7, p8, p9;
+    uint8_t h1;
+    int16_t h2;
+    uint8_t h3;
+    int16_t h4, h5;
+    int8_t h6;
+  };
+
+  struct Reading {
+    float temperature_c;
+    float humidity_percent;
+    float pressure_hpa;
+  };
+
+  Bme280(uint8_t address, uint32_t period_ms) : I2cDevice(address, period_ms) {}
+
+  std::string_view name() const override { return "bme280"; }
+  Action Start(I2cTransfer& next) override;
+  Action Continue(I2cStatus status, I2cTransfer& transfer) override;
+
+  // The last good reading.
+  const std::optional<Reading>& reading() const { return reading_; }
+
+  // From the registers at kRegCalibration1 and kRegCalibration2.
+  static Calibration ParseCalibration(
+      std::span<const uint8_t, 26> block1, std::span<const uint8_t, 7> block2);
+  // Bosch's integer compensation from the datasheet, for 20-bit temperature
+  // and pressure and 16-bit humidity readings.
+  static Reading Compensate(
+      const Calibration& c, int32_t adc_t, int32_t adc_p, int32_t adc_h);
+
+ private:
+  enum class Step : uint8_t {
+    kChipId,
+    kCalibration1,
+    kCalibration2,
+    kMeasure,
+    kConvert,
+    kRead,
+  };
+
+  Action StartMeasurement(I2cTransfer& next);
+
+  Step step_ = Step::kChipId;
+  std::array<uint8_t, 26> calibration1_{};
+  std::optional<Calibration> calibration_;
+  std::optional<Reading> reading_;
+};
@@ -0,0 +1,117 @@
+#include "broker_selector.h"
+
+#include <algorithm>
+
+namespace {
+
+// Weight of the newest result in the moving averages.
+constexpr float kScoreWeight = 0.3f;
+constexpr float kLatencyWeight = 0.25f;
+
+}  // namespace
+
+BrokerSelector::BrokerSelector(std::vector<std::string> hosts, Options options)
+    : options_(options) {
+  for (std::string& host : hosts) {
+    brokers_.push_back({.host = std::move(host)});
+  }
+}
+
+std::vector<size_t> BrokerSelector::Candidates(uint32_t now_ms) const {
+  std::vector<size_t> ready, idle;
+  for (size_t i = 0; i < brokers_.size(); ++i) {
+    if (brokers_[i].in_flight || current_ == i) continue;
+    idle.push_back(i);
+    if (!BackingOff(brokers_[i], now_ms)) ready.push_back(i);
+  }
+  std::vector<size_t>& picked = ready.empty() ? idle : ready;
+  // Stable, so equal scores keep the list's order.
+  std::stable_sort(picked.begin(), picked.end(), [&](size_t a, size_t b) {
+    return brokers_[a].score > brokers_[b].score;
+  });
+  if (picked.size() > options_.max_parallel) {
+    picked.resize(options_.max_parallel);
+  }
+  return picked;
+}
+
+bool BrokerSelector::PrimaryProbeDue(uint32_t now_ms) const {
+  if (!current_ || *current_ == 0 || brokers_.empty()) return false;
+  const Broker& primary = brokers_[0];
+  return !primary.in_flight && !BackingOff(primary, now_ms) &&
+         now_ms - primary.last_attempt_ms >= options_.probe_interval_ms;
+}
+
+bool BrokerSelector::RetryDue(uint32_t now_ms) const {
+  if (current_ || in_flight() > 0) return false;
+  return std::any_of(brokers_.begin(), brokers_.end(), [&](const Broker& b) {
+    return !BackingOff(b, now_ms);
+  });
+}
+
+void BrokerSelector::OnAttempt(size_t broker, uint32_t now_ms) {
+  Broker& b = brokers_[broker];
+  b.in_flight = true;
+  b.last_attempt_ms = now_ms;
+  ++b.attempts;
+}
+
+bool BrokerSelector::OnResult(
+    size_t broker, bool ok, uint32_t latency_ms, uint32_t now_ms) {
+  Broker& b = brokers_[broker];
+  b.in_flight = false;
+  b.last_latency_ms = latency_ms;
+  if (!ok) {
+    ++b.failures;
+    Fail(b, now_ms);
+    return false;
+  }
+  ++b.successes;
+  b.consecutive_failures = 0;
+  ++b.consecutive_successes;
+  b.retry_at_ms = now_ms;
+  b.score += kScoreWeight * (1 - b.score);
+  b.max_latency_ms = std::max(b.max_latency_ms, latency_ms);
+  if (b.successes == 1) {
+    b.mean_latency_ms = latency_ms;
+  } else {
+    b.mean_latency_ms += kLatencyWeight * (latency_ms - b.mean_latency_ms);
+  }
+
+  const bool take = !current_ || (broker == 0 && *current_ != 0 &&
+                                  b.consecutive_successes >=
+                                      options_.probes_to_return);
+  if (take) current_ = broker;
+  return take;
+}
+
+void BrokerSelector::OnDisconnected(uint32_t now_ms) {
+  if (!current_) return;
+  Broker& b = brokers_[*current_];
+  current_.reset();
+  ++b.drops;
+  Fail(b, now_ms);
+}
+
+size_t BrokerSelector::in_flight() const {
+  return std::count_if(brokers_.begin(), brokers_.end(), [](const Broker& b) {
+    return b.in_flight;
+  });
+}
+
+void BrokerSelector::Fail(Broker& broker, uint32_t now_ms) {
+  broker.consecutive_successes = 0;
+  ++broker.consecutive_failures;
+  broker.score -= kScoreWeight * broker.score;
+  const uint32_t doublings =
+      std::min<uint32_t>(broker.consecutive_failures - 1, 16);
+  const uint64_t backoff_ms =
+      static_cast<uint64_t>(options_.min_backoff_ms) << doublings;
+  broker.retry_at_ms =
+      now_ms + std::min<uint64_t>(backoff_ms, options_.max_backoff_ms);
+}
+
+bool BrokerSelector::BackingOff(const Broker& broker, uint32_t now_ms) const {
+  // Wraps with the ms clock, every 49 days.
+  return static_cast<int32_t>(broker.retry_at_ms - now_ms) > 0;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Chooses MQTT brokers to connect to from an ordered list, the first being
+// the primary, and keeps connect metrics for each.
+//
+// A broker's health score is a moving average of its connect results. One
+// that fails, or drops the station, backs off for a while, doubling with
+// each failure in a row. A failover races every broker not backing off or
+// already being tried, best score first, and keeps the first to connect.
+// While on a fallback, the primary is probed now and then, and the station
+// returns to it once it has answered a few probes in a row.
+//
+// Not thread-safe: one task owns it, and connect attempts running elsewhere
+// report back to that task.
+class BrokerSelector {
+ public:
+  struct Options {
+    // Brokers raced at once.
+    size_t max_parallel;
+    // Backoff after a broker's first failure; it doubles up to the max.
+    uint32_t min_backoff_ms;
+    uint32_t max_backoff_ms;
+    // While on a fallback, how often the primary is probed, and how many
+    // probes in a row it must answer to be used again.
+    uint32_t probe_interval_ms;
+    uint32_t probes_to_return;
+  };
+  static constexpr Options kDefaultOptions = {
+      .max_parallel = 3,
+      .min_backoff_ms = 5'000,
+      .max_backoff_ms = 300'000,
+      .probe_interval_ms = 60'000,
+      .probes_to_return = 2,
+  };
+
+  struct Broker {
+    std::string host;
+    // 1 after nothing but successes, toward 0 with failures.
+    float score = 1;
+    uint32_t consecutive_failures = 0;
+    uint32_t consecutive_successes = 0;
+    uint32_t retry_at_ms = 0;  // Backing off until then.
+    uint32_t last_attempt_ms = 0;
+    bool in_flight = false;
+    // Connect metrics.
+    uint32_t attempts = 0;
+    uint32_t successes = 0;
+    uint32_t failures = 0;
+    uint32_t drops = 0;  // Connections lost after connecting.
+    uint32_t last_latency_ms = 0;
+    uint32_t max_latency_ms = 0;
+    float mean_latency_ms = 0;  // Of successes, recent ones weighted more.
+  };
+
+  explicit BrokerSelector(
+      std::vector<std::string> hosts, Options options = kDefaultOptions);
+
+  // The brokers a failover should try now, best first. If every broker not
+  // already being tried is backing off, those are tried anyway.
+  std::vector<size_t> Candidates(uint32_t now_ms) const;
+  // Whether to probe the primary now.
+  bool PrimaryProbeDue(uint32_t now_ms) const;
+  // Whether to fail over again now, after a failover that took no broker:
+  // once any broker is through backing off.
+  bool RetryDue(uint32_t now_ms) const;
+
+  void OnAttempt(size_t broker, uint32_t now_ms);
+  // Returns whether to use the new connection: the first while the station
+  // has none, then only a primary that has answered enough probes.
+  bool OnResult(size_t broker, bool ok, uint32_t latency_ms, uint32_t now_ms);
+  // The connection in use was lost or dropped for a failover.
+  void OnDisconnected(uint32_t now_ms);
+
+  std::optional<size_t> current() const { return current_; }
+  // Attempts started and not yet reported.
+  size_t in_flight() const;
+  const std::vector<Broker>& brokers() const { return brokers_; }
+
+ private:
+  void Fail(Broker& broker, uint32_t now_ms);
+  bool BackingOff(const Broker& broker, uint32_t now_ms) const;
+
+  const Options options_;
+  std::vector<Broker> brokers_;
+  std::optional<size_t> current_;
+};
@@ -0,0 +1,65 @@
+#include "derived_metrics.h"
+
+#include <algorithm>
+#include <cmath>
+
+std::string_view RainIntensityName(RainIntensity intensity) {
+  switch (intensity) {
+    case RainIntensity::kNone:
+      return "none";
+    case RainIntensity::kLight:
+      return "light";
+    case RainIntensity::kModerate:
+      return "moderate";
+    case RainIntensity::kHeavy:
+      return "heavy";
+    case RainIntensity::kViolent:
+      return "violent";
+  }
+  return "unknown";
+}
+
+DerivedMetrics::WindChanges DerivedMetrics::OnWind(float mph, float seconds) {
+  WindChanges changes;
+  if (seconds <= 0) return changes;
+
+  wind_run_miles_ += mph * seconds / 3600.0;
+  const int64_t steps =
+      static_cast<int64_t>(wind_run_miles_ / kWindRunStepMiles);
+  if (steps != wind_run_steps_) {
+    wind_run_steps_ = steps;
+    changes.wind_run_miles = steps * kWindRunStepMiles;
+  }
+
+  window_mile_secs_ += mph * seconds;
+  window_secs_ += seconds;
+  window_peak_mph_ = std::max(window_peak_mph_, mph);
+  if (window_secs_ < kWindowSecs) return changes;
+
+  const float mean_mph = window_mile_secs_ / window_secs_;
+  const int force = BeaufortForce(mean_mph);
+  if (force != beaufort_) {
+    beaufort_ = force;
+    changes.beaufort = force;
+  }
+  if (mean_mph >= kMinGustFactorMeanMph) {
+    const int factor_steps =
+        std::lround(window_peak_mph_ / mean_mph / kGustFactorStep);
+    if (factor_steps != gust_factor_steps_) {
+      gust_factor_steps_ = factor_steps;
+      changes.gust_factor = factor_steps * kGustFactorStep;
+    }
+  }
+  window_mile_secs_ = 0;
+  window_secs_ = 0;
+  window_peak_mph_ = 0;
+  return changes;
+}
+
+std::optional<RainIntensity> DerivedMetrics::OnRainRate(
+    float inches_per_hour) {
+  const RainIntensity intensity = RainIntensityClass(inches_per_hour);
+  if (intensity == rain_intensity_) return std::nullopt;
+  rain_intensity_ = intensity;
+  return intensity;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Beaufort force from a mean wind speed. The WMO scale is defined in m/s;
+// these are the lower bounds of forces 1 to 12.
+inline constexpr std::array<float, 12> kBeaufortLowerMps = {
+    0.5, 1.6, 3.4, 5.5, 8.0, 10.8, 13.9, 17.2, 20.8, 24.5, 28.5, 32.7};
+inline constexpr float kMphPerMps = 2.236936;
+
+constexpr int BeaufortForce(float mph) {
+  int force = 0;
+  for (float lower : kBeaufortLowerMps) {
+    if (mph < lower * kMphPerMps) break;
+    ++force;
+  }
+  return force;
+}
+static_assert(BeaufortForce(0) == 0);
+static_assert(BeaufortForce(3) == 1);
+static_assert(BeaufortForce(20) == 5);
+static_assert(BeaufortForce(80) == 12);
+
+// Rain intensity classes, by the AMS glossary's rate thresholds with the
+// WMO's violent class on top.
+enum class RainIntensity : uint8_t {
+  kNone,
+  kLight,
+  kModerate,
+  kHeavy,
+  kViolent,
+};
+std::string_view RainIntensityName(RainIntensity intensity);
+
+// Lower bounds of moderate, heavy and violent, from 2.5, 7.6 and 50 mm/h.
+inline constexpr std::array<float, 3> kRainIntensityLowerInPerHour = {
+    2.5 / 25.4, 7.6 / 25.4, 50 / 25.4};
+
+constexpr RainIntensity RainIntensityClass(float inches_per_hour) {
+  if (inches_per_hour <= 0) return RainIntensity::kNone;
+  int level = static_cast<int>(RainIntensity::kLight);
+  for (float lower : kRainIntensityLowerInPerHour) {
+    if (inches_per_hour < lower) break;
+    ++level;
+  }
+  return static_cast<RainIntensity>(level);
+}
+static_assert(RainIntensityClass(0) == RainIntensity::kNone);
+static_assert(RainIntensityClass(0.066) == RainIntensity::kLight);
+static_assert(RainIntensityClass(0.2) == RainIntensity::kModerate);
+static_assert(RainIntensityClass(1) == RainIntensity::kHeavy);
+static_assert(RainIntensityClass(3) == RainIntensity::kViolent);
+
+// Metrics derived from the anemometer and rain gauge aggregates, updated
+// incrementally as each aggregate arrives. Each metric is reported only when
+// it crosses its natural boundary, so subscribers see a state change only
+// when there is something new:
+//
+//  - wind run, the distance the wind has travelled since boot, each 0.1 mi;
+//  - Beaufort force of the 10 minute mean, when the force changes;
+//  - gust factor, the window's peak speed over its mean, at the end of each
+//    10 minute window if it changed by 0.1 or more;
+//  - rain intensity class, when the class changes.
+class DerivedMetrics {
+ public:
+  // The WMO averaging period for mean wind.
+  static constexpr float kWindowSecs = 10 * 60;
+  // Below this mean the gust factor says more about the anemometer's
+  // starting threshold than the wind, so none is reported.
+  static constexpr float kMinGustFactorMeanMph = 2;
+  static constexpr float kWindRunStepMiles = 0.1;
+  static constexpr float kGustFactorStep = 0.1;
+
+  struct WindChanges {
+    std::optional<float> wind_run_miles;
+    std::optional<int> beaufort;
+    std::optional<float> gust_factor;
+  };
+
+  // With each anemometer aggregate: its mean speed over `seconds`. The peak
+  // of these means is the window's gust, so it is only as short as the
+  // aggregate.
+  WindChanges OnWind(float mph, float seconds);
+
+  // With each rain gauge aggregate.
+  std::optional<RainIntensity> OnRainRate(float inches_per_hour);
+
+ private:
+  // Double, so that a 5 s step still adds up after years of wind.
+  double wind_run_miles_ = 0;
+  std::optional<int64_t> wind_run_steps_;
+
+  float window_mile_secs_ = 0;  // mph * s over the window so far.
+  float window_secs_ = 0;
+  float window_peak_mph_ = 0;
+  std::optional<int> beaufort_;
+  std::optional<int> gust_factor_steps_;
+
+  std::optional<RainIntensity> rain_intensity_;
+};
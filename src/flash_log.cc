@@ -0,0 +1,434 @@
+#include "flash_log.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+// Reflected CRC-32 (IEEE), a nibble at a time: a 64-byte table instead of
+// 1 KiB, which is plenty for records this small.
+constexpr std::array<uint32_t, 16> kCrcNibbles = [] {
+  std::array<uint32_t, 16> table{};
+  for (uint32_t i = 0; i < 16; ++i) {
+    uint32_t c = i;
+    for (int bit = 0; bit < 4; ++bit) {
+      c = c & 1 ? (c >> 1) ^ 0xedb88320 : c >> 1;
+    }
+    table[i] = c;
+  }
+  return table;
+}();
+
+template <typename T>
+std::span<const uint8_t> Bytes(const T& value) {
+  return {reinterpret_cast<const uint8_t*>(&value), sizeof(value)};
+}
+
+}  // namespace
+
+uint32_t Crc32(std::span<const uint8_t> data, uint32_t crc) {
+  crc = ~crc;
+  for (uint8_t b : data) {
+    crc = kCrcNibbles[(crc ^ b) & 15] ^ (crc >> 4);
+    crc = kCrcNibbles[(crc ^ (b >> 4)) & 15] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+FlashLog::FlashLog(FlashDevice& flash)
+    : flash_(flash), count_(std::min(flash.sectors(), kMaxSectors)) {
+  // Every current value fits in a fresh sector beside the largest record,
+  // so the copy after a rotation always fits.
+  static_assert(
+      kHeaderBytes +
+          kMaxKeys * Align(kRecordHeaderBytes + 2 + kMaxValueBytes) +
+          Align(kMaxRecordBytes) <=
+      FlashDevice::kSectorBytes);
+}
+
+void FlashLog::ReadFlash(
+    uint32_t sector, uint32_t offset, std::span<uint8_t> out) {
+  ++reads_;
+  flash_.Read(sector * FlashDevice::kSectorBytes + offset, out);
+}
+
+bool FlashLog::Mount() {
+  mounted_ = false;
+  stats_ = {};
+  reads_ = 0;
+  sectors_ = {};
+  values_ = {};
+  if (count_ < kMinSectors) return false;
+
+  std::array<uint16_t, kMaxSectors> order;
+  uint32_t in_use = 0;
+  for (uint32_t s = 0; s < count_; ++s) {
+    Header h;
+    ReadFlash(s, 0, {reinterpret_cast<uint8_t*>(&h), sizeof(h)});
+    if (h.magic != kMagic ||
+        h.crc != Crc32(Bytes(h).first(offsetof(Header, crc)))) {
+      continue;
+    }
+    Sector& sector = sectors_[s];
+    sector.sequence = h.sequence;
+    sector.erase_count = h.erase_count;
+    if (h.seal_check == static_cast<uint16_t>(~h.seal)) {
+      sector.sealed = true;
+      sector.has_values = h.seal & kSealHasValues;
+      sector.end = h.seal & ~kSealHasValues;
+    } else if (h.seal != 0xffff || h.seal_check != 0xffff) {
+      // Sealing was cut short, so it can't be sealed again, and a rotation
+      // was under way.
+      sector.torn = true;
+      sector.full = true;
+    }
+    order[in_use++] = s;
+  }
+  if (in_use == 0) {
+    StartSector(0, 1);
+    head_ = 0;
+  } else {
+    std::sort(order.begin(), order.begin() + in_use, [&](auto a, auto b) {
+      return sectors_[a].sequence < sectors_[b].sequence;
+    });
+    for (uint32_t i = 0; i < in_use; ++i) Scan(order[i]);
+    head_ = order[in_use - 1];
+    // A sector without a header lost its erase count with it. Free sectors
+    // were erased after the head was, so take the head's.
+    for (uint32_t s = 0; s < count_; ++s) {
+      if (sectors_[s].sequence == 0) {
+        sectors_[s].erase_count = sectors_[head_].erase_count;
+      }
+    }
+    // Sectors left before the log could seal them.
+    for (uint32_t i = 0; i + 1 < in_use; ++i) {
+      if (!sectors_[order[i]].sealed) Seal(order[i]);
+    }
+    // A rotation cut short: the next sector must be free.
+    if (sectors_[Next(head_)].sequence != 0) Reclaim(Next(head_));
+  }
+  stats_.mount_reads = reads_;
+  mounted_ = true;
+  return true;
+}
+
+void FlashLog::Scan(uint32_t s) {
+  Sector& sector = sectors_[s];
+  uint32_t offset = kHeaderBytes;
+  if (sector.sealed) {
+    if (!sector.has_values) return;
+    // Sealed sectors were checked when they were written; only values are
+    // read in full.
+    while (offset + kRecordHeaderBytes <= sector.end) {
+      RecordHeader h;
+      ReadFlash(s, offset, {reinterpret_cast<uint8_t*>(&h), sizeof(h)});
+      if (h.type_check != static_cast<uint8_t>(~h.type)) break;
+      if (h.type < kFirstDataType) {
+        if (auto checked = ReadRecord(s, offset)) Apply(*checked, s, offset);
+      }
+      offset += Align(kRecordHeaderBytes + h.size);
+    }
+    return;
+  }
+
+  while (offset + kRecordHeaderBytes <= FlashDevice::kSectorBytes) {
+    if (auto h = ReadRecord(s, offset)) {
+      Apply(*h, s, offset);
+      offset += Align(kRecordHeaderBytes + h->size);
+      continue;
+    }
+    const uint32_t erased = ErasedFrom(s, offset);
+    if (erased == offset) break;
+    ++stats_.torn_records;
+    sector.torn = true;
+    offset = Resync(s, offset, erased).value_or(erased);
+  }
+  sector.end = offset;
+}
+
+std::optional<FlashLog::RecordHeader> FlashLog::ReadRecord(
+    uint32_t s, uint32_t offset) {
+  if (offset + kRecordHeaderBytes > FlashDevice::kSectorBytes) {
+    return std::nullopt;
+  }
+  RecordHeader h;
+  ReadFlash(s, offset, {reinterpret_cast<uint8_t*>(&h), sizeof(h)});
+  if (h.type_check != static_cast<uint8_t>(~h.type) || h.type == 0 ||
+      h.type == 0xff || h.size > kMaxPayloadBytes ||
+      offset + kRecordHeaderBytes + h.size > FlashDevice::kSectorBytes) {
+    return std::nullopt;
+  }
+  std::memcpy(scratch_.data(), &h, sizeof(h));
+  const std::span<uint8_t> payload(
+      scratch_.data() + kRecordHeaderBytes, h.size);
+  ReadFlash(s, offset + kRecordHeaderBytes, payload);
+  const uint32_t crc = Crc32(
+      payload, Crc32(Bytes(h).first(offsetof(RecordHeader, type_check))));
+  if (crc != h.crc) return std::nullopt;
+  return h;
+}
+
+std::optional<uint32_t> FlashLog::Resync(
+    uint32_t s, uint32_t offset, uint32_t limit) {
+  for (offset += 4; offset + kRecordHeaderBytes <= limit; offset += 4) {
+    if (ReadRecord(s, offset)) return offset;
+  }
+  return std::nullopt;
+}
+
+uint32_t FlashLog::ErasedFrom(uint32_t s, uint32_t from) {
+  uint32_t erased = from;
+  std::array<uint8_t, 64> chunk;
+  for (uint32_t at = from; at < FlashDevice::kSectorBytes;
+       at += chunk.size()) {
+    const uint32_t n =
+        std::min<uint32_t>(chunk.size(), FlashDevice::kSectorBytes - at);
+    ReadFlash(s, at, std::span(chunk).first(n));
+    for (uint32_t i = 0; i < n; ++i) {
+      if (chunk[i] != 0xff) erased = Align(at + i + 1);
+    }
+  }
+  return erased;
+}
+
+void FlashLog::Apply(const RecordHeader& h, uint32_t s, uint32_t offset) {
+  if (h.type >= kFirstDataType || h.size < 2) return;
+  sectors_[s].has_values = true;
+  uint16_t key;
+  std::memcpy(&key, scratch_.data() + kRecordHeaderBytes, sizeof(key));
+  if (h.type == kKeyValue) {
+    Index(key, s, offset);
+  } else if (h.type == kKeyRemoved) {
+    Unindex(key);
+  }
+}
+
+bool FlashLog::Append(uint8_t type, std::span<const uint8_t> payload) {
+  if (type < kFirstDataType || type == 0xff) return false;
+  return WriteRecord(type, {}, payload).has_value();
+}
+
+std::optional<uint32_t> FlashLog::WriteRecord(
+    uint8_t type,
+    std::span<const uint8_t> prefix,
+    std::span<const uint8_t> payload) {
+  const uint32_t size = prefix.size() + payload.size();
+  if (!mounted_ || size > kMaxPayloadBytes) return std::nullopt;
+  const uint32_t bytes = Align(kRecordHeaderBytes + size);
+  // A sealed head was sealed by a rotation a power cut interrupted.
+  if (sectors_[head_].sealed || sectors_[head_].full ||
+      sectors_[head_].end + bytes > FlashDevice::kSectorBytes) {
+    Rotate();
+  }
+
+  RecordHeader h = {
+      .size = static_cast<uint16_t>(size),
+      .type = type,
+      .type_check = static_cast<uint8_t>(~type),
+  };
+  uint8_t* p = scratch_.data() + kRecordHeaderBytes;
+  std::copy(prefix.begin(), prefix.end(), p);
+  std::copy(payload.begin(), payload.end(), p + prefix.size());
+  h.crc = Crc32(
+      std::span(p, size),
+      Crc32(Bytes(h).first(offsetof(RecordHeader, type_check))));
+  std::memcpy(scratch_.data(), &h, sizeof(h));
+  return Place(kRecordHeaderBytes + size);
+}
+
+std::optional<uint32_t> FlashLog::Place(uint32_t bytes) {
+  Sector& head = sectors_[head_];
+  if (head.end + bytes > FlashDevice::kSectorBytes) return std::nullopt;
+  const uint32_t offset = head.end;
+  flash_.Program(
+      head_ * FlashDevice::kSectorBytes + offset,
+      std::span(scratch_.data(), bytes));
+  head.end = offset + Align(bytes);
+  if (scratch_[2] < kFirstDataType) head.has_values = true;
+  return offset;
+}
+
+void FlashLog::Rotate() {
+  Seal(head_);
+  const uint32_t next = Next(head_);
+  StartSector(next, sectors_[head_].sequence + 1);
+  head_ = next;
+  // Once the log has gone all the way round, the sector after the head is
+  // the oldest. Freeing it now keeps one sector free for the next rotation.
+  if (sectors_[Next(head_)].sequence != 0) Reclaim(Next(head_));
+}
+
+void FlashLog::Reclaim(uint32_t s) {
+  for (Value& v : values_) {
+    if (!v.used || v.sector != s) continue;
+    const auto h = ReadRecord(s, v.offset);
+    const auto offset = h ? Place(kRecordHeaderBytes + h->size) : std::nullopt;
+    if (!offset) {
+      v.used = false;
+      continue;
+    }
+    v.sector = head_;
+    v.offset = *offset;
+    ++stats_.relocated;
+  }
+  flash_.EraseSector(s);
+  Sector& sector = sectors_[s];
+  sector = {.erase_count = sector.erase_count + 1, .erased = true};
+}
+
+void FlashLog::StartSector(uint32_t s, uint32_t sequence) {
+  Sector& sector = sectors_[s];
+  if (!sector.erased) {
+    flash_.EraseSector(s);
+    ++sector.erase_count;
+  }
+  Header h = {
+      .magic = kMagic,
+      .sequence = sequence,
+      .erase_count = sector.erase_count,
+      .seal = 0xffff,
+      .seal_check = 0xffff,
+  };
+  h.crc = Crc32(Bytes(h).first(offsetof(Header, crc)));
+  flash_.Program(s * FlashDevice::kSectorBytes, Bytes(h));
+  sector = {
+      .sequence = sequence,
+      .erase_count = sector.erase_count,
+      .end = kHeaderBytes,
+  };
+}
+
+void FlashLog::Seal(uint32_t s) {
+  Sector& sector = sectors_[s];
+  if (sector.sealed || sector.torn) return;
+  const uint16_t seal = sector.end | (sector.has_values ? kSealHasValues : 0);
+  const uint16_t words[2] = {seal, static_cast<uint16_t>(~seal)};
+  flash_.Program(
+      s * FlashDevice::kSectorBytes + offsetof(Header, seal),
+      {reinterpret_cast<const uint8_t*>(words), sizeof(words)});
+  sector.sealed = true;
+}
+
+std::optional<uint32_t> FlashLog::Oldest() const {
+  std::optional<uint32_t> oldest;
+  for (uint32_t s = 0; s < count_; ++s) {
+    if (sectors_[s].sequence != 0 &&
+        (!oldest || sectors_[s].sequence < sectors_[*oldest].sequence)) {
+      oldest = s;
+    }
+  }
+  return oldest;
+}
+
+std::optional<uint32_t> FlashLog::Holding(uint32_t sequence) const {
+  std::optional<uint32_t> best;
+  for (uint32_t s = 0; s < count_; ++s) {
+    const uint32_t seq = sectors_[s].sequence;
+    if (seq != 0 && seq >= sequence &&
+        (!best || seq < sectors_[*best].sequence)) {
+      best = s;
+    }
+  }
+  return best;
+}
+
+FlashLog::Position FlashLog::begin() const {
+  const auto oldest = Oldest();
+  return {oldest ? sectors_[*oldest].sequence : 0, kHeaderBytes};
+}
+
+std::optional<FlashLog::Record> FlashLog::ReadNext(
+    Position& position, std::span<uint8_t> out) {
+  if (!mounted_) return std::nullopt;
+  while (const auto s = Holding(position.sequence)) {
+    const Sector& sector = sectors_[*s];
+    if (sector.sequence != position.sequence) {
+      position = {sector.sequence, kHeaderBytes};
+    }
+    position.offset = std::max(position.offset, kHeaderBytes);
+    while (position.offset + kRecordHeaderBytes <= sector.end) {
+      const auto h = ReadRecord(*s, position.offset);
+      if (!h) {
+        position.offset =
+            Resync(*s, position.offset, sector.end).value_or(sector.end);
+        continue;
+      }
+      position.offset += Align(kRecordHeaderBytes + h->size);
+      if (h->type < kFirstDataType) continue;
+      const uint32_t n = std::min<uint32_t>(h->size, out.size());
+      std::copy_n(scratch_.data() + kRecordHeaderBytes, n, out.begin());
+      return Record{h->type, h->size};
+    }
+    // Caught up: the position stays at the head's end for the next call.
+    if (*s == head_) return std::nullopt;
+    position = {sector.sequence + 1, kHeaderBytes};
+  }
+  return std::nullopt;
+}
+
+FlashLog::Value* FlashLog::Find(uint16_t key) {
+  for (Value& v : values_) {
+    if (v.used && v.key == key) return &v;
+  }
+  return nullptr;
+}
+
+bool FlashLog::Index(uint16_t key, uint32_t s, uint32_t offset) {
+  Value* v = Find(key);
+  if (!v) {
+    v = std::find_if(
+        values_.begin(), values_.end(), [](const Value& v) { return !v.used; });
+    if (v == values_.end()) return false;
+  }
+  *v = {
+      .key = key,
+      .sector = static_cast<uint16_t>(s),
+      .offset = static_cast<uint16_t>(offset),
+      .used = true,
+  };
+  return true;
+}
+
+void FlashLog::Unindex(uint16_t key) {
+  if (Value* v = Find(key)) v->used = false;
+}
+
+bool FlashLog::Put(uint16_t key, std::span<const uint8_t> value) {
+  if (value.size() > kMaxValueBytes) return false;
+  if (!Find(key) && std::ranges::all_of(values_, &Value::used)) return false;
+  const auto offset = WriteRecord(kKeyValue, Bytes(key), value);
+  return offset && Index(key, head_, *offset);
+}
+
+std::optional<uint32_t> FlashLog::Get(uint16_t key, std::span<uint8_t> out) {
+  const Value* v = Find(key);
+  if (!mounted_ || !v) return std::nullopt;
+  const auto h = ReadRecord(v->sector, v->offset);
+  if (!h) return std::nullopt;
+  const uint32_t size = h->size - sizeof(key);
+  std::copy_n(
+      scratch_.data() + kRecordHeaderBytes + sizeof(key),
+      std::min<uint32_t>(size, out.size()),
+      out.begin());
+  return size;
+}
+
+bool FlashLog::Remove(uint16_t key) {
+  if (!Find(key)) return false;
+  if (!WriteRecord(kKeyRemoved, Bytes(key), {})) return false;
+  Unindex(key);
+  return true;
+}
+
+FlashLog::Stats FlashLog::stats() const {
+  Stats stats = stats_;
+  stats.min_erases = UINT32_MAX;
+  for (uint32_t s = 0; s < count_; ++s) {
+    if (sectors_[s].sequence != 0) ++stats.sectors_in_use;
+    stats.min_erases = std::min(stats.min_erases, sectors_[s].erase_count);
+    stats.max_erases = std::max(stats.max_erases, sectors_[s].erase_count);
+  }
+  if (count_ == 0) stats.min_erases = 0;
+  return stats;
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+// A region of NOR flash: erased in whole sectors to all ones, after which
+// programming can only clear bits. Offsets are from the start of the region.
+class FlashDevice {
+ public:
+  static constexpr uint32_t kSectorBytes = 4096;
+  static constexpr uint32_t kPageBytes = 256;
+
+  virtual ~FlashDevice() = default;
+  virtual uint32_t sectors() const = 0;
+  virtual void Read(uint32_t offset, std::span<uint8_t> out) = 0;
+  // Any offset and length within a sector. Bytes around them in the pages
+  // touched are programmed as 0xff, which leaves them as they were.
+  virtual void Program(uint32_t offset, std::span<const uint8_t> data) = 0;
+  virtual void EraseSector(uint32_t sector) = 0;
+};
+
+uint32_t Crc32(std::span<const uint8_t> data, uint32_t crc = 0);
+
+// An append-only log of small records over a FlashDevice, with a key/value
+// store for small state kept in the same log.
+//
+// Sectors are used in turn around the region. Each starts with a header
+// holding its place in the log (a sequence number) and how often it has
+// been erased; records follow, each with a CRC. When the newest sector
+// fills, the log moves on to the next and erases the one after that, the
+// oldest, once the values still current in it have been copied forward.
+// Every sector is erased once per trip around the region, which levels
+// wear, and the oldest data records are dropped to make room.
+//
+// A power cut at any point loses at most the record being written. A
+// record cut short fails its CRC and is skipped; writing resumes after it.
+//
+// Leaving a sector, the log seals it: it programs the sector's end into
+// the header, with whether it holds any key/value records. Mount reads
+// just the header of a sealed sector without values, so it costs one
+// small read per sector plus a walk of the record headers in the rest.
+class FlashLog {
+ public:
+  // Record types below kFirstDataType belong to the log.
+  static constexpr uint8_t kFirstDataType = 16;
+  static constexpr uint32_t kMaxPayloadBytes = 1024;
+  static constexpr int kMaxKeys = 32;
+  static constexpr uint32_t kMaxValueBytes = 64;
+  static constexpr uint32_t kMinSectors = 3;
+
+  // A place in the log, for reading data records in order.
+  struct Position {
+    uint32_t sequence = 0;
+    uint32_t offset = 0;
+  };
+
+  struct Record {
+    uint8_t type;
+    uint32_t size;  // Payload bytes; a longer one is truncated to the buffer.
+  };
+
+  struct Stats {
+    uint32_t sectors_in_use = 0;
+    uint32_t torn_records = 0;  // Found by Mount.
+    uint32_t relocated = 0;     // Values copied forward.
+    uint32_t mount_reads = 0;   // Flash reads Mount made.
+    uint32_t min_erases = 0;
+    uint32_t max_erases = 0;
+  };
+
+  explicit FlashLog(FlashDevice& flash);
+
+  // Finds the log, formatting the region if there is none, and finishes
+  // any sector rotation a power cut interrupted. Returns false if the region
+  // is too small to hold one.
+  bool Mount();
+
+  // Appends a record of `type` (kFirstDataType or above). False if the
+  // payload is too long or the log isn't mounted.
+  bool Append(uint8_t type, std::span<const uint8_t> payload);
+
+  // Reads the next data record at or after `position`, and moves it past
+  // the record. A position in a sector since erased skips to the oldest
+  // record still held.
+  std::optional<Record> ReadNext(Position& position, std::span<uint8_t> out);
+  // The oldest record held.
+  Position begin() const;
+
+  // False if the value is too long or kMaxKeys keys are already set.
+  bool Put(uint16_t key, std::span<const uint8_t> value);
+  // The value's size, with as much as fits copied to `out`.
+  std::optional<uint32_t> Get(uint16_t key, std::span<uint8_t> out);
+  bool Remove(uint16_t key);
+
+  Stats stats() const;
+
+ private:
+  enum RecordType : uint8_t {
+    kKeyValue = 1,  // Key as a uint16, then the value.
+    kKeyRemoved = 2,
+  };
+
+  // A sector header, then records, each 4-byte aligned.
+  struct Header {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t erase_count;
+    uint32_t crc;  // Of the fields above.
+    // Programmed when the sector is sealed: its end, with kSealHasValues
+    // set if it holds key/value records, and the complement as a check.
+    uint16_t seal;
+    uint16_t seal_check;
+  };
+  static constexpr uint32_t kMagic = 0x474c5857;  // "WXLG".
+  static constexpr uint32_t kHeaderBytes = sizeof(Header);
+  static constexpr uint16_t kSealHasValues = 0x8000;
+
+  struct RecordHeader {
+    uint16_t size;
+    uint8_t type;
+    uint8_t type_check;  // ~type.
+    uint32_t crc;        // Of size, type and the payload.
+  };
+  static constexpr uint32_t kRecordHeaderBytes = sizeof(RecordHeader);
+  static constexpr uint32_t kMaxRecordBytes =
+      kRecordHeaderBytes + kMaxPayloadBytes;
+
+  static constexpr uint32_t Align(uint32_t n) { return (n + 3) & ~3u; }
+
+  struct Sector {
+    uint32_t sequence = 0;  // Zero when free.
+    uint32_t erase_count = 0;
+    uint16_t end = 0;  // Where the next record goes.
+    bool has_values = false;
+    bool sealed = false;
+    bool torn = false;    // Holds a record or seal cut short; never sealed.
+    bool full = false;    // Takes no more records.
+    bool erased = false;  // Known to be erased.
+  };
+
+  struct Value {
+    uint16_t key;
+    uint16_t sector;
+    uint16_t offset;  // Of the record.
+    bool used = false;
+  };
+
+  // Reads the record at `offset`, verifying it. Returns its header, with
+  // the payload in scratch_.
+  std::optional<RecordHeader> ReadRecord(uint32_t sector, uint32_t offset);
+  // Walks a sector's records from the start, indexing values. Unsealed
+  // sectors are checked throughout and have their end found.
+  void Scan(uint32_t sector);
+  // After a record that fails its CRC, where the next one starts, if one
+  // does before `limit`.
+  std::optional<uint32_t> Resync(
+      uint32_t sector, uint32_t offset, uint32_t limit);
+  // The first offset at or after `from` past which the sector is erased.
+  uint32_t ErasedFrom(uint32_t sector, uint32_t from);
+  void ReadFlash(uint32_t sector, uint32_t offset, std::span<uint8_t> out);
+
+  // Appends a record of `prefix` then `payload`. Returns its offset in
+  // head_.
+  std::optional<uint32_t> WriteRecord(
+      uint8_t type,
+      std::span<const uint8_t> prefix,
+      std::span<const uint8_t> payload);
+  // Appends the whole record in scratch_.
+  std::optional<uint32_t> Place(uint32_t bytes);
+  void Rotate();
+  // Copies the oldest sector's current values forward and erases it.
+  void Reclaim(uint32_t sector);
+  void StartSector(uint32_t sector, uint32_t sequence);
+  void Seal(uint32_t sector);
+
+  Value* Find(uint16_t key);
+  bool Index(uint16_t key, uint32_t sector, uint32_t offset);
+  void Unindex(uint16_t key);
+  void Apply(const RecordHeader& header, uint32_t sector, uint32_t offset);
+  std::optional<uint32_t> Oldest() const;
+  // The sector holding `sequence`, or the next one after it.
+  std::optional<uint32_t> Holding(uint32_t sequence) const;
+  uint32_t Next(uint32_t sector) const { return (sector + 1) % count_; }
+
+  FlashDevice& flash_;
+  uint32_t count_;
+  bool mounted_ = false;
+  uint32_t head_ = 0;
+  Stats stats_;
+  uint32_t reads_ = 0;
+  // One entry per sector; the region is at most this many.
+  static constexpr uint32_t kMaxSectors = 128;
+  std::array<Sector, kMaxSectors> sectors_;
+  std::array<Value, kMaxKeys> values_;
+  std::array<uint8_t, kMaxRecordBytes> scratch_;
+};
@@ -0,0 +1,146 @@
+#include "i2c_bus.h"
+
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+bool Due(uint32_t now_ms, uint32_t due_ms) {
+  return static_cast<int32_t>(now_ms - due_ms) >= 0;
+}
+
+}  // namespace
+
+std::string_view I2cStatusName(I2cStatus status) {
+  switch (status) {
+    case I2cStatus::kOk:
+      return "ok";
+    case I2cStatus::kNack:
+      return "nack";
+    case I2cStatus::kTimeout:
+      return "timeout";
+    case I2cStatus::kError:
+      return "error";
+  }
+  return "unknown";
+}
+
+I2cTransfer I2cTransfer::Write(
+    uint8_t address, std::span<const uint8_t> bytes) {
+  I2cTransfer t;
+  t.address = address;
+  t.write_len = std::min<size_t>(bytes.size(), kMaxWrite);
+  std::copy_n(bytes.begin(), t.write_len, t.write.begin());
+  return t;
+}
+
+I2cTransfer I2cTransfer::ReadRegister(
+    uint8_t address, uint8_t reg, uint8_t len) {
+  I2cTransfer t = Read(address, len);
+  t.write[0] = reg;
+  t.write_len = 1;
+  return t;
+}
+
+I2cTransfer I2cTransfer::Read(uint8_t address, uint8_t len) {
+  I2cTransfer t;
+  t.address = address;
+  t.read_len = std::min<uint8_t>(len, kMaxRead);
+  return t;
+}
+
+void I2cBusScheduler::Add(I2cDevice& device, uint32_t start_ms) {
+  constexpr uint32_t kStaggerMs = 5;
+  slots_.push_back(
+      {.device = &device,
+       .due_ms = start_ms + kStaggerMs * uint32_t(slots_.size())});
+}
+
+const I2cBusScheduler::Stats& I2cBusScheduler::stats(
+    const I2cDevice& device) const {
+  return std::find_if(slots_.begin(), slots_.end(), [&](const Slot& s) {
+           return s.device == &device;
+         })->stats;
+}
+
+void I2cBusScheduler::Apply(
+    Slot& slot, I2cDevice::Action action, uint32_t now_ms) {
+  switch (action.kind) {
+    case I2cDevice::Action::Kind::kTransfer:
+      slot.state = Slot::State::kPending;
+      break;
+    case I2cDevice::Action::Kind::kWait:
+      slot.state = Slot::State::kWaiting;
+      slot.due_ms = now_ms + action.wait_ms;
+      break;
+    case I2cDevice::Action::Kind::kDone:
+      ++slot.stats.cycles;
+      if (!action.ok) ++slot.stats.failed_cycles;
+      slot.state = Slot::State::kIdle;
+      // Keep to the period, unless the cycle overran it.
+      slot.due_ms = slot.cycle_started_ms + slot.device->period_ms();
+      if (Due(now_ms, slot.due_ms)) slot.due_ms = now_ms;
+      on_done_(*slot.device, action.ok);
+      break;
+  }
+}
+
+uint32_t I2cBusScheduler::Run(uint32_t now_ms) {
+  if (active_) {
+    Slot& slot = slots_[*active_];
+    std::optional<I2cStatus> status = transport_.Finished();
+    if (!status && Due(now_ms, active_started_ms_ + kTransferTimeoutMs)) {
+      transport_.Abort();
+      status = I2cStatus::kTimeout;
+    }
+    if (status) {
+      active_.reset();
+      ++slot.stats.transfers;
+      if (*status != I2cStatus::kOk) {
+        ++slot.stats.transfer_errors;
+        slot.stats.last_error = *status;
+      }
+      Apply(slot, slot.device->Continue(*status, slot.transfer), now_ms);
+    }
+  }
+
+  for (Slot& slot : slots_) {
+    if (!Due(now_ms, slot.due_ms)) continue;
+    if (slot.state == Slot::State::kIdle) {
+      slot.cycle_started_ms = now_ms;
+      slot.stats.cycle_due_ms = slot.due_ms;
+      slot.stats.cycle_started_ms = now_ms;
+      Apply(slot, slot.device->Start(slot.transfer), now_ms);
+    } else if (slot.state == Slot::State::kWaiting) {
+      Apply(slot, slot.device->Continue(I2cStatus::kOk, slot.transfer), now_ms);
+    }
+  }
+
+  if (!active_) {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      const size_t index = (next_ + i) % slots_.size();
+      Slot& slot = slots_[index];
+      if (slot.state != Slot::State::kPending) continue;
+      slot.state = Slot::State::kActive;
+      active_ = index;
+      active_started_ms_ = now_ms;
+      next_ = index + 1;
+      transport_.Start(slot.transfer);
+      break;
+    }
+  }
+
+  uint32_t sleep_ms = UINT32_MAX;
+  if (active_) {
+    sleep_ms = active_started_ms_ + kTransferTimeoutMs - now_ms;
+  }
+  // Pending slots are waiting for the transfer in flight.
+  for (const Slot& slot : slots_) {
+    if (slot.state == Slot::State::kIdle ||
+        slot.state == Slot::State::kWaiting) {
+      sleep_ms = std::min(
+          sleep_ms, Due(now_ms, slot.due_ms) ? 0 : slot.due_ms - now_ms);
+    }
+  }
+  return sleep_ms;
+}
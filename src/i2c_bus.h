@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+enum class I2cStatus : uint8_t {
+  kOk,
+  kNack,     // Address or data not acknowledged.
+  kTimeout,  // No completion within I2cBusScheduler::kTransferTimeoutMs.
+  kError,    // Arbitration lost or any other abort.
+};
+std::string_view I2cStatusName(I2cStatus status);
+
+// One bus transaction: write `write_len` bytes, then, after a repeated
+// start, read `read_len` bytes into `read`. Either part may be empty.
+struct I2cTransfer {
+  static constexpr int kMaxWrite = 8;
+  static constexpr int kMaxRead = 32;
+
+  uint8_t address = 0;
+  std::array<uint8_t, kMaxWrite> write{};
+  uint8_t write_len = 0;
+  std::array<uint8_t, kMaxRead> read{};
+  uint8_t read_len = 0;
+
+  // Writes `bytes`; the usual register write.
+  static I2cTransfer Write(uint8_t address, std::span<const uint8_t> bytes);
+  // Writes the register address then reads `len` bytes from it.
+  static I2cTransfer ReadRegister(uint8_t address, uint8_t reg, uint8_t len);
+  static I2cTransfer Read(uint8_t address, uint8_t len);
+};
+
+// Carries out one transfer at a time. Start returns at once; the transfer
+// then runs in the background (on the RP2040, by DMA) and Finished reports
+// its status. Implementations should wake the scheduler's task from their
+// completion interrupt, so it can sleep in between.
+class I2cTransport {
+ public:
+  virtual ~I2cTransport() = default;
+  // `transfer` stays valid, and untouched by the caller, until Finished
+  // returns a status or Abort is called. Read bytes land in transfer.read.
+  virtual void Start(I2cTransfer& transfer) = 0;
+  virtual std::optional<I2cStatus> Finished() = 0;
+  // Gives up on the transfer in flight, recovering the bus.
+  virtual void Abort() = 0;
+};
+
+// A sensor driver, written as a state machine the scheduler steps. One
+// cycle of the machine produces one reading: a few transfers, with waits
+// for conversions in between, which the scheduler fills with other devices'
+// transfers.
+class I2cDevice {
+ public:
+  struct Action {
+    enum class Kind : uint8_t {
+      kTransfer,  // Run the transfer the driver filled in.
+      kWait,      // Call Continue again after wait_ms.
+      kDone,      // The cycle is over; `ok` says whether it read anything.
+    };
+    Kind kind;
+    uint32_t wait_ms = 0;
+    bool ok = false;
+
+    static Action Transfer() { return {Kind::kTransfer}; }
+    static Action Wait(uint32_t ms) { return {Kind::kWait, ms}; }
+    static Action Done(bool ok) { return {Kind::kDone, 0, ok}; }
+  };
+
+  I2cDevice(uint8_t address, uint32_t period_ms)
+      : address_(address), period_ms_(period_ms) {}
+  virtual ~I2cDevice() = default;
+
+  virtual std::string_view name() const = 0;
+  uint8_t address() const { return address_; }
+  uint32_t period_ms() const { return period_ms_; }
+
+  // Begins a cycle.
+  virtual Action Start(I2cTransfer& next) = 0;
+  // Continues after the last transfer finished with `status` (`transfer`
+  // holds it, with any bytes read) or after a wait (status kOk). Fills
+  // `transfer` again for a kTransfer action.
+  virtual Action Continue(I2cStatus status, I2cTransfer& transfer) = 0;
+
+ protected:
+  const uint8_t address_;
+  const uint32_t period_ms_;
+};
+
+// Time-slices several devices on one bus from a single task. Each device
+// starts a cycle every period_ms; only one transfer is on the bus at a
+// time, and a device waiting for a conversion doesn't hold it.
+class I2cBusScheduler {
+ public:
+  static constexpr uint32_t kTransferTimeoutMs = 50;
+
+  struct Stats {
+    uint32_t cycles = 0;
+    uint32_t failed_cycles = 0;
+    uint32_t transfers = 0;
+    uint32_t transfer_errors = 0;
+    I2cStatus last_error = I2cStatus::kOk;
+    // When the last cycle to start was due, and when it started.
+    uint32_t cycle_due_ms = 0;
+    uint32_t cycle_started_ms = 0;
+  };
+
+  // Called in the scheduler's task when a device finishes a cycle.
+  using DoneFn = std::function<void(I2cDevice& device, bool ok)>;
+
+  I2cBusScheduler(I2cTransport& transport, DoneFn on_done)
+      : transport_(transport), on_done_(std::move(on_done)) {}
+
+  // Devices start their first cycle at `start_ms`, staggered by a few ms so
+  // they don't all queue at once.
+  void Add(I2cDevice& device, uint32_t start_ms);
+
+  // Advances the bus and every due device. Returns how many ms the caller
+  // may sleep before calling again, unless the transport notifies first.
+  uint32_t Run(uint32_t now_ms);
+
+  const Stats& stats(const I2cDevice& device) const;
+
+ private:
+  struct Slot {
+    enum class State : uint8_t {
+      kIdle,     // Until due_ms, when the next cycle starts.
+      kWaiting,  // For a conversion, until due_ms.
+      kPending,  // For the bus.
+      kActive,   // On the bus.
+    };
+    I2cDevice* device;
+    State state = State::kIdle;
+    uint32_t due_ms = 0;
+    uint32_t cycle_started_ms = 0;
+    I2cTransfer transfer;
+    Stats stats;
+  };
+
+  void Apply(Slot& slot, I2cDevice::Action action, uint32_t now_ms);
+
+  I2cTransport& transport_;
+  DoneFn on_done_;
+  std::vector<Slot> slots_;
+  // The slot whose transfer is on the bus.
+  std::optional<size_t> active_;
+  uint32_t active_started_ms_ = 0;
+  // Round-robin start for picking among slots that want the bus.
+  size_t next_ = 0;
+};
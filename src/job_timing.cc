@@ -0,0 +1,88 @@
+#include "job_timing.h"
+
+#include <algorithm>
+
+namespace {
+
+uint32_t ClampUs(uint64_t us) { return std::min<uint64_t>(us, UINT32_MAX); }
+
+}  // namespace
+
+std::string_view PeriodicJobName(PeriodicJob job) {
+  switch (job) {
+    case PeriodicJob::kVaneSample:
+      return "vane_sample";
+    case PeriodicJob::kWindFlush:
+      return "wind_flush";
+    case PeriodicJob::kRainFlush:
+      return "rain_flush";
+    case PeriodicJob::kSht4x:
+      return "sht4x";
+    case PeriodicJob::kBme280:
+      return "bme280";
+  }
+  return "unknown";
+}
+
+void JobTiming::Register(PeriodicJob job, uint32_t period_us) {
+  Set(jobs_[static_cast<int>(job)].period_us, period_us);
+}
+
+void JobTiming::Record(
+    PeriodicJob job,
+    uint64_t scheduled_us,
+    uint64_t started_us,
+    uint64_t finished_us) {
+  Job& j = jobs_[static_cast<int>(job)];
+  // Early starts count as on time.
+  const uint32_t lateness_us =
+      started_us > scheduled_us ? ClampUs(started_us - scheduled_us) : 0;
+  const uint32_t execution_us = ClampUs(finished_us - started_us);
+  const uint32_t period_us = j.period_us.load(std::memory_order_relaxed);
+
+  Add(j.runs, 1);
+  Set(j.last_lateness_us, lateness_us);
+  Max(j.max_lateness_us, lateness_us);
+  Set(j.last_execution_us, execution_us);
+  Max(j.max_execution_us, execution_us);
+  if (period_us) {
+    // The periods due by this start, less those already due by the last
+    // one, which a run catching up after it has counted.
+    const uint64_t counted_from_us = std::max(scheduled_us, j.last_started_us);
+    if (started_us > counted_from_us) {
+      const uint64_t due_by_start = (started_us - scheduled_us) / period_us;
+      const uint64_t due_by_last = (counted_from_us - scheduled_us) / period_us;
+      Add(j.missed, due_by_start - due_by_last);
+    }
+    if (execution_us > period_us) Add(j.overruns, 1);
+  }
+  j.last_started_us = started_us;
+  const auto bucket = std::lower_bound(
+      kLatenessBucketUs.begin(), kLatenessBucketUs.end(), lateness_us);
+  Add(j.lateness[bucket - kLatenessBucketUs.begin()], 1);
+}
+
+JobTiming::Snapshot JobTiming::Read(PeriodicJob job) const {
+  const Job& j = jobs_[static_cast<int>(job)];
+  auto load = [](const Counter& c) {
+    return c.load(std::memory_order_relaxed);
+  };
+  Snapshot s;
+  s.period_us = load(j.period_us);
+  s.runs = load(j.runs);
+  s.missed = load(j.missed);
+  s.overruns = load(j.overruns);
+  s.last_lateness_us = load(j.last_lateness_us);
+  s.max_lateness_us = load(j.max_lateness_us);
+  s.last_execution_us = load(j.last_execution_us);
+  s.max_execution_us = load(j.max_execution_us);
+  for (int i = 0; i < kLatenessBuckets; ++i) {
+    s.lateness[i] = load(j.lateness[i]);
+  }
+  return s;
+}
+
+JobTiming& GetJobTiming() {
+  static JobTiming job_timing;
+  return job_timing;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+// The station's periodic jobs, one timing record each.
+enum class PeriodicJob : uint8_t {
+  kVaneSample,  // Windvane reading and spectra, kVaneSampleHz.
+  kWindFlush,   // Anemometer count and wind publishes.
+  kRainFlush,   // Rain gauge count and rain publishes.
+  kSht4x,       // I2C sensor cycles.
+  kBme280,
+};
+inline constexpr int kPeriodicJobCount = 5;
+std::string_view PeriodicJobName(PeriodicJob job);
+
+// How each periodic job keeps to its schedule: how late every run started,
+// how long it took, and how many periods went by unrun or were overrun. A
+// late start that the job then corrects for (the flushes scale their counts
+// by the time actually elapsed) still shows up here. A job that catches up
+// on a fixed schedule after a stall runs late several times over, but the
+// periods the stall cost are counted once.
+//
+// Each job's counters are written only by the task that runs it, with
+// relaxed loads and stores as in PublishHealth; readers see each field
+// atomically but not a consistent snapshot.
+class JobTiming {
+ public:
+  // Upper bounds of the lateness histogram's buckets; the last takes the
+  // rest.
+  static constexpr std::array<uint32_t, 6> kLatenessBucketUs = {
+      100, 1'000, 10'000, 100'000, 1'000'000, UINT32_MAX};
+  static constexpr int kLatenessBuckets = kLatenessBucketUs.size();
+
+  struct Snapshot {
+    uint32_t period_us = 0;
+    uint32_t runs = 0;
+    // Times the job came due again while a run was still waiting to start,
+    // on that run's schedule.
+    uint32_t missed = 0;
+    // Runs that took longer than a period.
+    uint32_t overruns = 0;
+    uint32_t last_lateness_us = 0;
+    uint32_t max_lateness_us = 0;
+    uint32_t last_execution_us = 0;
+    uint32_t max_execution_us = 0;
+    std::array<uint32_t, kLatenessBuckets> lateness{};
+  };
+
+  // Before the job's first run.
+  void Register(PeriodicJob job, uint32_t period_us);
+  // From the job's task after each run, with when it was due, started and
+  // finished, in us since boot.
+  void Record(
+      PeriodicJob job,
+      uint64_t scheduled_us,
+      uint64_t started_us,
+      uint64_t finished_us);
+
+  Snapshot Read(PeriodicJob job) const;
+
+ private:
+  using Counter = std::atomic<uint32_t>;
+  static_assert(Counter::is_always_lock_free);
+
+  static void Set(Counter& c, uint32_t value) {
+    c.store(value, std::memory_order_relaxed);
+  }
+  static void Add(Counter& c, uint32_t n) {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+  static void Max(Counter& c, uint32_t value) {
+    if (value > c.load(std::memory_order_relaxed)) Set(c, value);
+  }
+
+  struct Job {
+    Counter period_us{0};
+    Counter runs{0};
+    Counter missed{0};
+    Counter overruns{0};
+    Counter last_lateness_us{0};
+    Counter max_lateness_us{0};
+    Counter last_execution_us{0};
+    Counter max_execution_us{0};
+    std::array<Counter, kLatenessBuckets> lateness{};
+    // Only the job's own task touches this.
+    uint64_t last_started_us = 0;
+  };
+  std::array<Job, kPeriodicJobCount> jobs_;
+};
+
+JobTiming& GetJobTiming();
@@ -1,33 +1,59 @@
 #include <FreeRTOSConfig.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <format>
 #include <functional>
-#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #include "freertosxx/event.h"
 #include "freertosxx/mutex.h"
 #include "hardware/adc.h"
 #include "hardware/gpio.h"
+#include "hardware/i2c.h"
 #include "hardware/irq.h"
 #include "hardware/regs/intctrl.h"
-#include "hardware/structs/watchdog.h"
 #include "hardware/timer.h"
-#include "hardware/watchdog.h"
+#include "anemometer_health.h"
+#include "bme280.h"
+#include "broker_selector.h"
+#include "derived_metrics.h"
+#include "flash_log.h"
 #include "homeassistant/homeassistant.h"
+#include "i2c_bus.h"
+#include "job_timing.h"
 #include "lwip/err.h"
 #include "lwipxx/mqtt.h"
+#include "pico/cyw43_arch.h"
 #include "pico/platform.h"
 #include "pico/time.h"
 #include "pico/types.h"
 #include "portmacro.h"
+#include "publish_health.h"
+#include "queue.h"
+#include "rain_event.h"
+#include "reed_counter.h"
+#include "rp2040_flash.h"
+#include "rp2040_i2c.h"
+#include "sht4x.h"
+#include "spsc_ring.h"
+#include "supervisor.h"
 #include "task.h"
+#include "telemetry_frame.h"
+#include "tipping_bucket.h"
+#include "turbulence.h"
+#include "windvane_levels.h"
+#include "yamartino.h"
 
 using lwipxx::MqttClient;
 
@@ -40,55 +66,74 @@ constexpr uint64_t kAnemometerFlushUs = kWindReportPeriodSecs * 1e6;
 
 using SensorPubFn = std::function<void(std::string_view, std::string_view)>;
 
-struct LastSuccessfulPublishInfo {
-  absolute_time_t when;
-  int attempts_since = 0;
-};
+// The broker connection. The network task replaces the client when the
+// supervisor asks it to reconnect and when it fails over between brokers, so
+// other tasks borrow it for each use.
+freertosxx::OwnerBorrowable<std::unique_ptr<MqttClient>> g_mqtt = {
+    std::in_place};
+// Counts the connections g_mqtt has held, so that a publish failure reported
+// for one since replaced is ignored.
+std::atomic<uint32_t> g_connection = 0;
 
-freertosxx::OwnerBorrowable<LastSuccessfulPublishInfo>
-    g_last_successful_sensor_publish = {std::in_place, get_absolute_time(), 0};
-
-void CheckLastSuccessfulPublish() {
-  auto p = g_last_successful_sensor_publish.Borrow();
-  constexpr uint32_t kMinUsSinceSuccessToReboot = 20'000'000;
-  constexpr int kMinAttemptsToReboot = 5;
-  // We ensure both that time has passed and that many attempts have been made
-  // before rebooting to prevent a scenario where we fail just because no
-  // attempts are made due to a debugger being attached, for example.
-  if (absolute_time_diff_us(get_absolute_time(), p->when) >
-          kMinUsSinceSuccessToReboot &&
-      p->attempts_since > kMinAttemptsToReboot) {
-    printf(
-        "Last successful publish more than %0.1f seconds ago and we've tried "
-        "%d times since, rebooting\n",
-        kMinUsSinceSuccessToReboot / 1'000'000.,
-        p->attempts_since);
-    watchdog_reboot(0, 0, 0);
-    return;
-  } else {
-    ++p->attempts_since;
-  }
+// The network task, and the notification bit, beside the supervisor's
+// kRecover* ones, by which publishers report a connection lost.
+TaskHandle_t g_network_task = nullptr;
+constexpr uint32_t kConnectionLost = 1 << 2;
+static_assert((kConnectionLost & (kRecoverMqtt | kRecoverWifi)) == 0);
+std::atomic<uint32_t> g_lost_connection = 0;
+std::atomic<uint32_t> g_last_loss_report_ms = 0;
+
+// Whether a publish failed because the broker connection is gone.
+bool ConnectionLost(err_t err) {
+  return err == ERR_CONN || err == ERR_CLSD || err == ERR_RST ||
+         err == ERR_ABRT || err == ERR_TIMEOUT;
 }
 
-void UpdateLastSuccessfulPublish() {
-  const absolute_time_t now = get_absolute_time();
-  *g_last_successful_sensor_publish.Borrow() = {now, 0};
+// Has the network task fail over from `connection` now, rather than once the
+// publisher's deadline passes. Every publish on a dead connection fails, so
+// this reports at most every few seconds. Callable from lwIP's thread.
+void ReportConnectionLost(uint32_t connection) {
+  constexpr uint32_t kMinReportIntervalMs = 5'000;
+  if (!g_network_task) return;
+  const uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+  uint32_t last_ms = g_last_loss_report_ms.load(std::memory_order_relaxed);
+  if (last_ms != 0 && now_ms - last_ms < kMinReportIntervalMs) return;
+  if (!g_last_loss_report_ms.compare_exchange_strong(last_ms, now_ms)) return;
+  g_lost_connection.store(connection);
+  xTaskNotify(g_network_task, kConnectionLost, eSetBits);
 }
 
 void SensorPublish(
-    MqttClient& client, std::string_view topic, std::string_view payload) {
-  CheckLastSuccessfulPublish();
-  err_t err = client.Publish(
-      topic, payload, MqttClient::kAtLeastOnce, true, [](err_t err) {
+    PublishStream stream,
+    std::string_view topic,
+    std::string_view payload,
+    MqttClient::Qos qos = MqttClient::kAtLeastOnce,
+    bool retain = true) {
+  PublishHealth& health = GetPublishHealth();
+  health.OnAttempt(stream);
+  auto mqtt = g_mqtt.Borrow();
+  // Null while no broker is taken; the network task keeps retrying.
+  if (!*mqtt) {
+    health.OnDispatchFailure(stream, ERR_CONN);
+    return;
+  }
+  const uint32_t connection = g_connection.load();
+  err_t err = (*mqtt)->Publish(
+      topic, payload, qos, retain, [stream, connection](err_t err) {
+        // Runs in lwIP's thread: nothing here may block.
+        GetPublishHealth().OnComplete(stream, err);
         if (err == ERR_OK) {
-          UpdateLastSuccessfulPublish();
+          GetSupervisor().CheckIn(SupervisedTask::kPublisher);
         } else {
           printf(
               "%s\n",
               std::format("error publishing {}", lwip_strerr(err)).c_str());
+          if (ConnectionLost(err)) ReportConnectionLost(connection);
         }
       });
   if (err != ERR_OK) {
+    health.OnDispatchFailure(stream, err);
+    if (ConnectionLost(err)) ReportConnectionLost(connection);
     printf(
         "%s\n",
         std::format("error dispatching publish request {}", lwip_strerr(err))
@@ -96,41 +141,72 @@ void SensorPublish(
   }
 }
 
-std::string_view LevelToDirection(int32_t adc_reading) {
-  // ADC target levels assume a divider impedance of 3377 ohms, which can be
-  // achieved by putting a 5100 ohm and 10000 ohm resistor in parallel.
-  constexpr std::array<std::pair<std::string_view, int32_t>, 16> adc_targets{
-      // New: I have the divider, then the ADC, then the windvane, then ground.
-      {std::make_pair("NE", 2901),
-       std::make_pair("E", 936),
-       std::make_pair("SE", 1616),
-       std::make_pair("S", 2195),
-       std::make_pair("SW", 3382),
-       std::make_pair("W", 3984),
-       std::make_pair("NW", 3893),
-       std::make_pair("N", 3716),
-       std::make_pair("NNE", 2705),
-       std::make_pair("ENE", 855),
-       std::make_pair("ESE", 693),
-       std::make_pair("SSE", 1204),
-       std::make_pair("SSW", 1972),
-       std::make_pair("WSW", 3305),
-       std::make_pair("WNW", 3792),
-       std::make_pair("NNW", 3548)}};
-  int min_diff = std::numeric_limits<int>::max();
-  int min_index = -1;
-  for (int i = 0; i < adc_targets.size(); ++i) {
-    const int diff = std::abs(adc_targets[i].second - adc_reading);
-    if (min_diff > diff) {
-      min_diff = diff;
-      min_index = i;
-    }
+// Returns the vane position as an index into windvane::kSectorsByLevel and
+// kCompassIndexByLevel.
+size_t LevelToPosition(int32_t adc_reading) {
+  // Levels and boundaries come from tools/windvane_calibrate for the fitted
+  // divider (see WINDVANE_DIVIDER in src/CMakeLists.txt). The divider is
+  // between 3V3 and the ADC, the windvane between the ADC and ground.
+  const auto it = std::upper_bound(
+      windvane::kBoundaries.begin(), windvane::kBoundaries.end(), adc_reading);
+  return it - windvane::kBoundaries.begin();
+}
+
+// Direction statistics cover this many seconds of vane readings.
+constexpr int kDirectionStatsPeriodSecs = 10 * 60;
+
+// The vane is read fast enough to see it oscillate; each reading goes to
+// the turbulence spectra and every kWindReportPeriodSecs one is published.
+constexpr int kVaneSampleHz = TurbulenceSpectra::kDirectionHz;
+constexpr int kVaneSamplesPerReport = kVaneSampleHz * kWindReportPeriodSecs;
+constexpr int kVaneSamplesPerSpeed =
+    kVaneSampleHz / TurbulenceSpectra::kSpeedHz;
+static_assert(kVaneSamplesPerReport % kVaneSamplesPerSpeed == 0);
+
+float InstantaneousWindMph();
+
+// Opt-in, see HIGH_RATE_TELEMETRY_HZ in src/CMakeLists.txt. Frames go out
+// every kWindReportPeriodSecs at QoS 0 and unretained: a lost frame shows
+// as a gap in the sequence numbers, and a stale one is no use to anybody.
+constexpr int kHighRateTelemetryHz = HIGH_RATE_TELEMETRY_HZ;
+static_assert(
+    kHighRateTelemetryHz >= 0 && kHighRateTelemetryHz <= kVaneSampleHz &&
+    (kHighRateTelemetryHz == 0 || kVaneSampleHz % kHighRateTelemetryHz == 0));
+static_assert(
+    kHighRateTelemetryHz * kWindReportPeriodSecs <=
+    TelemetryFrameWriter::kMaxSamples);
+constexpr std::string_view kTelemetryTopic = "weatherstation/telemetry/wind";
+
+void PublishTurbulence(
+    const std::string& topic,
+    const TurbulenceSpectra::Result& spectra,
+    uint64_t analysis_us) {
+  const SpectrumSummary& speed = spectra.speed;
+  const SpectrumSummary& dir = spectra.direction;
+  const std::string summary = std::format(
+      "{{\"speed_mph2\":[{:.3f},{:.3f},{:.3f}],\"speed_peak_hz\":{:.3f},"
+      "\"direction_deg2\":[{:.1f},{:.1f},{:.1f},{:.1f}],"
+      "\"direction_peak_hz\":{:.3f},\"analysis_us\":{}}}",
+      speed.band_energy[0],
+      speed.band_energy[1],
+      speed.band_energy[2],
+      speed.dominant_hz,
+      dir.band_energy[0],
+      dir.band_energy[1],
+      dir.band_energy[2],
+      dir.band_energy[3],
+      dir.dominant_hz,
+      analysis_us);
+  printf("turbulence: %s\n", summary.c_str());
+  // The analysis runs between vane readings and should take a small part
+  // of one; tools/fft_bench checks the same budget on the host.
+  if (analysis_us > 1'000'000 / kVaneSampleHz / 10) {
+    printf("turbulence analysis over budget\n");
   }
-  return adc_targets[min_index].first;
+  SensorPublish(PublishStream::kTurbulence, topic, summary);
 }
 
 void wind_direction_task(void* args) {
-  MqttClient& mqtt = *static_cast<MqttClient*>(args);
   gpio_init(26);
   adc_init();
   adc_gpio_init(26);
@@ -146,63 +222,241 @@ void wind_direction_task(void* args) {
     JsonBuilder json;
     AddCommonInfo(windvane, json);
     AddSensorInfo(windvane, std::nullopt, json);
-    PublishDiscovery(mqtt, windvane, std::move(json).Finish());
+    PublishDiscovery(**g_mqtt.Borrow(), windvane, std::move(json).Finish());
   }
 
   std::string state_topic = AbsoluteChannel(windvane, topic_suffix::kState);
 
-  while (true) {
-    const uint16_t level = adc_read();
-    std::string_view direction = LevelToDirection(level);
-    SensorPublish(mqtt, state_topic, direction);
-    sleep_ms(kWindReportPeriodSecs * 1000);
+  CommonDeviceInfo mean_device("weatherstation_wind_dir_mean");
+  mean_device.name = "mean wind direction";
+  mean_device.component = "sensor";
+  mean_device.device_class = "wind_direction";
+
+  {
+    JsonBuilder json;
+    AddCommonInfo(mean_device, json);
+    AddSensorInfo(mean_device, "°", json);
+    PublishDiscovery(**g_mqtt.Borrow(), mean_device, std::move(json).Finish());
   }
-}
 
-struct RateLimitedCounter {
-  const uint64_t update_period;
-  uint64_t next_update = 0;
-  int count = 0;
+  // Standard deviation of the direction (sigma-theta), a measure of how
+  // steady the wind is.
+  CommonDeviceInfo sigma_device("weatherstation_wind_dir_sigma");
+  sigma_device.name = "wind direction variability";
+  sigma_device.component = "sensor";
 
-  void Inc(uint64_t timestamp) {
-    if (timestamp > next_update) {
-      ++count;
-      next_update = timestamp + update_period;
-    }
+  {
+    JsonBuilder json;
+    AddCommonInfo(sigma_device, json);
+    AddSensorInfo(sigma_device, "°", json);
+    PublishDiscovery(**g_mqtt.Borrow(), sigma_device, std::move(json).Finish());
   }
 
-  int Flush() { return std::exchange(count, 0); }
-};
+  const std::string mean_topic =
+      AbsoluteChannel(mean_device, topic_suffix::kState);
+  const std::string sigma_topic =
+      AbsoluteChannel(sigma_device, topic_suffix::kState);
+
+  // The state is a JSON summary of the speed and direction spectra.
+  CommonDeviceInfo turbulence_device("weatherstation_turbulence");
+  turbulence_device.name = "wind turbulence spectrum";
+  turbulence_device.component = "sensor";
+
+  {
+    JsonBuilder json;
+    AddCommonInfo(turbulence_device, json);
+    AddSensorInfo(turbulence_device, std::nullopt, json);
+    PublishDiscovery(
+        **g_mqtt.Borrow(), turbulence_device, std::move(json).Finish());
+  }
+
+  const std::string turbulence_topic =
+      AbsoluteChannel(turbulence_device, topic_suffix::kState);
+
+  // Static to keep their buffers off this task's stack.
+  static TurbulenceSpectra turbulence;
+  static TelemetryFrameWriter telemetry;
+  YamartinoWindow direction_stats;
+  int readings_in_window = 0;
+  int sample = 0;
+  JobTiming& timing = GetJobTiming();
+  timing.Register(PeriodicJob::kVaneSample, 1'000'000 / kVaneSampleHz);
+  absolute_time_t next_sample = get_absolute_time();
+  while (true) {
+    const uint64_t started_us = time_us_64();
+    const size_t position = LevelToPosition(adc_read());
+    turbulence.AddDirection(windvane::kCompassIndexByLevel[position]);
+    if (sample % kVaneSamplesPerSpeed == 0) {
+      turbulence.AddSpeed(InstantaneousWindMph());
+    }
+    if (kHighRateTelemetryHz > 0 &&
+        sample % (kVaneSampleHz / std::max(kHighRateTelemetryHz, 1)) == 0) {
+      telemetry.Add(
+          to_ms_since_boot(get_absolute_time()),
+          InstantaneousWindMph(),
+          windvane::kCompassIndexByLevel[position]);
+    }
+    const uint64_t analysis_start_us = time_us_64();
+    if (const auto spectra = turbulence.Finish()) {
+      PublishTurbulence(
+          turbulence_topic, *spectra, time_us_64() - analysis_start_us);
+    }
+
+    if (sample == 0) {
+      if (telemetry.samples() > 0) {
+        SensorPublish(
+            PublishStream::kTelemetry,
+            kTelemetryTopic,
+            telemetry.frame(),
+            MqttClient::kAtMostOnce,
+            false);
+        telemetry.Clear();
+      }
+      SensorPublish(
+          PublishStream::kWindDirection,
+          state_topic,
+          windvane::kSectorsByLevel[position]);
+      direction_stats.Add(windvane::kCompassIndexByLevel[position]);
+      if (++readings_in_window * kWindReportPeriodSecs >=
+          kDirectionStatsPeriodSecs) {
+        readings_in_window = 0;
+        if (const auto stats = direction_stats.Finish()) {
+          printf(
+              "wind direction mean %.0f, sigma-theta %.1f over %lu readings\n",
+              stats->mean_degrees,
+              stats->sigma_degrees,
+              static_cast<unsigned long>(stats->samples));
+          SensorPublish(
+              PublishStream::kWindDirectionMean,
+              mean_topic,
+              std::to_string(stats->mean_degrees));
+          SensorPublish(
+              PublishStream::kWindDirectionSigma,
+              sigma_topic,
+              std::to_string(stats->sigma_degrees));
+        }
+      }
+      GetSupervisor().CheckIn(SupervisedTask::kWindDirection);
+    }
+
+    timing.Record(
+        PeriodicJob::kVaneSample,
+        to_us_since_boot(next_sample),
+        started_us,
+        time_us_64());
+    sample = (sample + 1) % kVaneSamplesPerReport;
+    next_sample = delayed_by_us(next_sample, 1'000'000 / kVaneSampleHz);
+    sleep_until(next_sample);
+  }
+}
 
-// We'll measure up to 50mph wind. We're assuming a simple linear
-// relationship, when in reality doubling the tick speed is probably more than
-// doubling the wind speed.
-constexpr float kAnemometerSpeedPerTick = 1.73;  // mph
-constexpr float kAnemometerMaxSpeed = 100;
-constexpr uint64_t kAnemometerUpdateUs =
-    1e6 / (kAnemometerMaxSpeed / kAnemometerSpeedPerTick);
-RateLimitedCounter& AnemometerCounter() {
+__force_inline RateLimitedCounter& AnemometerCounter() {
   static RateLimitedCounter anemometer_counter{
       .update_period = kAnemometerUpdateUs};
   return anemometer_counter;
 }
 
-// We'll measure up to six inches of rain per hour.
-constexpr float kRainGaugeInchesPerTick = 0.011;
-constexpr float kRainGaugeMaxInchesPerSecond = 6. / (60 * 60);
-constexpr uint64_t kRainGaugeUpdateUs =
-    1e6 / (kRainGaugeMaxInchesPerSecond / kRainGaugeInchesPerTick);
-RateLimitedCounter& RainGaugeCounter() {
+// The last counted anemometer closure and the period ending at it, for the
+// turbulence spectra. Written only by the GPIO interrupt, so plain atomic
+// stores; a reader can pair a period with the next closure's time, which
+// costs one odd sample. The closure time is in 1.024 ms ticks (us >> 10):
+// 64-bit division is a library call, and the interrupt runs from RAM.
+struct AnemometerPeriod {
+  uint64_t last_closure_us = 0;  // Interrupt only.
+  std::atomic<uint32_t> last_closure_ticks{0};
+  std::atomic<uint32_t> period_us{0};  // Zero until the second closure.
+
+  __force_inline void OnClosure(uint64_t timestamp) {
+    if (last_closure_us) {
+      const uint64_t period = timestamp - last_closure_us;
+      period_us.store(
+          period > UINT32_MAX ? UINT32_MAX : period,
+          std::memory_order_relaxed);
+    }
+    last_closure_us = timestamp;
+    last_closure_ticks.store(timestamp >> 10, std::memory_order_relaxed);
+  }
+};
+__force_inline AnemometerPeriod& LastAnemometerPeriod() {
+  static AnemometerPeriod anemometer_period;
+  return anemometer_period;
+}
+
+// Speed from the last closure-to-closure period, or less once the next
+// closure is overdue.
+float InstantaneousWindMph() {
+  const AnemometerPeriod& p = LastAnemometerPeriod();
+  const uint32_t period_us = p.period_us.load(std::memory_order_relaxed);
+  if (period_us == 0) return 0;
+  const uint32_t since_ticks =
+      static_cast<uint32_t>(time_us_64() >> 10) -
+      p.last_closure_ticks.load(std::memory_order_relaxed);
+  const float seconds = std::max(period_us / 1e6f, since_ticks * 1.024e-3f);
+  return kAnemometerSpeedPerTick / seconds;
+}
+
+__force_inline RateLimitedCounter& RainGaugeCounter() {
   static RateLimitedCounter rain_gauge_counter{
       .update_period = kRainGaugeUpdateUs};
   return rain_gauge_counter;
 }
 
+// Counted rain gauge tips, handed from the GPIO interrupt to the wind and
+// rain task, which drains them with interrupts disabled like the counters.
+// The task wakes at least every kWindReportPeriodSecs, and the debounce
+// allows a tip every 6.6 s, so this never needs to hold more than two.
+struct TipQueue {
+  std::array<uint64_t, 8> tips;
+  size_t size = 0;
+  int dropped = 0;
+
+  __force_inline void Push(uint64_t timestamp) {
+    if (size < tips.size()) {
+      tips[size++] = timestamp;
+    } else {
+      ++dropped;
+    }
+  }
+};
+__force_inline TipQueue& RainGaugeTips() {
+  static TipQueue rain_gauge_tips;
+  return rain_gauge_tips;
+}
+
+// A rain event ends after an hour without a tip.
+constexpr uint64_t kRainEventDryGapUs = 60 * 60 * 1'000'000ull;
+
+// Both edges of the anemometer's reed switch are timestamped for bearing
+// and magnet health when the build sets ANEMOMETER_EDGE_TIMING.
+constexpr bool kAnemometerEdgeTiming = ANEMOMETER_EDGE_TIMING;
+
+// Reed switch edges as microsecond timestamps with bit 0 set when the edge
+// closed the switch. At 100 mph the reed makes ~115 edges a second; this
+// holds a little over one report period of them.
+using EdgeRing = SpscRing<uint32_t, 1024>;
+__force_inline EdgeRing& AnemometerEdges() {
+  static EdgeRing anemometer_edges;
+  return anemometer_edges;
+}
+
+struct WindAndRainTopics {
+  std::string wind;
+  std::string rain;
+  std::string rain_event_active;
+  std::string rain_event;
+  std::string wind_run;
+  std::string beaufort;
+  std::string gust_factor;
+  std::string rain_intensity;
+  // Only with kAnemometerEdgeTiming.
+  std::string anemometer_health;
+  std::string anemometer_edge_stats;
+};
+
 constexpr int kAnemometerPin = 14;
 constexpr int kRainGaugePin = 15;
 
-void setup_wind_and_rain(
-    MqttClient& client, std::string& wind_topic, std::string& rain_topic) {
+void setup_wind_and_rain(WindAndRainTopics& topics) {
   using namespace homeassistant;
   CommonDeviceInfo rain_device("weatherstation_rain_gauge");
   rain_device.name = "rainfall sensor";
@@ -213,8 +467,8 @@ void setup_wind_and_rain(
     JsonBuilder json;
     AddCommonInfo(rain_device, json);
     AddSensorInfo(rain_device, "in/h", json);
-    PublishDiscovery(client, rain_device, std::move(json).Finish());
-    rain_topic = AbsoluteChannel(rain_device, topic_suffix::kState);
+    PublishDiscovery(**g_mqtt.Borrow(), rain_device, std::move(json).Finish());
+    topics.rain = AbsoluteChannel(rain_device, topic_suffix::kState);
   }
 
   homeassistant::CommonDeviceInfo wind_device("weatherstation_anemometer");
@@ -226,14 +480,280 @@ void setup_wind_and_rain(
     JsonBuilder json;
     AddCommonInfo(wind_device, json);
     AddSensorInfo(wind_device, "mph", json);
-    PublishDiscovery(client, wind_device, std::move(json).Finish());
-    wind_topic = AbsoluteChannel(wind_device, topic_suffix::kState);
+    PublishDiscovery(**g_mqtt.Borrow(), wind_device, std::move(json).Finish());
+    topics.wind = AbsoluteChannel(wind_device, topic_suffix::kState);
+  }
+
+  CommonDeviceInfo rain_event_active_device(
+      "weatherstation_rain_event_active");
+  rain_event_active_device.name = "rain event in progress";
+  rain_event_active_device.component = "binary_sensor";
+  rain_event_active_device.device_class = "moisture";
+
+  {
+    JsonBuilder json;
+    AddCommonInfo(rain_event_active_device, json);
+    AddSensorInfo(rain_event_active_device, std::nullopt, json);
+    PublishDiscovery(
+        **g_mqtt.Borrow(), rain_event_active_device, std::move(json).Finish());
+    topics.rain_event_active =
+        AbsoluteChannel(rain_event_active_device, topic_suffix::kState);
+  }
+
+  // The state is a JSON summary of the last finished event.
+  CommonDeviceInfo rain_event_device("weatherstation_rain_event");
+  rain_event_device.name = "last rain event";
+  rain_event_device.component = "sensor";
+
+  {
+    JsonBuilder json;
+    AddCommonInfo(rain_event_device, json);
+    AddSensorInfo(rain_event_device, std::nullopt, json);
+    PublishDiscovery(
+        **g_mqtt.Borrow(), rain_event_device, std::move(json).Finish());
+    topics.rain_event =
+        AbsoluteChannel(rain_event_device, topic_suffix::kState);
+  }
+
+  // Derived on the station (see DerivedMetrics). Wind run counts up from
+  // boot, for a utility meter to turn into daily totals.
+  CommonDeviceInfo wind_run_device("weatherstation_wind_run");
+  wind_run_device.name = "wind run";
+  wind_run_device.component = "sensor";
+  wind_run_device.device_class = "distance";
+
+  {
+    JsonBuilder json;
+    AddCommonInfo(wind_run_device, json);
+    AddSensorInfo(wind_run_device, "mi", json);
+    PublishDiscovery(
+        **g_mqtt.Borrow(), wind_run_device, std::move(json).Finish());
+    topics.wind_run = AbsoluteChannel(wind_run_device, topic_suffix::kState);
+  }
+
+  CommonDeviceInfo beaufort_device("weatherstation_beaufort");
+  beaufort_device.name = "beaufort force";
+  beaufort_device.component = "sensor";
+
+  {
+    JsonBuilder json;
+    AddCommonInfo(beaufort_device, json);
+    AddSensorInfo(beaufort_device, std::nullopt, json);
+    PublishDiscovery(
+        **g_mqtt.Borrow(), beaufort_device, std::move(json).Finish());
+    topics.beaufort = AbsoluteChannel(beaufort_device, topic_suffix::kState);
+  }
+
+  CommonDeviceInfo gust_factor_device("weatherstation_gust_factor");
+  gust_factor_device.name = "gust factor";
+  gust_factor_device.component = "sensor";
+
+  {
+    JsonBuilder json;
+    AddCommonInfo(gust_factor_device, json);
+    AddSensorInfo(gust_factor_device, std::nullopt, json);
+    PublishDiscovery(
+        **g_mqtt.Borrow(), gust_factor_device, std::move(json).Finish());
+    topics.gust_factor =
+        AbsoluteChannel(gust_factor_device, topic_suffix::kState);
+  }
+
+  CommonDeviceInfo rain_intensity_device("weatherstation_rain_intensity");
+  rain_intensity_device.name = "rain intensity";
+  rain_intensity_device.component = "sensor";
+  rain_intensity_device.device_class = "enum";
+
+  {
+    JsonBuilder json;
+    AddCommonInfo(rain_intensity_device, json);
+    AddSensorInfo(rain_intensity_device, std::nullopt, json);
+    PublishDiscovery(
+        **g_mqtt.Borrow(), rain_intensity_device, std::move(json).Finish());
+    topics.rain_intensity =
+        AbsoluteChannel(rain_intensity_device, topic_suffix::kState);
+  }
+
+  if (!kAnemometerEdgeTiming) return;
+
+  CommonDeviceInfo health_device("weatherstation_anemometer_health");
+  health_device.name = "anemometer bearing health";
+  health_device.component = "sensor";
+
+  {
+    JsonBuilder json;
+    AddCommonInfo(health_device, json);
+    AddSensorInfo(health_device, "%", json);
+    PublishDiscovery(
+        **g_mqtt.Borrow(), health_device, std::move(json).Finish());
+    topics.anemometer_health =
+        AbsoluteChannel(health_device, topic_suffix::kState);
+  }
+
+  // The state is a JSON array of per-speed-band statistics.
+  CommonDeviceInfo edge_stats_device("weatherstation_anemometer_edge_stats");
+  edge_stats_device.name = "anemometer edge statistics";
+  edge_stats_device.component = "sensor";
+
+  {
+    JsonBuilder json;
+    AddCommonInfo(edge_stats_device, json);
+    AddSensorInfo(edge_stats_device, std::nullopt, json);
+    PublishDiscovery(
+        **g_mqtt.Borrow(), edge_stats_device, std::move(json).Finish());
+    topics.anemometer_edge_stats =
+        AbsoluteChannel(edge_stats_device, topic_suffix::kState);
+  }
+}
+
+void PublishAnemometerHealth(
+    const WindAndRainTopics& topics, const AnemometerHealth& health) {
+  std::string stats = "[";
+  for (int i = 0; i < AnemometerHealth::kBands; ++i) {
+    const AnemometerHealth::Band& b = health.bands()[i];
+    stats += std::format(
+        "{}{{\"min_mph\":{:.0f},\"closures\":{},\"duty\":{:.3f},"
+        "\"jitter\":{:.3f},\"asymmetry\":{:.3f}}}",
+        i ? "," : "",
+        AnemometerHealth::kBandEdgesMph[i],
+        b.closures,
+        b.duty,
+        b.jitter_rms,
+        b.asymmetry);
+  }
+  stats += "]";
+  printf("anemometer edge stats: %s\n", stats.c_str());
+  SensorPublish(
+      PublishStream::kAnemometerEdgeStats, topics.anemometer_edge_stats, stats);
+  if (const std::optional<float> percent = health.HealthPercent()) {
+    SensorPublish(
+        PublishStream::kAnemometerHealth,
+        topics.anemometer_health,
+        std::to_string(*percent));
+  }
+}
+
+// There's no wall clock on the board, so times are given relative to the
+// publish.
+void PublishRainEvent(
+    const WindAndRainTopics& topics, const RainEvent& event, uint64_t now_us) {
+  const std::string summary = std::format(
+      "{{\"started_s_ago\":{},\"ended_s_ago\":{},\"duration_s\":{},"
+      "\"tips\":{},\"depth_in\":{:.3f},\"peak_1m_in_h\":{:.2f},"
+      "\"peak_5m_in_h\":{:.2f},\"peak_15m_in_h\":{:.2f}}}",
+      (now_us - event.start_us) / 1'000'000,
+      (now_us - event.end_us) / 1'000'000,
+      event.duration_us() / 1'000'000,
+      event.tips,
+      event.depth_in,
+      event.peak_in_per_hour[0],
+      event.peak_in_per_hour[1],
+      event.peak_in_per_hour[2]);
+  printf("rain event finished: %s\n", summary.c_str());
+  SensorPublish(PublishStream::kRainEvent, topics.rain_event, summary);
+  SensorPublish(
+      PublishStream::kRainEventActive, topics.rain_event_active, "OFF");
+}
+
+void PublishDerivedWind(
+    const WindAndRainTopics& topics,
+    const DerivedMetrics::WindChanges& changes) {
+  if (changes.wind_run_miles) {
+    SensorPublish(
+        PublishStream::kWindRun,
+        topics.wind_run,
+        std::format("{:.1f}", *changes.wind_run_miles));
+  }
+  if (changes.beaufort) {
+    SensorPublish(
+        PublishStream::kBeaufort,
+        topics.beaufort,
+        std::to_string(*changes.beaufort));
+  }
+  if (changes.gust_factor) {
+    SensorPublish(
+        PublishStream::kGustFactor,
+        topics.gust_factor,
+        std::format("{:.1f}", *changes.gust_factor));
+  }
+}
+
+// Reed switch interrupts, counted to show that flash writes don't lose any.
+// Both edges of a pin latched at once mean the interrupt was late enough for
+// the next edge to arrive, which is the only way one can be lost; with none
+// merged while flash was busy, no edge was lost to it. Written only by the
+// interrupt.
+struct EdgeAudit {
+  std::atomic<uint32_t> edges{0};
+  std::atomic<uint32_t> merged{0};
+  std::atomic<uint32_t> edges_during_flash{0};
+  std::atomic<uint32_t> merged_during_flash{0};
+
+  __force_inline static void Bump(std::atomic<uint32_t>& counter) {
+    counter.store(
+        counter.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+  }
+
+  __force_inline void OnEdge(uint32_t events) {
+    const bool merged_edges = (events & GPIO_IRQ_EDGE_FALL) &&
+                              (events & GPIO_IRQ_EDGE_RISE);
+    Bump(edges);
+    if (merged_edges) Bump(merged);
+    if (Rp2040Flash::busy()) {
+      Bump(edges_during_flash);
+      if (merged_edges) Bump(merged_during_flash);
+    }
+  }
+};
+__force_inline EdgeAudit& GetEdgeAudit() {
+  static EdgeAudit edge_audit;
+  return edge_audit;
+}
+
+// time_us_64, which is in flash, inlined for the GPIO interrupt.
+__force_inline uint64_t EdgeTimeUs() {
+  uint32_t hi = timer_hw->timerawh;
+  while (true) {
+    const uint32_t lo = timer_hw->timerawl;
+    const uint32_t next_hi = timer_hw->timerawh;
+    if (next_hi == hi) return uint64_t{hi} << 32 | lo;
+    hi = next_hi;
+  }
+}
+
+// In RAM, as is everything it reaches, so that it keeps running while a
+// flash erase or program stalls execution from flash.
+void __not_in_flash_func(OnGpioEdge)(uint gpio, uint32_t events) {
+  const uint64_t timestamp = EdgeTimeUs();
+  switch (gpio) {
+    case kAnemometerPin:
+      GetEdgeAudit().OnEdge(events);
+      if ((events & GPIO_IRQ_EDGE_FALL) &&
+          AnemometerCounter().Inc(timestamp)) {
+        LastAnemometerPeriod().OnClosure(timestamp);
+      }
+      if (kAnemometerEdgeTiming) {
+        // Both bits means a bounce too quick to order; the falling edge
+        // goes first and the health tracker debounces the rest.
+        const uint32_t t = static_cast<uint32_t>(timestamp) & ~1u;
+        if (events & GPIO_IRQ_EDGE_FALL) AnemometerEdges().Push(t | 1);
+        if (events & GPIO_IRQ_EDGE_RISE) AnemometerEdges().Push(t);
+      }
+      break;
+    case kRainGaugePin:
+      GetEdgeAudit().OnEdge(events);
+      if ((events & GPIO_IRQ_EDGE_FALL) && RainGaugeCounter().Inc(timestamp)) {
+        RainGaugeTips().Push(timestamp);
+      }
+      break;
+    default:
+      // Never while flash is busy: only the pins above are live then.
+      printf("Unexpected gpio %d", gpio);
+      break;
   }
 }
 
-void track_wind_and_rain(
-    MqttClient& mqtt, std::string_view wind_topic,
-    std::string_view rain_topic) {
+void track_wind_and_rain(const WindAndRainTopics& topics) {
   // Keep this task on the current core so that when we pause interrupts
   // we are pausing them on the same core as the one we live on.
   vTaskCoreAffinitySet(nullptr, 1 << get_core_num());
@@ -245,25 +765,31 @@ void track_wind_and_rain(
   gpio_pull_up(kAnemometerPin);
   gpio_pull_up(kRainGaugePin);
 
-  gpio_irq_callback_t callback = [](uint gpio, uint32_t events) {
-    const uint64_t timestamp = time_us_64();
-    switch (gpio) {
-      case kAnemometerPin:
-        AnemometerCounter().Inc(timestamp);
-        break;
-      case kRainGaugePin:
-        RainGaugeCounter().Inc(timestamp);
-        break;
-      default:
-        printf("Unexpected gpio %d", gpio);
-        break;
-    }
-  };
-  gpio_set_irq_enabled(kAnemometerPin, GPIO_IRQ_EDGE_FALL, true);
-  gpio_set_irq_enabled(kRainGaugePin, GPIO_IRQ_EDGE_FALL, true);
-  gpio_set_irq_callback(callback);
+  // Both edges of each, though only closures count, so that the interrupt
+  // can tell when it fell behind (see EdgeAudit).
+  constexpr uint32_t kBothEdges = GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE;
+  gpio_set_irq_enabled(kAnemometerPin, kBothEdges, true);
+  gpio_set_irq_enabled(kRainGaugePin, kBothEdges, true);
+  gpio_set_irq_callback(OnGpioEdge);
   irq_set_enabled(IO_IRQ_BANK0, true);
+  // Flash erases and programs now park this core with just these on.
+  Rp2040Flash::KeepGpioLive(
+      1u << kAnemometerPin | 1u << kRainGaugePin, OnGpioEdge);
+
+  // Static to keep their state off this task's small stack.
+  static RainEventTracker rain_events({.dry_gap_us = kRainEventDryGapUs});
+  static AnemometerHealth anemometer_health(kSen15901Anemometer);
+  static DerivedMetrics derived;
+  SensorPublish(
+      PublishStream::kRainEventActive, topics.rain_event_active, "OFF");
+  TipQueue tips;
+  // Tips carry corrected depths (see TipInches), summed here for the rate.
+  std::optional<uint64_t> last_tip_us;
+  double rain_inches_since_flush = 0;
 
+  JobTiming& timing = GetJobTiming();
+  timing.Register(PeriodicJob::kRainFlush, kRainGaugeFlushUs);
+  timing.Register(PeriodicJob::kWindFlush, kAnemometerFlushUs);
   absolute_time_t next_rain_gauge_flush =
       delayed_by_us(get_absolute_time(), kRainGaugeFlushUs);
   absolute_time_t next_anemometer_flush =
@@ -281,6 +807,7 @@ void track_wind_and_rain(
         absolute_time_diff_us(get_absolute_time(), min_flush_time));
 
     sleep_until(min_flush_time);
+    GetSupervisor().CheckIn(SupervisedTask::kWindAndRain);
     absolute_time_t now = get_absolute_time();
 
     // Disable interrupts and flush whichever of the two counters is ready.
@@ -299,21 +826,66 @@ void track_wind_and_rain(
       anemometer_end_time = std::exchange(
           next_anemometer_flush, delayed_by_us(now, kAnemometerFlushUs));
     }
+    tips = std::exchange(RainGaugeTips(), {});
     portENABLE_INTERRUPTS();
 
+    if (tips.dropped > 0) printf("dropped %d rain gauge tips\n", tips.dropped);
+    for (size_t i = 0; i < tips.size; ++i) {
+      const uint64_t tip_us = tips.tips[i];
+      const float inches = TipInches(
+          kRainGaugeCurve,
+          last_tip_us ? (tip_us - *last_tip_us) / 1e6f : 0);
+      last_tip_us = tip_us;
+      rain_inches_since_flush += inches;
+      if (auto event = rain_events.Poll(tip_us)) {
+        PublishRainEvent(topics, *event, to_us_since_boot(now));
+      }
+      if (rain_events.OnTip(tip_us, inches)) {
+        SensorPublish(
+            PublishStream::kRainEventActive, topics.rain_event_active, "ON");
+      }
+    }
+    if (auto event = rain_events.Poll(to_us_since_boot(now))) {
+      PublishRainEvent(topics, *event, to_us_since_boot(now));
+    }
+
+    if (kAnemometerEdgeTiming) {
+      uint32_t edge;
+      while (AnemometerEdges().Pop(edge)) {
+        anemometer_health.OnEdge(edge & ~1u, edge & 1);
+      }
+    }
+
     // Publish whichever of the two counters was flushed.
     if (rain_gauge_flush.has_value()) {
+      if (kAnemometerEdgeTiming) {
+        PublishAnemometerHealth(topics, anemometer_health);
+      }
       const double elapsed_time_sec =
           (kRainGaugeFlushUs +
            absolute_time_diff_us(now, *rain_gauge_end_time)) /
           1e6;
-      const double rain_inches = *rain_gauge_flush * kRainGaugeInchesPerTick;
+      const double rain_inches = std::exchange(rain_inches_since_flush, 0);
       const double rain_inches_per_hour = rain_inches / elapsed_time_sec * 3600;
       printf(
           "collected %d ticks, %.1f in/h\n",
           *rain_gauge_flush,
           rain_inches_per_hour);
-      SensorPublish(mqtt, rain_topic, std::to_string(rain_inches_per_hour));
+      SensorPublish(
+          PublishStream::kRain,
+          topics.rain,
+          std::to_string(rain_inches_per_hour));
+      if (auto intensity = derived.OnRainRate(rain_inches_per_hour)) {
+        SensorPublish(
+            PublishStream::kRainIntensity,
+            topics.rain_intensity,
+            RainIntensityName(*intensity));
+      }
+      timing.Record(
+          PeriodicJob::kRainFlush,
+          to_us_since_boot(*rain_gauge_end_time),
+          to_us_since_boot(now),
+          time_us_64());
     }
 
     if (anemometer_flush) {
@@ -325,19 +897,543 @@ void track_wind_and_rain(
           *anemometer_flush * kAnemometerSpeedPerTick;
       const double wind_mph = counted_wind_mph / elapsed_time_sec;
       printf("collected %d ticks, %.1f mph\n", *anemometer_flush, wind_mph);
-      SensorPublish(mqtt, wind_topic, std::to_string(wind_mph));
+      SensorPublish(
+          PublishStream::kWindSpeed, topics.wind, std::to_string(wind_mph));
+      PublishDerivedWind(topics, derived.OnWind(wind_mph, elapsed_time_sec));
+      timing.Record(
+          PeriodicJob::kWindFlush,
+          to_us_since_boot(*anemometer_end_time),
+          to_us_since_boot(now),
+          time_us_64());
     }
   }
 }
 
 void wind_and_rain_task(void* args) {
-  MqttClient& mqtt = *static_cast<MqttClient*>(args);
-  std::string wind_topic, rain_topic;
-  setup_wind_and_rain(mqtt, wind_topic, rain_topic);
-  track_wind_and_rain(mqtt, wind_topic, rain_topic);
+  WindAndRainTopics topics;
+  setup_wind_and_rain(topics);
+  track_wind_and_rain(topics);
+}
+
+// Temperature, humidity and pressure sensors share one I2C bus, run by a
+// single scheduler task rather than a task per sensor.
+constexpr int kI2cSdaPin = 4;
+constexpr int kI2cSclPin = 5;
+constexpr uint32_t kI2cBaudHz = 400'000;
+constexpr uint32_t kSht4xPeriodMs = 30'000;
+constexpr uint32_t kBme280PeriodMs = 60'000;
+
+struct EnvironmentTopics {
+  std::string temperature;
+  std::string humidity;
+  std::string pressure;
+};
+
+void setup_environment(EnvironmentTopics& topics) {
+  using namespace homeassistant;
+  struct Sensor {
+    const char* id;
+    const char* name;
+    const char* device_class;
+    const char* unit;
+    std::string& topic;
+  };
+  for (const Sensor& sensor : {
+           Sensor{
+               "weatherstation_temperature",
+               "temperature",
+               "temperature",
+               "°C",
+               topics.temperature},
+           Sensor{
+               "weatherstation_humidity",
+               "humidity",
+               "humidity",
+               "%",
+               topics.humidity},
+           Sensor{
+               "weatherstation_pressure",
+               "pressure",
+               "pressure",
+               "hPa",
+               topics.pressure},
+       }) {
+    CommonDeviceInfo device(sensor.id);
+    device.name = sensor.name;
+    device.component = "sensor";
+    device.device_class = sensor.device_class;
+
+    JsonBuilder json;
+    AddCommonInfo(device, json);
+    AddSensorInfo(device, sensor.unit, json);
+    PublishDiscovery(**g_mqtt.Borrow(), device, std::move(json).Finish());
+    sensor.topic = AbsoluteChannel(device, topic_suffix::kState);
+  }
+}
+
+void environment_task(void* args) {
+  i2c_init(i2c0, kI2cBaudHz);
+  gpio_set_function(kI2cSdaPin, GPIO_FUNC_I2C);
+  gpio_set_function(kI2cSclPin, GPIO_FUNC_I2C);
+  gpio_pull_up(kI2cSdaPin);
+  gpio_pull_up(kI2cSclPin);
+
+  // Static to keep them off this task's stack; the callback below uses
+  // them without capturing.
+  static EnvironmentTopics topics;
+  setup_environment(topics);
+  static Rp2040I2cTransport transport(i2c0, xTaskGetCurrentTaskHandle());
+  static Bme280 bme280(Bme280::kAddress, kBme280PeriodMs);
+  static Sht4x sht4x(Sht4x::kAddress, kSht4xPeriodMs);
+  // The SHT4x is the better thermometer and hygrometer. The BME280's stand
+  // in while it isn't answering.
+  static bool sht4x_ok = false;
+  static I2cBusScheduler scheduler(transport, [](I2cDevice& device, bool ok) {
+    // The scheduler's ms since boot wrap, so work back from now.
+    const I2cBusScheduler::Stats& stats = scheduler.stats(device);
+    const uint64_t now_us = time_us_64();
+    const uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+    const uint64_t started_us =
+        now_us - uint64_t{now_ms - stats.cycle_started_ms} * 1000;
+    GetJobTiming().Record(
+        &device == &sht4x ? PeriodicJob::kSht4x : PeriodicJob::kBme280,
+        started_us -
+            uint64_t{stats.cycle_started_ms - stats.cycle_due_ms} * 1000,
+        started_us,
+        now_us);
+    if (!ok) printf("%s reading failed\n", device.name().data());
+    float temperature_c, humidity_percent;
+    if (&device == &sht4x) {
+      sht4x_ok = ok;
+      if (!ok) return;
+      temperature_c = sht4x.reading()->temperature_c;
+      humidity_percent = sht4x.reading()->humidity_percent;
+    } else {
+      if (!ok) return;
+      const Bme280::Reading& r = *bme280.reading();
+      SensorPublish(
+          PublishStream::kPressure,
+          topics.pressure,
+          std::to_string(r.pressure_hpa));
+      if (sht4x_ok) return;
+      temperature_c = r.temperature_c;
+      humidity_percent = r.humidity_percent;
+    }
+    SensorPublish(
+        PublishStream::kTemperature,
+        topics.temperature,
+        std::to_string(temperature_c));
+    SensorPublish(
+        PublishStream::kHumidity,
+        topics.humidity,
+        std::to_string(humidity_percent));
+  });
+
+  GetJobTiming().Register(PeriodicJob::kSht4x, kSht4xPeriodMs * 1000);
+  GetJobTiming().Register(PeriodicJob::kBme280, kBme280PeriodMs * 1000);
+  const uint32_t start_ms = to_ms_since_boot(get_absolute_time());
+  scheduler.Add(sht4x, start_ms);
+  scheduler.Add(bme280, start_ms);
+  while (true) {
+    const uint32_t sleep_ms =
+        scheduler.Run(to_ms_since_boot(get_absolute_time()));
+    GetSupervisor().CheckIn(SupervisedTask::kEnvironment);
+    // The transport's interrupt cuts this short when a transfer finishes.
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(std::min<uint32_t>(sleep_ms, 1000)));
+  }
+}
+
+// Brokers in order of preference: MQTT_HOST, then those in
+// MQTT_FALLBACK_HOSTS, a comma-separated list that may be empty.
+std::vector<std::string> BrokerHosts() {
+  std::vector<std::string> hosts = {MQTT_HOST};
+  std::string_view fallbacks = MQTT_FALLBACK_HOSTS;
+  while (!fallbacks.empty()) {
+    const size_t comma = fallbacks.find(',');
+    if (const std::string_view host = fallbacks.substr(0, comma);
+        !host.empty()) {
+      hosts.emplace_back(host);
+    }
+    if (comma == std::string_view::npos) break;
+    fallbacks.remove_prefix(comma + 1);
+  }
+  return hosts;
+}
+
+// MqttClient::Create blocks until the broker answers or the attempt times
+// out, so each attempt runs in a task of its own and sends its result to the
+// network task.
+struct ConnectAttempt {
+  size_t broker;
+  MqttClient::ConnectInfo info;
+};
+struct ConnectResult {
+  size_t broker;
+  MqttClient* client;  // Null on failure. The receiver owns it.
+  err_t err;
+  uint32_t latency_ms;
+};
+QueueHandle_t g_connect_results;
+
+void connect_attempt_task(void* param) {
+  ConnectResult result;
+  {
+    std::unique_ptr<ConnectAttempt> attempt(
+        static_cast<ConnectAttempt*>(param));
+    const uint32_t start_ms = to_ms_since_boot(get_absolute_time());
+    auto client = MqttClient::Create(attempt->info);
+    result = {
+        .broker = attempt->broker,
+        .client = client ? client->release() : nullptr,
+        .err = client ? err_t{ERR_OK} : client.error(),
+        .latency_ms = to_ms_since_boot(get_absolute_time()) - start_ms,
+    };
+  }
+  xQueueSend(g_connect_results, &result, portMAX_DELAY);
+  vTaskDelete(nullptr);
+}
+
+void StartConnectAttempt(
+    BrokerSelector& selector,
+    size_t broker,
+    const MqttClient::ConnectInfo& connect_info) {
+  auto* attempt = new ConnectAttempt{broker, connect_info};
+  attempt->info.broker_address = selector.brokers()[broker].host.c_str();
+  if (xTaskCreate(
+          connect_attempt_task, "mqtt_connect", 1024, attempt, 1, nullptr) !=
+      pdPASS) {
+    printf("No memory for an MQTT connect attempt\n");
+    delete attempt;
+    return;
+  }
+  selector.OnAttempt(broker, to_ms_since_boot(get_absolute_time()));
+}
+
+// Switches the station to a finished attempt's connection if the selector
+// takes it, and otherwise drops it.
+void TakeConnectResult(BrokerSelector& selector, const ConnectResult& result) {
+  std::unique_ptr<MqttClient> client(result.client);
+  const char* host = selector.brokers()[result.broker].host.c_str();
+  if (!client) printf("MQTT connect to %s failed: %d\n", host, result.err);
+  const bool failing_over = !selector.current();
+  if (!selector.OnResult(
+          result.broker,
+          client != nullptr,
+          result.latency_ms,
+          to_ms_since_boot(get_absolute_time()))) {
+    return;
+  }
+  printf(
+      "MQTT connected to %s in %u ms%s\n",
+      host,
+      static_cast<unsigned>(result.latency_ms),
+      failing_over ? "" : ", back on the primary");
+  auto mqtt = g_mqtt.Borrow();
+  *mqtt = std::move(client);
+  g_connection.fetch_add(1);
+  homeassistant::PublishAvailable(**mqtt);
+  GetSupervisor().Resume(SupervisedTask::kPublisher);
+}
+
+// Races connects to every candidate broker and waits until one is taken, or
+// until all have failed. Attempts still running after that are taken or
+// dropped by the main loop as they finish. An attempt on a broker that never
+// answers lasts until lwIP gives up on it, so this checks in meanwhile.
+void ConnectToBroker(
+    BrokerSelector& selector, const MqttClient::ConnectInfo& connect_info) {
+  constexpr TickType_t kCheckInTicks = pdMS_TO_TICKS(1000);
+  for (size_t broker :
+       selector.Candidates(to_ms_since_boot(get_absolute_time()))) {
+    StartConnectAttempt(selector, broker, connect_info);
+  }
+  while (!selector.current() && selector.in_flight() > 0) {
+    ConnectResult result;
+    if (xQueueReceive(g_connect_results, &result, kCheckInTicks) == pdTRUE) {
+      TakeConnectResult(selector, result);
+    }
+    GetSupervisor().CheckIn(SupervisedTask::kNetwork);
+  }
+}
+
+// Drops the broker connection, counting it against the broker, and fails
+// over. Publishers skip their publishes meanwhile, and aren't held to their
+// deadline until a broker is taken: finding one is this task's job, and it
+// checks in while it tries.
+void ReconnectMqtt(
+    BrokerSelector& selector, const MqttClient::ConnectInfo& connect_info) {
+  g_mqtt.Borrow()->reset();
+  GetSupervisor().Suspend(SupervisedTask::kPublisher);
+  selector.OnDisconnected(to_ms_since_boot(get_absolute_time()));
+  ConnectToBroker(selector, connect_info);
+  if (!selector.current()) printf("Failed to reconnect to an MQTT broker\n");
+}
+
+void ReconnectWifi() {
+  constexpr uint32_t kWifiConnectTimeoutMs = 20'000;
+  cyw43_arch_disable_sta_mode();
+  cyw43_arch_enable_sta_mode();
+  const int err = cyw43_arch_wifi_connect_timeout_ms(
+      WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK, kWifiConnectTimeoutMs);
+  if (err != 0) printf("Failed to reconnect Wi-Fi: %d\n", err);
+}
+
+// Publishes why the previous boot ended, so watchdog resets are visible in
+// Home Assistant with the task that caused them.
+void publish_reset_cause(std::optional<SupervisedTask> cause) {
+  using namespace homeassistant;
+  CommonDeviceInfo reset_device("weatherstation_reset_cause");
+  reset_device.name = "last reset cause";
+  reset_device.component = "sensor";
+  {
+    JsonBuilder json;
+    AddCommonInfo(reset_device, json);
+    AddSensorInfo(reset_device, std::nullopt, json);
+    PublishDiscovery(**g_mqtt.Borrow(), reset_device, std::move(json).Finish());
+  }
+  SensorPublish(
+      PublishStream::kResetCause,
+      AbsoluteChannel(reset_device, topic_suffix::kState),
+      cause ? SupervisedTaskName(*cause) : "none");
+}
+
+using JobTimingTopics = std::array<std::string, kPeriodicJobCount>;
+
+// A diagnostic sensor per periodic job, whose state is a JSON summary of its
+// timing (see JobTiming).
+void setup_job_timing(JobTimingTopics& topics) {
+  using namespace homeassistant;
+  for (int i = 0; i < kPeriodicJobCount; ++i) {
+    const std::string_view job = PeriodicJobName(static_cast<PeriodicJob>(i));
+    const std::string id = std::format("weatherstation_job_{}", job);
+    const std::string name = std::format("{} timing", job);
+    CommonDeviceInfo device(id.c_str());
+    device.name = name.c_str();
+    device.component = "sensor";
+
+    JsonBuilder json;
+    AddCommonInfo(device, json);
+    AddSensorInfo(device, std::nullopt, json);
+    PublishDiscovery(**g_mqtt.Borrow(), device, std::move(json).Finish());
+    topics[i] = AbsoluteChannel(device, topic_suffix::kState);
+  }
+}
+
+// Lateness and execution times in ms; the histogram's buckets are bounded
+// by JobTiming::kLatenessBucketUs.
+void PublishJobTiming(const JobTimingTopics& topics) {
+  for (int i = 0; i < kPeriodicJobCount; ++i) {
+    const auto job = static_cast<PeriodicJob>(i);
+    const JobTiming::Snapshot t = GetJobTiming().Read(job);
+    if (t.runs == 0) continue;
+    std::string lateness;
+    for (int b = 0; b < JobTiming::kLatenessBuckets; ++b) {
+      lateness += std::format("{}{}", b ? "," : "", t.lateness[b]);
+    }
+    const std::string summary = std::format(
+        "{{\"runs\":{},\"missed\":{},\"overruns\":{},"
+        "\"late_ms\":{:.1f},\"max_late_ms\":{:.1f},\"exec_ms\":{:.1f},"
+        "\"max_exec_ms\":{:.1f},\"lateness\":[{}]}}",
+        t.runs,
+        t.missed,
+        t.overruns,
+        t.last_lateness_us / 1e3,
+        t.max_lateness_us / 1e3,
+        t.last_execution_us / 1e3,
+        t.max_execution_us / 1e3,
+        lateness);
+    if (t.missed || t.overruns) {
+      printf("%s timing: %s\n", PeriodicJobName(job).data(), summary.c_str());
+    }
+    SensorPublish(PublishStream::kJobTiming, topics[i], summary);
+  }
+}
+
+// A diagnostic sensor per MQTT broker, whose state is a JSON summary of its
+// health and connect latency (see BrokerSelector).
+void setup_broker_metrics(
+    const BrokerSelector& selector, std::vector<std::string>& topics) {
+  using namespace homeassistant;
+  for (size_t i = 0; i < selector.brokers().size(); ++i) {
+    const std::string id = std::format("weatherstation_broker_{}", i);
+    const std::string name = std::format("broker {} connects", i);
+    CommonDeviceInfo device(id.c_str());
+    device.name = name.c_str();
+    device.component = "sensor";
+
+    JsonBuilder json;
+    AddCommonInfo(device, json);
+    AddSensorInfo(device, std::nullopt, json);
+    PublishDiscovery(**g_mqtt.Borrow(), device, std::move(json).Finish());
+    topics.push_back(AbsoluteChannel(device, topic_suffix::kState));
+  }
+}
+
+void PublishBrokerMetrics(
+    const BrokerSelector& selector, const std::vector<std::string>& topics) {
+  for (size_t i = 0; i < topics.size(); ++i) {
+    const BrokerSelector::Broker& b = selector.brokers()[i];
+    SensorPublish(
+        PublishStream::kBroker,
+        topics[i],
+        std::format(
+            "{{\"host\":\"{}\",\"current\":{},\"score\":{:.2f},"
+            "\"attempts\":{},\"failures\":{},\"drops\":{},"
+            "\"latency_ms\":{},\"mean_latency_ms\":{:.0f},"
+            "\"max_latency_ms\":{}}}",
+            b.host,
+            selector.current() == i,
+            b.score,
+            b.attempts,
+            b.failures,
+            b.drops,
+            b.last_latency_ms,
+            b.mean_latency_ms,
+            b.max_latency_ms));
+  }
+}
+
+// State that survives power loss, in a log over the last 256 KiB of flash.
+// Only the main task uses it, and only once the reed switch interrupts are
+// live, so that every erase and program keeps them running.
+constexpr uint32_t kFlashLogSectors = 64;
+enum FlashLogKey : uint16_t {
+  kBootCountKey = 1,
+  // Minutes the current boot has run, as of its last record_uptime.
+  kUptimeKey = 2,
+};
+// Data records: a watchdog reset, as the boot count and the overdue task.
+constexpr uint8_t kCrashRecordType = FlashLog::kFirstDataType;
+// How often the uptime is persisted, and flash written with acquisition on.
+constexpr uint32_t kUptimeRecordMs = 60 * 60'000;
+
+// Mounted on first use, which can format or erase; null if it doesn't fit.
+FlashLog* GetFlashLog() {
+  static Rp2040Flash flash(kFlashLogSectors);
+  static FlashLog log(flash);
+  static const bool mounted = flash.valid() && log.Mount();
+  return mounted ? &log : nullptr;
+}
+
+void record_uptime(uint32_t now_ms) {
+  FlashLog* log = GetFlashLog();
+  if (!log) return;
+  const uint32_t minutes = now_ms / 60'000;
+  log->Put(
+      kUptimeKey,
+      {reinterpret_cast<const uint8_t*>(&minutes), sizeof(minutes)});
+}
+
+// Counts this boot, records a watchdog reset and logs how long the last boot
+// ran.
+void record_boot(std::optional<SupervisedTask> reset_cause) {
+  FlashLog* log_or_null = GetFlashLog();
+  if (!log_or_null) {
+    printf("No room for the flash log above the program image\n");
+    return;
+  }
+  FlashLog& log = *log_or_null;
+  uint32_t last_uptime_min = 0;
+  log.Get(
+      kUptimeKey,
+      {reinterpret_cast<uint8_t*>(&last_uptime_min), sizeof(last_uptime_min)});
+  uint32_t boots = 0;
+  log.Get(kBootCountKey, {reinterpret_cast<uint8_t*>(&boots), sizeof(boots)});
+  ++boots;
+  log.Put(kBootCountKey, {reinterpret_cast<uint8_t*>(&boots), sizeof(boots)});
+  if (reset_cause) {
+    const uint8_t record[5] = {
+        static_cast<uint8_t>(boots),
+        static_cast<uint8_t>(boots >> 8),
+        static_cast<uint8_t>(boots >> 16),
+        static_cast<uint8_t>(boots >> 24),
+        static_cast<uint8_t>(*reset_cause)};
+    log.Append(kCrashRecordType, record);
+  }
+
+  int crashes = 0;
+  uint8_t record[5];
+  FlashLog::Position position = log.begin();
+  while (auto r = log.ReadNext(position, record)) {
+    if (r->type == kCrashRecordType) ++crashes;
+  }
+  const FlashLog::Stats stats = log.stats();
+  printf(
+      "%s\n",
+      std::format(
+          "boot {}: last ran at least {} min, {} watchdog resets on "
+          "record, flash log {} of {} sectors, {} torn records, erases "
+          "{}-{}, mount {} reads",
+          boots,
+          last_uptime_min,
+          crashes,
+          stats.sectors_in_use,
+          kFlashLogSectors,
+          stats.torn_records,
+          stats.min_erases,
+          stats.max_erases,
+          stats.mount_reads)
+          .c_str());
+  record_uptime(to_ms_since_boot(get_absolute_time()));
+}
+
+// Logs flash erases and programs since the last report, with the reed switch
+// edges that arrived during them.
+void ReportFlashActivity() {
+  static uint32_t reported_operations = 0;
+  const Rp2040Flash::Stats& flash = Rp2040Flash::stats();
+  if (flash.operations == reported_operations) return;
+  reported_operations = flash.operations;
+  const EdgeAudit& audit = GetEdgeAudit();
+  printf(
+      "%s\n",
+      std::format(
+          "flash: {} operations, {} ms busy, longest {} us; {} edges "
+          "meanwhile, {} merged ({} of {} merged in all)",
+          flash.operations,
+          flash.busy_us / 1000,
+          flash.longest_us,
+          audit.edges_during_flash.load(std::memory_order_relaxed),
+          audit.merged_during_flash.load(std::memory_order_relaxed),
+          audit.merged.load(std::memory_order_relaxed),
+          audit.edges.load(std::memory_order_relaxed))
+          .c_str());
+}
+
+// Logs the streams whose last few publishes haven't completed, so a stall
+// shows which sensor it affects before the supervisor steps in.
+void ReportStalledStreams() {
+  constexpr uint32_t kStalledAttempts = 3;
+  const uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+  for (int i = 0; i < kPublishStreamCount; ++i) {
+    const auto stream = static_cast<PublishStream>(i);
+    const PublishHealth::Snapshot h = GetPublishHealth().Read(stream);
+    if (h.attempts_since_success < kStalledAttempts) continue;
+    printf(
+        "%s\n",
+        std::format(
+            "publish stalled: {} has {} attempts since the last success "
+            "({} s ago), {} of {} failed, last error {}",
+            PublishStreamName(stream),
+            h.attempts_since_success,
+            h.last_success_ms ? (now_ms - h.last_success_ms) / 1000
+                              : now_ms / 1000,
+            h.failures,
+            h.attempts,
+            lwip_strerr(h.last_error))
+            .c_str());
+  }
 }
 
 extern "C" void main_task(void* args) {
+  g_network_task = xTaskGetCurrentTaskHandle();
+  const std::optional<SupervisedTask> reset_cause =
+      Supervisor::PreviousResetCause();
+  if (reset_cause) {
+    printf(
+        "Watchdog reset: %s missed its deadline\n",
+        SupervisedTaskName(*reset_cause).data());
+  }
+
   MqttClient::ConnectInfo connect_info{
       .broker_address = MQTT_HOST,
       .client_id = MQTT_CLIENT_ID,
@@ -345,24 +1441,89 @@ extern "C" void main_task(void* args) {
       .password = MQTT_PASSWORD,
   };
   homeassistant::SetAvailablityLwt(connect_info);
-  std::unique_ptr<MqttClient> mqtt;
-  while (!mqtt) {
-    auto maybe_mqtt = MqttClient::Create(connect_info);
-    if (!maybe_mqtt) {
-      printf("Failed to create MQTT client: %d\n", maybe_mqtt.error());
-      sleep_ms(5000);
-      continue;
-    }
-    mqtt = *std::move(maybe_mqtt);
+  BrokerSelector brokers(BrokerHosts());
+  g_connect_results = xQueueCreate(
+      brokers.brokers().size(), sizeof(ConnectResult));
+  while (true) {
+    ConnectToBroker(brokers, connect_info);
+    if (brokers.current()) break;
+    sleep_ms(5000);
   }
-  homeassistant::PublishAvailable(*mqtt);
+  publish_reset_cause(reset_cause);
+  JobTimingTopics job_timing_topics;
+  setup_job_timing(job_timing_topics);
+  std::vector<std::string> broker_topics;
+  setup_broker_metrics(brokers, broker_topics);
+
+  // Deadlines are several report periods. The network task's covers a Wi-Fi
+  // reconnect plus an MQTT one.
+  Supervisor& supervisor = GetSupervisor();
+  supervisor.Register(
+      SupervisedTask::kWindDirection, 6 * kWindReportPeriodSecs * 1000);
+  supervisor.Register(
+      SupervisedTask::kWindAndRain, 6 * kWindReportPeriodSecs * 1000);
+  supervisor.Register(
+      SupervisedTask::kPublisher, 12 * kWindReportPeriodSecs * 1000);
+  supervisor.Register(SupervisedTask::kNetwork, 45'000);
+  supervisor.Register(SupervisedTask::kEnvironment, 30'000);
+  supervisor.Start(xTaskGetCurrentTaskHandle());
 
   xTaskCreate(
-      wind_and_rain_task,
-      "wind_and_rain",
-      512,
-      static_cast<void*>(mqtt.get()),
-      1,
-      nullptr);
-  wind_direction_task(static_cast<void*>(mqtt.get()));
-}
\ No newline at end of file
+      wind_and_rain_task, "wind_and_rain", 512, nullptr, 1, nullptr);
+  xTaskCreate(
+      wind_direction_task, "wind_direction", 512, nullptr, 1, nullptr);
+  xTaskCreate(environment_task, "environment", 512, nullptr, 1, nullptr);
+
+  // This task stays behind to carry out soft recovery for the supervisor.
+  constexpr uint32_t kHealthReportMs = 60'000;
+  uint32_t next_health_report_ms = kHealthReportMs;
+  bool boot_recorded = false;
+  uint32_t next_uptime_record_ms = kUptimeRecordMs;
+  while (true) {
+    supervisor.CheckIn(SupervisedTask::kNetwork);
+    // Flash waits for acquisition, so that the reed switch edges arriving
+    // during erases and programs are counted (see ReportFlashActivity).
+    if (Rp2040Flash::gpio_live()) {
+      const uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+      if (!boot_recorded) {
+        record_boot(reset_cause);
+        boot_recorded = true;
+      } else if (static_cast<int32_t>(now_ms - next_uptime_record_ms) >= 0) {
+        next_uptime_record_ms = now_ms + kUptimeRecordMs;
+        record_uptime(now_ms);
+      }
+    }
+    if (const uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+        static_cast<int32_t>(now_ms - next_health_report_ms) >= 0) {
+      next_health_report_ms = now_ms + kHealthReportMs;
+      ReportStalledStreams();
+      ReportFlashActivity();
+      PublishJobTiming(job_timing_topics);
+      PublishBrokerMetrics(brokers, broker_topics);
+    }
+    // Attempts left over from a failover, and probes of the primary.
+    ConnectResult result;
+    while (xQueueReceive(g_connect_results, &result, 0) == pdTRUE) {
+      TakeConnectResult(brokers, result);
+    }
+    if (brokers.PrimaryProbeDue(to_ms_since_boot(get_absolute_time()))) {
+      StartConnectAttempt(brokers, 0, connect_info);
+    }
+    // A failover that took no broker goes again as soon as a broker may be
+    // retried, rather than when the supervisor next escalates.
+    if (brokers.RetryDue(to_ms_since_boot(get_absolute_time()))) {
+      ConnectToBroker(brokers, connect_info);
+    }
+    uint32_t requests = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &requests, pdMS_TO_TICKS(1000));
+    // The supervisor's requests are the backstop for losses no publish
+    // reported.
+    const bool lost = (requests & kConnectionLost) && brokers.current() &&
+                      g_lost_connection.load() == g_connection.load();
+    if (lost) printf("MQTT connection lost, failing over\n");
+    if (requests & kRecoverWifi) ReconnectWifi();
+    if (lost || (requests & (kRecoverMqtt | kRecoverWifi))) {
+      ReconnectMqtt(brokers, connect_info);
+    }
+  }
+}
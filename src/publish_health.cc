@@ -0,0 +1,120 @@
+#include "publish_health.h"
+
+#include "pico/time.h"
+
+namespace {
+
+uint32_t NowMs() { return to_ms_since_boot(get_absolute_time()); }
+
+}  // namespace
+
+std::string_view PublishStreamName(PublishStream stream) {
+  switch (stream) {
+    case PublishStream::kWindDirection:
+      return "wind_direction";
+    case PublishStream::kWindDirectionMean:
+      return "wind_direction_mean";
+    case PublishStream::kWindDirectionSigma:
+      return "wind_direction_sigma";
+    case PublishStream::kWindSpeed:
+      return "wind_speed";
+    case PublishStream::kRain:
+      return "rain";
+    case PublishStream::kRainEventActive:
+      return "rain_event_active";
+    case PublishStream::kRainEvent:
+      return "rain_event";
+    case PublishStream::kAnemometerHealth:
+      return "anemometer_health";
+    case PublishStream::kAnemometerEdgeStats:
+      return "anemometer_edge_stats";
+    case PublishStream::kResetCause:
+      return "reset_cause";
+    case PublishStream::kTurbulence:
+      return "turbulence";
+    case PublishStream::kTelemetry:
+      return "telemetry";
+    case PublishStream::kTemperature:
+      return "temperature";
+    case PublishStream::kHumidity:
+      return "humidity";
+    case PublishStream::kPressure:
+      return "pressure";
+    case PublishStream::kWindRun:
+      return "wind_run";
+    case PublishStream::kBeaufort:
+      return "beaufort";
+    case PublishStream::kGustFactor:
+      return "gust_factor";
+    case PublishStream::kRainIntensity:
+      return "rain_intensity";
+    case PublishStream::kJobTiming:
+      return "job_timing";
+    case PublishStream::kBroker:
+      return "broker";
+  }
+  return "unknown";
+}
+
+int PublishHealth::ErrorIndex(err_t err) {
+  // Anything outside lwIP's range shares the last slot.
+  return err <= 0 && -err < kErrorCodes ? -err : kErrorCodes - 1;
+}
+
+void PublishHealth::OnAttempt(PublishStream stream) {
+  Stream& s = streams_[static_cast<int>(stream)];
+  s.last_attempt_ms.store(NowMs(), std::memory_order_relaxed);
+  Bump(s.attempts);
+}
+
+void PublishHealth::OnDispatchFailure(PublishStream stream, err_t err) {
+  Stream& s = streams_[static_cast<int>(stream)];
+  Bump(s.dispatch_errors[ErrorIndex(err)]);
+  s.last_dispatch_error.store(err, std::memory_order_relaxed);
+}
+
+void PublishHealth::OnComplete(PublishStream stream, err_t err) {
+  Stream& s = streams_[static_cast<int>(stream)];
+  if (err != ERR_OK) {
+    Bump(s.completion_errors[ErrorIndex(err)]);
+    s.last_completion_error.store(err, std::memory_order_relaxed);
+    return;
+  }
+  s.last_success_ms.store(NowMs(), std::memory_order_relaxed);
+  // Reading the other side's counter is fine; a publish that started since
+  // only makes attempts_since_success read low by one.
+  s.attempts_at_last_success.store(
+      s.attempts.load(std::memory_order_relaxed), std::memory_order_release);
+  Bump(s.successes);
+}
+
+PublishHealth::Snapshot PublishHealth::Read(PublishStream stream) const {
+  const Stream& s = streams_[static_cast<int>(stream)];
+  Snapshot snap;
+  // Acquired before reading attempts, so attempts is at least the value
+  // the callback copied and attempts_since_success can't wrap.
+  const uint32_t attempts_at_last_success =
+      s.attempts_at_last_success.load(std::memory_order_acquire);
+  snap.attempts = s.attempts.load(std::memory_order_relaxed);
+  snap.successes = s.successes.load(std::memory_order_relaxed);
+  snap.last_attempt_ms = s.last_attempt_ms.load(std::memory_order_relaxed);
+  snap.last_success_ms = s.last_success_ms.load(std::memory_order_relaxed);
+  for (int i = 0; i < kErrorCodes; ++i) {
+    snap.failures_by_error[i] =
+        s.dispatch_errors[i].load(std::memory_order_relaxed) +
+        s.completion_errors[i].load(std::memory_order_relaxed);
+    snap.failures += snap.failures_by_error[i];
+  }
+  // Completion errors are the more recent signal when both are set.
+  snap.last_error = s.last_completion_error.load(std::memory_order_relaxed);
+  if (snap.last_error == ERR_OK) {
+    snap.last_error = s.last_dispatch_error.load(std::memory_order_relaxed);
+  }
+  snap.attempts_since_success = snap.attempts - attempts_at_last_success;
+  return snap;
+}
+
+PublishHealth& GetPublishHealth() {
+  static PublishHealth health;
+  return health;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+#include "lwip/err.h"
+
+// The state topics the station publishes, one health record each.
+enum class PublishStream : uint8_t {
+  kWindDirection,
+  kWindDirectionMean,
+  kWindDirectionSigma,
+  kWindSpeed,
+  kRain,
+  kRainEventActive,
+  kRainEvent,
+  kAnemometerHealth,
+  kAnemometerEdgeStats,
+  kResetCause,
+  kTurbulence,
+  kTelemetry,
+  kTemperature,
+  kHumidity,
+  kPressure,
+  kWindRun,
+  kBeaufort,
+  kGustFactor,
+  kRainIntensity,
+  kJobTiming,  // One topic per periodic job.
+  kBroker,     // One topic per MQTT broker.
+};
+inline constexpr int kPublishStreamCount = 21;
+std::string_view PublishStreamName(PublishStream stream);
+
+// Publish health per stream, updated without locks from both sides of a
+// publish: the task that publishes the stream records attempts and dispatch
+// errors, and the completion callback in lwIP's thread records results.
+//
+// Every counter has exactly one writer, so an increment is a relaxed load and
+// store. Unlike fetch_add, which the M0+ can only do under a lock, that is
+// wait-free. Readers get each field atomically but not a consistent
+// snapshot across fields, which is fine for diagnostics.
+class PublishHealth {
+ public:
+  // lwIP errors run from ERR_OK (0) down to ERR_ARG (-16).
+  static constexpr int kErrorCodes = 17;
+
+  struct Snapshot {
+    uint32_t attempts = 0;
+    uint32_t successes = 0;
+    uint32_t failures = 0;  // Dispatch and completion failures.
+    uint32_t last_attempt_ms = 0;
+    uint32_t last_success_ms = 0;  // Zero if none yet.
+    err_t last_error = ERR_OK;
+    std::array<uint32_t, kErrorCodes> failures_by_error{};
+    // Attempts made since the last successful completion.
+    uint32_t attempts_since_success = 0;
+  };
+
+  // From the task that publishes `stream`.
+  void OnAttempt(PublishStream stream);
+  void OnDispatchFailure(PublishStream stream, err_t err);
+  // From the publish completion callback.
+  void OnComplete(PublishStream stream, err_t err);
+
+  Snapshot Read(PublishStream stream) const;
+
+ private:
+  using Counter = std::atomic<uint32_t>;
+  static_assert(Counter::is_always_lock_free);
+
+  static void Bump(Counter& c) {
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+  static int ErrorIndex(err_t err);
+
+  struct Stream {
+    // Written by the publishing task.
+    Counter attempts{0};
+    Counter last_attempt_ms{0};
+    std::array<Counter, kErrorCodes> dispatch_errors{};
+    std::atomic<err_t> last_dispatch_error{ERR_OK};
+    // Written by the lwIP thread.
+    Counter successes{0};
+    Counter last_success_ms{0};
+    Counter attempts_at_last_success{0};
+    std::array<Counter, kErrorCodes> completion_errors{};
+    std::atomic<err_t> last_completion_error{ERR_OK};
+  };
+  std::array<Stream, kPublishStreamCount> streams_;
+};
+
+PublishHealth& GetPublishHealth();
@@ -0,0 +1,55 @@
+#include "rain_event.h"
+
+static_assert(
+    (RainEventTracker::kRingSize & (RainEventTracker::kRingSize - 1)) == 0);
+
+bool RainEventTracker::OnTip(uint64_t t_us, float inches) {
+  const bool started = !in_event_;
+  if (started) {
+    in_event_ = true;
+    event_ = RainEvent{.start_us = t_us};
+    head_ = 0;
+    tails_.fill(0);
+    sums_.fill(0);
+  }
+  event_.end_us = t_us;
+  ++event_.tips;
+  event_.depth_in += inches;
+
+  const uint32_t t_ms = (t_us - event_.start_us) / 1000;
+  Tip& slot = ring_[head_ & (kRingSize - 1)];
+  for (size_t w = 0; w < kPeakWindowMins.size(); ++w) {
+    // The slot is still in this window: the window holds more tips than the
+    // ring, so the oldest leaves early.
+    if (head_ - tails_[w] == kRingSize) {
+      sums_[w] -= slot.inches;
+      ++tails_[w];
+    }
+  }
+  slot = {t_ms, inches};
+  ++head_;
+  for (size_t w = 0; w < kPeakWindowMins.size(); ++w) {
+    const uint32_t window_ms = kPeakWindowMins[w] * 60'000;
+    uint32_t& tail = tails_[w];
+    float& sum = sums_[w];
+    sum += inches;
+    // Each tip enters and leaves a window once, hence amortised O(1).
+    while (ring_[tail & (kRingSize - 1)].t_ms + window_ms <= t_ms) {
+      sum -= ring_[tail & (kRingSize - 1)].inches;
+      ++tail;
+    }
+    const float in_per_hour = sum * 60 / kPeakWindowMins[w];
+    if (in_per_hour > event_.peak_in_per_hour[w]) {
+      event_.peak_in_per_hour[w] = in_per_hour;
+    }
+  }
+  return started;
+}
+
+std::optional<RainEvent> RainEventTracker::Poll(uint64_t now_us) {
+  if (!in_event_ || now_us < event_.end_us + options_.dry_gap_us) {
+    return std::nullopt;
+  }
+  in_event_ = false;
+  return event_;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+struct RainEvent {
+  uint64_t start_us = 0;  // First tip.
+  uint64_t end_us = 0;    // Last tip.
+  uint32_t tips = 0;
+  float depth_in = 0;
+  // Highest intensity over any window of kPeakWindowMins[i] minutes ending
+  // on a tip, in in/h.
+  std::array<float, 3> peak_in_per_hour{};
+
+  uint64_t duration_us() const { return end_us - start_us; }
+};
+
+// Groups rain gauge tips into events. An event starts with a tip and ends
+// once no tip has come for dry_gap_us. Each tip costs amortised O(1), and
+// the state is a fixed-size ring of recent tip times.
+class RainEventTracker {
+ public:
+  static constexpr std::array<uint32_t, 3> kPeakWindowMins = {1, 5, 15};
+  // The gauge is debounced to 6 in/h, about 140 tips per 15 minutes. Past
+  // this many tips in a window the oldest are forgotten and the peak for
+  // that window reads low.
+  static constexpr uint32_t kRingSize = 256;
+
+  struct Options {
+    uint64_t dry_gap_us = 60 * 60 * 1'000'000ull;
+  };
+
+  explicit RainEventTracker(Options options) : options_(options) {}
+
+  // `inches` is the depth this tip represents (see TipInches). Call
+  // Poll(t_us) first so an event that ended before this tip is reported.
+  // Returns true if the tip starts a new event.
+  bool OnTip(uint64_t t_us, float inches);
+  // Returns the finished event once it has been dry for dry_gap_us.
+  std::optional<RainEvent> Poll(uint64_t now_us);
+
+  bool in_event() const { return in_event_; }
+  const RainEvent& current() const { return event_; }
+
+ private:
+  Options options_;
+  bool in_event_ = false;
+  RainEvent event_;
+  struct Tip {
+    uint32_t t_ms;  // Since the event started.
+    float inches;
+  };
+  // head_ and the per-window tails count tips and are masked to index the
+  // ring. sums_ holds the depth between each tail and head_.
+  std::array<Tip, kRingSize> ring_{};
+  uint32_t head_ = 0;
+  std::array<uint32_t, kPeakWindowMins.size()> tails_{};
+  std::array<float, kPeakWindowMins.size()> sums_{};
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+#include "tipping_bucket.h"
+
+// Debounced counting of the anemometer's and rain gauge's reed switch
+// closures. tools/param_sweep runs the same counters over traces with
+// ground truth to tune the periods below.
+
+// Counts closures, ignoring any within update_period of the last counted
+// one: contact bounce, and anything faster than the sensor can go.
+struct RateLimitedCounter {
+  const uint64_t update_period;
+  uint64_t next_update = 0;
+  int count = 0;
+
+  // Returns whether the edge counted. Inlined into the GPIO interrupt, which
+  // runs from RAM.
+  [[gnu::always_inline]] bool Inc(uint64_t timestamp) {
+    if (timestamp > next_update) {
+      ++count;
+      next_update = timestamp + update_period;
+      return true;
+    }
+    return false;
+  }
+
+  int Flush() { return std::exchange(count, 0); }
+};
+
+// We'll measure up to 50mph wind. We're assuming a simple linear
+// relationship, when in reality doubling the tick speed is probably more than
+// doubling the wind speed.
+inline constexpr float kAnemometerSpeedPerTick = 1.73;  // mph
+inline constexpr float kAnemometerMaxSpeed = 100;
+inline constexpr uint64_t kAnemometerUpdateUs =
+    1e6 / (kAnemometerMaxSpeed / kAnemometerSpeedPerTick);
+
+// We'll measure up to six inches of rain per hour.
+inline constexpr const TipCurve& kRainGaugeCurve = kSen15901TipCurve;
+inline constexpr float kRainGaugeInchesPerTick = kRainGaugeCurve.nominal_in;
+inline constexpr float kRainGaugeMaxInchesPerSecond = 6. / (60 * 60);
+inline constexpr uint64_t kRainGaugeUpdateUs =
+    1e6 / (kRainGaugeMaxInchesPerSecond / kRainGaugeInchesPerTick);
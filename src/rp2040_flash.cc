@@ -0,0 +1,240 @@
+#include "rp2040_flash.h"
+
+#include <FreeRTOS.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "hardware/flash.h"
+#include "hardware/irq.h"
+#include "hardware/regs/addressmap.h"
+#include "hardware/regs/intctrl.h"
+#include "hardware/regs/m0plus.h"
+#include "hardware/structs/iobank0.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "pico/flash.h"
+#include "pico/platform.h"
+#include "task.h"
+
+// From the linker script: the end of the program image in flash.
+extern "C" char __flash_binary_end;
+
+namespace {
+
+// For parking the other core; the operation itself may take longer.
+constexpr uint32_t kSafeExecuteTimeoutMs = 100;
+
+struct ProgramArgs {
+  uint32_t offset;  // From the start of flash.
+  std::span<const uint8_t> data;
+};
+
+void ProgramPages(void* param) {
+  const ProgramArgs& args = *static_cast<const ProgramArgs*>(param);
+  // Pages are programmed whole, with 0xff outside `data`. Static, as the
+  // source must not be in flash and task stacks are small.
+  static uint8_t page[FLASH_PAGE_SIZE];
+  uint32_t offset = args.offset;
+  std::span<const uint8_t> data = args.data;
+  while (!data.empty()) {
+    const uint32_t page_start = offset & ~(FLASH_PAGE_SIZE - 1);
+    const uint32_t in_page = offset - page_start;
+    const uint32_t n =
+        std::min<uint32_t>(data.size(), FLASH_PAGE_SIZE - in_page);
+    std::fill(std::begin(page), std::end(page), 0xff);
+    std::copy_n(data.begin(), n, page + in_page);
+    flash_range_program(page_start, page, FLASH_PAGE_SIZE);
+    offset += n;
+    data = data.subspan(n);
+  }
+}
+
+void EraseRange(void* param) {
+  flash_range_erase(*static_cast<const uint32_t*>(param), FLASH_SECTOR_SIZE);
+}
+
+// The live core's progress through a flash operation on the other core.
+enum ParkState : uint32_t { kRunning, kParked, kReleased };
+
+// Set once by KeepGpioLive; after that only `state` and `saved_handler`
+// change.
+struct LiveGpio {
+  uint32_t core = 0;
+  gpio_irq_callback_t callback = nullptr;
+  // The GPIO interrupt enables, four bits a pin, left on while parked.
+  uint32_t inte[4] = {};
+  TaskHandle_t parker = nullptr;
+  irq_handler_t saved_handler = nullptr;
+  std::atomic<uint32_t> state{kRunning};
+};
+LiveGpio g_live;
+
+__force_inline io_irq_ctrl_hw_t* IrqCtrl(uint32_t core) {
+  return core ? &iobank0_hw->proc1_irq_ctrl : &iobank0_hw->proc0_irq_ctrl;
+}
+
+__force_inline volatile uint32_t& PpbRegister(uint32_t offset) {
+  return *reinterpret_cast<volatile uint32_t*>(PPB_BASE + offset);
+}
+
+// Takes IO_IRQ_BANK0 in place of the SDK's dispatch while the live core is
+// parked, so that nothing it runs is in flash. The vector table is shared,
+// so the other core's GPIO interrupts, before it turns them off, go on to
+// the usual handler.
+void __not_in_flash_func(LiveGpioIrq)() {
+  if (get_core_num() != g_live.core) {
+    g_live.saved_handler();
+    return;
+  }
+  io_irq_ctrl_hw_t* ctrl = IrqCtrl(g_live.core);
+  for (uint32_t reg = 0; reg < 4; ++reg) {
+    uint32_t events8 = ctrl->ints[reg];
+    for (uint gpio = reg * 8; events8; ++gpio, events8 >>= 4) {
+      const uint32_t events = events8 & 0xf;
+      if (!events) continue;
+      iobank0_hw->intr[reg] = events << (4 * (gpio & 7));
+      g_live.callback(gpio, events);
+    }
+  }
+}
+
+// Parks the live core for one flash operation: every interrupt but the live
+// GPIOs' is masked, the tick included, and it waits in RAM to be released.
+// Anything masked stays pending and is taken afterwards.
+void __not_in_flash_func(Park)() {
+  volatile uint32_t& iser = PpbRegister(M0PLUS_NVIC_ISER_OFFSET);
+  volatile uint32_t& icer = PpbRegister(M0PLUS_NVIC_ICER_OFFSET);
+  volatile uint32_t& syst_csr = PpbRegister(M0PLUS_SYST_CSR_OFFSET);
+  io_irq_ctrl_hw_t* ctrl = IrqCtrl(g_live.core);
+  irq_handler_t* const vector =
+      &irq_get_vtable()[VTABLE_FIRST_IRQ + IO_IRQ_BANK0];
+
+  uint32_t interrupts = save_and_disable_interrupts();
+  const uint32_t enabled = iser;
+  icer = enabled & ~(1u << IO_IRQ_BANK0);
+  const uint32_t systick = syst_csr;
+  syst_csr = systick & ~M0PLUS_SYST_CSR_TICKINT_BITS;
+  uint32_t inte[4];
+  for (int i = 0; i < 4; ++i) {
+    inte[i] = ctrl->inte[i];
+    ctrl->inte[i] = inte[i] & g_live.inte[i];
+  }
+  g_live.saved_handler = *vector;
+  *vector = LiveGpioIrq;
+  g_live.state.store(kParked, std::memory_order_release);
+  __sev();
+  restore_interrupts(interrupts);
+
+  while (g_live.state.load(std::memory_order_acquire) != kReleased) __wfe();
+
+  interrupts = save_and_disable_interrupts();
+  *vector = g_live.saved_handler;
+  for (int i = 0; i < 4; ++i) ctrl->inte[i] = inte[i];
+  syst_csr = systick;
+  iser = enabled;
+  g_live.state.store(kRunning, std::memory_order_release);
+  __sev();
+  restore_interrupts(interrupts);
+}
+
+// Pinned to the live core above every other task, so it gets the core as
+// soon as it is notified.
+void ParkerTask(void*) {
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    Park();
+  }
+}
+
+}  // namespace
+
+static_assert(FlashDevice::kSectorBytes == FLASH_SECTOR_SIZE);
+static_assert(FlashDevice::kPageBytes == FLASH_PAGE_SIZE);
+
+Rp2040Flash::Stats Rp2040Flash::stats_;
+
+Rp2040Flash::Rp2040Flash(uint32_t sectors)
+    : sectors_(sectors),
+      base_(PICO_FLASH_SIZE_BYTES - sectors * FLASH_SECTOR_SIZE) {}
+
+void Rp2040Flash::KeepGpioLive(
+    uint32_t gpio_mask, gpio_irq_callback_t callback) {
+  g_live.core = get_core_num();
+  g_live.callback = callback;
+  for (uint gpio = 0; gpio < 32; ++gpio) {
+    if (!(gpio_mask & (1u << gpio))) continue;
+    g_live.inte[gpio / 8] |= 0xfu << 4 * (gpio % 8);
+  }
+  xTaskCreateAffinitySet(
+      ParkerTask,
+      "flash_park",
+      configMINIMAL_STACK_SIZE,
+      nullptr,
+      configMAX_PRIORITIES - 1,
+      1u << g_live.core,
+      &g_live.parker);
+  gpio_live_.store(true, std::memory_order_release);
+}
+
+void Rp2040Flash::Run(void (*func)(void*), void* param, const char* what) {
+  uint32_t elapsed_us;
+  if (!gpio_live()) {
+    const uint32_t start_us = time_us_32();
+    busy_.store(true, std::memory_order_relaxed);
+    const int err = flash_safe_execute(func, param, kSafeExecuteTimeoutMs);
+    busy_.store(false, std::memory_order_relaxed);
+    elapsed_us = time_us_32() - start_us;
+    if (err != PICO_OK) printf("flash %s failed: %d\n", what, err);
+  } else {
+    // Off the live core, so that it can be parked. There's no timeout: the
+    // parker preempts whatever runs there, and the watchdog covers a hang.
+    const UBaseType_t affinity = vTaskCoreAffinityGet(nullptr);
+    vTaskCoreAffinitySet(nullptr, 1u << (1 - g_live.core));
+    xTaskNotifyGive(g_live.parker);
+    while (g_live.state.load(std::memory_order_acquire) != kParked) {
+      tight_loop_contents();
+    }
+    const uint32_t interrupts = save_and_disable_interrupts();
+    const uint32_t start_us = time_us_32();
+    busy_.store(true, std::memory_order_relaxed);
+    func(param);
+    busy_.store(false, std::memory_order_relaxed);
+    elapsed_us = time_us_32() - start_us;
+    g_live.state.store(kReleased, std::memory_order_release);
+    __sev();
+    while (g_live.state.load(std::memory_order_acquire) != kRunning) {
+      tight_loop_contents();
+    }
+    restore_interrupts(interrupts);
+    vTaskCoreAffinitySet(nullptr, affinity);
+  }
+  ++stats_.operations;
+  stats_.busy_us += elapsed_us;
+  stats_.longest_us = std::max(stats_.longest_us, elapsed_us);
+}
+
+bool Rp2040Flash::valid() const {
+  const uintptr_t image_end =
+      reinterpret_cast<uintptr_t>(&__flash_binary_end) - XIP_BASE;
+  return sectors_ * FLASH_SECTOR_SIZE <= PICO_FLASH_SIZE_BYTES &&
+         image_end <= base_;
+}
+
+void Rp2040Flash::Read(uint32_t offset, std::span<uint8_t> out) {
+  // Uncached, so scanning the log doesn't evict code from the XIP cache.
+  const auto* src = reinterpret_cast<const uint8_t*>(
+      XIP_NOCACHE_NOALLOC_BASE + base_ + offset);
+  std::memcpy(out.data(), src, out.size());
+}
+
+void Rp2040Flash::Program(uint32_t offset, std::span<const uint8_t> data) {
+  ProgramArgs args = {base_ + offset, data};
+  Run(ProgramPages, &args, "program");
+}
+
+void Rp2040Flash::EraseSector(uint32_t sector) {
+  uint32_t offset = base_ + sector * FLASH_SECTOR_SIZE;
+  Run(EraseRange, &offset, "erase");
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <span>
+
+#include "flash_log.h"
+#include "hardware/gpio.h"
+
+// FlashDevice over the last `sectors` sectors of the Pico W's QSPI flash,
+// above the program image. Reads go through the XIP window. Erasing and
+// programming stall execution from flash on both cores. Until some GPIO
+// interrupts are kept live (KeepGpioLive), they run under
+// flash_safe_execute, which parks the other core's tasks in RAM with
+// interrupts off until they are done. After that they run on the other
+// core from the live one, and the live core is parked with only those
+// GPIO interrupts on, handled from RAM.
+class Rp2040Flash : public FlashDevice {
+ public:
+  // Erases and programs since boot, for all instances.
+  struct Stats {
+    uint32_t operations = 0;
+    uint64_t busy_us = 0;
+    uint32_t longest_us = 0;
+  };
+
+  explicit Rp2040Flash(uint32_t sectors);
+
+  // False if the region overlaps the program image.
+  bool valid() const;
+
+  // Keeps the interrupts for the GPIOs in `gpio_mask` running on the
+  // calling core while flash is busy, delivered to `callback` as
+  // gpio_set_irq_callback's would be. The callback, and everything it calls
+  // or reads, must be in RAM. Call once, after enabling the interrupts, from
+  // a task pinned to the core.
+  static void KeepGpioLive(uint32_t gpio_mask, gpio_irq_callback_t callback);
+  // Whether KeepGpioLive has run, from any task.
+  static bool gpio_live() { return gpio_live_.load(std::memory_order_acquire); }
+
+  // Whether an erase or program is under way. Inline for RAM-resident
+  // interrupt handlers.
+  static bool busy() { return busy_.load(std::memory_order_relaxed); }
+
+  // Only for the task that erases and programs.
+  static const Stats& stats() { return stats_; }
+
+  uint32_t sectors() const override { return sectors_; }
+  void Read(uint32_t offset, std::span<uint8_t> out) override;
+  void Program(uint32_t offset, std::span<const uint8_t> data) override;
+  void EraseSector(uint32_t sector) override;
+
+ private:
+  // Runs `func`, which erases or programs, with flash safe to stall.
+  static void Run(void (*func)(void*), void* param, const char* what);
+
+  inline static std::atomic<bool> busy_{false};
+  inline static std::atomic<bool> gpio_live_{false};
+  static Stats stats_;
+
+  const uint32_t sectors_;
+  // Of the region, from the start of flash.
+  const uint32_t base_;
+};
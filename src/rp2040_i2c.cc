@@ -0,0 +1,126 @@
+#include "rp2040_i2c.h"
+
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+
+namespace {
+
+// The transports by controller, for the interrupt handlers.
+std::array<Rp2040I2cTransport*, 2> g_transports;
+
+uint ClaimDma() { return dma_claim_unused_channel(true); }
+
+}  // namespace
+
+Rp2040I2cTransport::Rp2040I2cTransport(i2c_inst_t* i2c, TaskHandle_t task)
+    : i2c_(i2c), task_(task), tx_dma_(ClaimDma()), rx_dma_(ClaimDma()) {
+  const uint index = i2c_hw_index(i2c_);
+  g_transports[index] = this;
+  i2c_hw_t* hw = i2c_get_hw(i2c_);
+  hw->intr_mask = 0;
+  hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS;
+  const uint irq = index == 0 ? I2C0_IRQ : I2C1_IRQ;
+  irq_set_exclusive_handler(irq, index == 0 ? HandleIrq0 : HandleIrq1);
+  irq_set_enabled(irq, true);
+}
+
+void Rp2040I2cTransport::HandleIrq0() { g_transports[0]->HandleIrq(); }
+void Rp2040I2cTransport::HandleIrq1() { g_transports[1]->HandleIrq(); }
+
+void Rp2040I2cTransport::Start(I2cTransfer& transfer) {
+  const int writes = transfer.write_len;
+  const int reads = transfer.read_len;
+  status_.store(kRunning, std::memory_order_relaxed);
+  if (writes + reads == 0) {
+    // The controller can't address a device without a data byte.
+    status_.store(
+        static_cast<uint8_t>(I2cStatus::kError), std::memory_order_release);
+    return;
+  }
+
+  int n = 0;
+  for (int i = 0; i < writes; ++i) {
+    const bool last = reads == 0 && i == writes - 1;
+    commands_[n++] =
+        transfer.write[i] | (last ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+  }
+  for (int i = 0; i < reads; ++i) {
+    commands_[n++] = I2C_IC_DATA_CMD_CMD_BITS |
+                     (i == 0 && writes > 0 ? I2C_IC_DATA_CMD_RESTART_BITS : 0) |
+                     (i == reads - 1 ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+  }
+
+  i2c_hw_t* hw = i2c_get_hw(i2c_);
+  // The target address can only change while the controller is disabled.
+  hw->enable = 0;
+  hw->tar = transfer.address;
+  hw->enable = I2C_IC_ENABLE_ENABLE_BITS;
+  (void)hw->clr_intr;
+  hw->intr_mask =
+      I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+
+  if (reads > 0) {
+    dma_channel_config rx = dma_channel_get_default_config(rx_dma_);
+    channel_config_set_transfer_data_size(&rx, DMA_SIZE_8);
+    channel_config_set_read_increment(&rx, false);
+    channel_config_set_write_increment(&rx, true);
+    channel_config_set_dreq(&rx, i2c_get_dreq(i2c_, false));
+    dma_channel_configure(
+        rx_dma_, &rx, transfer.read.data(), &hw->data_cmd, reads, true);
+  }
+  dma_channel_config tx = dma_channel_get_default_config(tx_dma_);
+  channel_config_set_transfer_data_size(&tx, DMA_SIZE_32);
+  channel_config_set_read_increment(&tx, true);
+  channel_config_set_write_increment(&tx, false);
+  channel_config_set_dreq(&tx, i2c_get_dreq(i2c_, true));
+  dma_channel_configure(tx_dma_, &tx, &hw->data_cmd, commands_.data(), n, true);
+}
+
+std::optional<I2cStatus> Rp2040I2cTransport::Finished() {
+  const uint8_t status = status_.load(std::memory_order_acquire);
+  if (status == kRunning) return std::nullopt;
+  return static_cast<I2cStatus>(status);
+}
+
+void Rp2040I2cTransport::Abort() {
+  i2c_get_hw(i2c_)->intr_mask = 0;
+  dma_channel_abort(tx_dma_);
+  dma_channel_abort(rx_dma_);
+  // Disabling the controller flushes its FIFOs and releases the bus.
+  i2c_get_hw(i2c_)->enable = 0;
+  status_.store(
+      static_cast<uint8_t>(I2cStatus::kTimeout), std::memory_order_release);
+}
+
+// From the interrupt only.
+void Rp2040I2cTransport::Complete(I2cStatus status) {
+  status_.store(static_cast<uint8_t>(status), std::memory_order_release);
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(task_, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+void Rp2040I2cTransport::HandleIrq() {
+  i2c_hw_t* hw = i2c_get_hw(i2c_);
+  const uint32_t stat = hw->intr_stat;
+  if (stat & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+    const uint32_t source = hw->tx_abrt_source;
+    (void)hw->clr_tx_abrt;
+    hw->intr_mask = 0;
+    dma_channel_abort(tx_dma_);
+    dma_channel_abort(rx_dma_);
+    Complete(
+        source & (I2C_IC_TX_ABRT_SOURCE_ABRT_7B_ADDR_NOACK_BITS |
+                  I2C_IC_TX_ABRT_SOURCE_ABRT_TXDATA_NOACK_BITS)
+            ? I2cStatus::kNack
+            : I2cStatus::kError);
+  } else if (stat & I2C_IC_INTR_STAT_R_STOP_DET_BITS) {
+    (void)hw->clr_stop_det;
+    hw->intr_mask = 0;
+    // The last byte can still be on its way from the FIFO; it takes a few
+    // cycles.
+    while (dma_channel_is_busy(rx_dma_)) {
+    }
+    Complete(I2cStatus::kOk);
+  }
+}
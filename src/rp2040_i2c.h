@@ -0,0 +1,47 @@
+#pragma once
+
+#include <FreeRTOS.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+
+#include "hardware/i2c.h"
+#include "i2c_bus.h"
+#include "task.h"
+
+// I2cTransport on an RP2040 I2C controller. One DMA channel feeds the
+// controller's command FIFO and another drains its receive FIFO, so a
+// transfer costs the CPU its setup and a single interrupt at the end, when
+// the controller detects its STOP or aborts.
+class Rp2040I2cTransport : public I2cTransport {
+ public:
+  // `i2c` must already be initialised with its pins set up. Each completion
+  // gives `task` a notification (ulTaskNotifyTake wakes it).
+  Rp2040I2cTransport(i2c_inst_t* i2c, TaskHandle_t task);
+
+  void Start(I2cTransfer& transfer) override;
+  std::optional<I2cStatus> Finished() override;
+  void Abort() override;
+
+ private:
+  // Sentinel in status_ while a transfer runs.
+  static constexpr uint8_t kRunning = 0xff;
+
+  static void HandleIrq0();
+  static void HandleIrq1();
+  void HandleIrq();
+  void Complete(I2cStatus status);
+
+  i2c_inst_t* const i2c_;
+  const TaskHandle_t task_;
+  const uint tx_dma_;
+  const uint rx_dma_;
+  // Data/command words for the controller: a byte to write, or a read, with
+  // RESTART and STOP flags.
+  std::array<uint32_t, I2cTransfer::kMaxWrite + I2cTransfer::kMaxRead>
+      commands_;
+  // Written by the interrupt, read by the scheduler's task.
+  std::atomic<uint8_t> status_{static_cast<uint8_t>(I2cStatus::kOk)};
+};
@@ -0,0 +1,50 @@
+#include "sht4x.h"
+
+#include <algorithm>
+
+uint8_t Sht4x::Crc8(std::span<const uint8_t> data) {
+  uint8_t crc = 0xff;
+  for (uint8_t byte : data) {
+    crc ^= byte;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+I2cDevice::Action Sht4x::Start(I2cTransfer& next) {
+  const uint8_t command[] = {kMeasureHighRepeatability};
+  next = I2cTransfer::Write(address_, command);
+  step_ = Step::kMeasure;
+  return Action::Transfer();
+}
+
+I2cDevice::Action Sht4x::Continue(I2cStatus status, I2cTransfer& transfer) {
+  if (status != I2cStatus::kOk) return Action::Done(false);
+  switch (step_) {
+    case Step::kMeasure:
+      step_ = Step::kConvert;
+      return Action::Wait(kConversionMs);
+    case Step::kConvert:
+      transfer = I2cTransfer::Read(address_, 6);
+      step_ = Step::kRead;
+      return Action::Transfer();
+    case Step::kRead:
+      break;
+  }
+
+  // Two words, each followed by its CRC.
+  const std::span<const uint8_t> data(transfer.read.data(), 6);
+  if (Crc8(data.subspan(0, 2)) != data[2] ||
+      Crc8(data.subspan(3, 2)) != data[5]) {
+    return Action::Done(false);
+  }
+  const uint16_t raw_t = data[0] << 8 | data[1];
+  const uint16_t raw_rh = data[3] << 8 | data[4];
+  reading_ = Reading{
+      .temperature_c = -45 + 175 * (raw_t / 65535.0f),
+      .humidity_percent =
+          std::clamp(-6 + 125 * (raw_rh / 65535.0f), 0.0f, 100.0f)};
+  return Action::Done(true);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+
+#include "i2c_bus.h"
+
+// Sensirion SHT4x temperature and humidity sensor. Each cycle triggers a
+// high-repeatability measurement, waits out the conversion with the bus
+// free, and reads the result back.
+class Sht4x : public I2cDevice {
+ public:
+  static constexpr uint8_t kAddress = 0x44;
+  static constexpr uint8_t kMeasureHighRepeatability = 0xfd;
+  // The datasheet's maximum is 8.3 ms; the sensor NACKs reads before then.
+  static constexpr uint32_t kConversionMs = 10;
+
+  struct Reading {
+    float temperature_c;
+    float humidity_percent;
+  };
+
+  Sht4x(uint8_t address, uint32_t period_ms) : I2cDevice(address, period_ms) {}
+
+  std::string_view name() const override { return "sht4x"; }
+  Action Start(I2cTransfer& next) override;
+  Action Continue(I2cStatus status, I2cTransfer& transfer) override;
+
+  // The last good reading.
+  const std::optional<Reading>& reading() const { return reading_; }
+
+  // CRC-8 over each 16-bit word: polynomial 0x31, initial value 0xff.
+  static uint8_t Crc8(std::span<const uint8_t> data);
+
+ private:
+  enum class Step : uint8_t { kMeasure, kConvert, kRead };
+
+  Step step_ = Step::kMeasure;
+  std::optional<Reading> reading_;
+};
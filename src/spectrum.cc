@@ -0,0 +1,89 @@
+#include "spectrum.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+
+void FixedFft(std::span<ComplexQ15> data) {
+  const uint32_t n = data.size();
+  for (uint32_t i = 1, j = 0; i < n; ++i) {
+    uint32_t bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) std::swap(data[i], data[j]);
+  }
+  // Inputs of magnitude below one stay below one: |a +- wb| / 2 <= 1.
+  for (uint32_t half = 1; half < n; half *= 2) {
+    const uint32_t stride = kMaxFftPoints / (2 * half);
+    for (uint32_t k = 0; k < half; ++k) {
+      const int32_t c = kTwiddles.cos[k * stride];
+      const int32_t s = kTwiddles.sin[k * stride];
+      for (uint32_t i = k; i < n; i += 2 * half) {
+        ComplexQ15& a = data[i];
+        ComplexQ15& b = data[i + half];
+        // b * exp(-j theta), rounded back to Q15.
+        const int32_t tr = (b.re * c + b.im * s + (1 << 14)) >> 15;
+        const int32_t ti = (b.im * c - b.re * s + (1 << 14)) >> 15;
+        b.re = (a.re - tr + 1) >> 1;
+        b.im = (a.im - ti + 1) >> 1;
+        a.re = (a.re + tr + 1) >> 1;
+        a.im = (a.im + ti + 1) >> 1;
+      }
+    }
+  }
+}
+
+SpectrumSummary AnalyzeSpectrum(
+    std::span<const int16_t> samples,
+    float sample_hz,
+    float units_per_count,
+    std::span<const float> band_edges_hz,
+    std::span<ComplexQ15> work) {
+  const int32_t n = samples.size();
+  int32_t sum = 0;
+  for (int16_t s : samples) sum += s;
+  const int32_t mean = sum / n;
+  int32_t peak = 1;
+  for (int16_t s : samples) peak = std::max(peak, std::abs(s - mean));
+
+  // Block floating point: scale the largest deviation to just under full
+  // scale so quiet spectra keep their precision through the halvings.
+  int shift = 0;
+  while (peak > 32767) peak >>= 1, --shift;
+  while (peak <= 16383) peak <<= 1, ++shift;
+
+  // Hann window 0.5 (1 - cos(2 pi i / n)), with cos from the twiddles.
+  const int32_t stride = kMaxFftPoints / n;
+  for (int32_t i = 0; i < n; ++i) {
+    const int32_t d = samples[i] - mean;
+    const int32_t x = shift >= 0 ? d << shift : d >> -shift;
+    const int32_t w = (32767 - kTwiddles.cos[std::min(i, n - i) * stride]) >> 1;
+    work[i] = {static_cast<int16_t>((x * w) >> 15), 0};
+  }
+  FixedFft(work);
+
+  // One-sided mean square per bin. The window keeps 3/8 of the power.
+  const float unit = std::ldexp(units_per_count, -shift);
+  const float to_units_sq = unit * unit / 0.375f;
+  const int bands = std::min<int>(
+      band_edges_hz.size() - 1, SpectrumSummary::kMaxBands);
+  SpectrumSummary summary;
+  uint32_t best_power = 0;
+  int best_bin = 0;
+  for (int32_t k = 1; k <= n / 2; ++k) {
+    const uint32_t power = work[k].re * work[k].re + work[k].im * work[k].im;
+    if (power > best_power) best_power = power, best_bin = k;
+    const float energy = power * (k == n / 2 ? 1 : 2) * to_units_sq;
+    summary.variance += energy;
+    const float hz = k * sample_hz / n;
+    for (int b = 0; b < bands; ++b) {
+      if (hz >= band_edges_hz[b] && hz < band_edges_hz[b + 1]) {
+        summary.band_energy[b] += energy;
+        break;
+      }
+    }
+  }
+  summary.dominant_hz = best_bin * sample_hz / n;
+  return summary;
+}
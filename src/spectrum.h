@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <numbers>
+#include <span>
+
+struct ComplexQ15 {
+  int16_t re;
+  int16_t im;
+};
+
+inline constexpr int kMaxFftPoints = 1024;
+
+namespace spectrum_internal {
+
+// Taylor series, good to double precision on [-pi, pi]; only used to build
+// tables at compile time.
+constexpr double Sin(double x) {
+  double term = x;
+  double sum = x;
+  for (int i = 1; i < 30; ++i) {
+    term *= -x * x / ((2 * i) * (2 * i + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr int16_t ToQ15(double x) {
+  const double scaled = x * 32767;
+  return static_cast<int16_t>(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+}  // namespace spectrum_internal
+
+// cos and sin of 2 pi k / kMaxFftPoints in Q15 for k in [0, kMaxFftPoints/2].
+// Smaller transforms stride through them. constexpr, so they live in flash.
+struct TwiddleTable {
+  std::array<int16_t, kMaxFftPoints / 2 + 1> cos;
+  std::array<int16_t, kMaxFftPoints / 2 + 1> sin;
+};
+inline constexpr TwiddleTable kTwiddles = [] {
+  TwiddleTable t{};
+  for (int k = 0; k <= kMaxFftPoints / 2; ++k) {
+    const double angle = 2 * std::numbers::pi * k / kMaxFftPoints;
+    t.sin[k] = spectrum_internal::ToQ15(spectrum_internal::Sin(angle));
+    t.cos[k] = spectrum_internal::ToQ15(
+        spectrum_internal::Sin(std::numbers::pi / 2 - angle));
+  }
+  return t;
+}();
+
+// In-place radix-2 decimation-in-time FFT of a power-of-two number of points
+// from 16 to kMaxFftPoints. Every stage halves its outputs so nothing can
+// overflow: the result is the DFT divided by the number of points.
+void FixedFft(std::span<ComplexQ15> data);
+
+struct SpectrumSummary {
+  static constexpr int kMaxBands = 4;
+  // Mean-square contribution of each band, in input units squared. They add
+  // up to the variance, less whatever falls outside the bands.
+  std::array<float, kMaxBands> band_energy{};
+  // Centre of the strongest non-DC bin.
+  float dominant_hz = 0;
+  float variance = 0;
+};
+
+// Removes the mean, applies a Hann window (compensated for its power loss),
+// transforms and sums the one-sided power into bands [edges[i],
+// edges[i + 1]). Samples are in units of `units_per_count`; `work` must be as
+// long as `samples`, which must be a valid FixedFft size.
+SpectrumSummary AnalyzeSpectrum(
+    std::span<const int16_t> samples,
+    float sample_hz,
+    float units_per_count,
+    std::span<const float> band_edges_hz,
+    std::span<ComplexQ15> work);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Single-producer single-consumer ring, for handing data from an interrupt
+// handler to a task. Each index has one writer, so Push and Pop are plain
+// loads and stores: lock-free and wait-free on the M0+. When full, Push
+// drops the item and counts it.
+template <typename T, uint32_t N>
+class SpscRing {
+  static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+ public:
+  // Always inlined, so that RAM-resident interrupt handlers stay in RAM.
+  [[gnu::always_inline]] bool Push(const T& item) {
+    const uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == N) {
+      dropped_.store(
+          dropped_.load(std::memory_order_relaxed) + 1,
+          std::memory_order_relaxed);
+      return false;
+    }
+    items_[head & (N - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool Pop(T& item) {
+    const uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) return false;
+    item = items_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  std::array<T, N> items_;
+  std::atomic<uint32_t> head_{0};  // Written by the producer.
+  std::atomic<uint32_t> tail_{0};  // Written by the consumer.
+  std::atomic<uint32_t> dropped_{0};
+};
@@ -0,0 +1,145 @@
+#include "supervisor.h"
+
+#include <cstdio>
+
+#include "hardware/structs/watchdog.h"
+#include "hardware/watchdog.h"
+#include "pico/time.h"
+
+namespace {
+
+// scratch[4..7] belong to the SDK's watchdog_reboot(); we use scratch[0].
+constexpr uint32_t kCauseMagic = 0x5e5e0000;
+constexpr uint32_t kCauseMagicMask = 0xffff0000;
+
+uint32_t NowMs() { return to_ms_since_boot(get_absolute_time()); }
+
+}  // namespace
+
+std::string_view SupervisedTaskName(SupervisedTask task) {
+  switch (task) {
+    case SupervisedTask::kWindDirection:
+      return "wind_direction";
+    case SupervisedTask::kWindAndRain:
+      return "wind_and_rain";
+    case SupervisedTask::kPublisher:
+      return "publisher";
+    case SupervisedTask::kNetwork:
+      return "network";
+    case SupervisedTask::kEnvironment:
+      return "environment";
+  }
+  return "unknown";
+}
+
+void Supervisor::Register(SupervisedTask task, uint32_t deadline_ms) {
+  Entry& e = entries_[static_cast<int>(task)];
+  e.last_check_in_ms.store(NowMs(), std::memory_order_relaxed);
+  e.deadline_ms = deadline_ms;
+}
+
+void Supervisor::CheckIn(SupervisedTask task) {
+  entries_[static_cast<int>(task)].last_check_in_ms.store(
+      NowMs(), std::memory_order_relaxed);
+}
+
+void Supervisor::Suspend(SupervisedTask task) {
+  entries_[static_cast<int>(task)].suspended.store(
+      true, std::memory_order_relaxed);
+}
+
+void Supervisor::Resume(SupervisedTask task) {
+  Entry& e = entries_[static_cast<int>(task)];
+  // Checked in first, so the supervisor never sees it resumed and stale.
+  e.last_check_in_ms.store(NowMs(), std::memory_order_relaxed);
+  e.suspended.store(false, std::memory_order_release);
+}
+
+void Supervisor::Start(TaskHandle_t network_task) {
+  network_task_ = network_task;
+  watchdog_hw->scratch[0] = 0;
+  watchdog_enable(kWatchdogMs, /*pause_on_debug=*/true);
+  // Above the sensor tasks so a busy loop elsewhere can't starve the feed.
+  xTaskCreate(
+      &Supervisor::Run,
+      "supervisor",
+      256,
+      this,
+      configMAX_PRIORITIES - 1,
+      nullptr);
+}
+
+std::optional<SupervisedTask> Supervisor::PreviousResetCause() {
+  const uint32_t cause = watchdog_hw->scratch[0];
+  if (!watchdog_caused_reboot() || (cause & kCauseMagicMask) != kCauseMagic) {
+    return std::nullopt;
+  }
+  const uint32_t task = cause & ~kCauseMagicMask;
+  if (task >= kSupervisedTaskCount) return std::nullopt;
+  return static_cast<SupervisedTask>(task);
+}
+
+void Supervisor::Run(void* self) {
+  Supervisor& supervisor = *static_cast<Supervisor*>(self);
+  TickType_t last_wake = xTaskGetTickCount();
+  while (true) {
+    supervisor.Tick(NowMs());
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(kTickMs));
+  }
+}
+
+void Supervisor::Tick(uint32_t now_ms) {
+  constexpr int kNetwork = static_cast<int>(SupervisedTask::kNetwork);
+  // The first overdue task, unless the network task is among them: then
+  // soft recovery can't happen, whatever else is overdue.
+  int overdue = -1;
+  for (int i = 0; i < kSupervisedTaskCount; ++i) {
+    const Entry& e = entries_[i];
+    if (e.deadline_ms == 0 || e.suspended.load(std::memory_order_acquire)) {
+      continue;
+    }
+    // Unsigned subtraction copes with the millisecond counter wrapping.
+    const uint32_t since =
+        now_ms - e.last_check_in_ms.load(std::memory_order_relaxed);
+    if (since > e.deadline_ms && (overdue < 0 || i == kNetwork)) overdue = i;
+  }
+
+  if (overdue < 0) {
+    if (stage_ != 0) printf("supervisor: all tasks checked in, recovered\n");
+    stage_ = 0;
+    watchdog_hw->scratch[0] = 0;
+    watchdog_update();
+    return;
+  }
+
+  // Recorded now so a reset from any later stage, or a hang of this task,
+  // leaves the cause behind.
+  watchdog_hw->scratch[0] = kCauseMagic | overdue;
+  const bool network_alive = overdue != kNetwork;
+  // A hung network task skips the stages left, even part way through one.
+  if (stage_ < 3 && (!network_alive || stage_ == 0 ||
+                     now_ms - stage_started_ms_ >= kStageMs)) {
+    ++stage_;
+    stage_started_ms_ = now_ms;
+    const std::string_view name =
+        SupervisedTaskName(static_cast<SupervisedTask>(overdue));
+    if (stage_ == 1 && network_alive) {
+      printf("supervisor: %s overdue, reconnecting MQTT\n", name.data());
+      xTaskNotify(network_task_, kRecoverMqtt, eSetBits);
+    } else if (stage_ == 2 && network_alive) {
+      printf("supervisor: %s still overdue, reconnecting Wi-Fi\n", name.data());
+      xTaskNotify(network_task_, kRecoverWifi, eSetBits);
+    } else {
+      printf(
+          "supervisor: %s overdue, letting the watchdog reset\n",
+          name.data());
+      stage_ = 3;
+    }
+  }
+  if (stage_ < 3) watchdog_update();
+}
+
+Supervisor& GetSupervisor() {
+  static Supervisor supervisor;
+  return supervisor;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <FreeRTOS.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "task.h"
+
+// The tasks whose liveness gates the hardware watchdog.
+enum class SupervisedTask : uint8_t {
+  kWindDirection,  // Windvane acquisition loop.
+  kWindAndRain,    // Anemometer and rain gauge flush loop.
+  kPublisher,      // Checks in when a publish completes; see Suspend().
+  kNetwork,        // The task that carries out soft recovery.
+  kEnvironment,    // I2C sensor bus scheduler.
+};
+inline constexpr int kSupervisedTaskCount = 5;
+std::string_view SupervisedTaskName(SupervisedTask task);
+
+// Task notification bits the supervisor sends the network task.
+inline constexpr uint32_t kRecoverMqtt = 1 << 0;
+inline constexpr uint32_t kRecoverWifi = 1 << 1;
+
+// Feeds the RP2040 hardware watchdog only while every registered task has
+// checked in within its deadline. When one hasn't, it escalates: first it
+// asks the network task to reconnect MQTT, then Wi-Fi, and finally it stops
+// feeding the watchdog so the chip resets. When the network task is overdue,
+// alone or with others, it goes straight to the reset. The overdue task is
+// recorded in a watchdog scratch register, which survives the reset.
+class Supervisor {
+ public:
+  // How long each escalation stage gets before the next one starts.
+  static constexpr uint32_t kStageMs = 20'000;
+  // Hardware watchdog period; the supervisor feeds it every kTickMs.
+  static constexpr uint32_t kWatchdogMs = 5'000;
+  static constexpr uint32_t kTickMs = 1'000;
+
+  // Tasks start counting from registration, so register before the task's
+  // first check-in is due.
+  void Register(SupervisedTask task, uint32_t deadline_ms);
+  // Callable from any task or from a callback in the lwIP thread.
+  void CheckIn(SupervisedTask task);
+  // A suspended task has no deadline, for while it can't make progress until
+  // another supervised task has done its part, as the publisher can't while
+  // the network task looks for a broker. Resuming restarts the deadline.
+  void Suspend(SupervisedTask task);
+  void Resume(SupervisedTask task);
+
+  // Starts the supervisor task and enables the watchdog. `network_task`
+  // receives kRecover* notifications; while it is itself overdue, soft
+  // recovery is skipped.
+  void Start(TaskHandle_t network_task);
+
+  // If the last reset was the supervisor's doing, the task that missed its
+  // deadline. Read this before Start().
+  static std::optional<SupervisedTask> PreviousResetCause();
+
+ private:
+  struct Entry {
+    std::atomic<uint32_t> last_check_in_ms{0};
+    std::atomic<bool> suspended{false};
+    uint32_t deadline_ms = 0;  // Zero when not registered.
+  };
+
+  static void Run(void* self);
+  void Tick(uint32_t now_ms);
+
+  std::array<Entry, kSupervisedTaskCount> entries_;
+  TaskHandle_t network_task_ = nullptr;
+  // Escalation state, only touched by the supervisor task.
+  int stage_ = 0;
+  uint32_t stage_started_ms_ = 0;
+};
+
+Supervisor& GetSupervisor();
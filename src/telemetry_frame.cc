@@ -0,0 +1,39 @@
+#include "telemetry_frame.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool TelemetryFrameWriter::Add(uint32_t t_ms, float mph, int compass_index) {
+  const int count = samples();
+  if (count == kMaxSamples) return false;
+  if (count == 0) {
+    buffer_[4] = t_ms;
+    buffer_[5] = t_ms >> 8;
+    buffer_[6] = t_ms >> 16;
+    buffer_[7] = t_ms >> 24;
+    last_ms_ = t_ms;
+  }
+  uint32_t delta = t_ms - last_ms_;
+  last_ms_ = t_ms;
+  while (delta >= 0x80) {
+    buffer_[size_++] = (delta & 0x7f) | 0x80;
+    delta >>= 7;
+  }
+  buffer_[size_++] = delta;
+
+  const uint32_t speed = std::clamp<float>(
+      std::lround(mph * kTelemetrySpeedPerMph), 0, 0xfff);
+  const uint16_t packed = speed << 4 | (compass_index & 15);
+  buffer_[size_++] = packed;
+  buffer_[size_++] = packed >> 8;
+  buffer_[1] = count + 1;
+  return true;
+}
+
+void TelemetryFrameWriter::Clear() {
+  ++sequence_;
+  buffer_[1] = 0;
+  buffer_[2] = sequence_;
+  buffer_[3] = sequence_ >> 8;
+  size_ = kTelemetryHeaderBytes;
+}
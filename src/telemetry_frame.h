@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// High-rate wind samples packed into one binary frame, for research users
+// who want more than the 5 s sensor states. Layout, little-endian:
+//
+//   offset  size  field
+//   0       1     version, kTelemetryFrameVersion
+//   1       1     sample count
+//   2       2     frame sequence number, from 0 at boot, wrapping
+//   4       4     time of the first sample, ms since boot
+//   8       ...   samples
+//
+// Each sample is the ms since the previous one (0 for the first) as an
+// unsigned LEB128 varint, then a uint16 with the speed in 1/20 mph in the
+// top 12 bits (saturating at 204.75 mph) and the compass index (0 for N,
+// clockwise in 22.5 degree steps) in the low 4. At 1 Hz that is 4 bytes a
+// sample. tools/telemetry decodes it.
+inline constexpr uint8_t kTelemetryFrameVersion = 1;
+inline constexpr int kTelemetryHeaderBytes = 8;
+inline constexpr int kTelemetrySpeedPerMph = 20;
+
+class TelemetryFrameWriter {
+ public:
+  static constexpr int kMaxSamples = 64;
+  // A varint of a uint32 is at most 5 bytes.
+  static constexpr int kMaxBytes = kTelemetryHeaderBytes + kMaxSamples * 7;
+
+  // Returns false, dropping the sample, when the frame is full.
+  bool Add(uint32_t t_ms, float mph, int compass_index);
+
+  int samples() const { return buffer_[1]; }
+  // Valid until the next Add or Clear.
+  std::string_view frame() const {
+    return {reinterpret_cast<const char*>(buffer_.data()), size_};
+  }
+  // Starts the next frame.
+  void Clear();
+
+ private:
+  std::array<uint8_t, kMaxBytes> buffer_{kTelemetryFrameVersion};
+  size_t size_ = kTelemetryHeaderBytes;
+  uint16_t sequence_ = 0;
+  uint32_t last_ms_ = 0;
+};
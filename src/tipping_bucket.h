@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+// Dynamic calibration of a tipping-bucket rain gauge. Water keeps arriving
+// while the bucket tips and some of it is lost, so at high intensity a tip
+// stands for more than the nominal volume. We use the usual power law
+//
+//   I = a * Im^b
+//
+// where Im is the intensity implied by the interval since the previous tip
+// at the nominal volume, and I the true intensity, both in in/h.
+// tools/rain_gauge_fit fits a and b from calibration rig runs.
+struct TipCurve {
+  float nominal_in;  // Depth per tip from the datasheet.
+  float a;
+  float b;
+  // Cap on the correction, for intervals beyond the fitted range.
+  float max_factor;
+};
+
+// SparkFun SEN-15901 (Argent 80422) 0.011 in bucket. Until a rig run of our
+// own is fitted, these follow published dynamic calibrations of small
+// buckets: +1% at 1 in/h, +8% at 4 in/h.
+inline constexpr TipCurve kSen15901TipCurve = {
+    .nominal_in = 0.011,
+    .a = 1.01,
+    .b = 1.0484,
+    .max_factor = 1.25,
+};
+
+// Depth a tip represents when it comes `interval_s` after the previous one.
+// Pass a non-positive interval for a first tip; it gets the nominal depth.
+// Slow rain is never corrected below nominal.
+inline float TipInches(const TipCurve& curve, float interval_s) {
+  if (!(interval_s > 0)) return curve.nominal_in;
+  const float measured_in_h = curve.nominal_in * 3600 / interval_s;
+  const float true_in_h = curve.a * std::pow(measured_in_h, curve.b);
+  return curve.nominal_in *
+         std::clamp(true_in_h / measured_in_h, 1.0f, curve.max_factor);
+}
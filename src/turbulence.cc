@@ -0,0 +1,52 @@
+#include "turbulence.h"
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+
+namespace {
+
+int16_t ToCounts(float value) {
+  return std::clamp<float>(std::lround(value), -32767, 32767);
+}
+
+}  // namespace
+
+void TurbulenceSpectra::AddSpeed(float mph) {
+  if (speed_samples_ == kSpeedPoints) return;
+  speed_[speed_samples_++] = ToCounts(mph * kCountsPerUnit);
+}
+
+void TurbulenceSpectra::AddDirection(int compass_index) {
+  if (direction_samples_ == kDirectionPoints) return;
+  if (direction_samples_ > 0) {
+    // The shorter way round, -8 to 7 sectors.
+    unwrapped_sectors_ += ((compass_index - last_compass_index_ + 8) & 15) - 8;
+  }
+  last_compass_index_ = compass_index;
+  direction_[direction_samples_++] =
+      ToCounts(unwrapped_sectors_ * kCountsPerUnit);
+}
+
+std::optional<TurbulenceSpectra::Result> TurbulenceSpectra::Finish() {
+  if (speed_samples_ < kSpeedPoints || direction_samples_ < kDirectionPoints) {
+    return std::nullopt;
+  }
+  Result result;
+  result.speed = AnalyzeSpectrum(
+      speed_,
+      kSpeedHz,
+      1.0f / kCountsPerUnit,
+      kSpeedBandEdgesHz,
+      std::span(work_).first(kSpeedPoints));
+  result.direction = AnalyzeSpectrum(
+      direction_,
+      kDirectionHz,
+      22.5f / kCountsPerUnit,
+      kDirectionBandEdgesHz,
+      work_);
+  speed_samples_ = 0;
+  direction_samples_ = 0;
+  unwrapped_sectors_ = 0;
+  return result;
+}
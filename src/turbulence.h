@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+#include "spectrum.h"
+
+// Spectra of wind speed and vane motion over a window of kWindowSecs. Speed
+// shows how gusty the wind is and on what time scale; the vane's spectrum
+// separates slow meandering from eddies and from the vane's own
+// oscillation, which grows as its bearing wears. Samples go into fixed
+// buffers and each window costs one FixedFft of each.
+class TurbulenceSpectra {
+ public:
+  static constexpr int kSpeedHz = 2;
+  static constexpr int kDirectionHz = 8;
+  static constexpr int kWindowSecs = 128;
+  static constexpr int kSpeedPoints = kSpeedHz * kWindowSecs;
+  static constexpr int kDirectionPoints = kDirectionHz * kWindowSecs;
+  static_assert(kDirectionPoints <= kMaxFftPoints);
+
+  // Periods over 20 s (gusts and lulls), 5-20 s, and under 5 s.
+  static constexpr std::array<float, 4> kSpeedBandEdgesHz = {
+      0, 0.05, 0.2, kSpeedHz};
+  // Meander over 10 s, eddies of 2-10 s, vane oscillation around 1 Hz, and
+  // chatter.
+  static constexpr std::array<float, 5> kDirectionBandEdgesHz = {
+      0, 0.1, 0.5, 1.5, kDirectionHz};
+
+  struct Result {
+    SpectrumSummary speed;      // mph^2.
+    SpectrumSummary direction;  // deg^2.
+  };
+
+  // At kSpeedHz.
+  void AddSpeed(float mph);
+  // At kDirectionHz. `compass_index` is 0 for N, clockwise in 22.5 degree
+  // steps; it is unwrapped so turning through north is a single step.
+  void AddDirection(int compass_index);
+
+  // Once both buffers are full, analyses them and starts the next window.
+  std::optional<Result> Finish();
+
+ private:
+  // Speed in 1/256 mph, direction in 1/256 sector from the window's first
+  // reading.
+  static constexpr int kCountsPerUnit = 256;
+
+  std::array<int16_t, kSpeedPoints> speed_;
+  std::array<int16_t, kDirectionPoints> direction_;
+  std::array<ComplexQ15, kDirectionPoints> work_;
+  int speed_samples_ = 0;
+  int direction_samples_ = 0;
+  int last_compass_index_ = 0;
+  int unwrapped_sectors_ = 0;
+};
@@ -0,0 +1,25 @@
+#include "yamartino.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+std::optional<YamartinoWindow::Result> YamartinoWindow::Finish() {
+  if (samples_ == 0) return std::nullopt;
+  // Only here, once per window, does this go to (soft) floating point.
+  const float scale = 1.0f / (32767.0f * samples_);
+  const float sa = sum_sin_ * scale;
+  const float ca = sum_cos_ * scale;
+  const float epsilon = std::sqrt(std::max(0.0f, 1 - (sa * sa + ca * ca)));
+  constexpr float kToDegrees = 180 / std::numbers::pi_v<float>;
+  // Yamartino (1984): sigma = asin(e) * (1 + (2 / sqrt(3) - 1) * e^3).
+  constexpr float kB = 2 / std::numbers::sqrt3_v<float> - 1;
+  const float sigma = std::asin(std::min(epsilon, 1.0f)) *
+                      (1 + kB * epsilon * epsilon * epsilon) * kToDegrees;
+  float mean = std::atan2(sa, ca) * kToDegrees;
+  if (mean < 0) mean += 360;
+
+  const Result result{mean, sigma, samples_};
+  *this = {};
+  return result;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+// Single-pass wind direction statistics over a window of vane sectors, by
+// Yamartino's method: the mean direction from the summed unit vectors, and
+// sigma-theta from their mean resultant length. Each sample adds a
+// fixed-point sine and cosine from a table, so a window is three integers.
+class YamartinoWindow {
+ public:
+  // sin(k * 22.5 degrees) in Q15. cos(k) is sin(k + 4).
+  static constexpr std::array<int16_t, 16> kSinQ15 = {
+      0,      12540,  23170,  30274,  32767,  30274,  23170,  12540,
+      0,      -12540, -23170, -30274, -32767, -30274, -23170, -12540};
+
+  struct Result {
+    float mean_degrees;   // Clockwise from north, [0, 360).
+    float sigma_degrees;  // Sigma-theta.
+    uint32_t samples;
+  };
+
+  // `compass_index` is 0 for N, clockwise in 22.5 degree steps.
+  void Add(int compass_index) {
+    sum_sin_ += kSinQ15[compass_index & 15];
+    sum_cos_ += kSinQ15[(compass_index + 4) & 15];
+    ++samples_;
+  }
+
+  // Returns the window's statistics and starts a new window. Nullopt if
+  // there were no samples.
+  std::optional<Result> Finish();
+
+ private:
+  // 64 bits so no window length can overflow; adds stay cheap on the M0+.
+  int64_t sum_sin_ = 0;
+  int64_t sum_cos_ = 0;
+  uint32_t samples_ = 0;
+};
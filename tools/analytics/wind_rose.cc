@@ -0,0 +1,204 @@
+#include "analytics/wind_rose.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace analytics {
+namespace {
+
+Season SeasonOf(std::chrono::month m) {
+  const unsigned month = static_cast<unsigned>(m);
+  if (month == 12 || month <= 2) return kWinter;
+  if (month <= 5) return kSpring;
+  if (month <= 8) return kSummer;
+  return kAutumn;
+}
+
+int FineBin(float mph) {
+  return std::clamp(static_cast<int>(mph / kFineBinMph), 0, kFineBins - 1);
+}
+
+double FineBinCenter(int bin) { return (bin + 0.5) * kFineBinMph; }
+
+// Beyond any real wind; a histogram a few bins wide would otherwise drive k
+// toward its degenerate limit.
+constexpr double kMaxWeibullK = 100;
+
+}  // namespace
+
+int RoseSpeedBin(float mph) {
+  return std::upper_bound(kRoseSpeedEdges.begin(), kRoseSpeedEdges.end(), mph) -
+         kRoseSpeedEdges.begin();
+}
+
+std::optional<Weibull> FitWeibull(const SpeedHistogram& speeds) {
+  // Calm readings carry no shape information (and ln 0 is undefined), so the
+  // fit only uses speeds above the calm threshold, as is usual for siting.
+  const int first = FineBin(kRoseSpeedEdges[0]);
+  int top = -1;
+  double n = 0;
+  for (int i = first; i < kFineBins; ++i) {
+    n += speeds[i];
+    if (speeds[i] > 0) top = i;
+  }
+  if (n < 2) return std::nullopt;
+  // Speeds are taken relative to the fastest, u = v / v_max, so that u^k
+  // stays within [0, 1] however large k gets.
+  const double v_max = FineBinCenter(top);
+  auto ln_u = [&](int i) { return std::log(FineBinCenter(i) / v_max); };
+  double sum_ln = 0;
+  double sum_ln2 = 0;
+  for (int i = first; i < kFineBins; ++i) {
+    sum_ln += speeds[i] * ln_u(i);
+    sum_ln2 += speeds[i] * ln_u(i) * ln_u(i);
+  }
+  const double mean_ln = sum_ln / n;
+  // Every speed in one bin: no spread to fit a shape to.
+  if (sum_ln2 / n - mean_ln * mean_ln <= 1e-12) return std::nullopt;
+
+  // Newton's method on the profile likelihood equation for k:
+  //   sum(u^k ln u) / sum(u^k) - 1/k - mean(ln u) = 0
+  double k = 2;
+  for (int iter = 0; iter < 100; ++iter) {
+    double a = 0;  // sum u^k
+    double b = 0;  // sum u^k ln u
+    double d = 0;  // sum u^k (ln u)^2
+    for (int i = first; i <= top; ++i) {
+      if (speeds[i] == 0) continue;
+      const double uk = speeds[i] * std::exp(k * ln_u(i));
+      a += uk;
+      b += uk * ln_u(i);
+      d += uk * ln_u(i) * ln_u(i);
+    }
+    const double f = b / a - 1 / k - mean_ln;
+    const double df = (d * a - b * b) / (a * a) + 1 / (k * k);
+    const double next = std::clamp(k - f / df, k / 2, kMaxWeibullK);
+    const bool converged = std::abs(next - k) < 1e-9 * k;
+    k = next;
+    if (converged) break;
+  }
+
+  double a = 0;
+  for (int i = first; i <= top; ++i) {
+    a += speeds[i] * std::exp(k * ln_u(i));
+  }
+  return Weibull{.k = k, .c = v_max * std::pow(a / n, 1 / k)};
+}
+
+void Persistence::Add(const tsdb::Sample& s) {
+  if (current_.samples > 0 && current_.sector == s.sector &&
+      s.timestamp_ms - current_.last_ms <= kMaxRunGapMs) {
+    ++current_.samples;
+    current_.last_ms = s.timestamp_ms;
+    return;
+  }
+  if (current_.samples > 0) Close(current_);
+  current_ = {s.sector, 1, s.timestamp_ms, s.timestamp_ms};
+}
+
+void Persistence::Close(const Run& run) {
+  if (!leading_closed_) {
+    leading_ = run;
+    leading_closed_ = true;
+  } else {
+    Commit(run);
+  }
+}
+
+void Persistence::Commit(const Run& run) {
+  if (run.samples == 0) return;
+  ++runs[run.sector];
+  run_samples[run.sector] += run.samples;
+  longest_ms[run.sector] =
+      std::max(longest_ms[run.sector], run.last_ms - run.first_ms);
+}
+
+void Persistence::Merge(const Persistence& later) {
+  for (int s = 0; s < 16; ++s) {
+    runs[s] += later.runs[s];
+    run_samples[s] += later.run_samples[s];
+    longest_ms[s] = std::max(longest_ms[s], later.longest_ms[s]);
+  }
+  const Run& later_first =
+      later.leading_closed_ ? later.leading_ : later.current_;
+  if (later_first.samples == 0) return;
+  if (current_.samples == 0) {
+    // Nothing open on our side; adopt the later partial's edges as-is.
+    if (later.leading_closed_) Close(later.leading_);
+    current_ = later.current_;
+    return;
+  }
+
+  if (current_.sector == later_first.sector &&
+      later_first.first_ms - current_.last_ms <= kMaxRunGapMs) {
+    current_.samples += later_first.samples;
+    current_.last_ms = later_first.last_ms;
+    if (!later.leading_closed_) return;  // The later partial was one run.
+    Close(current_);
+  } else {
+    Close(current_);
+    if (later.leading_closed_) Close(later.leading_);
+  }
+  current_ = later.current_;
+}
+
+void Persistence::Finish() {
+  if (leading_closed_) Commit(leading_);
+  Commit(current_);
+  leading_ = {};
+  leading_closed_ = false;
+  current_ = {};
+}
+
+void WindStats::Add(const tsdb::Sample& s, int64_t utc_offset_ms) {
+  using namespace std::chrono;
+  const int sector = s.sector & 0xf;
+  ++samples;
+  speed_sum += s.wind_mph;
+  ++rose[sector][RoseSpeedBin(s.wind_mph)];
+  ++sector_speeds[sector][FineBin(s.wind_mph)];
+
+  const sys_time<milliseconds> local{
+      milliseconds(s.timestamp_ms + utc_offset_ms)};
+  const sys_days day = floor<days>(local);
+  const int hour = duration_cast<std::chrono::hours>(local - day).count();
+  HourStats& h = hours[hour];
+  ++h.samples;
+  h.speed_sum += s.wind_mph;
+  ++h.sectors[sector];
+
+  SeasonStats& season = seasons[SeasonOf(year_month_day(day).month())];
+  ++season.samples;
+  season.speed_sum += s.wind_mph;
+  ++season.sectors[sector];
+  ++season.speeds[FineBin(s.wind_mph)];
+}
+
+void WindStats::Merge(const WindStats& other) {
+  samples += other.samples;
+  speed_sum += other.speed_sum;
+  for (int s = 0; s < 16; ++s) {
+    for (int b = 0; b < kRoseSpeedBins; ++b) rose[s][b] += other.rose[s][b];
+    for (int b = 0; b < kFineBins; ++b) {
+      sector_speeds[s][b] += other.sector_speeds[s][b];
+    }
+  }
+  for (int h = 0; h < 24; ++h) {
+    hours[h].samples += other.hours[h].samples;
+    hours[h].speed_sum += other.hours[h].speed_sum;
+    for (int s = 0; s < 16; ++s) {
+      hours[h].sectors[s] += other.hours[h].sectors[s];
+    }
+  }
+  for (int i = 0; i < 4; ++i) {
+    SeasonStats& a = seasons[i];
+    const SeasonStats& b = other.seasons[i];
+    a.samples += b.samples;
+    a.speed_sum += b.speed_sum;
+    for (int s = 0; s < 16; ++s) a.sectors[s] += b.sectors[s];
+    for (int f = 0; f < kFineBins; ++f) a.speeds[f] += b.speeds[f];
+  }
+}
+
+}  // namespace analytics
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+#include "tsdb/block.h"
+
+namespace analytics {
+
+// Wind rose speed classes in mph (roughly Beaufort 0, 1, 2, ...). The first
+// class is calm; the last is open-ended.
+inline constexpr std::array<float, 7> kRoseSpeedEdges = {
+    1, 4, 8, 13, 19, 25, 32};
+inline constexpr int kRoseSpeedBins = kRoseSpeedEdges.size() + 1;
+
+// Speeds are also kept in a fine histogram so Weibull fits can be computed
+// after merging partials. The anemometer only reports multiples of
+// 1.73 mph / 5 s, so 0.1 mph bins lose nothing.
+inline constexpr float kFineBinMph = 0.1;
+inline constexpr int kFineBins = 1200;
+using SpeedHistogram = std::array<uint64_t, kFineBins>;
+
+// Samples further apart than this break a direction run.
+inline constexpr int64_t kMaxRunGapMs = 60'000;
+
+enum Season { kWinter, kSpring, kSummer, kAutumn };  // DJF, MAM, JJA, SON.
+
+struct Weibull {
+  double k;  // Shape.
+  double c;  // Scale, mph.
+};
+
+// Maximum-likelihood Weibull fit over non-calm speeds, with k at most 100.
+// Nullopt with fewer than two such speeds, or all of them in one bin.
+std::optional<Weibull> FitWeibull(const SpeedHistogram& speeds);
+
+// How long the vane stays in each sector. Runs that straddle partial
+// boundaries are stitched together by Merge().
+struct Persistence {
+  struct Run {
+    int sector = -1;
+    uint64_t samples = 0;
+    int64_t first_ms = 0;
+    int64_t last_ms = 0;
+  };
+
+  std::array<uint64_t, 16> runs = {};
+  std::array<uint64_t, 16> run_samples = {};
+  std::array<int64_t, 16> longest_ms = {};
+
+  void Add(const tsdb::Sample& s);
+  // Appends `later`, which must cover a later stretch of the same station.
+  void Merge(const Persistence& later);
+  // Closes the open runs at the ends of a station's history.
+  void Finish();
+
+ private:
+  void Close(const Run& run);
+  void Commit(const Run& run);
+
+  // The first run to end within this partial. It may continue a run from the
+  // previous partial, so it isn't committed until Merge() or Finish().
+  Run leading_;
+  bool leading_closed_ = false;
+  Run current_;
+};
+
+struct HourStats {
+  uint64_t samples = 0;
+  double speed_sum = 0;
+  std::array<uint64_t, 16> sectors = {};
+};
+
+struct SeasonStats {
+  uint64_t samples = 0;
+  double speed_sum = 0;
+  std::array<uint64_t, 16> sectors = {};
+  SpeedHistogram speeds = {};
+};
+
+// Order-independent survey statistics: partials can be accumulated per thread
+// and merged in any order. Direction persistence is kept separately because
+// it depends on sample order.
+struct WindStats {
+  uint64_t samples = 0;
+  double speed_sum = 0;
+  std::array<std::array<uint64_t, kRoseSpeedBins>, 16> rose = {};
+  std::array<SpeedHistogram, 16> sector_speeds = {};
+  std::array<HourStats, 24> hours = {};
+  std::array<SeasonStats, 4> seasons = {};
+
+  // `utc_offset_ms` shifts timestamps to local time for the hourly and
+  // seasonal breakdowns.
+  void Add(const tsdb::Sample& s, int64_t utc_offset_ms);
+  void Merge(const WindStats& other);
+};
+
+int RoseSpeedBin(float mph);
+
+}  // namespace analytics
@@ -0,0 +1,73 @@
+#include "api/cache.h"
+
+namespace api {
+namespace {
+
+int64_t Floor(int64_t t_ms, int64_t size_ms) {
+  return t_ms - ((t_ms % size_ms) + size_ms) % size_ms;
+}
+
+}  // namespace
+
+ResultCache::ShapeList::iterator ResultCache::Touch(
+    std::string_view station, int64_t bucket_ms) {
+  const auto s = by_station_.find(station);
+  if (s == by_station_.end()) return shapes_.end();
+  const auto shape = s->second.find(bucket_ms);
+  if (shape == s->second.end()) return shapes_.end();
+  shapes_.splice(shapes_.begin(), shapes_, shape->second);
+  return shape->second;
+}
+
+const query::Bucket* ResultCache::Find(
+    std::string_view station, int64_t bucket_ms, int64_t start_ms) {
+  const auto shape = Touch(station, bucket_ms);
+  if (shape != shapes_.end()) {
+    if (const auto b = shape->buckets.find(start_ms);
+        b != shape->buckets.end()) {
+      ++stats_.hits;
+      return &b->second;
+    }
+  }
+  ++stats_.misses;
+  return nullptr;
+}
+
+void ResultCache::Insert(
+    std::string_view station, int64_t bucket_ms, const query::Bucket& bucket) {
+  if (capacity_ == 0) return;
+  auto shape = Touch(station, bucket_ms);
+  if (shape == shapes_.end()) {
+    shapes_.push_front(
+        {.station = std::string(station), .bucket_ms = bucket_ms});
+    shape = shapes_.begin();
+    by_station_[shape->station][bucket_ms] = shape;
+  }
+  if (shape->buckets.insert_or_assign(bucket.start_ms, bucket).second) {
+    ++stats_.buckets;
+  }
+  while (stats_.buckets > capacity_) Evict();
+}
+
+void ResultCache::Invalidate(std::string_view station, int64_t t_ms) {
+  const auto s = by_station_.find(station);
+  if (s == by_station_.end()) return;
+  for (auto& [bucket_ms, shape] : s->second) {
+    if (shape->buckets.erase(Floor(t_ms, bucket_ms)) > 0) {
+      ++stats_.invalidated;
+      --stats_.buckets;
+    }
+  }
+}
+
+void ResultCache::Evict() {
+  Shape& shape = shapes_.back();
+  stats_.evicted += shape.buckets.size();
+  stats_.buckets -= shape.buckets.size();
+  const auto s = by_station_.find(shape.station);
+  s->second.erase(shape.bucket_ms);
+  if (s->second.empty()) by_station_.erase(s);
+  shapes_.pop_back();
+}
+
+}  // namespace api
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "query/aggregate.h"
+
+namespace api {
+
+struct CacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  // Buckets dropped because a sample landed in them, and to make room.
+  uint64_t invalidated = 0;
+  uint64_t evicted = 0;
+  uint64_t buckets = 0;
+};
+
+// Aggregate buckets already computed, by query shape (station and bucket
+// size) and bucket start. Buckets are aligned to the Unix epoch, so queries
+// over sliding windows of one shape share all but their ends. A new sample
+// drops only the buckets containing it, one per shape of its station; the
+// shape used least recently goes when the cache is full. Not thread-safe.
+class ResultCache {
+ public:
+  explicit ResultCache(size_t capacity_buckets) : capacity_(capacity_buckets) {}
+
+  // The bucket of `station` and `bucket_ms` starting at start_ms, or null.
+  const query::Bucket* Find(
+      std::string_view station, int64_t bucket_ms, int64_t start_ms);
+  void Insert(
+      std::string_view station, int64_t bucket_ms, const query::Bucket& bucket);
+  // Drops the buckets of `station` that contain t_ms.
+  void Invalidate(std::string_view station, int64_t t_ms);
+
+  const CacheStats& stats() const { return stats_; }
+
+ private:
+  struct Shape {
+    std::string station;
+    int64_t bucket_ms;
+    std::map<int64_t, query::Bucket> buckets;
+  };
+  using ShapeList = std::list<Shape>;
+  struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const {
+      return std::hash<std::string_view>()(s);
+    }
+  };
+
+  // The shape's entry, made most recently used, or end() if absent.
+  ShapeList::iterator Touch(std::string_view station, int64_t bucket_ms);
+  void Evict();
+
+  const size_t capacity_;
+  CacheStats stats_;
+  // Most recently used first.
+  ShapeList shapes_;
+  // Each station's shapes, by bucket size.
+  std::unordered_map<
+      std::string,
+      std::map<int64_t, ShapeList::iterator>,
+      StringHash,
+      std::equal_to<>>
+      by_station_;
+};
+
+}  // namespace api
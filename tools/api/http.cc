@@ -0,0 +1,339 @@
+#include "api/http.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+
+namespace api {
+namespace {
+
+// Requests whose headers run longer are refused.
+constexpr size_t kMaxHeaderBytes = 16 << 10;
+// Pieces of a response handed to one sendmsg().
+constexpr size_t kMaxIovecs = 64;
+
+std::string Errno(std::string_view what) {
+  return std::string(what) + ": " + std::strerror(errno);
+}
+
+const char* StatusText(int status) {
+  switch (status) {
+    case 200:
+      return "OK";
+    case 400:
+      return "Bad Request";
+    case 404:
+      return "Not Found";
+    case 405:
+      return "Method Not Allowed";
+    case 431:
+      return "Request Header Fields Too Large";
+    default:
+      return "Error";
+  }
+}
+
+bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+  return std::ranges::equal(
+      a, b, [](char x, char y) { return tolower(x) == tolower(y); });
+}
+
+// A response on its way out: the status line and headers, the body, then
+// the parts, sent up to `piece` and `offset` into it.
+struct Outgoing {
+  std::string head;
+  HttpResponse response;
+  size_t piece = 0;
+  size_t offset = 0;
+
+  size_t pieces() const { return 2 + response.parts.size(); }
+  std::span<const uint8_t> Piece(size_t i) const {
+    if (i == 0) {
+      return {reinterpret_cast<const uint8_t*>(head.data()), head.size()};
+    }
+    if (i == 1) {
+      return {
+          reinterpret_cast<const uint8_t*>(response.body.data()),
+          response.body.size()};
+    }
+    return response.parts[i - 2];
+  }
+};
+
+struct Connection {
+  std::string in;
+  std::deque<Outgoing> out;
+  // Closed once `out` is sent.
+  bool closing = false;
+};
+
+// Sends what the socket takes. Returns false if the connection failed.
+bool Flush(int fd, Connection& c) {
+  while (!c.out.empty()) {
+    Outgoing& o = c.out.front();
+    iovec iov[kMaxIovecs];
+    size_t n = 0;
+    for (size_t i = o.piece; i < o.pieces() && n < kMaxIovecs; ++i) {
+      std::span<const uint8_t> piece = o.Piece(i);
+      if (i == o.piece) piece = piece.subspan(o.offset);
+      if (piece.empty()) continue;
+      iov[n++] = {const_cast<uint8_t*>(piece.data()), piece.size()};
+    }
+    if (n > 0) {
+      // MSG_NOSIGNAL, so a client that reset the connection is an EPIPE
+      // rather than a SIGPIPE that kills the process.
+      msghdr msg{.msg_iov = iov, .msg_iovlen = n};
+      const ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+      if (sent < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+      }
+      size_t left = sent;
+      while (o.piece < o.pieces() &&
+             left >= o.Piece(o.piece).size() - o.offset) {
+        left -= o.Piece(o.piece).size() - o.offset;
+        ++o.piece;
+        o.offset = 0;
+      }
+      o.offset += left;
+    }
+    if (o.piece < o.pieces()) return true;
+    c.out.pop_front();
+  }
+  return true;
+}
+
+void Queue(Connection& c, HttpResponse response) {
+  size_t length = response.body.size();
+  for (const auto& part : response.parts) length += part.size();
+  char head[256];
+  snprintf(
+      head,
+      sizeof(head),
+      "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s\r\n",
+      response.status,
+      StatusText(response.status),
+      response.content_type.c_str(),
+      length,
+      c.closing ? "Connection: close\r\n" : "");
+  c.out.push_back({.head = head, .response = std::move(response)});
+}
+
+void QueueError(Connection& c, int status, std::string_view message) {
+  HttpResponse response{.status = status};
+  response.body = "{\"error\":\"" + std::string(message) + "\"}\n";
+  Queue(c, std::move(response));
+}
+
+}  // namespace
+
+std::optional<std::string_view> HttpRequest::Param(
+    std::string_view name) const {
+  std::string_view rest = query;
+  while (!rest.empty()) {
+    const size_t amp = rest.find('&');
+    const std::string_view pair = rest.substr(0, amp);
+    const size_t eq = pair.find('=');
+    if (pair.substr(0, eq) == name) {
+      return eq == std::string_view::npos ? std::string_view()
+                                          : pair.substr(eq + 1);
+    }
+    rest = amp == std::string_view::npos ? "" : rest.substr(amp + 1);
+  }
+  return std::nullopt;
+}
+
+HttpServer::HttpServer(HttpHandler handler) : handler_(std::move(handler)) {}
+
+HttpServer::~HttpServer() { Stop(); }
+
+std::expected<std::unique_ptr<HttpServer>, std::string> HttpServer::Start(
+    const std::string& host, int port, HttpHandler handler) {
+  std::unique_ptr<HttpServer> server(new HttpServer(std::move(handler)));
+  addrinfo hints{
+      .ai_flags = AI_PASSIVE,
+      .ai_family = AF_INET,
+      .ai_socktype = SOCK_STREAM,
+  };
+  addrinfo* addrs = nullptr;
+  if (const int rc = getaddrinfo(host.c_str(), nullptr, &hints, &addrs);
+      rc != 0) {
+    return std::unexpected(host + ": " + gai_strerror(rc));
+  }
+  sockaddr_in addr = *reinterpret_cast<const sockaddr_in*>(addrs->ai_addr);
+  freeaddrinfo(addrs);
+  addr.sin_port = htons(port);
+
+  const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (fd < 0) return std::unexpected(Errno("socket"));
+  const int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  socklen_t len = sizeof(addr);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+      listen(fd, 128) != 0 ||
+      getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+    const std::string error = Errno("listen");
+    close(fd);
+    return std::unexpected(error);
+  }
+  if (pipe(server->wake_fds_) != 0) {
+    close(fd);
+    return std::unexpected(Errno("pipe"));
+  }
+  server->listen_fd_ = fd;
+  server->port_ = ntohs(addr.sin_port);
+  server->thread_ = std::thread([s = server.get()] { s->Serve(); });
+  return server;
+}
+
+void HttpServer::Post(std::function<void()> task) {
+  {
+    std::lock_guard lock(mutex_);
+    posted_.push_back(std::move(task));
+  }
+  const char wake = 0;
+  (void)write(wake_fds_[1], &wake, 1);
+}
+
+void HttpServer::Stop() {
+  if (!thread_.joinable()) return;
+  stop_ = true;
+  const char wake = 0;
+  (void)write(wake_fds_[1], &wake, 1);
+  thread_.join();
+  close(wake_fds_[0]);
+  close(wake_fds_[1]);
+  close(listen_fd_);
+  listen_fd_ = -1;
+}
+
+void HttpServer::Serve() {
+  std::unordered_map<int, Connection> connections;
+  std::vector<std::function<void()>> tasks;
+
+  // Answers every complete request in c.in. One that can't be answered gets
+  // an error, and the connection is closed after it.
+  auto handle = [&](Connection& c) {
+    while (!c.closing) {
+      const size_t end = c.in.find("\r\n\r\n");
+      if (end == std::string::npos) {
+        if (c.in.size() <= kMaxHeaderBytes) return;
+        c.closing = true;
+        QueueError(c, 431, "headers too long");
+        return;
+      }
+      const std::string_view head = std::string_view(c.in).substr(0, end + 2);
+      const size_t line_end = head.find("\r\n");
+      const std::string_view line = head.substr(0, line_end);
+      const size_t sp1 = line.find(' ');
+      const size_t sp2 = line.rfind(' ');
+      if (sp1 == std::string_view::npos || sp2 <= sp1) {
+        c.closing = true;
+        QueueError(c, 400, "malformed request line");
+        return;
+      }
+      const std::string_view target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+      const size_t q = target.find('?');
+      HttpRequest request{
+          .method = line.substr(0, sp1),
+          .path = target.substr(0, q),
+          .query = q == std::string_view::npos ? "" : target.substr(q + 1),
+      };
+      bool keep_alive = line.substr(sp2 + 1) == "HTTP/1.1";
+      for (std::string_view rest = head.substr(line_end + 2); !rest.empty();) {
+        const size_t eol = rest.find("\r\n");
+        const std::string_view header = rest.substr(0, eol);
+        rest = rest.substr(eol + 2);
+        const size_t colon = header.find(':');
+        if (colon == std::string_view::npos) continue;
+        std::string_view value = header.substr(colon + 1);
+        while (value.starts_with(' ')) value.remove_prefix(1);
+        if (EqualsIgnoreCase(header.substr(0, colon), "connection")) {
+          keep_alive = EqualsIgnoreCase(value, "keep-alive");
+        }
+      }
+      ++requests_;
+      if (request.method != "GET") {
+        // Its body, if any, would be taken for the next request.
+        c.closing = true;
+        QueueError(c, 405, "only GET is supported");
+        return;
+      }
+      c.closing = !keep_alive;
+      HttpResponse response;
+      handler_(request, response);
+      Queue(c, std::move(response));
+      c.in.erase(0, end + 4);
+    }
+  };
+
+  while (!stop_) {
+    std::vector<pollfd> fds = {
+        {.fd = wake_fds_[0], .events = POLLIN},
+        {.fd = listen_fd_, .events = POLLIN},
+    };
+    for (const auto& [fd, c] : connections) {
+      short events = c.closing ? 0 : POLLIN;
+      if (!c.out.empty()) events |= POLLOUT;
+      fds.push_back({.fd = fd, .events = events});
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR) break;
+    if (fds[0].revents & POLLIN) {
+      char drain[256];
+      (void)read(wake_fds_[0], drain, sizeof(drain));
+      {
+        std::lock_guard lock(mutex_);
+        tasks.swap(posted_);
+      }
+      for (auto& task : tasks) task();
+      tasks.clear();
+    }
+    if (fds[1].revents & POLLIN) {
+      for (int fd;
+           (fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK)) >= 0;) {
+        // Responses are written whole, so Nagle would only hold back their
+        // tails.
+        const int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        connections[fd];
+      }
+    }
+
+    std::vector<int> closed;
+    for (size_t i = 2; i < fds.size(); ++i) {
+      if (!fds[i].revents) continue;
+      const int fd = fds[i].fd;
+      Connection& c = connections[fd];
+      bool ok = true;
+      if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+        char chunk[16 * 1024];
+        const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+          c.in.append(chunk, n);
+          handle(c);
+        } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+          ok = false;
+        }
+      }
+      ok = ok && Flush(fd, c);
+      if (!ok || (c.closing && c.out.empty())) closed.push_back(fd);
+    }
+    for (int fd : closed) {
+      close(fd);
+      connections.erase(fd);
+    }
+  }
+  for (const auto& [fd, c] : connections) close(fd);
+}
+
+}  // namespace api
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace api {
+
+struct HttpRequest {
+  std::string_view method;
+  std::string_view path;
+  std::string_view query;  // After the '?', not unescaped.
+
+  // The value of the first `name=value` in the query.
+  std::optional<std::string_view> Param(std::string_view name) const;
+};
+
+struct HttpResponse {
+  int status = 200;
+  std::string content_type = "application/json";
+  // The body is `body` followed by `parts`, which are sent from where they
+  // lie, without copying. Whatever they point into must stay alive until
+  // the response is sent, which `keep_alive` can see to.
+  std::string body;
+  std::vector<std::span<const uint8_t>> parts;
+  std::shared_ptr<const void> keep_alive;
+};
+
+// Called on the server thread for each request.
+using HttpHandler = std::function<void(const HttpRequest&, HttpResponse&)>;
+
+// A minimal HTTP/1.1 server for host tools: GET requests, keep-alive and
+// pipelining, served by one thread that polls every connection. Responses
+// go out with sendmsg() as the socket takes them.
+class HttpServer {
+ public:
+  // Listens on host:port, an ephemeral port if 0.
+  static std::expected<std::unique_ptr<HttpServer>, std::string> Start(
+      const std::string& host, int port, HttpHandler handler);
+  ~HttpServer();
+
+  HttpServer(const HttpServer&) = delete;
+  HttpServer& operator=(const HttpServer&) = delete;
+
+  int port() const { return port_; }
+  uint64_t requests() const { return requests_.load(); }
+
+  // Runs `task` on the server thread, between requests, so that it needn't
+  // synchronise with the handler.
+  void Post(std::function<void()> task);
+  // Closes the listener and every connection.
+  void Stop();
+
+ private:
+  explicit HttpServer(HttpHandler handler);
+
+  void Serve();
+
+  const HttpHandler handler_;
+  int port_ = 0;
+  int listen_fd_ = -1;
+  int wake_fds_[2] = {-1, -1};  // Post() and Stop() write to [1].
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+  std::atomic<uint64_t> requests_{0};
+
+  std::mutex mutex_;  // For posted_.
+  std::vector<std::function<void()>> posted_;
+};
+
+}  // namespace api
@@ -0,0 +1,325 @@
+#include "api/service.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "fleet/topics.h"
+#include "query/aggregate.h"
+
+namespace api {
+namespace {
+
+int64_t Floor(int64_t t_ms, int64_t size_ms) {
+  return t_ms - ((t_ms % size_ms) + size_ms) % size_ms;
+}
+
+std::optional<int64_t> ParseInt(std::optional<std::string_view> s) {
+  if (!s) return std::nullopt;
+  int64_t value;
+  const auto [end, ec] =
+      std::from_chars(s->data(), s->data() + s->size(), value);
+  if (ec != std::errc() || end != s->data() + s->size()) return std::nullopt;
+  return value;
+}
+
+// The query's [from, to), or nullopt if it names neither or is malformed.
+std::optional<std::pair<int64_t, int64_t>> Range(
+    const HttpRequest& request, int64_t now_ms) {
+  if (const auto last = ParseInt(request.Param("last"))) {
+    if (*last <= 0) return std::nullopt;
+    return std::pair(now_ms - *last, now_ms);
+  }
+  const auto from = ParseInt(request.Param("from"));
+  const auto to = ParseInt(request.Param("to"));
+  if (!from || !to || *to <= *from) return std::nullopt;
+  return std::pair(*from, *to);
+}
+
+// Station names become directory names and go into JSON unescaped.
+bool ValidStationName(std::string_view name) {
+  return !name.empty() && name != "." && name != ".." &&
+         std::ranges::all_of(name, [](char c) {
+           return isalnum(static_cast<unsigned char>(c)) || c == '_' ||
+                  c == '-' || c == '.';
+         });
+}
+
+void AppendBucket(const query::Bucket& b, std::string& out) {
+  char direction[16] = "null";
+  if (auto degrees = b.direction_mean_degrees()) {
+    snprintf(direction, sizeof(direction), "%.1f", *degrees);
+  }
+  char line[256];
+  const int n = snprintf(
+      line,
+      sizeof(line),
+      "{\"start_ms\":%" PRId64 ",\"count\":%" PRIu64
+      ",\"wind_mean_mph\":%.3f,\"wind_min_mph\":%.3f,\"wind_max_mph\":%.3f,"
+      "\"direction_deg\":%s,\"rain_ticks\":%" PRIu64 "}",
+      b.start_ms,
+      b.count,
+      b.wind_mean(),
+      b.wind_min,
+      b.wind_max,
+      direction,
+      b.rain_ticks);
+  out.append(line, n);
+}
+
+}  // namespace
+
+QueryService::QueryService(ServiceOptions options)
+    : options_(std::move(options)), cache_(options_.cache_buckets) {}
+
+std::expected<std::unique_ptr<QueryService>, std::string> QueryService::Open(
+    ServiceOptions options) {
+  std::unique_ptr<QueryService> service(new QueryService(std::move(options)));
+  const std::filesystem::path& dir = service->options_.dir;
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) return std::unexpected(dir.string() + ": " + ec.message());
+  for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+    const std::string name = entry.path().filename().string();
+    if (!entry.is_directory() || !ValidStationName(name)) continue;
+    auto store = tsdb::Store::Open(entry.path());
+    if (!store) return std::unexpected(store.error());
+    service->stations_[name].store = *std::move(store);
+  }
+  if (service->options_.compaction) {
+    std::vector<tsdb::Store*> stores;
+    for (auto& [name, station] : service->stations_) {
+      stores.push_back(station.store.get());
+    }
+    service->compactor_ = std::make_unique<tsdb::Compactor>(
+        std::move(stores), *service->options_.compaction);
+    service->compactor_->Start();
+  }
+  return service;
+}
+
+int64_t QueryService::NowMs() const {
+  if (options_.now_ms) return options_.now_ms();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+void QueryService::OnMessage(
+    int64_t t_ms, std::string_view topic, std::string_view payload) {
+  const auto state = fleet::ParseStateTopic(topic);
+  if (!state || !ValidStationName(state->station)) return;
+  const auto value = fleet::ParsePayload(state->sensor, payload);
+  if (!value) return;
+  ++stats_.readings;
+
+  auto it = stations_.find(state->station);
+  if (it == stations_.end()) {
+    auto store = tsdb::Store::Open(options_.dir / state->station);
+    if (!store) return;
+    it = stations_.emplace(std::string(state->station), Station{}).first;
+    it->second.store = *std::move(store);
+    if (compactor_) compactor_->AddStore(it->second.store.get());
+  }
+  Station& station = it->second;
+  switch (state->sensor) {
+    case fleet::Sensor::kWindDirection:
+      station.sector = static_cast<uint8_t>(*value);
+      return;
+    case fleet::Sensor::kRain:
+      station.rain_ticks += *value * options_.rain_period_ms / 3'600'000.0 /
+                            options_.rain_inches_per_tick;
+      return;
+    case fleet::Sensor::kWindSpeed:
+      break;
+  }
+  const double ticks = std::clamp(
+      std::floor(station.rain_ticks + 0.5),
+      0.0,
+      static_cast<double>(std::numeric_limits<uint16_t>::max()));
+  const tsdb::Sample sample{
+      .timestamp_ms = t_ms,
+      .wind_mph = *value,
+      .sector = station.sector,
+      .rain_ticks = static_cast<uint16_t>(ticks),
+  };
+  if (!station.store->Append(sample)) {
+    ++stats_.rejected;
+    return;
+  }
+  station.rain_ticks -= ticks;
+  ++stats_.samples;
+  cache_.Invalidate(it->first, t_ms);
+}
+
+std::optional<tsdb::CompactionStats> QueryService::compaction_stats() const {
+  if (!compactor_) return std::nullopt;
+  return compactor_->stats();
+}
+
+void QueryService::Flush() {
+  for (auto& [name, station] : stations_) (void)station.store->Flush();
+}
+
+void QueryService::Handle(const HttpRequest& request, HttpResponse& response) {
+  ++stats_.queries;
+  if (request.path == "/v1/stations") {
+    response.body = "{\"stations\":[";
+    for (const auto& [name, station] : stations_) {
+      if (response.body.back() != '[') response.body += ',';
+      response.body += '"' + name + '"';
+    }
+    response.body += "]}\n";
+    return;
+  }
+  if (request.path != "/v1/aggregate" && request.path != "/v1/blocks") {
+    response.status = 404;
+    response.body = "{\"error\":\"no such path\"}\n";
+    return;
+  }
+  const auto it = stations_.find(request.Param("station").value_or(""));
+  if (it == stations_.end()) {
+    response.status = 404;
+    response.body = "{\"error\":\"no such station\"}\n";
+    return;
+  }
+  if (request.path == "/v1/aggregate") {
+    Aggregate(request, *it->second.store, response);
+  } else {
+    Blocks(request, *it->second.store, response);
+  }
+}
+
+void QueryService::BadRequest(
+    std::string_view message, HttpResponse& response) {
+  ++stats_.bad_requests;
+  response.status = 400;
+  response.body = "{\"error\":\"" + std::string(message) + "\"}\n";
+}
+
+void QueryService::Aggregate(
+    const HttpRequest& request,
+    const tsdb::Store& store,
+    HttpResponse& response) {
+  const std::string_view station = *request.Param("station");
+  const auto bucket_ms = ParseInt(request.Param("bucket"));
+  const auto range = Range(request, NowMs());
+  if (!bucket_ms || *bucket_ms <= 0 || !range) {
+    return BadRequest("want bucket, and from and to or last", response);
+  }
+  const int64_t from = Floor(range->first, *bucket_ms);
+  const int64_t to = Floor(range->second - 1, *bucket_ms) + *bucket_ms;
+  const int64_t n = (to - from) / *bucket_ms;
+  if (n > options_.max_buckets) return BadRequest("too many buckets", response);
+  const bool cached =
+      options_.cache_buckets > 0 && request.Param("cache") != "0";
+
+  std::vector<query::Bucket> buckets(n);
+  std::vector<bool> found(n);
+  if (cached) {
+    for (int64_t i = 0; i < n; ++i) {
+      const int64_t start_ms = from + i * *bucket_ms;
+      if (const query::Bucket* b = cache_.Find(station, *bucket_ms, start_ms)) {
+        buckets[i] = *b;
+        found[i] = true;
+      }
+    }
+  }
+  // Each run of buckets the cache lacks takes one scan.
+  for (int64_t i = 0; i < n;) {
+    if (found[i]) {
+      ++i;
+      continue;
+    }
+    int64_t j = i + 1;
+    while (j < n && !found[j]) ++j;
+    const std::vector<query::Bucket> computed = query::Aggregate(
+        store, {from + i * *bucket_ms, from + j * *bucket_ms, *bucket_ms});
+    for (int64_t k = i; k < j; ++k) {
+      buckets[k] = computed[k - i];
+      if (cached) cache_.Insert(station, *bucket_ms, buckets[k]);
+    }
+    i = j;
+  }
+
+  std::string& out = response.body;
+  out.reserve(64 + n * 160);
+  char head[160];
+  out.append(
+      head,
+      snprintf(
+          head,
+          sizeof(head),
+          "{\"station\":\"%.*s\",\"bucket_ms\":%" PRId64 ",\"from_ms\":%" PRId64
+          ",\"to_ms\":%" PRId64 ",\"buckets\":[",
+          static_cast<int>(station.size()),
+          station.data(),
+          *bucket_ms,
+          from,
+          to));
+  for (int64_t i = 0; i < n; ++i) {
+    if (i > 0) out += ',';
+    AppendBucket(buckets[i], out);
+  }
+  out += "]}\n";
+}
+
+void QueryService::Blocks(
+    const HttpRequest& request,
+    const tsdb::Store& store,
+    HttpResponse& response) {
+  const auto range = Range(request, NowMs());
+  if (!range) return BadRequest("want from and to, or last", response);
+  const auto [from, to] = *range;
+  auto overlaps = [&](const tsdb::BlockIndex& b) {
+    return b.t_max >= from && b.t_min < to;
+  };
+  auto bytes = [](const auto& x) {
+    return std::span(reinterpret_cast<const uint8_t*>(&x), sizeof(x));
+  };
+
+  // Sealed blocks go out from the mapping, which the snapshot keeps alive;
+  // the head's change with the next append, so they're copied.
+  struct Held {
+    std::shared_ptr<const tsdb::SegmentList> segments;
+    std::vector<tsdb::BlockIndex> head_index;
+    std::vector<uint8_t> head_data;
+  };
+  auto held = std::make_shared<Held>();
+  held->segments = store.segments();
+  for (const auto& segment : *held->segments) {
+    if (segment->t_max() < from || segment->t_min() >= to) continue;
+    const auto index = segment->index();
+    for (size_t i = 0; i < index.size(); ++i) {
+      if (!overlaps(index[i])) continue;
+      response.parts.push_back(bytes(index[i]));
+      response.parts.push_back(segment->block(i));
+    }
+  }
+  store.ForEachHeadBlock(
+      from,
+      to - 1,
+      [&](const tsdb::BlockIndex& b, std::span<const uint8_t> block) {
+        tsdb::BlockIndex copy = b;
+        copy.offset = held->head_data.size();
+        held->head_index.push_back(copy);
+        held->head_data.insert(
+            held->head_data.end(), block.begin(), block.end());
+      });
+  for (const tsdb::BlockIndex& b : held->head_index) {
+    response.parts.push_back(bytes(b));
+    response.parts.push_back(
+        std::span(held->head_data).subspan(b.offset, b.length));
+  }
+  response.content_type = "application/octet-stream";
+  response.keep_alive = std::move(held);
+}
+
+}  // namespace api
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "api/cache.h"
+#include "api/http.h"
+#include "tsdb/compaction.h"
+#include "tsdb/store.h"
+
+namespace api {
+
+struct ServiceOptions {
+  // Holds a tsdb store per station, named after it.
+  std::filesystem::path dir;
+  // Buckets the result cache keeps; 0 turns it off.
+  size_t cache_buckets = 1 << 18;
+  // The most buckets one query may ask for.
+  int64_t max_buckets = 100'000;
+  // The station's rain report period and gauge, for turning its rain rates
+  // back into ticks.
+  int64_t rain_period_ms = 10 * 60'000;
+  double rain_inches_per_tick = 0.011;
+  // `last` windows end at this clock's now; the system clock if empty.
+  std::function<int64_t()> now_ms;
+  // Compacts every station's store in the background with these, stations
+  // added later included; nothing is compacted if empty.
+  std::optional<tsdb::CompactionOptions> compaction;
+};
+
+struct ServiceStats {
+  uint64_t readings = 0;
+  uint64_t samples = 0;
+  // Samples older than their station's latest, which its store refuses.
+  uint64_t rejected = 0;
+  uint64_t queries = 0;
+  uint64_t bad_requests = 0;
+};
+
+// Records the stations' state messages into a tsdb store each, and answers
+// range queries over them:
+//
+//   GET /v1/stations
+//   GET /v1/aggregate?station=S&bucket=MS&(from=MS&to=MS|last=MS)[&cache=0]
+//       Wind mean, min and max, mean direction and rain ticks per bucket, as
+//       JSON. Buckets are aligned to the Unix epoch; the range is widened to
+//       whole buckets.
+//   GET /v1/blocks?station=S&(from=MS&to=MS|last=MS)
+//       The encoded blocks overlapping the range, each as its 96-byte
+//       tsdb::BlockIndex followed by its bytes, sent from the mapped
+//       segments without copying.
+//
+// Each wind speed reading becomes a sample, with the vane's latest sector and
+// the rain reported since as gauge ticks; the sample drops the cached buckets
+// it lands in. Not thread-safe: everything runs on the HTTP server's thread
+// (see HttpServer::Post()), bar compaction, which has its own.
+class QueryService {
+ public:
+  // Opens the stores already under options.dir.
+  static std::expected<std::unique_ptr<QueryService>, std::string> Open(
+      ServiceOptions options);
+
+  void OnMessage(
+      int64_t t_ms, std::string_view topic, std::string_view payload);
+  void Handle(const HttpRequest& request, HttpResponse& response);
+  // Flushes the stores' head logs.
+  void Flush();
+
+  const ServiceStats& stats() const { return stats_; }
+  const CacheStats& cache_stats() const { return cache_.stats(); }
+  // Thread-safe; nullopt without options.compaction.
+  std::optional<tsdb::CompactionStats> compaction_stats() const;
+
+ private:
+  struct Station {
+    std::unique_ptr<tsdb::Store> store;
+    uint8_t sector = 0;
+    // Rain reported and not yet put on a sample.
+    double rain_ticks = 0;
+  };
+
+  explicit QueryService(ServiceOptions options);
+
+  int64_t NowMs() const;
+  void Aggregate(
+      const HttpRequest& request,
+      const tsdb::Store& store,
+      HttpResponse& response);
+  void Blocks(
+      const HttpRequest& request,
+      const tsdb::Store& store,
+      HttpResponse& response);
+  void BadRequest(std::string_view message, HttpResponse& response);
+
+  const ServiceOptions options_;
+  std::map<std::string, Station, std::less<>> stations_;
+  // Stopped before the stores it compacts are closed.
+  std::unique_ptr<tsdb::Compactor> compactor_;
+  ResultCache cache_;
+  ServiceStats stats_;
+};
+
+}  // namespace api
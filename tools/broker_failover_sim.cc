@@ -0,0 +1,363 @@
+// Runs the firmware's broker selection (src/broker_selector.h) against fake
+// brokers on localhost, connecting the way the station does: each attempt
+// in a thread of its own, reporting back to the one loop that owns the
+// selector and the connection.
+//
+//   broker_failover_sim
+//
+// The primary answers in 5 ms, the first fallback in 60 ms, and the second
+// fallback accepts connections but never answers. The primary goes down at
+// 1 s and comes back at 2.5 s. At 4.5 s the primary and the first fallback
+// both go down, so that failover takes no broker, and the fallback comes
+// back at 4.8 s. Unlike the station, which waits for the supervisor to
+// notice a dead connection, the loop here notices at once, so the outage is
+// the failover's alone; it never hears from the supervisor otherwise.
+// Exits non-zero if the station waited on the unresponsive broker, went
+// without checking in while an attempt on it ran, didn't fail over to the
+// working fallback, didn't return to the primary soon after it came back,
+// or didn't retry the fallback on its own once it was back.
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "broker_selector.h"
+#include "mqtt/client.h"
+#include "mqtt/fake_broker.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+
+constexpr BrokerSelector::Options kOptions = {
+    .max_parallel = 3,
+    .min_backoff_ms = 200,
+    .max_backoff_ms = 1'000,
+    .probe_interval_ms = 250,
+    .probes_to_return = 2,
+};
+constexpr auto kConnackTimeout = 500ms;
+constexpr uint32_t kPrimaryDownMs = 1'000;
+constexpr uint32_t kPrimaryUpMs = 2'500;
+constexpr uint32_t kBothDownMs = 4'500;
+constexpr uint32_t kFallbackUpMs = 4'800;
+constexpr uint32_t kEndMs = 7'000;
+// How long ConnectToBroker waits for a result before checking in.
+constexpr auto kCheckInWait = 50ms;
+
+struct Result {
+  size_t broker;
+  std::unique_ptr<mqtt::Client> client;  // Null on failure.
+  std::string error;
+  uint32_t latency_ms;
+};
+
+// What the firmware's connect-result queue does.
+class Results {
+ public:
+  void Push(Result result) {
+    {
+      std::lock_guard lock(mutex_);
+      results_.push_back(std::move(result));
+    }
+    ready_.notify_one();
+  }
+
+  std::optional<Result> Pop(std::chrono::milliseconds timeout) {
+    std::unique_lock lock(mutex_);
+    if (!ready_.wait_for(lock, timeout, [&] { return !results_.empty(); })) {
+      return std::nullopt;
+    }
+    Result result = std::move(results_.front());
+    results_.pop_front();
+    return result;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<Result> results_;
+};
+
+struct Switch {
+  uint32_t at_ms;
+  std::optional<size_t> broker;  // Nullopt for a lost connection.
+};
+
+// The network task's side: ConnectToBroker, TakeConnectResult and the main
+// loop's draining, probing and retrying, with its supervisor check-ins.
+class Station {
+ public:
+  explicit Station(std::vector<int> ports)
+      : ports_(std::move(ports)),
+        selector_(Hosts(ports_.size()), kOptions),
+        start_(std::chrono::steady_clock::now()) {}
+
+  ~Station() {
+    for (std::thread& t : attempts_) t.join();
+  }
+
+  uint32_t NowMs() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - start_)
+        .count();
+  }
+
+  void ConnectToBroker() {
+    for (size_t broker : selector_.Candidates(NowMs())) StartAttempt(broker);
+    max_parallel_ = std::max(max_parallel_, selector_.in_flight());
+    while (!selector_.current() && selector_.in_flight() > 0) {
+      if (auto result = results_.Pop(kCheckInWait)) Take(std::move(*result));
+      CheckIn();
+    }
+  }
+
+  // One pass of the main loop: takes finished attempts, probes the primary
+  // when due, retries a failover that took no broker, and fails over when
+  // the connection drops.
+  void Step() {
+    CheckIn();
+    while (auto result = results_.Pop(0ms)) Take(std::move(*result));
+    if (selector_.PrimaryProbeDue(NowMs())) StartAttempt(0);
+    if (selector_.RetryDue(NowMs())) {
+      ++retries_;
+      ConnectToBroker();
+    }
+    if (!client_) {
+      std::this_thread::sleep_for(10ms);
+      return;
+    }
+    if (auto polled = client_->Poll(10ms); !polled) {
+      client_.reset();
+      selector_.OnDisconnected(NowMs());
+      switches_.push_back({NowMs(), std::nullopt});
+      ConnectToBroker();
+    }
+  }
+
+  const BrokerSelector& selector() const { return selector_; }
+  const std::vector<Switch>& switches() const { return switches_; }
+  size_t max_parallel() const { return max_parallel_; }
+  uint32_t retries() const { return retries_; }
+  uint32_t max_check_in_gap_ms() const { return max_check_in_gap_ms_; }
+
+ private:
+  static std::vector<std::string> Hosts(size_t n) {
+    std::vector<std::string> hosts;
+    for (size_t i = 0; i < n; ++i) hosts.push_back("127.0.0.1");
+    return hosts;
+  }
+
+  void CheckIn() {
+    const uint32_t now_ms = NowMs();
+    max_check_in_gap_ms_ =
+        std::max(max_check_in_gap_ms_, now_ms - last_check_in_ms_);
+    last_check_in_ms_ = now_ms;
+  }
+
+  void StartAttempt(size_t broker) {
+    selector_.OnAttempt(broker, NowMs());
+    const mqtt::ConnectInfo info = {
+        .host = selector_.brokers()[broker].host,
+        .port = ports_[broker],
+        .client_id = "weatherstation",
+        .keepalive_secs = 5,
+        .connack_timeout = kConnackTimeout,
+    };
+    attempts_.emplace_back([this, broker, info] {
+      const auto start = std::chrono::steady_clock::now();
+      auto client = mqtt::Client::Connect(info);
+      const uint32_t latency_ms =
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::steady_clock::now() - start)
+              .count();
+      results_.Push({
+          .broker = broker,
+          .client = client ? std::move(*client) : nullptr,
+          .error = client ? "" : client.error(),
+          .latency_ms = latency_ms,
+      });
+    });
+  }
+
+  void Take(Result result) {
+    if (!selector_.OnResult(
+            result.broker, result.client != nullptr, result.latency_ms,
+            NowMs())) {
+      return;
+    }
+    client_ = std::move(result.client);
+    switches_.push_back({NowMs(), result.broker});
+  }
+
+  const std::vector<int> ports_;
+  BrokerSelector selector_;
+  const std::chrono::steady_clock::time_point start_;
+  Results results_;
+  std::vector<std::thread> attempts_;
+  std::unique_ptr<mqtt::Client> client_;
+  std::vector<Switch> switches_;
+  size_t max_parallel_ = 0;
+  uint32_t retries_ = 0;
+  uint32_t last_check_in_ms_ = 0;
+  uint32_t max_check_in_gap_ms_ = 0;
+};
+
+}  // namespace
+
+int main() {
+  auto primary = mqtt::FakeBroker::Start(5ms);
+  auto fallback = mqtt::FakeBroker::Start(60ms);
+  auto blackhole =
+      mqtt::FakeBroker::Start(0ms, mqtt::FakeBroker::Mode::kBlackhole);
+  for (auto* broker : {&primary, &fallback, &blackhole}) {
+    if (!*broker) {
+      fprintf(stderr, "fake broker: %s\n", broker->error().c_str());
+      return 1;
+    }
+  }
+
+  std::vector<Switch> switches;
+  std::vector<BrokerSelector::Broker> brokers;
+  size_t max_parallel;
+  uint32_t retries, max_check_in_gap_ms;
+  {
+    Station station(
+        {(*primary)->port(), (*fallback)->port(), (*blackhole)->port()});
+    auto restart = [](mqtt::FakeBroker& broker, const char* name) {
+      auto restarted = broker.Restart();
+      if (!restarted) {
+        fprintf(stderr, "%s restart: %s\n", name, restarted.error().c_str());
+      }
+      return restarted.has_value();
+    };
+    int event = 0;
+    while (station.NowMs() < kEndMs) {
+      const uint32_t now_ms = station.NowMs();
+      if (event == 0 && now_ms >= kPrimaryDownMs) {
+        (*primary)->Stop();
+        ++event;
+      } else if (event == 1 && now_ms >= kPrimaryUpMs) {
+        if (!restart(**primary, "primary")) return 1;
+        ++event;
+      } else if (event == 2 && now_ms >= kBothDownMs) {
+        (*primary)->Stop();
+        (*fallback)->Stop();
+        ++event;
+      } else if (event == 3 && now_ms >= kFallbackUpMs) {
+        if (!restart(**fallback, "fallback")) return 1;
+        ++event;
+      }
+      station.Step();
+    }
+    // Ends the attempts still waiting on it.
+    (*blackhole)->Stop();
+    switches = station.switches();
+    brokers = station.selector().brokers();
+    max_parallel = station.max_parallel();
+    retries = station.retries();
+    max_check_in_gap_ms = station.max_check_in_gap_ms();
+  }
+
+  const char* kNames[] = {"primary", "fallback", "silent fallback"};
+  for (const Switch& s : switches) {
+    printf(
+        "%5" PRIu32 " ms  %s\n",
+        s.at_ms,
+        s.broker ? kNames[*s.broker] : "connection lost");
+  }
+  for (size_t i = 0; i < brokers.size(); ++i) {
+    const BrokerSelector::Broker& b = brokers[i];
+    printf(
+        "%-15s score %.2f, %3" PRIu32 " attempts, %3" PRIu32
+        " failures, %" PRIu32 " drops, connect %.1f ms mean, %" PRIu32
+        " ms max\n",
+        kNames[i],
+        b.score,
+        b.attempts,
+        b.failures,
+        b.drops,
+        b.mean_latency_ms,
+        b.max_latency_ms);
+  }
+
+  bool ok = true;
+  auto expect = [&](bool condition, const char* what) {
+    if (!condition) {
+      fprintf(stderr, "%s\n", what);
+      ok = false;
+    }
+  };
+  // Connected to the primary, lost it, failed over to the fallback, came
+  // back to the primary, lost both, and got the fallback once it was back.
+  expect(
+      switches.size() == 6 && switches[0].broker == 0 &&
+          !switches[1].broker && switches[2].broker == 1 &&
+          switches[3].broker == 0 && !switches[4].broker &&
+          switches[5].broker == 1,
+      "expected primary, lost, fallback, primary, lost, fallback");
+  if (switches.size() == 6) {
+    const uint32_t outage_ms = switches[2].at_ms - switches[1].at_ms;
+    const uint32_t return_ms = switches[3].at_ms - kPrimaryUpMs;
+    printf(
+        "first connect %" PRIu32 " ms, failover outage %" PRIu32
+        " ms (%" PRIu32 " ms on the primary alone), back on the primary %"
+        PRIu32 " ms after it came up\n",
+        switches[0].at_ms,
+        outage_ms,
+        kPrimaryUpMs - switches[1].at_ms,
+        return_ms);
+    // The silent broker, raced alongside, must not hold either up.
+    expect(
+        switches[0].at_ms < kConnackTimeout.count() / 2,
+        "the first connect waited on the silent broker");
+    expect(
+        outage_ms < kConnackTimeout.count() / 2,
+        "the failover waited on the silent broker");
+    const uint32_t probing_ms =
+        kOptions.probes_to_return * kOptions.probe_interval_ms;
+    expect(
+        return_ms <= kOptions.max_backoff_ms + probing_ms + 250,
+        "took too long to return to the primary");
+    // Nothing but the retry loop brings the station back after the failover
+    // that found both down, once the fallback's backoff allows.
+    const uint32_t retried_ms = switches[5].at_ms - kFallbackUpMs;
+    printf(
+        "back on the fallback %" PRIu32 " ms after it came up, %" PRIu32
+        " failovers retried in all\n",
+        retried_ms,
+        retries);
+    expect(
+        retried_ms <= kOptions.max_backoff_ms + kConnackTimeout.count() + 250,
+        "didn't retry the fallback soon after it came back");
+  }
+  printf(
+      "longest between network task check-ins %" PRIu32 " ms\n",
+      max_check_in_gap_ms);
+  expect(
+      max_check_in_gap_ms < kConnackTimeout.count() / 2,
+      "stopped checking in while waiting on the silent broker");
+  // Retries wait out the brokers' backoffs rather than spinning.
+  expect(
+      retries <= 2 + (kEndMs - kBothDownMs) / kOptions.min_backoff_ms,
+      "retried failovers faster than the brokers' backoff");
+  expect(max_parallel >= 2, "attempts weren't raced");
+  expect(
+      brokers[2].successes == 0 && brokers[2].failures > 0,
+      "the silent broker should only have failed");
+  expect(
+      brokers[0].mean_latency_ms < brokers[1].mean_latency_ms &&
+          brokers[1].mean_latency_ms >= 60,
+      "connect latencies don't match the brokers'");
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
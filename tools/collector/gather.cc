@@ -0,0 +1,162 @@
+#include "collector/gather.h"
+
+#include <algorithm>
+#include <random>
+#include <set>
+
+#include "collector/wire.h"
+
+namespace collector {
+namespace {
+
+constexpr auto kListen = std::chrono::milliseconds(600);
+constexpr int kAttempts = 5;
+
+struct Reply {
+  std::string status;
+  std::vector<std::string> tags;
+  std::string rows;
+};
+
+// Collects heartbeats for kListen: the nodes that will answer.
+std::expected<std::set<std::string>, std::string> LiveNodes(
+    mqtt::Client& client, std::string_view control) {
+  std::set<std::string> nodes;
+  const std::string prefix = std::string(control) + "/members/";
+  const auto until = std::chrono::steady_clock::now() + kListen;
+  while (true) {
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        until - std::chrono::steady_clock::now());
+    if (left.count() <= 0) return nodes;
+    auto message = client.Poll(left);
+    if (!message) return std::unexpected(message.error());
+    if (!*message || !(*message)->topic.starts_with(prefix)) continue;
+    const std::string node = (*message)->topic.substr(prefix.size());
+    if ((*message)->payload.starts_with("gone")) {
+      nodes.erase(node);
+    } else {
+      nodes.insert(node);
+    }
+  }
+}
+
+}  // namespace
+
+std::expected<GatherResult, std::string> Gather(
+    mqtt::Client& client, std::string_view control, const GatherQuery& query,
+    std::chrono::milliseconds timeout) {
+  if (query.bucket_ms <= 0 || query.t_end < query.t_begin) {
+    return std::unexpected("bad range");
+  }
+  const std::string members = std::string(control) + "/members/+";
+  if (auto ok = client.Subscribe(members); !ok) {
+    return std::unexpected(ok.error());
+  }
+
+  std::mt19937_64 rng(std::random_device{}());
+  GatherResult result;
+  for (result.attempts = 1; result.attempts <= kAttempts; ++result.attempts) {
+    auto nodes = LiveNodes(client, control);
+    if (!nodes) return std::unexpected(nodes.error());
+
+    const std::string id = std::to_string(rng());
+    const std::string reply_topic = std::string(control) + "/reply/" + id;
+    if (auto ok = client.Subscribe(reply_topic); !ok) {
+      return std::unexpected(ok.error());
+    }
+    const std::string request =
+        query.station + " " + std::to_string(query.t_begin) + " " +
+        std::to_string(query.t_end) + " " + std::to_string(query.bucket_ms);
+    const std::string query_topic = std::string(control) + "/query/" + id;
+    if (auto ok = client.Publish(query_topic, request); !ok) {
+      return std::unexpected(ok.error());
+    }
+
+    std::map<std::string, Reply> replies;
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!std::ranges::all_of(
+        *nodes, [&](const std::string& n) { return replies.contains(n); })) {
+      const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      if (left.count() <= 0) break;
+      auto message = client.Poll(left);
+      if (!message) return std::unexpected(message.error());
+      if (!*message || (*message)->topic != reply_topic) continue;
+      std::string_view payload = (*message)->payload;
+      const size_t newline = payload.find('\n');
+      std::string_view header = payload.substr(0, newline);
+      Reply reply;
+      const size_t space = header.find(' ');
+      const std::string node(header.substr(0, space));
+      header = space == std::string_view::npos ? "" : header.substr(space + 1);
+      reply.status = header.substr(0, header.find(' '));
+      if (const size_t tags = header.find(' ');
+          tags != std::string_view::npos) {
+        std::string_view rest = header.substr(tags + 1);
+        while (!rest.empty()) {
+          const size_t comma = rest.find(',');
+          if (comma != 0) reply.tags.emplace_back(rest.substr(0, comma));
+          rest = comma == std::string_view::npos ? "" : rest.substr(comma + 1);
+        }
+      }
+      if (newline != std::string_view::npos) {
+        reply.rows = payload.substr(newline + 1);
+      }
+      replies[node] = std::move(reply);
+    }
+    (void)client.Unsubscribe(reply_topic);
+
+    std::set<std::string> taken;
+    for (const auto& [node, reply] : replies) {
+      if (reply.status == "error") {
+        return std::unexpected(node + " refused the query");
+      }
+      if (reply.status == "ok") {
+        taken.insert(reply.tags.begin(), reply.tags.end());
+      }
+    }
+    // A node that has handed off answers with nothing: its rows must have
+    // reached a node that answered, or this reply is missing them.
+    const bool complete = std::ranges::all_of(replies, [&](const auto& r) {
+      return r.second.status != "handed-off" ||
+             std::ranges::all_of(r.second.tags, [&](const std::string& tag) {
+               return taken.contains(tag);
+             });
+    });
+    if (!complete) continue;
+
+    const int64_t n =
+        (query.t_end - query.t_begin + query.bucket_ms - 1) / query.bucket_ms;
+    result.stations.clear();
+    result.nodes.clear();
+    for (const auto& [node, reply] : replies) {
+      result.nodes.push_back(node);
+      ForEachLine(reply.rows, [&](std::string_view line) {
+        auto row = ParseRow(line);
+        if (!row || row->second.start_ms < query.t_begin ||
+            row->second.start_ms >= query.t_end) {
+          return;
+        }
+        auto [it, added] = result.stations.try_emplace(row->first);
+        if (added) {
+          it->second.resize(n);
+          for (int64_t i = 0; i < n; ++i) {
+            it->second[i].start_ms = query.t_begin + i * query.bucket_ms;
+          }
+        }
+        const int64_t i =
+            (row->second.start_ms - query.t_begin) / query.bucket_ms;
+        it->second[i].Merge(row->second);
+      });
+    }
+    for (const std::string& node : *nodes) {
+      if (!replies.contains(node)) {
+        return std::unexpected(node + " didn't answer");
+      }
+    }
+    return result;
+  }
+  return std::unexpected("a handoff didn't complete");
+}
+
+}  // namespace collector
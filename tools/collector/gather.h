@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mqtt/client.h"
+#include "rollup/rollup.h"
+
+namespace collector {
+
+struct GatherQuery {
+  std::string station = "*";  // Or every station.
+  int64_t t_begin;            // Inclusive, ms, a whole minute.
+  int64_t t_end;              // Exclusive, ms, a whole minute.
+  int64_t bucket_ms;          // Whole minutes.
+};
+
+struct GatherResult {
+  // One bucket per bucket_ms step for every station any node holds, merged
+  // over the nodes' shares.
+  std::map<std::string, std::vector<rollup::Rollup>> stations;
+  std::vector<std::string> nodes;  // That answered.
+  int attempts = 0;
+};
+
+// Scatter-gather over a collector fleet: learns the live nodes from their
+// heartbeats, publishes the query, and merges the replies of all of them.
+// Asks again if a node has handed off rows that no node reports having taken
+// yet. `client` should be the caller's alone while this runs.
+std::expected<GatherResult, std::string> Gather(
+    mqtt::Client& client, std::string_view control, const GatherQuery& query,
+    std::chrono::milliseconds timeout = std::chrono::seconds(5));
+
+}  // namespace collector
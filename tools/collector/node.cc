@@ -0,0 +1,368 @@
+#include "collector/node.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+#include "collector/wire.h"
+#include "fleet/topics.h"
+
+namespace collector {
+namespace {
+
+constexpr int64_t kRefreshMs = 1'000;
+constexpr fleet::Sensor kSensors[] = {
+    fleet::Sensor::kWindDirection,
+    fleet::Sensor::kWindSpeed,
+    fleet::Sensor::kRain,
+};
+
+// Splits off the text before the first `sep`.
+std::string_view Next(std::string_view& s, char sep) {
+  const size_t at = s.find(sep);
+  const std::string_view head = s.substr(0, at);
+  s = at == std::string_view::npos ? std::string_view() : s.substr(at + 1);
+  return head;
+}
+
+}  // namespace
+
+const char* CollectorNode::StateName(State state) {
+  switch (state) {
+    case State::kUp:
+      return "up";
+    case State::kLeaving:
+      return "leaving";
+    case State::kHandedOff:
+      return "handed-off";
+    case State::kGone:
+      return "gone";
+  }
+  return "?";
+}
+
+CollectorNode::CollectorNode(
+    NodeOptions options, std::vector<std::string> stations,
+    Transport& transport)
+    : options_(std::move(options)),
+      stations_(std::move(stations)),
+      transport_(transport),
+      store_(options_.rollup) {}
+
+std::string CollectorNode::Topic(
+    std::string_view kind, std::string_view a, std::string_view b) const {
+  std::string topic = options_.control;
+  for (std::string_view part : {kind, a, b}) {
+    if (part.empty()) break;
+    topic += '/';
+    topic += part;
+  }
+  return topic;
+}
+
+void CollectorNode::Start(int64_t now_ms) {
+  members_[options_.id] = {State::kUp, now_ms};
+  transport_.Subscribe(Topic("members", "+"));
+  transport_.Subscribe(Topic("epoch"));
+  transport_.Subscribe(Topic("query", "+"));
+  transport_.Subscribe(Topic("handoff", options_.id, "+"));
+  transport_.Subscribe(Topic("handoff-ack", options_.id, "+"));
+  Heartbeat();
+  next_heartbeat_ms_ = now_ms + options_.heartbeat_ms;
+  next_refresh_ms_ = now_ms + kRefreshMs;
+  listen_until_ms_ = now_ms + 2 * options_.heartbeat_ms;
+}
+
+void CollectorNode::OnMessage(
+    int64_t now_ms, std::string_view topic, std::string_view payload) {
+  if (topic.starts_with(options_.control) &&
+      topic.substr(options_.control.size()).starts_with('/')) {
+    std::string_view rest = topic.substr(options_.control.size() + 1);
+    const std::string_view kind = Next(rest, '/');
+    if (kind == "epoch") {
+      OnEpoch(now_ms, payload);
+    } else if (kind == "members") {
+      OnHeartbeat(now_ms, rest, payload);
+    } else if (kind == "query") {
+      OnQuery(rest, payload);
+    } else if (kind == "handoff" && Next(rest, '/') == options_.id) {
+      OnHandoff(rest, payload);
+    } else if (kind == "handoff-ack" && Next(rest, '/') == options_.id) {
+      if (auto it = unacked_.find(rest); it != unacked_.end()) {
+        unacked_.erase(it);
+      }
+      if (state_ == State::kHandedOff && unacked_.empty()) {
+        state_ = State::kGone;
+        Heartbeat();
+      }
+    }
+    return;
+  }
+
+  const auto state = fleet::ParseStateTopic(topic);
+  if (!state) return;
+  const std::string* owner = ring_.Owner(state->station);
+  if (state_ == State::kHandedOff || state_ == State::kGone || !owner ||
+      *owner != options_.id) {
+    ++stats_.foreign;
+    return;
+  }
+  const auto value = fleet::ParsePayload(state->sensor, payload);
+  if (!value) return;
+  // Readings are stamped on arrival, and two of a station's in the same
+  // millisecond are two readings, not a redelivery the store should drop.
+  auto last = last_reading_ms_.find(state->station);
+  if (last == last_reading_ms_.end()) {
+    last = last_reading_ms_.emplace(std::string(state->station), INT64_MIN)
+               .first;
+  }
+  last->second = std::max(now_ms, last->second + 1);
+  store_.OnReading(last->second, state->station, state->sensor, *value);
+  ++stats_.readings;
+}
+
+void CollectorNode::OnEpoch(int64_t now_ms, std::string_view payload) {
+  const uint64_t epoch =
+      strtoull(std::string(Next(payload, ' ')).c_str(), nullptr, 10);
+  if (epoch <= epoch_) return;
+  std::vector<std::string> nodes;
+  while (!payload.empty()) nodes.emplace_back(Next(payload, ' '));
+  epoch_ = epoch;
+  known_epoch_ = std::max(known_epoch_, epoch);
+  ring_ = HashRing(std::move(nodes));
+  ++stats_.epochs;
+  UpdateSubscriptions();
+  if (state_ == State::kLeaving &&
+      !std::ranges::binary_search(ring_.nodes(), options_.id)) {
+    HandOff(now_ms);
+  }
+}
+
+void CollectorNode::OnHeartbeat(
+    int64_t now_ms, std::string_view node, std::string_view payload) {
+  if (node == options_.id) return;
+  const std::string_view state_name = Next(payload, ' ');
+  const uint64_t epoch =
+      strtoull(std::string(Next(payload, ' ')).c_str(), nullptr, 10);
+  known_epoch_ = std::max(known_epoch_, epoch);
+  for (State state :
+       {State::kUp, State::kLeaving, State::kHandedOff, State::kGone}) {
+    if (state_name != StateName(state)) continue;
+    auto it = members_.find(node);
+    if (state == State::kGone) {
+      if (it != members_.end()) members_.erase(it);
+    } else if (it == members_.end()) {
+      members_.emplace(std::string(node), Member{state, now_ms});
+    } else {
+      it->second = {state, now_ms};
+    }
+  }
+}
+
+void CollectorNode::OnHandoff(std::string_view from, std::string_view payload) {
+  // The first line tags the handoff "NODE@EPOCH", so that a retry isn't
+  // imported twice.
+  const std::string_view tag = Next(payload, '\n');
+  if (!taken_.contains(tag)) {
+    ForEachLine(payload, [&](std::string_view line) {
+      if (auto row = ParseRow(line)) {
+        store_.Import(row->first, row->second);
+        ++stats_.rows_taken_over;
+      }
+    });
+    taken_.emplace(tag);
+  }
+  transport_.Publish(Topic("handoff-ack", from, options_.id), "");
+}
+
+void CollectorNode::OnQuery(std::string_view id, std::string_view payload) {
+  ++stats_.queries;
+  const std::string station(Next(payload, ' '));
+  int64_t bounds[3] = {};
+  for (int64_t& b : bounds) {
+    b = strtoll(std::string(Next(payload, ' ')).c_str(), nullptr, 10);
+  }
+
+  std::string reply = options_.id;
+  if (state_ == State::kHandedOff || state_ == State::kGone) {
+    reply += " handed-off " + handoff_tag_ + "\n";
+    transport_.Publish(Topic("reply", id), reply);
+    return;
+  }
+  store_.Refresh();
+  std::string rows;
+  bool ok = true;
+  std::vector<std::string> stations = {station};
+  if (station == "*") stations = store_.stations();
+  for (const std::string& s : stations) {
+    const auto buckets = store_.Query(s, bounds[0], bounds[1], bounds[2]);
+    if (!buckets) {
+      ok = false;
+      break;
+    }
+    for (const rollup::Rollup& r : *buckets) {
+      if (!r.empty()) AppendRow(rows, s, r);
+    }
+  }
+  if (!ok) {
+    transport_.Publish(Topic("reply", id), reply + " error\n");
+    return;
+  }
+  reply += " ok ";
+  for (const std::string& tag : taken_) reply += tag + ",";
+  reply += "\n";
+  transport_.Publish(Topic("reply", id), reply + rows);
+}
+
+void CollectorNode::Heartbeat() {
+  char payload[64];
+  snprintf(
+      payload,
+      sizeof(payload),
+      "%s %" PRIu64 " %" PRIu64,
+      StateName(state_),
+      epoch_,
+      stats_.readings);
+  transport_.Publish(Topic("members", options_.id), payload);
+}
+
+std::vector<std::string> CollectorNode::LiveView(int64_t now_ms) const {
+  std::vector<std::string> view;
+  for (const auto& [node, m] : members_) {
+    const bool live =
+        node == options_.id
+            ? state_ == State::kUp
+            : m.state == State::kUp &&
+                  now_ms - m.heard_ms <= options_.member_timeout_ms;
+    if (live) view.push_back(node);
+  }
+  return view;
+}
+
+void CollectorNode::Tick(int64_t now_ms) {
+  if (now_ms < next_tick_ms_ || state_ == State::kGone) return;
+  next_tick_ms_ = now_ms + options_.heartbeat_ms / 5;
+  if (now_ms >= next_heartbeat_ms_) {
+    Heartbeat();
+    next_heartbeat_ms_ = now_ms + options_.heartbeat_ms;
+  }
+  if (now_ms >= next_refresh_ms_) {
+    store_.Refresh();
+    next_refresh_ms_ = now_ms + kRefreshMs;
+  }
+  std::erase_if(members_, [&](const auto& m) {
+    return m.first != options_.id &&
+           now_ms - m.second.heard_ms > 10 * options_.member_timeout_ms;
+  });
+  if (now_ms < listen_until_ms_) return;
+
+  if (std::vector<std::string> view = LiveView(now_ms); view != view_) {
+    view_ = std::move(view);
+    view_since_ms_ = now_ms;
+    UpdateSubscriptions();
+  }
+  if (state_ == State::kLeaving && view_.empty()) {
+    // The last node: there is no one to hand off to.
+    HandOff(now_ms);
+    return;
+  }
+  const bool coordinator = !view_.empty() && view_.front() == options_.id;
+  if (coordinator && view_ != ring_.nodes() &&
+      now_ms - view_since_ms_ >= options_.settle_ms &&
+      (proposed_epoch_ <= epoch_ ||
+       now_ms - proposed_ms_ >= options_.settle_ms)) {
+    proposed_epoch_ = std::max(epoch_, known_epoch_) + 1;
+    proposed_ms_ = now_ms;
+    std::string payload = std::to_string(proposed_epoch_);
+    for (const std::string& node : view_) payload += " " + node;
+    transport_.Publish(Topic("epoch"), payload);
+  }
+
+  if (state_ == State::kHandedOff && now_ms >= next_handoff_ms_) {
+    // A new owner that has itself gone, or timed out, will never answer.
+    std::erase_if(unacked_, [&](const auto& u) {
+      return !members_.contains(u.first);
+    });
+    if (unacked_.empty()) {
+      state_ = State::kGone;
+      Heartbeat();
+      return;
+    }
+    for (const auto& [owner, rows] : unacked_) {
+      transport_.Publish(Topic("handoff", owner, options_.id), rows);
+    }
+    next_handoff_ms_ = now_ms + options_.handoff_retry_ms;
+  }
+}
+
+void CollectorNode::UpdateSubscriptions() {
+  std::set<std::string, std::less<>> wanted;
+  if (state_ == State::kUp || state_ == State::kLeaving) {
+    // The stations owned now, and those the next epoch will bring if the
+    // membership holds.
+    const HashRing next(
+        state_ == State::kUp ? view_ : std::vector<std::string>());
+    for (const std::string& station : stations_) {
+      const std::string* now_owner = ring_.Owner(station);
+      const std::string* next_owner = next.Owner(station);
+      if ((now_owner && *now_owner == options_.id) ||
+          (next_owner && *next_owner == options_.id)) {
+        wanted.insert(station);
+      }
+    }
+  }
+  for (const std::string& station : wanted) {
+    if (subscribed_.contains(station)) continue;
+    for (fleet::Sensor sensor : kSensors) {
+      transport_.Subscribe(
+          fleet::StateTopicFor(options_.prefix, station, sensor));
+    }
+  }
+  for (const std::string& station : subscribed_) {
+    if (wanted.contains(station)) continue;
+    for (fleet::Sensor sensor : kSensors) {
+      transport_.Unsubscribe(
+          fleet::StateTopicFor(options_.prefix, station, sensor));
+    }
+  }
+  subscribed_ = std::move(wanted);
+  stats_.subscribed_stations = subscribed_.size();
+}
+
+void CollectorNode::Leave(int64_t now_ms) {
+  if (state_ != State::kUp) return;
+  state_ = State::kLeaving;
+  members_[options_.id].state = state_;
+  Heartbeat();
+  if (!std::ranges::binary_search(ring_.nodes(), options_.id)) {
+    HandOff(now_ms);
+  } else {
+    UpdateSubscriptions();
+  }
+}
+
+void CollectorNode::HandOff(int64_t now_ms) {
+  state_ = State::kHandedOff;
+  UpdateSubscriptions();
+  store_.Refresh();
+  handoff_tag_ = options_.id + "@" + std::to_string(epoch_);
+  for (const std::string& station : store_.stations()) {
+    const std::string* owner = ring_.Owner(station);
+    if (!owner || *owner == options_.id) continue;
+    std::string& rows = unacked_[*owner];
+    if (rows.empty()) rows = handoff_tag_ + "\n";
+    for (const rollup::Rollup& r :
+         store_.Rows(station, rollup::Level::kMinute, INT64_MIN, INT64_MAX)) {
+      AppendRow(rows, station, r);
+      ++stats_.rows_handed_off;
+    }
+  }
+  for (const auto& [owner, rows] : unacked_) {
+    transport_.Publish(Topic("handoff", owner, options_.id), rows);
+  }
+  next_handoff_ms_ = now_ms + options_.handoff_retry_ms;
+  if (unacked_.empty()) state_ = State::kGone;
+  Heartbeat();
+}
+
+}  // namespace collector
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "collector/ring.h"
+#include "rollup/rollup.h"
+
+namespace collector {
+
+// What a node needs of its broker connection.
+class Transport {
+ public:
+  virtual ~Transport() = default;
+  virtual void Subscribe(std::string_view filter) = 0;
+  virtual void Unsubscribe(std::string_view filter) = 0;
+  virtual void Publish(std::string_view topic, std::string_view payload) = 0;
+};
+
+struct NodeOptions {
+  std::string id;
+  // Control topics live under this (see collector/wire.h).
+  std::string control = "collectors";
+  // The stations' discovery prefix.
+  std::string prefix = "homeassistant";
+  int64_t heartbeat_ms = 250;
+  // A node not heard from for this long has gone without handing off, and
+  // what it held is lost.
+  int64_t member_timeout_ms = 2'000;
+  // The coordinator publishes a new epoch once the live membership has held
+  // this long, by when every node has heard of the change and subscribed to
+  // the stations it will take.
+  int64_t settle_ms = 1'000;
+  int64_t handoff_retry_ms = 1'000;
+  rollup::RollupOptions rollup;
+};
+
+struct NodeStats {
+  // Readings of stations the node owned when they arrived, and of stations
+  // it was subscribed to but didn't, as around an epoch.
+  uint64_t readings = 0;
+  uint64_t foreign = 0;
+  uint64_t subscribed_stations = 0;
+  uint64_t epochs = 0;
+  uint64_t queries = 0;
+  uint64_t rows_handed_off = 0;
+  uint64_t rows_taken_over = 0;
+};
+
+// One collector of a fleet that shards station ingest by consistent hashing
+// of station ids. Each node subscribes to just the state topics of the
+// stations it owns, and keeps their rollups.
+//
+// Ownership changes at epochs: the coordinator, the live node with the
+// lowest id, publishes the new ring on the epoch topic, and every node
+// switches as that message reaches it. On a broker that delivers messages
+// to every subscriber in the same order, as single-threaded mosquitto and
+// mqtt::FakeBroker do, the old and new owners of a station split its
+// readings exactly at the epoch, with none lost or taken twice, given that
+// the new owner subscribed before the epoch was published. MQTT promises
+// no such thing: order holds only per topic from one publisher, and the
+// epoch and the readings come from different publishers on different
+// topics. A broker that reorders them may have a reading near an epoch
+// counted by both owners or by neither. A node that leaves hands its
+// rollups to the stations' new owners before it exits. A node that joins
+// takes only new readings: the old owners keep the history, and queries
+// gather every node's share.
+class CollectorNode {
+ public:
+  CollectorNode(
+      NodeOptions options, std::vector<std::string> stations,
+      Transport& transport);
+
+  // Subscribes to the control topics and announces the node. It owns
+  // nothing until an epoch includes it.
+  void Start(int64_t now_ms);
+  void OnMessage(
+      int64_t now_ms, std::string_view topic, std::string_view payload);
+  // Heartbeats, membership timeouts, subscription changes, the coordinator's
+  // epochs and handoff retries. Call at least every heartbeat_ms / 5.
+  void Tick(int64_t now_ms);
+
+  // Asks to leave. done() once an epoch without the node has reached it and
+  // the new owners have taken its rollups.
+  void Leave(int64_t now_ms);
+  bool done() const { return state_ == State::kGone; }
+
+  const NodeStats& stats() const { return stats_; }
+  uint64_t epoch() const { return epoch_; }
+  const HashRing& ring() const { return ring_; }
+  const rollup::RollupStore& store() const { return store_; }
+
+ private:
+  enum class State { kUp, kLeaving, kHandedOff, kGone };
+  static const char* StateName(State state);
+
+  struct Member {
+    State state;
+    int64_t heard_ms;
+  };
+
+  void OnEpoch(int64_t now_ms, std::string_view payload);
+  void OnHeartbeat(
+      int64_t now_ms, std::string_view node, std::string_view payload);
+  void OnHandoff(std::string_view from, std::string_view payload);
+  void OnQuery(std::string_view id, std::string_view payload);
+  void Heartbeat();
+  // The nodes that should own stations: those heard from recently that
+  // aren't leaving, in order.
+  std::vector<std::string> LiveView(int64_t now_ms) const;
+  void UpdateSubscriptions();
+  void HandOff(int64_t now_ms);
+  std::string Topic(std::string_view kind, std::string_view a = {},
+                    std::string_view b = {}) const;
+
+  const NodeOptions options_;
+  const std::vector<std::string> stations_;
+  Transport& transport_;
+  rollup::RollupStore store_;
+  NodeStats stats_;
+
+  State state_ = State::kUp;
+  std::map<std::string, Member, std::less<>> members_;
+  // Until then the node only listens for the others' heartbeats.
+  int64_t listen_until_ms_ = 0;
+  int64_t next_tick_ms_ = 0;
+  int64_t next_heartbeat_ms_ = 0;
+  int64_t next_refresh_ms_ = 0;
+
+  uint64_t epoch_ = 0;
+  HashRing ring_;
+  // The highest epoch any heartbeat reported, so that a node that just
+  // joined proposes past it when it coordinates.
+  uint64_t known_epoch_ = 0;
+  std::vector<std::string> view_;
+  int64_t view_since_ms_ = 0;
+  uint64_t proposed_epoch_ = 0;
+  int64_t proposed_ms_ = 0;
+
+  std::set<std::string, std::less<>> subscribed_;
+  std::map<std::string, int64_t, std::less<>> last_reading_ms_;
+
+  // "NODE@EPOCH", naming this node's handoff in query replies.
+  std::string handoff_tag_;
+  // Rows handed off and not yet acknowledged, by new owner.
+  std::map<std::string, std::string, std::less<>> unacked_;
+  int64_t next_handoff_ms_ = 0;
+  // Tags of the handoffs this node has imported.
+  std::set<std::string, std::less<>> taken_;
+};
+
+}  // namespace collector
@@ -0,0 +1,42 @@
+#include "collector/ring.h"
+
+#include <algorithm>
+
+namespace collector {
+
+uint64_t Hash(std::string_view s) {
+  uint64_t h = 0xcbf29ce484222325;
+  for (const char c : s) {
+    h ^= static_cast<uint8_t>(c);
+    h *= 0x100000001b3;
+  }
+  // The splitmix64 finaliser.
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111eb;
+  return h ^ (h >> 31);
+}
+
+HashRing::HashRing(std::vector<std::string> nodes) : nodes_(std::move(nodes)) {
+  std::ranges::sort(nodes_);
+  nodes_.erase(std::unique(nodes_.begin(), nodes_.end()), nodes_.end());
+  points_.reserve(nodes_.size() * kPointsPerNode);
+  for (uint32_t i = 0; i < nodes_.size(); ++i) {
+    for (int p = 0; p < kPointsPerNode; ++p) {
+      points_.emplace_back(Hash(nodes_[i] + "#" + std::to_string(p)), i);
+    }
+  }
+  std::ranges::sort(points_);
+}
+
+const std::string* HashRing::Owner(std::string_view station) const {
+  if (points_.empty()) return nullptr;
+  const uint64_t h = Hash(station);
+  auto it = std::ranges::lower_bound(
+      points_, h, {}, &std::pair<uint64_t, uint32_t>::first);
+  if (it == points_.end()) it = points_.begin();
+  return &nodes_[it->second];
+}
+
+}  // namespace collector
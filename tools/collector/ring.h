@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace collector {
+
+// The same 64-bit hash of a string in every process: FNV-1a, then mixed so
+// that ids differing only in their last characters spread over the ring.
+uint64_t Hash(std::string_view s);
+
+// Consistent hashing of station ids onto collector nodes. Each node sits at
+// kPointsPerNode points on a 64-bit ring and owns the stations that hash to
+// just before one of them, so a node joining or leaving moves only the
+// stations it takes or gives up, about 1/N of them.
+class HashRing {
+ public:
+  static constexpr int kPointsPerNode = 64;
+
+  HashRing() = default;
+  explicit HashRing(std::vector<std::string> nodes);
+
+  // Null if the ring has no nodes.
+  const std::string* Owner(std::string_view station) const;
+
+  // Sorted.
+  const std::vector<std::string>& nodes() const { return nodes_; }
+  bool operator==(const HashRing& other) const {
+    return nodes_ == other.nodes_;
+  }
+
+ private:
+  std::vector<std::string> nodes_;
+  std::vector<std::pair<uint64_t, uint32_t>> points_;  // Sorted by hash.
+};
+
+}  // namespace collector
@@ -0,0 +1,66 @@
+#include "collector/wire.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+namespace collector {
+namespace {
+
+// Appends one number formatted by snprintf, at most 24 characters for the
+// formats below; anything longer is cut short rather than overrun.
+template <typename T>
+void AppendNumber(std::string& out, const char* format, T value) {
+  char buffer[32];
+  const int n = snprintf(buffer, sizeof(buffer), format, value);
+  out.append(buffer, std::clamp<int>(n, 0, sizeof(buffer) - 1));
+}
+
+}  // namespace
+
+void AppendRow(
+    std::string& out, std::string_view station, const rollup::Rollup& r) {
+  // Appended as is: a handoff row's station can be 255 characters.
+  out.append(station);
+  AppendNumber(out, " %" PRId64, r.start_ms);
+  AppendNumber(out, " %" PRIu32, r.wind_count);
+  AppendNumber(out, " %.17g", r.wind_sum);
+  AppendNumber(out, " %.9g", static_cast<double>(r.gust_mph));
+  AppendNumber(out, " %" PRIu32, r.rain_count);
+  AppendNumber(out, " %.17g", r.rain_in);
+  for (uint32_t count : r.sector_counts) {
+    AppendNumber(out, " %" PRIu32, count);
+  }
+  out += '\n';
+}
+
+std::optional<std::pair<std::string, rollup::Rollup>> ParseRow(
+    std::string_view line) {
+  const std::string copy(line);
+  char station[256];
+  rollup::Rollup r;
+  int at = 0;
+  if (sscanf(
+          copy.c_str(),
+          "%255s %" SCNd64 " %" SCNu32 " %lf %f %" SCNu32 " %lf%n",
+          station,
+          &r.start_ms,
+          &r.wind_count,
+          &r.wind_sum,
+          &r.gust_mph,
+          &r.rain_count,
+          &r.rain_in,
+          &at) != 7) {
+    return std::nullopt;
+  }
+  for (uint32_t& count : r.sector_counts) {
+    int n = 0;
+    if (sscanf(copy.c_str() + at, " %" SCNu32 "%n", &count, &n) != 1) {
+      return std::nullopt;
+    }
+    at += n;
+  }
+  return std::pair{std::string(station), r};
+}
+
+}  // namespace collector
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "rollup/rollup.h"
+
+namespace collector {
+
+// Control topics, under the fleet's control prefix C:
+//
+//   C/members/NODE           "STATE EPOCH READINGS" heartbeats, STATE being
+//                            up, leaving, handed-off or gone
+//   C/epoch                  "EPOCH NODE..." from the coordinator: the ring
+//                            from this point in the stream on
+//   C/handoff/TO/FROM        rows FROM hands to TO as it leaves
+//   C/handoff-ack/FROM/TO    TO has taken them
+//   C/query/ID               "STATION|* BEGIN_MS END_MS BUCKET_MS"
+//   C/reply/ID               "NODE STATUS [TAKEN,...]" then rows, STATUS
+//                            being ok, handed-off or error, TAKEN the nodes
+//                            whose rows it has imported
+//
+// A row is one station's bucket on a line: "STATION START_MS WIND_COUNT
+// WIND_SUM GUST_MPH RAIN_COUNT RAIN_IN" and the sixteen sector counts, with
+// doubles printed exactly.
+void AppendRow(
+    std::string& out, std::string_view station, const rollup::Rollup& r);
+std::optional<std::pair<std::string, rollup::Rollup>> ParseRow(
+    std::string_view line);
+
+// Calls fn(line) for each line of `text`, without the newline.
+template <typename Fn>
+void ForEachLine(std::string_view text, Fn&& fn) {
+  while (!text.empty()) {
+    const size_t newline = text.find('\n');
+    fn(text.substr(0, newline));
+    if (newline == std::string_view::npos) break;
+    text.remove_prefix(newline + 1);
+  }
+}
+
+}  // namespace collector
@@ -0,0 +1,444 @@
+// Runs a collector fleet (collector_node.cc) as separate processes against one
+// broker on this machine, and reports the aggregate ingest rate as nodes are
+// added. Then checks that a node joining and another leaving, while
+// readings arrive, neither lose nor double-count any.
+//
+//   collector_bench [--nodes=4] [--stations=1000] [--phase-s=3]
+//                   [--mqtt=HOST[:PORT]]
+//
+// Without --mqtt it starts an in-process fake broker. Collectors are
+// started from the directory this binary is in. Each scaling phase
+// publishes wind readings to the stations as fast as one client can, so
+// the rate is the fleet's or the publisher's, whichever is slower, and
+// readings a collector's broker queue couldn't hold are reported as
+// dropped. Exits non-zero if the check's counts don't match.
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "collector/gather.h"
+#include "fleet/topics.h"
+#include "mqtt/client.h"
+#include "mqtt/fake_broker.h"
+
+extern char** environ;
+
+namespace {
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+constexpr int kCheckStations = 50;
+constexpr auto kCheckRound = 20ms;
+constexpr auto kMembershipTimeout = 15s;
+
+struct Node {
+  std::string id;
+  pid_t pid = -1;
+};
+
+// Follows the fleet on the control topics.
+class Observer {
+ public:
+  Observer(mqtt::Client& client, std::string control)
+      : client_(client), control_(std::move(control)) {}
+
+  std::expected<void, std::string> Start() {
+    if (auto ok = client_.Subscribe(control_ + "/members/+"); !ok) return ok;
+    return client_.Subscribe(control_ + "/epoch");
+  }
+
+  // Handles control messages for `duration`.
+  std::expected<void, std::string> Pump(Clock::duration duration) {
+    const auto until = Clock::now() + duration;
+    while (true) {
+      const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          until - Clock::now());
+      if (left.count() <= 0) return {};
+      auto message = client_.Poll(left);
+      if (!message) return std::unexpected(message.error());
+      if (*message) Handle((*message)->topic, (*message)->payload);
+    }
+  }
+
+  // Pumps until done() or the timeout. Returns whether done() held.
+  std::expected<bool, std::string> WaitFor(
+      const std::function<bool()>& done, Clock::duration timeout) {
+    const auto until = Clock::now() + timeout;
+    while (!done()) {
+      if (Clock::now() >= until) return false;
+      if (auto ok = Pump(50ms); !ok) return std::unexpected(ok.error());
+    }
+    return true;
+  }
+
+  // The nodes of the last epoch.
+  const std::vector<std::string>& ring() const { return ring_; }
+  // Readings ingested, per the heartbeats.
+  uint64_t readings() const {
+    uint64_t total = 0;
+    for (const auto& [node, n] : readings_) total += n;
+    return total;
+  }
+
+ private:
+  void Handle(std::string_view topic, std::string_view payload) {
+    if (topic == control_ + "/epoch") {
+      ring_.clear();
+      payload.remove_prefix(std::min(payload.find(' '), payload.size()));
+      while (!payload.empty()) {
+        payload.remove_prefix(1);
+        const size_t space = payload.find(' ');
+        ring_.emplace_back(payload.substr(0, space));
+        payload.remove_prefix(std::min(space, payload.size()));
+      }
+      return;
+    }
+    const std::string node(topic.substr(topic.rfind('/') + 1));
+    const size_t last_space = payload.rfind(' ');
+    if (last_space == std::string_view::npos) return;
+    const std::string count(payload.substr(last_space + 1));
+    readings_[node] = strtoull(count.c_str(), nullptr, 10);
+  }
+
+  mqtt::Client& client_;
+  const std::string control_;
+  std::vector<std::string> ring_;
+  std::map<std::string, uint64_t> readings_;
+};
+
+// A station or node id: `kind` followed by `i`.
+std::string Id(char kind, int i) {
+  std::string id(1, kind);
+  id += std::to_string(i);
+  return id;
+}
+
+std::expected<pid_t, std::string> Spawn(
+    const std::string& program, const std::vector<std::string>& args) {
+  std::vector<char*> argv;
+  argv.push_back(const_cast<char*>(program.c_str()));
+  for (const std::string& arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+  pid_t pid;
+  if (const int err = posix_spawn(
+          &pid, program.c_str(), nullptr, nullptr, argv.data(), environ);
+      err != 0) {
+    return std::unexpected(program + ": " + strerror(err));
+  }
+  return pid;
+}
+
+// Waits for `pid` to exit, killing it after `timeout`. Returns whether it
+// exited cleanly by itself.
+bool Reap(pid_t pid, Observer& observer, Clock::duration timeout) {
+  const auto until = Clock::now() + timeout;
+  int status;
+  while (waitpid(pid, &status, WNOHANG) == 0) {
+    if (Clock::now() >= until) {
+      kill(pid, SIGKILL);
+      waitpid(pid, &status, 0);
+      return false;
+    }
+    (void)observer.Pump(20ms);
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int nodes = 4;
+  int stations = 1000;
+  double phase_s = 3;
+  mqtt::ConnectInfo connect;
+  bool use_mqtt = false;
+  bool bad = false;
+  for (int i = 1; i < argc && !bad; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg.starts_with("--nodes=")) {
+      nodes = atoi(value("--nodes="));
+    } else if (arg.starts_with("--stations=")) {
+      stations = atoi(value("--stations="));
+    } else if (arg.starts_with("--phase-s=")) {
+      phase_s = atof(value("--phase-s="));
+    } else if (arg.starts_with("--mqtt=")) {
+      use_mqtt = true;
+      const std::string_view host = value("--mqtt=");
+      const size_t colon = host.rfind(':');
+      connect.host = host.substr(0, colon);
+      if (colon != std::string_view::npos) {
+        connect.port = atoi(std::string(host.substr(colon + 1)).c_str());
+      }
+    } else {
+      bad = true;
+    }
+  }
+  if (bad || nodes < 2 || stations < 1 || phase_s <= 0) {
+    fprintf(
+        stderr,
+        "usage: %s [--nodes=N>=2] [--stations=N] [--phase-s=S] "
+        "[--mqtt=HOST[:PORT]]\n",
+        argv[0]);
+    return 1;
+  }
+
+  std::unique_ptr<mqtt::FakeBroker> broker;
+  if (!use_mqtt) {
+    auto started = mqtt::FakeBroker::Start(0ms);
+    if (!started) {
+      fprintf(stderr, "%s\n", started.error().c_str());
+      return 1;
+    }
+    broker = std::move(*started);
+    connect.host = "127.0.0.1";
+    connect.port = broker->port();
+  }
+  const std::string host = connect.host + ":" + std::to_string(connect.port);
+  const std::string tag = "collector_bench_" + std::to_string(getpid());
+  const std::string control = tag + "/control";
+  const std::string prefix = tag;
+
+  // "a" stations take the scaling phases' load, "b" stations the check's.
+  char stations_path[] = "/tmp/collector_bench_XXXXXX";
+  const int fd = mkstemp(stations_path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+  std::vector<std::string> load_stations;
+  std::vector<std::string> check_stations;
+  std::string list;
+  for (int i = 0; i < stations; ++i) load_stations.push_back(Id('a', i));
+  for (int i = 0; i < kCheckStations; ++i) check_stations.push_back(Id('b', i));
+  for (const auto& group : {load_stations, check_stations}) {
+    for (const std::string& s : group) list += s + "\n";
+  }
+  if (write(fd, list.data(), list.size()) !=
+      static_cast<ssize_t>(list.size())) {
+    perror(stations_path);
+    return 1;
+  }
+  close(fd);
+
+  const std::string self = argv[0];
+  const size_t slash = self.rfind('/');
+  const std::string dir =
+      slash == std::string::npos ? "." : self.substr(0, slash);
+  const std::string program = dir + "/collector_node";
+  auto start_node = [&](int n) -> std::expected<Node, std::string> {
+    Node node{.id = Id('n', n)};
+    auto pid = Spawn(
+        program,
+        {"--node=" + node.id,
+         std::string("--stations=") + stations_path,
+         "--control=" + control,
+         "--prefix=" + prefix,
+         "--mqtt=" + host});
+    if (!pid) return std::unexpected(pid.error());
+    node.pid = *pid;
+    return node;
+  };
+
+  connect.client_id = tag + "_observer";
+  auto observer_client = mqtt::Client::Connect(connect);
+  if (!observer_client) {
+    fprintf(stderr, "%s\n", observer_client.error().c_str());
+    return 1;
+  }
+  Observer observer(**observer_client, control);
+  if (auto ok = observer.Start(); !ok) {
+    fprintf(stderr, "%s\n", ok.error().c_str());
+    return 1;
+  }
+
+  std::vector<Node> running;
+  auto fail = [&](const std::string& error) {
+    fprintf(stderr, "%s\n", error.c_str());
+    for (const Node& node : running) kill(node.pid, SIGKILL);
+    for (const Node& node : running) waitpid(node.pid, nullptr, 0);
+    unlink(stations_path);
+    return 1;
+  };
+  auto ring_size_is = [&](size_t n) {
+    return [&observer, n] { return observer.ring().size() == n; };
+  };
+
+  // Publishes `payload` for each station in turn until told to stop, each
+  // round taking at least `round`. Counts what it sent, per station.
+  struct Publisher {
+    std::atomic<bool> stop{false};
+    std::vector<uint64_t> sent;
+    std::string error;
+    std::thread thread;
+  };
+  auto publish = [&](Publisher& p, const std::vector<std::string>& to,
+                     Clock::duration round, const std::string& client_id) {
+    p.stop = false;
+    p.sent.assign(to.size(), 0);
+    mqtt::ConnectInfo info = connect;
+    info.client_id = client_id;
+    p.thread = std::thread([&p, &to, round, info, &prefix] {
+      auto client = mqtt::Client::Connect(info);
+      if (!client) {
+        p.error = client.error();
+        return;
+      }
+      std::vector<std::string> topics;
+      for (const std::string& s : to) {
+        topics.push_back(
+            fleet::StateTopicFor(prefix, s, fleet::Sensor::kWindSpeed));
+      }
+      while (!p.stop) {
+        const auto next = Clock::now() + round;
+        for (size_t i = 0; i < topics.size() && !p.stop; ++i) {
+          if (auto ok = (*client)->Publish(topics[i], "7.500000"); !ok) {
+            p.error = ok.error();
+            return;
+          }
+          ++p.sent[i];
+        }
+        std::this_thread::sleep_until(next);
+      }
+    });
+  };
+  auto total = [](const Publisher& p) {
+    uint64_t n = 0;
+    for (uint64_t s : p.sent) n += s;
+    return n;
+  };
+
+  printf("nodes  published/s  ingested/s  dropped\n");
+  for (int k = 1; k <= nodes; ++k) {
+    auto node = start_node(k);
+    if (!node) return fail(node.error());
+    running.push_back(*node);
+    auto joined = observer.WaitFor(ring_size_is(k), kMembershipTimeout);
+    if (!joined || !*joined) return fail(Id('n', k) + " never joined");
+
+    const uint64_t dropped_before = broker ? broker->dropped() : 0;
+    Publisher load;
+    publish(load, load_stations, 0ms, tag + "_load");
+    // Measures once the queues have filled.
+    (void)observer.Pump(500ms);
+    const uint64_t readings_before = observer.readings();
+    const uint64_t sent_before = total(load);
+    const auto begin = Clock::now();
+    (void)observer.Pump(std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(phase_s)));
+    const double seconds =
+        std::chrono::duration<double>(Clock::now() - begin).count();
+    const uint64_t readings = observer.readings() - readings_before;
+    const uint64_t sent = total(load) - sent_before;
+    load.stop = true;
+    load.thread.join();
+    if (!load.error.empty()) return fail(load.error);
+    // Lets the collectors drain their queues before the next phase.
+    uint64_t last = observer.readings();
+    while (true) {
+      (void)observer.Pump(1s);
+      if (observer.readings() == last) break;
+      last = observer.readings();
+    }
+    printf(
+        "%5d  %11.0f  %10.0f  %7" PRIu64 "%s\n",
+        k,
+        sent / seconds,
+        readings / seconds,
+        (broker ? broker->dropped() : 0) - dropped_before,
+        broker ? "" : " (not counted)");
+    fflush(stdout);
+  }
+
+  // The check: steady readings for the "b" stations while a node joins and
+  // another leaves.
+  const uint64_t dropped_before = broker ? broker->dropped() : 0;
+  Publisher check;
+  publish(check, check_stations, kCheckRound, tag + "_check");
+  (void)observer.Pump(1s);
+  auto joining = start_node(nodes + 1);
+  if (!joining) return fail(joining.error());
+  running.push_back(*joining);
+  auto joined = observer.WaitFor(ring_size_is(nodes + 1), kMembershipTimeout);
+  if (!joined || !*joined) return fail("the joining node never joined");
+  (void)observer.Pump(1s);
+  const Node leaving = running.front();
+  running.erase(running.begin());
+  kill(leaving.pid, SIGTERM);
+  if (!Reap(leaving.pid, observer, kMembershipTimeout)) {
+    return fail(leaving.id + " didn't leave cleanly");
+  }
+  (void)observer.Pump(1s);
+  check.stop = true;
+  check.thread.join();
+  if (!check.error.empty()) return fail(check.error);
+  (void)observer.Pump(2s);
+
+  connect.client_id = tag + "_query";
+  auto query_client = mqtt::Client::Connect(connect);
+  if (!query_client) return fail(query_client.error());
+  const int64_t day_ms = 86'400'000;
+  const int64_t now_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+  const int64_t end_ms = (now_ms / day_ms + 1) * day_ms;
+  auto gathered = collector::Gather(
+      **query_client,
+      control,
+      {.t_begin = 0, .t_end = end_ms, .bucket_ms = end_ms});
+  if (!gathered) return fail(gathered.error());
+
+  bool ok = true;
+  if (broker && broker->dropped() != dropped_before) {
+    printf("the broker dropped readings during the check\n");
+    ok = false;
+  }
+  uint64_t counted = 0;
+  for (size_t i = 0; i < check_stations.size(); ++i) {
+    const auto it = gathered->stations.find(check_stations[i]);
+    const uint64_t n =
+        it == gathered->stations.end() ? 0 : it->second[0].wind_count;
+    counted += n;
+    if (n != check.sent[i]) {
+      printf(
+          "%s: %" PRIu64 " readings gathered, %" PRIu64 " published\n",
+          check_stations[i].c_str(),
+          n,
+          check.sent[i]);
+      ok = false;
+    }
+  }
+  printf(
+      "check: %" PRIu64 " readings published, %" PRIu64
+      " gathered from %zu nodes in %d attempts across a join and a leave\n",
+      total(check),
+      counted,
+      gathered->nodes.size(),
+      gathered->attempts);
+
+  for (const Node& node : running) kill(node.pid, SIGTERM);
+  for (const Node& node : running) Reap(node.pid, observer, kMembershipTimeout);
+  unlink(stations_path);
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
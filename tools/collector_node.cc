@@ -0,0 +1,185 @@
+// One node of a collector fleet that shards station ingest across processes
+// by consistent hashing of station ids (see collector/node.h). Each node
+// subscribes to the state topics of just the stations it owns and keeps
+// their rollups; collector_query gathers them back.
+//
+//   collector_node --node=ID --stations=FILE [--control=collectors]
+//                  [--prefix=homeassistant] [--late-window-h=48]
+//                  [--rain-period-s=600] --mqtt=HOST[:PORT] [--user=U]
+//                  [--password=P]
+//
+// The stations file has a station id at the start of each line; a station
+// not in it isn't collected. SIGTERM or SIGINT hands the node's rollups to
+// the others before it exits.
+//
+// Every node must use a broker that delivers messages to all subscribers in
+// the same order, such as a single-threaded mosquitto. On one that doesn't,
+// as MQTT allows, readings that arrive around a membership change may be
+// counted twice or not at all.
+
+#include <chrono>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "collector/node.h"
+#include "mqtt/client.h"
+
+namespace {
+
+volatile sig_atomic_t leave_requested = 0;
+
+void OnSignal(int) { leave_requested = 1; }
+
+int64_t NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+bool LoadStations(const char* path, std::vector<std::string>& stations) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  char line[1024];
+  while (fgets(line, sizeof(line), f)) {
+    const std::string_view s(line);
+    const size_t end = s.find_first_of(" \t\r\n");
+    if (end != 0) stations.emplace_back(s.substr(0, end));
+  }
+  fclose(f);
+  return true;
+}
+
+// Reports the first error and drops the rest: the loop stops on it.
+class MqttTransport : public collector::Transport {
+ public:
+  explicit MqttTransport(mqtt::Client& client) : client_(client) {}
+
+  void Subscribe(std::string_view filter) override {
+    Check(client_.Subscribe(filter));
+  }
+  void Unsubscribe(std::string_view filter) override {
+    Check(client_.Unsubscribe(filter));
+  }
+  void Publish(std::string_view topic, std::string_view payload) override {
+    Check(client_.Publish(topic, payload));
+  }
+
+  const std::string& error() const { return error_; }
+
+ private:
+  void Check(const std::expected<void, std::string>& ok) {
+    if (!ok && error_.empty()) error_ = ok.error();
+  }
+
+  mqtt::Client& client_;
+  std::string error_;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  collector::NodeOptions options;
+  const char* stations_path = nullptr;
+  mqtt::ConnectInfo connect;
+  bool use_mqtt = false;
+  bool bad = false;
+  for (int i = 1; i < argc && !bad; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg.starts_with("--node=")) {
+      options.id = value("--node=");
+    } else if (arg.starts_with("--stations=")) {
+      stations_path = value("--stations=");
+    } else if (arg.starts_with("--control=")) {
+      options.control = value("--control=");
+    } else if (arg.starts_with("--prefix=")) {
+      options.prefix = value("--prefix=");
+    } else if (arg.starts_with("--late-window-h=")) {
+      options.rollup.late_window_ms =
+          atof(value("--late-window-h=")) * 3'600'000;
+    } else if (arg.starts_with("--rain-period-s=")) {
+      options.rollup.rain_period_ms = atof(value("--rain-period-s=")) * 1000;
+    } else if (arg.starts_with("--mqtt=")) {
+      use_mqtt = true;
+      const std::string_view host = value("--mqtt=");
+      const size_t colon = host.rfind(':');
+      connect.host = host.substr(0, colon);
+      if (colon != std::string_view::npos) {
+        connect.port = atoi(std::string(host.substr(colon + 1)).c_str());
+      }
+    } else if (arg.starts_with("--user=")) {
+      connect.user = value("--user=");
+    } else if (arg.starts_with("--password=")) {
+      connect.password = value("--password=");
+    } else {
+      bad = true;
+    }
+  }
+  // Ids go in topic levels, and heartbeats are split on spaces.
+  if (options.id.find_first_of("/+# ") != std::string::npos) bad = true;
+  if (bad || options.id.empty() || !stations_path || !use_mqtt) {
+    fprintf(
+        stderr,
+        "usage: %s --node=ID --stations=FILE [--control=TOPIC] "
+        "[--prefix=TOPIC] [--late-window-h=H] [--rain-period-s=S] "
+        "--mqtt=HOST[:PORT] [--user=U] [--password=P]\n"
+        "The broker must deliver to every subscriber in the same order, as a "
+        "single-threaded mosquitto does.\n",
+        argv[0]);
+    return 1;
+  }
+  std::vector<std::string> stations;
+  if (!LoadStations(stations_path, stations)) return 1;
+
+  connect.client_id = "collector-" + options.id;
+  auto client = mqtt::Client::Connect(connect);
+  if (!client) {
+    fprintf(stderr, "%s\n", client.error().c_str());
+    return 1;
+  }
+  signal(SIGTERM, OnSignal);
+  signal(SIGINT, OnSignal);
+
+  MqttTransport transport(**client);
+  collector::CollectorNode node(options, std::move(stations), transport);
+  node.Start(NowMs());
+  while (!node.done()) {
+    if (leave_requested) node.Leave(NowMs());
+    auto message = (*client)->Poll(std::chrono::milliseconds(20));
+    if (!message) {
+      fprintf(stderr, "%s\n", message.error().c_str());
+      return 1;
+    }
+    if (*message) {
+      node.OnMessage(NowMs(), (*message)->topic, (*message)->payload);
+    }
+    node.Tick(NowMs());
+    if (!transport.error().empty()) {
+      fprintf(stderr, "%s\n", transport.error().c_str());
+      return 1;
+    }
+  }
+
+  const collector::NodeStats& s = node.stats();
+  fprintf(
+      stderr,
+      "%s: %" PRIu64 " readings, %" PRIu64 " foreign, %" PRIu64
+      " epochs, %" PRIu64 " queries; handed off %" PRIu64
+      " rows, took over %" PRIu64 "\n",
+      options.id.c_str(),
+      s.readings,
+      s.foreign,
+      s.epochs,
+      s.queries,
+      s.rows_handed_off,
+      s.rows_taken_over);
+  return 0;
+}
@@ -0,0 +1,101 @@
+// Queries a collector fleet's rollups (see collector_node.cc), gathering every
+// node's share, and prints a JSON line per station and bucket.
+//
+//   collector_query --begin-ms=T --end-ms=T [--bucket-s=3600]
+//                   [--station=ID] [--control=collectors]
+//                   --mqtt=HOST[:PORT] [--user=U] [--password=P]
+//
+// Times are whole minutes; empty buckets aren't printed.
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include "collector/gather.h"
+#include "mqtt/client.h"
+
+int main(int argc, char** argv) {
+  collector::GatherQuery query{
+      .t_begin = -1, .t_end = -1, .bucket_ms = 3'600'000};
+  std::string control = "collectors";
+  mqtt::ConnectInfo connect{.client_id = "collector_query"};
+  bool use_mqtt = false;
+  bool bad = false;
+  for (int i = 1; i < argc && !bad; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg.starts_with("--begin-ms=")) {
+      query.t_begin = strtoll(value("--begin-ms="), nullptr, 10);
+    } else if (arg.starts_with("--end-ms=")) {
+      query.t_end = strtoll(value("--end-ms="), nullptr, 10);
+    } else if (arg.starts_with("--bucket-s=")) {
+      query.bucket_ms = atof(value("--bucket-s=")) * 1000;
+    } else if (arg.starts_with("--station=")) {
+      query.station = value("--station=");
+    } else if (arg.starts_with("--control=")) {
+      control = value("--control=");
+    } else if (arg.starts_with("--mqtt=")) {
+      use_mqtt = true;
+      const std::string_view host = value("--mqtt=");
+      const size_t colon = host.rfind(':');
+      connect.host = host.substr(0, colon);
+      if (colon != std::string_view::npos) {
+        connect.port = atoi(std::string(host.substr(colon + 1)).c_str());
+      }
+    } else if (arg.starts_with("--user=")) {
+      connect.user = value("--user=");
+    } else if (arg.starts_with("--password=")) {
+      connect.password = value("--password=");
+    } else {
+      bad = true;
+    }
+  }
+  if (bad || !use_mqtt || query.t_begin < 0 || query.t_end < query.t_begin) {
+    fprintf(
+        stderr,
+        "usage: %s --begin-ms=T --end-ms=T [--bucket-s=S] [--station=ID] "
+        "[--control=TOPIC] --mqtt=HOST[:PORT] [--user=U] [--password=P]\n",
+        argv[0]);
+    return 1;
+  }
+
+  auto client = mqtt::Client::Connect(connect);
+  if (!client) {
+    fprintf(stderr, "%s\n", client.error().c_str());
+    return 1;
+  }
+  auto result = collector::Gather(**client, control, query);
+  if (!result) {
+    fprintf(stderr, "%s\n", result.error().c_str());
+    return 1;
+  }
+  for (const auto& [station, buckets] : result->stations) {
+    for (const rollup::Rollup& r : buckets) {
+      if (r.empty()) continue;
+      char direction[16] = "null";
+      if (auto degrees = r.direction_mean_degrees()) {
+        snprintf(direction, sizeof(direction), "%.1f", *degrees);
+      }
+      printf(
+          "{\"station\":\"%s\",\"start_ms\":%" PRId64
+          ",\"wind_mean_mph\":%.2f,\"gust_mph\":%.2f,\"direction_deg\":%s,"
+          "\"rain_in\":%.3f,\"wind_readings\":%" PRIu32 "}\n",
+          station.c_str(),
+          r.start_ms,
+          r.wind_mean(),
+          r.gust_mph,
+          direction,
+          r.rain_in,
+          r.wind_count);
+    }
+  }
+  fprintf(
+      stderr,
+      "%zu nodes answered, %d attempts\n",
+      result->nodes.size(),
+      result->attempts);
+  return 0;
+}
@@ -0,0 +1,279 @@
+// Benchmarks tsdb compaction on synthetic station history sealed into a
+// segment a day, as a collector restarted daily leaves it: bytes on disk and
+// query times before and after, with compaction running in the background
+// under its budgets while a reader keeps querying.
+//
+//   compaction_bench [--stations=2] [--days=730] [--io-mb-s=64]
+//                    [--cpu-share=0.5] [--dir=/tmp/compaction_bench]
+//
+// History older than 30 days is downsampled to minutes, and older than a year
+// to hours. Exits non-zero if any hour's sample count, max gust or rain total
+// changed, if the mean wind moved by more than float rounding, or if a query
+// during compaction saw anything different.
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "query/aggregate.h"
+#include "query/work_stealing_pool.h"
+#include "tsdb/compaction.h"
+#include "tsdb/store.h"
+#include "tsdb/synthetic.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+constexpr int64_t kStartMs = 1'700'000'000'000;
+constexpr int64_t kHourMs = 60 * 60 * 1000;
+constexpr int64_t kDayMs = 24 * kHourMs;
+constexpr float kGustMph = 20;
+
+struct Results {
+  std::vector<std::vector<query::Bucket>> hourly;
+  std::vector<std::vector<query::Bucket>> daily;
+  std::vector<std::vector<query::Bucket>> gusts;
+};
+
+// Runs each query over every station, best of three, and prints the times.
+Results RunQueries(
+    const char* label, std::span<const tsdb::Store* const> stations,
+    int64_t t_begin, int64_t t_end, query::WorkStealingPool& pool) {
+  Results results;
+  auto time = [&](const char* name, auto&& run) {
+    double best = INFINITY;
+    for (int round = 0; round < 3; ++round) {
+      const auto start = Clock::now();
+      run();
+      best = std::min(best, SecondsSince(start));
+    }
+    printf("  %-6s %-7s %8.2f ms\n", label, name, best * 1e3);
+  };
+  time("hourly", [&] {
+    results.hourly =
+        query::AggregateStations(stations, {t_begin, t_end, kHourMs}, pool);
+  });
+  time("daily", [&] {
+    results.daily =
+        query::AggregateStations(stations, {t_begin, t_end, kDayMs}, pool);
+  });
+  time("gusts", [&] {
+    results.gusts.clear();
+    for (const tsdb::Store* s : stations) {
+      results.gusts.push_back(
+          query::FindGusts(*s, {t_begin, t_end, kHourMs}, kGustMph));
+    }
+  });
+  return results;
+}
+
+// Whether the buckets agree on what compaction keeps: counts, max gusts and
+// rain totals exactly, mean wind to float precision.
+bool SameBuckets(
+    const std::vector<query::Bucket>& a, const std::vector<query::Bucket>& b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].start_ms != b[i].start_ms || a[i].count != b[i].count ||
+        a[i].wind_max != b[i].wind_max || a[i].rain_ticks != b[i].rain_ticks ||
+        std::abs(a[i].wind_sum - b[i].wind_sum) >
+            1e-6 * (1 + std::abs(a[i].wind_sum))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// FindGusts() fills in just the start and max of its buckets.
+bool SameGusts(
+    const std::vector<query::Bucket>& a, const std::vector<query::Bucket>& b) {
+  return std::ranges::equal(
+      a, b, [](const query::Bucket& x, const query::Bucket& y) {
+        return x.start_ms == y.start_ms && x.wind_max == y.wind_max;
+      });
+}
+
+bool SameResults(const Results& a, const Results& b) {
+  return std::ranges::equal(a.hourly, b.hourly, SameBuckets) &&
+         std::ranges::equal(a.daily, b.daily, SameBuckets) &&
+         std::ranges::equal(a.gusts, b.gusts, SameGusts);
+}
+
+uint64_t DiskBytes(std::span<const std::unique_ptr<tsdb::Store>> stores) {
+  uint64_t bytes = 0;
+  for (const auto& s : stores) bytes += s->disk_bytes();
+  return bytes;
+}
+
+void PrintDisk(
+    const char* label, std::span<const std::unique_ptr<tsdb::Store>> stores,
+    uint64_t samples) {
+  const uint64_t bytes = DiskBytes(stores);
+  size_t segments = 0;
+  for (const auto& s : stores) segments += s->segments()->size();
+  printf(
+      "%s: %zu segments, %.1f MB, %.3f B/sample\n",
+      label,
+      segments,
+      bytes / 1e6,
+      static_cast<double>(bytes) / samples);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int num_stations = 2;
+  int days = 730;
+  double io_mb_s = 64;
+  double cpu_share = 0.5;
+  std::filesystem::path dir = "/tmp/compaction_bench";
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--stations=")) {
+      num_stations = atoi(argv[i] + strlen("--stations="));
+    } else if (arg.starts_with("--days=")) {
+      days = atoi(argv[i] + strlen("--days="));
+    } else if (arg.starts_with("--io-mb-s=")) {
+      io_mb_s = atof(argv[i] + strlen("--io-mb-s="));
+    } else if (arg.starts_with("--cpu-share=")) {
+      cpu_share = atof(argv[i] + strlen("--cpu-share="));
+    } else if (arg.starts_with("--dir=")) {
+      dir = argv[i] + strlen("--dir=");
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--stations=N] [--days=N] [--io-mb-s=X] [--cpu-share=X] "
+          "[--dir=PATH]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  std::filesystem::remove_all(dir);
+
+  // Seals every day, as a collector restarted daily would.
+  const size_t samples_per_day = kDayMs / 5000;
+  std::vector<std::unique_ptr<tsdb::Store>> stores;
+  for (int s = 0; s < num_stations; ++s) {
+    auto store = tsdb::Store::Open(dir / ("station" + std::to_string(s)));
+    if (!store) {
+      fprintf(stderr, "%s\n", store.error().c_str());
+      return 1;
+    }
+    tsdb::SyntheticStation station(s + 1, kStartMs);
+    for (int d = 0; d < days; ++d) {
+      for (size_t i = 0; i < samples_per_day; ++i) {
+        if (auto ok = (*store)->Append(station.Next()); !ok) {
+          fprintf(stderr, "%s\n", ok.error().c_str());
+          return 1;
+        }
+      }
+      if (auto sealed = (*store)->Seal(); !sealed) {
+        fprintf(stderr, "%s\n", sealed.error().c_str());
+        return 1;
+      }
+    }
+    stores.push_back(*std::move(store));
+  }
+  const uint64_t samples = uint64_t{samples_per_day} * days * num_stations;
+  printf(
+      "%d stations, %d days at 5 s: %" PRIu64 " samples\n",
+      num_stations,
+      days,
+      samples);
+
+  std::vector<const tsdb::Store*> stations;
+  for (const auto& s : stores) stations.push_back(s.get());
+  const int64_t t_begin = kStartMs / kDayMs * kDayMs;
+  const int64_t t_end =
+      (kStartMs + int64_t{days + 1} * kDayMs) / kDayMs * kDayMs + kDayMs;
+  query::WorkStealingPool pool(
+      std::max(1u, std::thread::hardware_concurrency()));
+
+  const uint64_t bytes_before = DiskBytes(stores);
+  PrintDisk("before", stores, samples);
+  const Results before = RunQueries("before", stations, t_begin, t_end, pool);
+
+  tsdb::CompactionOptions options;
+  options.io_bytes_per_s = io_mb_s * 1e6;
+  options.cpu_share = cpu_share;
+  options.idle_interval = std::chrono::milliseconds(10);
+  const int64_t now_ms = kStartMs + int64_t{days} * kDayMs;
+  options.now_ms = [now_ms] { return now_ms; };
+  std::vector<tsdb::Store*> targets;
+  for (const auto& s : stores) targets.push_back(s.get());
+  tsdb::Compactor compactor(targets, options);
+
+  // A reader keeps asking for station 0's hourly history while the segments
+  // are replaced under it.
+  const std::vector<const tsdb::Store*> first = {stations[0]};
+  uint64_t reads = 0;
+  double slowest_s = 0;
+  bool reads_ok = true;
+  const auto start = Clock::now();
+  compactor.Start();
+  while (compactor.HasWork()) {
+    const auto read_start = Clock::now();
+    const auto hourly =
+        query::AggregateStations(first, {t_begin, t_end, kHourMs}, pool);
+    slowest_s = std::max(slowest_s, SecondsSince(read_start));
+    reads_ok = reads_ok && SameBuckets(hourly[0], before.hourly[0]);
+    ++reads;
+  }
+  compactor.Stop();
+  const double compact_s = SecondsSince(start);
+  const tsdb::CompactionStats stats = compactor.stats();
+  printf(
+      "compacted in %.2f s (%.0f MB/s and %.0f%% of a core allowed): %" PRIu64
+      " downsamples, %" PRIu64 " merges of %" PRIu64 " segments; read %.1f MB, "
+      "wrote %.1f MB, throttled %.2f s\n",
+      compact_s,
+      io_mb_s,
+      cpu_share * 100,
+      stats.downsamples,
+      stats.merges,
+      stats.segments_replaced,
+      stats.bytes_read / 1e6,
+      stats.bytes_written / 1e6,
+      stats.throttled_ms / 1e3);
+  printf(
+      "  %" PRIu64 " reader queries meanwhile, slowest %.2f ms, %s\n",
+      reads,
+      slowest_s * 1e3,
+      reads_ok ? "all consistent" : "INCONSISTENT");
+
+  const uint64_t bytes_after = DiskBytes(stores);
+  PrintDisk("after", stores, samples);
+  printf("saved %.1f%%\n", 100.0 * (bytes_before - bytes_after) / bytes_before);
+  const Results after = RunQueries("after", stations, t_begin, t_end, pool);
+
+  // Reopening finds the compacted segments alone.
+  bool reopened_ok = true;
+  for (int s = 0; s < num_stations; ++s) {
+    auto store = tsdb::Store::Open(dir / ("station" + std::to_string(s)));
+    reopened_ok = reopened_ok && store &&
+                  (*store)->sample_count() == stores[s]->sample_count() &&
+                  (*store)->segments()->size() == stores[s]->segments()->size();
+  }
+
+  const bool ok = stats.failures == 0 && reads_ok && reopened_ok &&
+                  SameResults(before, after);
+  if (stats.failures > 0) {
+    printf("compaction failed: %s\n", stats.last_error.c_str());
+  }
+  if (!reopened_ok) printf("reopened stores differ\n");
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+// Checks the firmware's fixed-point FFT (src/spectrum.h) against a double
+// precision DFT and times it on the host. From the butterfly count it
+// projects the time on the RP2040 and fails if the turbulence analysis
+// would not fit well inside one vane sample period.
+//
+//   fft_bench [--cycles-per-butterfly=60] [--mhz=125] [--budget-ms=12.5]
+//
+// The cycle figure is an allowance for the M0+ (single-cycle multiplier,
+// two-cycle loads and stores), not a measurement; the firmware publishes
+// the real analysis time with each spectrum.
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <numbers>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "spectrum.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Error of FixedFft relative to the exact scaled DFT, in dB below the
+// signal.
+double SignalToErrorDb(int n, std::mt19937& rng) {
+  std::normal_distribution<double> noise(0, 3000);
+  std::vector<ComplexQ15> data(n);
+  std::vector<double> x(n);
+  for (int i = 0; i < n; ++i) {
+    x[i] = std::clamp(
+        8000 * std::sin(2 * std::numbers::pi * 5 * i / n) + noise(rng),
+        -32767.0,
+        32767.0);
+    x[i] = std::round(x[i]);
+    data[i] = {static_cast<int16_t>(x[i]), 0};
+  }
+  FixedFft(data);
+  double signal = 0, error = 0;
+  for (int k = 0; k < n; ++k) {
+    std::complex<double> exact = 0;
+    for (int i = 0; i < n; ++i) {
+      exact += x[i] * std::polar(1.0, -2 * std::numbers::pi * k * i / n);
+    }
+    exact /= n;
+    signal += std::norm(exact);
+    error += std::norm(exact - std::complex<double>(data[k].re, data[k].im));
+  }
+  return 10 * std::log10(signal / error);
+}
+
+double MicrosPerTransform(int n, std::mt19937& rng) {
+  std::uniform_int_distribution<int> sample(-16000, 16000);
+  std::vector<int16_t> input(n);
+  for (int16_t& s : input) s = sample(rng);
+  std::vector<ComplexQ15> data(n);
+  const int iterations = 2'000'000 / n;
+  int64_t sink = 0;
+  const auto start = Clock::now();
+  for (int it = 0; it < iterations; ++it) {
+    for (int i = 0; i < n; ++i) data[i] = {input[i], 0};
+    FixedFft(data);
+    sink += data[1].re;
+  }
+  const double secs =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  if (sink == 42) printf(" ");
+  return secs / iterations * 1e6;
+}
+
+// Sanity check of the summary: a 1 mph rms sine at 0.3 Hz sampled at 2 Hz
+// should put about 1 mph^2 in the band holding 0.3 Hz.
+bool CheckSummary() {
+  constexpr int kN = 256;
+  constexpr float kHz = 2;
+  std::vector<int16_t> samples(kN);
+  for (int i = 0; i < kN; ++i) {
+    const double mph =
+        10 + std::numbers::sqrt2 *
+                 std::sin(2 * std::numbers::pi * 0.3 * i / kHz);
+    samples[i] = std::lround(mph * 256);
+  }
+  std::vector<ComplexQ15> work(kN);
+  const float edges[] = {0, 0.05, 0.2, 1.01};
+  const SpectrumSummary s =
+      AnalyzeSpectrum(samples, kHz, 1.0f / 256, edges, work);
+  printf(
+      "summary: bands %.3f %.3f %.3f mph^2, variance %.3f, dominant %.3f Hz\n",
+      s.band_energy[0],
+      s.band_energy[1],
+      s.band_energy[2],
+      s.variance,
+      s.dominant_hz);
+  return std::abs(s.band_energy[2] - 1) < 0.05 &&
+         std::abs(s.dominant_hz - 0.3) < kHz / kN;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  double cycles_per_butterfly = 60;
+  double mhz = 125;
+  double budget_ms = 12.5;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) {
+      return atof(argv[i] + flag.size());
+    };
+    if (arg.starts_with("--cycles-per-butterfly=")) {
+      cycles_per_butterfly = value("--cycles-per-butterfly=");
+    } else if (arg.starts_with("--mhz=")) {
+      mhz = value("--mhz=");
+    } else if (arg.starts_with("--budget-ms=")) {
+      budget_ms = value("--budget-ms=");
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--cycles-per-butterfly=N] [--mhz=N] [--budget-ms=N]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  std::mt19937 rng(1);
+  bool ok = true;
+  printf(
+      "%6s %10s %12s %12s %14s\n",
+      "points",
+      "error dB",
+      "host us",
+      "butterflies",
+      "rp2040 ms");
+  for (int n : {256, 512, 1024}) {
+    const int butterflies = n / 2 * std::countr_zero(static_cast<unsigned>(n));
+    const double rp2040_ms = butterflies * cycles_per_butterfly / (mhz * 1e3);
+    const double db = SignalToErrorDb(n, rng);
+    printf(
+        "%6d %10.1f %12.2f %12d %14.2f\n",
+        n,
+        db,
+        MicrosPerTransform(n, rng),
+        butterflies,
+        rp2040_ms);
+    ok &= db > 40 && rp2040_ms < budget_ms;
+  }
+  ok &= CheckSummary();
+  printf(
+      "%s (budget %.1f ms per transform)\n", ok ? "ok" : "FAILED", budget_ms);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+// Measures the firmware's flash log (src/flash_log.h) on a simulated part:
+// write amplification and wear for a few record sizes, and the cost of
+// mounting a full log, projected onto the Pico W's flash.
+//
+//   flash_log_bench [--sectors=64] [--laps=10] [--read-mb-per-s=20]
+//                   [--read-setup-us=1] [--crc-cycles-per-byte=30]
+//                   [--mhz=125] [--kib-per-day=256] [--endurance=100000]
+//
+// Each workload appends records until the log has gone round the region
+// --laps times, setting one of eight values every tenth record, as the
+// station's state would change alongside buffered readings. Amplification
+// is flash bytes programmed, and erased, per payload byte.
+//
+// Mount reads go through the XIP window uncached: --read-setup-us is the
+// command and address for each, --read-mb-per-s the rate after that. The
+// CRC figure is an allowance for the nibble-table CRC on the M0+, charged
+// on every byte read. Exits non-zero if wear isn't level: every sector's
+// erase count within one of the others'.
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+#include <vector>
+
+#include "flash_log.h"
+#include "flashsim/flash.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  uint32_t sectors = 64;
+  int laps = 10;
+  double read_mb_per_s = 20;
+  double read_setup_us = 1;
+  double crc_cycles_per_byte = 30;
+  double mhz = 125;
+  double kib_per_day = 256;
+  double endurance = 100'000;
+};
+
+struct MountCost {
+  uint64_t reads;
+  uint64_t read_bytes;
+  double host_us;
+  double projected_ms;
+};
+
+MountCost TimeMount(const Options& o, flashsim::RamFlash& flash) {
+  flash.ResetCounters();
+  FlashLog log(flash);
+  const auto start = Clock::now();
+  log.Mount();
+  const double host_us =
+      std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+  const auto& c = flash.counters();
+  const double projected_us =
+      c.reads * o.read_setup_us + c.read_bytes / o.read_mb_per_s +
+      c.read_bytes * o.crc_cycles_per_byte / o.mhz;
+  return {c.reads, c.read_bytes, host_us, projected_us / 1000};
+}
+
+// Fills a log with records of `size` bytes and reports on it. `values_every`
+// is how many records go by between value updates, 0 for none.
+bool Run(const Options& o, uint32_t size, int values_every) {
+  flashsim::RamFlash flash(o.sectors);
+  FlashLog log(flash);
+  log.Mount();
+  flash.ResetCounters();
+
+  std::vector<uint8_t> payload(size);
+  std::vector<uint8_t> value(16);
+  const uint64_t region = uint64_t{o.sectors} * FlashDevice::kSectorBytes;
+  uint64_t payload_bytes = 0;
+  uint64_t records = 0;
+  while (flash.counters().erases < uint64_t{o.sectors} * o.laps) {
+    payload[0] = records;
+    log.Append(FlashLog::kFirstDataType, payload);
+    payload_bytes += size;
+    ++records;
+    if (values_every && records % values_every == 0) {
+      value[0] = records;
+      log.Put(records / values_every % 8, value);
+      payload_bytes += value.size();
+    }
+  }
+  const auto& c = flash.counters();
+  const double programmed = double(c.programmed_bytes) / payload_bytes;
+  const double erased =
+      double(c.erases) * FlashDevice::kSectorBytes / payload_bytes;
+  const auto [fewest, most] = std::ranges::minmax(flash.erase_counts());
+  // Sector erases a day, spread over the region, against the part's rated
+  // cycles.
+  const double erases_per_day =
+      o.kib_per_day * 1024 * erased / FlashDevice::kSectorBytes;
+  const double years = o.endurance * o.sectors / erases_per_day / 365;
+  printf(
+      "%4u B records%s: %.2f B programmed and %.2f B erased per byte, "
+      "%.2f page programs a record, %" PRIu64 " values relocated, "
+      "erases %u-%u, %.0f years at %.0f KiB/day\n",
+      size,
+      values_every == 1 ? " + a value each" : values_every ? " + values" : "",
+      programmed,
+      erased,
+      double(c.page_programs) / records,
+      uint64_t{log.stats().relocated},
+      fewest,
+      most,
+      years,
+      o.kib_per_day);
+
+  const MountCost m = TimeMount(o, flash);
+  printf(
+      "      mount of a full %.0f KiB log: %" PRIu64 " reads, %" PRIu64
+      " bytes, %.0f us here, %.1f ms projected\n",
+      region / 1024.0,
+      m.reads,
+      m.read_bytes,
+      m.host_us,
+      m.projected_ms);
+  return most - fewest <= 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options o;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg.starts_with("--sectors=")) {
+      o.sectors = atoi(value("--sectors="));
+    } else if (arg.starts_with("--laps=")) {
+      o.laps = atoi(value("--laps="));
+    } else if (arg.starts_with("--read-mb-per-s=")) {
+      o.read_mb_per_s = atof(value("--read-mb-per-s="));
+    } else if (arg.starts_with("--read-setup-us=")) {
+      o.read_setup_us = atof(value("--read-setup-us="));
+    } else if (arg.starts_with("--crc-cycles-per-byte=")) {
+      o.crc_cycles_per_byte = atof(value("--crc-cycles-per-byte="));
+    } else if (arg.starts_with("--mhz=")) {
+      o.mhz = atof(value("--mhz="));
+    } else if (arg.starts_with("--kib-per-day=")) {
+      o.kib_per_day = atof(value("--kib-per-day="));
+    } else if (arg.starts_with("--endurance=")) {
+      o.endurance = atof(value("--endurance="));
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--sectors=N] [--laps=N] [--read-mb-per-s=R] "
+          "[--read-setup-us=T] [--crc-cycles-per-byte=N] [--mhz=F] "
+          "[--kib-per-day=N] [--endurance=N]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  if (o.sectors < FlashLog::kMinSectors) {
+    fprintf(stderr, "need at least %u sectors\n", FlashLog::kMinSectors);
+    return 1;
+  }
+
+  bool ok = true;
+  for (uint32_t size : {16, 64, 256, 1024}) {
+    ok &= Run(o, size, 0);
+    ok &= Run(o, size, 10);
+  }
+  // Every record a value: every sector has some, so mount reads them all.
+  ok &= Run(o, 16, 1);
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,271 @@
+// Runs the firmware's flash log (src/flash_log.h) on a simulated flash part
+// through cycles of random writes, each ended by a power cut at a random
+// point in some program or erase, then remounts and checks that nothing
+// acknowledged before the cut was lost or changed.
+//
+//   flash_log_sim [--sectors=8] [--cycles=2000] [--ops=300] [--seed=1]
+//
+// Each cycle appends data records (most of them), sets and removes values
+// for a handful of keys, and is cut short. After it, every value must read
+// back as last set, or for the operation the cut interrupted, as it was
+// before or after. Data records must read back in order with no gaps, from
+// the oldest still held to the last acknowledged, or the interrupted one.
+// Exits non-zero on any failure.
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "flash_log.h"
+#include "flashsim/flash.h"
+
+namespace {
+
+constexpr uint8_t kDataType = FlashLog::kFirstDataType;
+constexpr uint16_t kKeys = 12;
+
+// Record `id`'s payload: the id, then bytes that depend on it.
+std::vector<uint8_t> DataPayload(uint32_t id) {
+  std::vector<uint8_t> payload(4 + (id * 2654435761u >> 24) % 200);
+  for (int i = 0; i < 4; ++i) payload[i] = id >> (8 * i);
+  for (size_t i = 4; i < payload.size(); ++i) payload[i] = id * 31 + i;
+  return payload;
+}
+
+std::vector<uint8_t> Value(uint16_t key, uint32_t version) {
+  std::vector<uint8_t> value(
+      (key * 7 + version) % (FlashLog::kMaxValueBytes + 1));
+  for (size_t i = 0; i < value.size(); ++i) value[i] = key ^ version ^ i;
+  return value;
+}
+
+using Values = std::map<uint16_t, std::vector<uint8_t>>;
+
+struct Totals {
+  uint64_t appends = 0;
+  uint64_t puts = 0;
+  uint64_t removes = 0;
+  uint64_t torn = 0;
+  uint64_t relocated = 0;
+  uint64_t held_min = UINT64_MAX;
+};
+
+class Checker {
+ public:
+  Checker(FlashLog& log, uint32_t sectors) : log_(log), sectors_(sectors) {}
+
+  // Checks the log against what was acknowledged, allowing for `pending`,
+  // and takes what it finds as the new state. False on a mismatch.
+  bool Check(
+      std::optional<uint32_t> pending_id,
+      std::optional<std::pair<uint16_t, std::optional<std::vector<uint8_t>>>>
+          pending_value,
+      Totals& totals) {
+    bool ok = true;
+    for (uint16_t key = 0; key < kKeys; ++key) {
+      std::vector<uint8_t> buffer(FlashLog::kMaxValueBytes);
+      std::optional<std::vector<uint8_t>> got;
+      if (const auto size = log_.Get(key, buffer)) {
+        buffer.resize(*size);
+        got = buffer;
+      }
+      const auto it = values_.find(key);
+      const std::optional<std::vector<uint8_t>> want =
+          it == values_.end() ? std::nullopt : std::optional(it->second);
+      if (got == want) continue;
+      if (pending_value && pending_value->first == key &&
+          got == pending_value->second) {
+        if (got) {
+          values_[key] = *got;
+        } else {
+          values_.erase(key);
+        }
+        continue;
+      }
+      fprintf(stderr, "key %u: value lost or changed\n", key);
+      ok = false;
+    }
+
+    std::optional<uint32_t> first, last;
+    std::vector<uint8_t> buffer(FlashLog::kMaxPayloadBytes);
+    FlashLog::Position position = log_.begin();
+    while (const auto record = log_.ReadNext(position, buffer)) {
+      buffer.resize(record->size);
+      const uint32_t id = buffer[0] | buffer[1] << 8 | buffer[2] << 16 |
+                          uint32_t(buffer[3]) << 24;
+      if (record->type != kDataType || buffer != DataPayload(id)) {
+        fprintf(stderr, "record %u corrupt\n", id);
+        ok = false;
+      } else if (last && id != *last + 1) {
+        fprintf(stderr, "records %u to %u missing\n", *last + 1, id - 1);
+        ok = false;
+      }
+      if (!first) first = id;
+      last = id;
+      buffer.resize(FlashLog::kMaxPayloadBytes);
+    }
+    const std::optional<uint32_t> acked =
+        next_id_ ? std::optional(next_id_ - 1) : std::nullopt;
+    if (last != acked && !(pending_id && last == pending_id)) {
+      fprintf(
+          stderr,
+          "last record %d, expected %d\n",
+          last ? int(*last) : -1,
+          acked ? int(*acked) : -1);
+      ok = false;
+    }
+    if (last) next_id_ = *last + 1;
+    // Once the log has gone round, how much it keeps.
+    if (first && last && log_.stats().sectors_in_use + 1 == sectors_) {
+      totals.held_min = std::min<uint64_t>(totals.held_min, *last - *first + 1);
+    }
+    return ok;
+  }
+
+  uint32_t next_id() const { return next_id_; }
+  void Acked(uint32_t id) { next_id_ = id + 1; }
+  Values& values() { return values_; }
+
+ private:
+  FlashLog& log_;
+  const uint32_t sectors_;
+  uint32_t next_id_ = 0;
+  Values values_;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint32_t sectors = 8;
+  int cycles = 2000;
+  int ops = 300;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg.starts_with("--sectors=")) {
+      sectors = atoi(value("--sectors="));
+    } else if (arg.starts_with("--cycles=")) {
+      cycles = atoi(value("--cycles="));
+    } else if (arg.starts_with("--ops=")) {
+      ops = atoi(value("--ops="));
+    } else if (arg.starts_with("--seed=")) {
+      seed = atoi(value("--seed="));
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--sectors=N] [--cycles=N] [--ops=N] [--seed=N]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  flashsim::RamFlash flash(sectors, seed);
+  // Whatever the part held before, the first mount formats it.
+  flash.Scramble();
+  FlashLog log(flash);
+  Checker checker(log, sectors);
+  std::mt19937 rng(seed);
+  Totals totals;
+  bool ok = true;
+  uint32_t versions[kKeys] = {};
+
+  for (int cycle = 0; cycle < cycles && ok; ++cycle) {
+    // The power cut lands somewhere in the cycle's flash operations, which
+    // run a few to an op, or not at all. Now and then it lands in the mount,
+    // while that finishes a rotation.
+    std::uniform_int_distribution<int> cut_at(0, ops);
+    const bool cut_in_mount =
+        std::uniform_int_distribution<int>(0, 9)(rng) == 0;
+    if (cut_in_mount) flash.CutPowerAfter(cut_at(rng) % 4);
+    if (!log.Mount()) {
+      fprintf(stderr, "mount failed\n");
+      return 1;
+    }
+    totals.torn += log.stats().torn_records;
+    if (!cut_in_mount) flash.CutPowerAfter(cut_at(rng));
+
+    // What the op the power cut interrupted was writing, if any.
+    std::optional<uint32_t> cut_id;
+    std::optional<std::pair<uint16_t, std::optional<std::vector<uint8_t>>>>
+        cut_value;
+    for (int op = 0; op < ops && flash.powered(); ++op) {
+      std::optional<uint32_t> pending_id;
+      std::optional<std::pair<uint16_t, std::optional<std::vector<uint8_t>>>>
+          pending_value;
+      const int kind = std::uniform_int_distribution<int>(0, 99)(rng);
+      const uint16_t key =
+          std::uniform_int_distribution<int>(0, kKeys - 1)(rng);
+      bool done;
+      if (kind < 75) {
+        const uint32_t id = checker.next_id();
+        pending_id = id;
+        done = log.Append(kDataType, DataPayload(id));
+        if (done && flash.powered()) checker.Acked(id);
+        ++totals.appends;
+      } else if (kind < 95) {
+        const std::vector<uint8_t> value = Value(key, ++versions[key]);
+        pending_value = {key, value};
+        done = log.Put(key, value);
+        if (done && flash.powered()) checker.values()[key] = value;
+        ++totals.puts;
+      } else {
+        pending_value = {key, std::nullopt};
+        done = log.Remove(key) || !checker.values().contains(key);
+        if (done && flash.powered()) checker.values().erase(key);
+        ++totals.removes;
+      }
+      if (!done) {
+        fprintf(stderr, "cycle %d: a write failed\n", cycle);
+        ok = false;
+      }
+      if (!flash.powered()) {
+        cut_id = pending_id;
+        cut_value = std::move(pending_value);
+      }
+    }
+    totals.relocated += log.stats().relocated;
+    flash.PowerOn();
+    if (!log.Mount()) {
+      fprintf(stderr, "remount failed\n");
+      return 1;
+    }
+    if (!checker.Check(cut_id, cut_value, totals)) {
+      fprintf(stderr, "cycle %d failed\n", cycle);
+      ok = false;
+    }
+  }
+
+  const FlashLog::Stats stats = log.stats();
+  const auto [fewest, most] = std::ranges::minmax(flash.erase_counts());
+  printf(
+      "%d cycles: %" PRIu64 " appends, %" PRIu64 " puts, %" PRIu64
+      " removes, %" PRIu64 " torn records seen by mounts, %" PRIu64
+      " values relocated\n",
+      cycles,
+      totals.appends,
+      totals.puts,
+      totals.removes,
+      totals.torn,
+      totals.relocated);
+  printf(
+      "sector erases %u-%u (the log counts %u-%u), fewest records held %" PRIu64
+      ", bad programs %" PRIu64 "\n",
+      fewest,
+      most,
+      stats.min_erases,
+      stats.max_erases,
+      totals.held_min == UINT64_MAX ? 0 : totals.held_min,
+      flash.counters().bad_programs);
+  ok &= flash.counters().bad_programs == 0;
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
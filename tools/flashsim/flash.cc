@@ -0,0 +1,104 @@
+#include "flashsim/flash.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace flashsim {
+
+RamFlash::RamFlash(uint32_t sectors, uint32_t seed)
+    : sectors_(sectors),
+      bytes_(sectors * kSectorBytes, 0xff),
+      erase_counts_(sectors),
+      rng_(seed) {}
+
+void RamFlash::Scramble() {
+  std::uniform_int_distribution<int> byte(0, 255);
+  for (uint8_t& b : bytes_) b = byte(rng_);
+}
+
+void RamFlash::PowerOn() {
+  powered_ = true;
+  cut_after_.reset();
+}
+
+bool RamFlash::Operate(bool& cut) {
+  cut = false;
+  if (!powered_) return false;
+  if (cut_after_) {
+    if (*cut_after_ == 0) {
+      cut = true;
+      powered_ = false;
+    } else {
+      --*cut_after_;
+    }
+  }
+  return true;
+}
+
+void RamFlash::Read(uint32_t offset, std::span<uint8_t> out) {
+  if (offset + out.size() > bytes_.size()) {
+    fprintf(stderr, "flash read out of range at %u\n", offset);
+    abort();
+  }
+  ++counters_.reads;
+  counters_.read_bytes += out.size();
+  std::copy_n(bytes_.begin() + offset, out.size(), out.begin());
+}
+
+void RamFlash::Program(uint32_t offset, std::span<const uint8_t> data) {
+  if (data.empty()) return;
+  if (offset / kSectorBytes != (offset + data.size() - 1) / kSectorBytes ||
+      offset + data.size() > bytes_.size()) {
+    fprintf(stderr, "flash program crosses a sector at %u\n", offset);
+    abort();
+  }
+  bool cut;
+  if (!Operate(cut)) return;
+  ++counters_.programs;
+  counters_.programmed_bytes += data.size();
+  counters_.page_programs += (offset + data.size() - 1) / kPageBytes -
+                             offset / kPageBytes + 1;
+
+  size_t n = data.size();
+  uint8_t last_mask = 0xff;
+  if (cut) {
+    n = std::uniform_int_distribution<size_t>(0, data.size() - 1)(rng_);
+    last_mask = std::uniform_int_distribution<int>(0, 255)(rng_);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    uint8_t& b = bytes_[offset + i];
+    if ((b & data[i]) != data[i]) ++counters_.bad_programs;
+    b &= data[i];
+  }
+  // The byte the cut landed in gets some of its zero bits.
+  if (cut) bytes_[offset + n] &= data[n] | last_mask;
+}
+
+void RamFlash::EraseSector(uint32_t sector) {
+  bool cut;
+  if (!Operate(cut)) return;
+  ++counters_.erases;
+  ++erase_counts_[sector];
+  const auto begin = bytes_.begin() + sector * kSectorBytes;
+  if (!cut) {
+    std::fill_n(begin, kSectorBytes, 0xff);
+    return;
+  }
+  // A prefix is erased, half the time none of it. The rest is anywhere from
+  // barely touched, header and all, to nearly erased.
+  std::uniform_real_distribution<double> chance(0, 1);
+  const uint32_t n =
+      chance(rng_) < 0.5
+          ? 0
+          : std::uniform_int_distribution<uint32_t>(0, kSectorBytes - 1)(rng_);
+  std::fill_n(begin, n, 0xff);
+  const double p = std::pow(chance(rng_), 4);
+  std::uniform_int_distribution<int> bits(0, 255);
+  for (uint32_t i = n; i < kSectorBytes; ++i) {
+    if (chance(rng_) < p) begin[i] |= bits(rng_);
+  }
+}
+
+}  // namespace flashsim
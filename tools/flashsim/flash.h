@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "flash_log.h"
+
+// A RAM-backed NOR flash for running the firmware's flash log
+// (src/flash_log.h) on the host, with power cuts that leave an operation
+// half done.
+namespace flashsim {
+
+class RamFlash : public FlashDevice {
+ public:
+  struct Counters {
+    uint64_t reads = 0;
+    uint64_t read_bytes = 0;
+    uint64_t programs = 0;
+    uint64_t programmed_bytes = 0;  // As asked for, before page padding.
+    uint64_t page_programs = 0;
+    uint64_t erases = 0;
+    // Programs that tried to turn a 0 bit back into a 1, which NOR flash
+    // can't do. The log should never make one.
+    uint64_t bad_programs = 0;
+  };
+
+  // Starts erased, as a new part is.
+  explicit RamFlash(uint32_t sectors, uint32_t seed = 1);
+
+  // Fills the whole part with random bytes, as an unknown previous use might
+  // have left it.
+  void Scramble();
+
+  // The program or erase `ops` operations from now (0 for the next) is cut
+  // short part way, and every operation after it is ignored until PowerOn.
+  // A cut program writes a prefix of its bytes, the last one only partly;
+  // a cut erase erases a prefix of the sector and leaves the rest with some
+  // bits set.
+  void CutPowerAfter(uint64_t ops) { cut_after_ = ops; }
+  bool powered() const { return powered_; }
+  void PowerOn();
+
+  const Counters& counters() const { return counters_; }
+  void ResetCounters() { counters_ = {}; }
+  const std::vector<uint32_t>& erase_counts() const { return erase_counts_; }
+
+  uint32_t sectors() const override { return sectors_; }
+  void Read(uint32_t offset, std::span<uint8_t> out) override;
+  void Program(uint32_t offset, std::span<const uint8_t> data) override;
+  void EraseSector(uint32_t sector) override;
+
+ private:
+  // False if the operation should be dropped; sets `cut` if it is the one
+  // that gets cut short.
+  bool Operate(bool& cut);
+
+  const uint32_t sectors_;
+  std::vector<uint8_t> bytes_;
+  std::vector<uint32_t> erase_counts_;
+  std::mt19937 rng_;
+  std::optional<uint64_t> cut_after_;
+  bool powered_ = true;
+  Counters counters_;
+};
+
+}  // namespace flashsim
@@ -0,0 +1,238 @@
+#include "fleet/anomaly.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace fleet {
+namespace {
+
+double DistanceKm(double lat1, double lon1, double lat2, double lon2) {
+  constexpr double kEarthRadiusKm = 6371;
+  constexpr double kRad = std::numbers::pi / 180;
+  const double dlat = (lat2 - lat1) * kRad;
+  const double dlon = (lon2 - lon1) * kRad;
+  const double a = std::sin(dlat / 2) * std::sin(dlat / 2) +
+                   std::cos(lat1 * kRad) * std::cos(lat2 * kRad) *
+                       std::sin(dlon / 2) * std::sin(dlon / 2);
+  return 2 * kEarthRadiusKm * std::asin(std::sqrt(a));
+}
+
+}  // namespace
+
+const char* AlertName(AlertKind kind) {
+  switch (kind) {
+    case AlertKind::kStuckVane:
+      return "stuck_vane";
+    case AlertKind::kDeadAnemometer:
+      return "dead_anemometer";
+    case AlertKind::kCloggedRainGauge:
+      return "clogged_rain_gauge";
+    case AlertKind::kDivergentWind:
+      return "divergent_wind";
+    case AlertKind::kSilent:
+      return "silent";
+  }
+  return "unknown";
+}
+
+FleetDetector::FleetDetector(DetectorOptions options) : options_(options) {}
+
+uint32_t FleetDetector::AddStation(
+    std::string_view id, double lat, double lon) {
+  const uint32_t i = StationIndex(id);
+  stations_[i].lat = lat;
+  stations_[i].lon = lon;
+  stations_[i].located = true;
+  return i;
+}
+
+uint32_t FleetDetector::StationIndex(std::string_view id) {
+  if (auto it = by_id_.find(id); it != by_id_.end()) return it->second;
+  const uint32_t i = stations_.size();
+  stations_.emplace_back();
+  ids_.emplace_back(id);
+  by_id_.emplace(ids_.back(), i);
+  return i;
+}
+
+void FleetDetector::ComputeNeighbours(int k, double max_km) {
+  neighbours_.clear();
+  std::vector<std::pair<double, uint32_t>> candidates;
+  for (uint32_t i = 0; i < stations_.size(); ++i) {
+    Station& s = stations_[i];
+    s.first_neighbour = neighbours_.size();
+    s.neighbour_count = 0;
+    if (!s.located) continue;
+    candidates.clear();
+    for (uint32_t j = 0; j < stations_.size(); ++j) {
+      const Station& o = stations_[j];
+      if (j == i || !o.located) continue;
+      const double d = DistanceKm(s.lat, s.lon, o.lat, o.lon);
+      if (d <= max_km) candidates.emplace_back(d, j);
+    }
+    const size_t n = std::min<size_t>(std::min(k, 255), candidates.size());
+    std::partial_sort(
+        candidates.begin(), candidates.begin() + n, candidates.end());
+    for (size_t c = 0; c < n; ++c) neighbours_.push_back(candidates[c].second);
+    s.neighbour_count = n;
+  }
+}
+
+bool FleetDetector::OnMessage(
+    int64_t t_ms, std::string_view topic, std::string_view payload) {
+  const std::optional<StateTopic> parsed = ParseStateTopic(topic);
+  if (!parsed) return false;
+  const std::optional<float> value = ParsePayload(parsed->sensor, payload);
+  if (!value) return false;
+  OnReading(t_ms, StationIndex(parsed->station), parsed->sensor, *value);
+  return true;
+}
+
+void FleetDetector::OnReading(
+    int64_t t_ms, uint32_t station, Sensor sensor, float value) {
+  Station& s = stations_[station];
+  s.last_message_ms = t_ms;
+  if (s.active & (1 << static_cast<int>(AlertKind::kSilent))) {
+    Set(t_ms, station, AlertKind::kSilent, false);
+  }
+
+  switch (sensor) {
+    case Sensor::kWindSpeed: {
+      if (s.wind_ms < 0) {
+        s.wind_ewma = value;
+        s.last_nonzero_wind_ms = t_ms;
+      } else {
+        const double dt = std::max<int64_t>(t_ms - s.wind_ms, 0);
+        const double alpha = 1 - std::exp(-dt / options_.wind_tau_ms);
+        s.wind_ewma += alpha * (value - s.wind_ewma);
+        if (s.wind_ewma >= options_.windy_mph) {
+          s.windy_ms_since_vane_moved += dt;
+        }
+      }
+      s.wind_ms = t_ms;
+      if (value > 0) {
+        s.last_nonzero_wind_ms = t_ms;
+        if (s.active & (1 << static_cast<int>(AlertKind::kDeadAnemometer))) {
+          Set(t_ms, station, AlertKind::kDeadAnemometer, false);
+        }
+      }
+      if (s.windy_ms_since_vane_moved >= options_.stuck_vane_ms &&
+          !(s.active & (1 << static_cast<int>(AlertKind::kStuckVane)))) {
+        Set(t_ms, station, AlertKind::kStuckVane, true);
+      }
+      break;
+    }
+    case Sensor::kWindDirection: {
+      const int8_t sector = static_cast<int8_t>(value);
+      if (sector != s.sector) {
+        s.sector = sector;
+        s.windy_ms_since_vane_moved = 0;
+        if (s.active & (1 << static_cast<int>(AlertKind::kStuckVane))) {
+          Set(t_ms, station, AlertKind::kStuckVane, false);
+        }
+      }
+      break;
+    }
+    case Sensor::kRain:
+      s.rain_rate = value;
+      s.rain_ms = t_ms;
+      if (value > 0) {
+        s.dry_while_neighbours_wet_ms = 0;
+        if (s.active & (1 << static_cast<int>(AlertKind::kCloggedRainGauge))) {
+          Set(t_ms, station, AlertKind::kCloggedRainGauge, false);
+        }
+      }
+      break;
+  }
+
+  if (t_ms >= next_sweep_ms_) Sweep(t_ms);
+}
+
+void FleetDetector::Sweep(int64_t now_ms) {
+  if (last_sweep_ms_ == INT64_MIN) first_sweep_ms_ = now_ms;
+  const int64_t dt = last_sweep_ms_ == INT64_MIN ? 0 : now_ms - last_sweep_ms_;
+  last_sweep_ms_ = now_ms;
+  next_sweep_ms_ = now_ms + options_.sweep_ms;
+  // Rain is reported every ten minutes; a neighbour's last report counts as
+  // current for a little longer than that.
+  constexpr int64_t kRainFreshMs = 25 * 60'000;
+
+  for (uint32_t i = 0; i < stations_.size(); ++i) {
+    Station& s = stations_[i];
+    // Stations that haven't spoken yet get silent_ms from when we started.
+    const int64_t heard_ms = std::max(s.last_message_ms, first_sweep_ms_);
+    if (now_ms - heard_ms > options_.silent_ms &&
+        !(s.active & (1 << static_cast<int>(AlertKind::kSilent)))) {
+      Set(now_ms, i, AlertKind::kSilent, true);
+    }
+    if (s.neighbour_count == 0) continue;
+
+    double wind_sum = 0;
+    int wind_n = 0;
+    int rain_fresh = 0;
+    int rain_wet = 0;
+    for (int n = 0; n < s.neighbour_count; ++n) {
+      const Station& o = stations_[neighbours_[s.first_neighbour + n]];
+      if (o.wind_ms >= 0 && now_ms - o.wind_ms <= options_.silent_ms &&
+          !(o.active & (1 << static_cast<int>(AlertKind::kDeadAnemometer)))) {
+        wind_sum += o.wind_ewma;
+        ++wind_n;
+      }
+      if (o.rain_ms >= 0 && now_ms - o.rain_ms <= kRainFreshMs) {
+        ++rain_fresh;
+        if (o.rain_rate > 0) ++rain_wet;
+      }
+    }
+
+    if (wind_n > 0 && s.wind_ms >= 0) {
+      const double neighbours = wind_sum / wind_n;
+      if (neighbours >= options_.windy_mph &&
+          now_ms - s.last_nonzero_wind_ms >= options_.dead_anemometer_ms &&
+          !(s.active & (1 << static_cast<int>(AlertKind::kDeadAnemometer)))) {
+        Set(now_ms, i, AlertKind::kDeadAnemometer, true);
+      }
+
+      const double ratio = (s.wind_ewma + 1) / (neighbours + 1);
+      const bool windy =
+          std::max(s.wind_ewma, static_cast<float>(neighbours)) >=
+          options_.windy_mph;
+      const bool diverging = windy && (ratio > options_.divergence_ratio ||
+                                       ratio < 1 / options_.divergence_ratio);
+      const bool active =
+          s.active & (1 << static_cast<int>(AlertKind::kDivergentWind));
+      if (diverging) {
+        s.divergent_ms += dt;
+        if (s.divergent_ms >= options_.divergent_wind_ms && !active) {
+          Set(now_ms, i, AlertKind::kDivergentWind, true);
+        }
+      } else {
+        s.divergent_ms = 0;
+        if (active) Set(now_ms, i, AlertKind::kDivergentWind, false);
+      }
+    }
+
+    if (s.rain_ms >= 0 && s.rain_rate == 0 && rain_fresh >= 2 &&
+        2 * rain_wet > rain_fresh) {
+      s.dry_while_neighbours_wet_ms += dt;
+      if (s.dry_while_neighbours_wet_ms >= options_.clogged_rain_ms &&
+          !(s.active & (1 << static_cast<int>(AlertKind::kCloggedRainGauge)))) {
+        Set(now_ms, i, AlertKind::kCloggedRainGauge, true);
+      }
+    }
+  }
+}
+
+void FleetDetector::Set(
+    int64_t t_ms, uint32_t station, AlertKind kind, bool active) {
+  const uint8_t bit = 1 << static_cast<int>(kind);
+  Station& s = stations_[station];
+  if (active) {
+    s.active |= bit;
+  } else {
+    s.active &= ~bit;
+  }
+  if (alert_handler_) alert_handler_({t_ms, station, kind, active});
+}
+
+}  // namespace fleet
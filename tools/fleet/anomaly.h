@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "fleet/topics.h"
+
+namespace fleet {
+
+struct DetectorOptions {
+  // Wind at or above this (EWMA, mph) counts as "windy" for the checks below.
+  float windy_mph = 5;
+  // Time constant of the per-station wind EWMA.
+  int64_t wind_tau_ms = 30 * 60'000;
+  // The vane hasn't left its sector through this much windy time.
+  int64_t stuck_vane_ms = 24 * 3'600'000;
+  // The anemometer has read zero this long while neighbours are windy.
+  int64_t dead_anemometer_ms = 2 * 3'600'000;
+  // The gauge reported dry for this much time while most neighbours reported
+  // rain.
+  int64_t clogged_rain_ms = 60 * 60'000;
+  // Wind has differed from the neighbours' by more than divergence_ratio
+  // (either way, on (mph + 1)) for this long.
+  int64_t divergent_wind_ms = 6 * 3'600'000;
+  float divergence_ratio = 2.5;
+  // No state message at all for this long.
+  int64_t silent_ms = 15 * 60'000;
+  // Cross-station checks run every sweep_ms of stream time.
+  int64_t sweep_ms = 60'000;
+};
+
+enum class AlertKind : uint8_t {
+  kStuckVane,
+  kDeadAnemometer,
+  kCloggedRainGauge,
+  kDivergentWind,
+  kSilent,
+};
+inline constexpr int kAlertKinds = 5;
+const char* AlertName(AlertKind kind);
+
+struct Alert {
+  int64_t t_ms;
+  uint32_t station;
+  AlertKind kind;
+  bool raised;  // False when the condition clears.
+};
+
+// Keeps constant-size rolling state per station, updated in O(1) per message,
+// and periodically compares each station with its nearest neighbours.
+class FleetDetector {
+ public:
+  explicit FleetDetector(DetectorOptions options = {});
+
+  // Registers a station with a location for neighbour comparisons. Stations
+  // first seen in a topic are added without one and only get self checks.
+  uint32_t AddStation(std::string_view id, double lat, double lon);
+  // Picks up to `k` neighbours within `max_km` for every located station.
+  void ComputeNeighbours(int k, double max_km);
+
+  // Returns false if the message isn't a parseable station state message.
+  bool OnMessage(
+      int64_t t_ms, std::string_view topic, std::string_view payload);
+  void OnReading(int64_t t_ms, uint32_t station, Sensor sensor, float value);
+
+  // Runs the cross-station checks. OnReading calls this every sweep_ms.
+  void Sweep(int64_t now_ms);
+
+  void set_alert_handler(std::function<void(const Alert&)> handler) {
+    alert_handler_ = std::move(handler);
+  }
+
+  size_t station_count() const { return stations_.size(); }
+  const std::string& station_id(uint32_t i) const { return ids_[i]; }
+  // Bytes of per-station state, for sizing a deployment.
+  static constexpr size_t kStateBytes();
+
+ private:
+  struct Station {
+    double lat = 0;
+    double lon = 0;
+    bool located = false;
+    int64_t last_message_ms = 0;
+
+    float wind_ewma = 0;
+    int64_t wind_ms = -1;  // Time of the last wind reading.
+    int64_t last_nonzero_wind_ms = 0;
+
+    int8_t sector = -1;
+    int64_t windy_ms_since_vane_moved = 0;
+
+    float rain_rate = 0;
+    int64_t rain_ms = -1;
+    int64_t dry_while_neighbours_wet_ms = 0;
+
+    int64_t divergent_ms = 0;
+    uint8_t active = 0;  // Bit per AlertKind.
+    uint32_t first_neighbour = 0;
+    uint8_t neighbour_count = 0;
+  };
+
+  struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const {
+      return std::hash<std::string_view>{}(s);
+    }
+  };
+
+  uint32_t StationIndex(std::string_view id);
+  void Set(int64_t t_ms, uint32_t station, AlertKind kind, bool active);
+
+  DetectorOptions options_;
+  std::vector<Station> stations_;
+  std::vector<std::string> ids_;
+  std::unordered_map<std::string, uint32_t, StringHash, std::equal_to<>> by_id_;
+  // Neighbour lists of all stations, back to back.
+  std::vector<uint32_t> neighbours_;
+  int64_t next_sweep_ms_ = INT64_MIN;
+  int64_t last_sweep_ms_ = INT64_MIN;
+  int64_t first_sweep_ms_ = 0;
+  std::function<void(const Alert&)> alert_handler_;
+};
+
+constexpr size_t FleetDetector::kStateBytes() { return sizeof(Station); }
+
+}  // namespace fleet
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <charconv>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "tsdb/block.h"
+
+namespace fleet {
+
+// The three state topics each station publishes.
+enum class Sensor { kWindDirection, kWindSpeed, kRain };
+
+// Object id suffixes of the devices the firmware registers for discovery
+// (weatherstation_wind_dir, weatherstation_anemometer,
+// weatherstation_rain_gauge). Whatever precedes the suffix identifies the
+// station, so a fleet gives each board its own prefix.
+inline constexpr std::string_view kWindDirectionSuffix = "_wind_dir";
+inline constexpr std::string_view kWindSpeedSuffix = "_anemometer";
+inline constexpr std::string_view kRainSuffix = "_rain_gauge";
+
+struct StateTopic {
+  std::string_view station;
+  Sensor sensor;
+};
+
+// Parses "<station><suffix>", the object id the firmware registers a sensor
+// under, which Home Assistant also names its entity after
+// (sensor.<station><suffix>).
+inline std::optional<StateTopic> ParseObjectId(std::string_view object_id) {
+  for (const auto& [suffix, sensor] :
+       {std::pair{kWindDirectionSuffix, Sensor::kWindDirection},
+        std::pair{kWindSpeedSuffix, Sensor::kWindSpeed},
+        std::pair{kRainSuffix, Sensor::kRain}}) {
+    if (object_id.size() > suffix.size() && object_id.ends_with(suffix)) {
+      return StateTopic{
+          object_id.substr(0, object_id.size() - suffix.size()), sensor};
+    }
+  }
+  return std::nullopt;
+}
+
+// Parses ".../<station><suffix>/state". Returns nullopt for other topics
+// (discovery config, availability, ...).
+inline std::optional<StateTopic> ParseStateTopic(std::string_view topic) {
+  constexpr std::string_view kState = "/state";
+  if (!topic.ends_with(kState)) return std::nullopt;
+  topic.remove_suffix(kState.size());
+  const size_t slash = topic.rfind('/');
+  return ParseObjectId(
+      slash == std::string_view::npos ? topic : topic.substr(slash + 1));
+}
+
+// The topic a station publishes `sensor` on, for generators and replays.
+inline std::string StateTopicFor(
+    std::string_view prefix, std::string_view station, Sensor sensor) {
+  std::string topic(prefix);
+  topic += "/sensor/";
+  topic += station;
+  switch (sensor) {
+    case Sensor::kWindDirection:
+      topic += kWindDirectionSuffix;
+      break;
+    case Sensor::kWindSpeed:
+      topic += kWindSpeedSuffix;
+      break;
+    case Sensor::kRain:
+      topic += kRainSuffix;
+      break;
+  }
+  topic += "/state";
+  return topic;
+}
+
+// Parses a state payload: a sector name for the vane, otherwise a number
+// (mph or in/h as printed by std::to_string).
+inline std::optional<float> ParsePayload(
+    Sensor sensor, std::string_view payload) {
+  if (sensor == Sensor::kWindDirection) {
+    for (size_t i = 0; i < tsdb::kSectorNames.size(); ++i) {
+      if (tsdb::kSectorNames[i] == payload) return static_cast<float>(i);
+    }
+    return std::nullopt;
+  }
+  float value;
+  const auto [end, ec] =
+      std::from_chars(payload.data(), payload.data() + payload.size(), value);
+  if (ec != std::errc() || end == payload.data()) return std::nullopt;
+  return value;
+}
+
+}  // namespace fleet
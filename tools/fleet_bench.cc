@@ -0,0 +1,293 @@
+// Replays a synthetic fleet through FleetDetector on one core and reports
+// message throughput and how many injected faults were caught.
+//
+//   fleet_bench [--stations=1000] [--days=3] [--seed=1] [--write-replay=FILE]
+//
+// Stations sit on a 5 km grid; blocks of 4x4 stations share a regional
+// weather generator so neighbours agree. A few percent of stations get each
+// kind of fault partway through the run.
+
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fleet/anomaly.h"
+#include "fleet/topics.h"
+#include "tsdb/synthetic.h"
+
+namespace {
+
+constexpr int64_t kStartMs = 1'700'000'000'000;
+constexpr int64_t kTickMs = 5000;
+constexpr int kRainEveryTicks = 120;  // Ten minutes.
+constexpr float kMphPerTick = 1.73 / 5;
+constexpr float kRainInchesPerTick = 0.011;
+
+enum Fault {
+  kNone,
+  kStuckVane,
+  kDeadAnemometer,
+  kClogged,
+  kDivergent,
+  kSilent
+};
+constexpr const char* kFaultNames[] = {
+    "none",
+    "stuck_vane",
+    "dead_anemometer",
+    "clogged_rain_gauge",
+    "divergent_wind",
+    "silent"};
+
+fleet::AlertKind AlertFor(Fault f) {
+  switch (f) {
+    case kStuckVane:
+      return fleet::AlertKind::kStuckVane;
+    case kDeadAnemometer:
+      return fleet::AlertKind::kDeadAnemometer;
+    case kClogged:
+      return fleet::AlertKind::kCloggedRainGauge;
+    case kDivergent:
+      return fleet::AlertKind::kDivergentWind;
+    default:
+      return fleet::AlertKind::kSilent;
+  }
+}
+
+struct SimStation {
+  std::string id;
+  std::array<std::string, 3> topics;
+  int region;
+  float factor;
+  Fault fault = kNone;
+  int64_t fault_tick = 0;
+  int frozen_sector = -1;
+  uint32_t detector_index = 0;
+  bool caught = false;
+  // Clogging is only observable while it rains, so count how long it did.
+  int64_t wet_while_clogged_ms = 0;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int num_stations = 1000;
+  int days = 3;
+  uint32_t seed = 1;
+  const char* replay_path = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--stations=")) {
+      num_stations = atoi(argv[i] + strlen("--stations="));
+    } else if (arg.starts_with("--days=")) {
+      days = atoi(argv[i] + strlen("--days="));
+    } else if (arg.starts_with("--seed=")) {
+      seed = atoi(argv[i] + strlen("--seed="));
+    } else if (arg.starts_with("--write-replay=")) {
+      replay_path = argv[i] + strlen("--write-replay=");
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--stations=N] [--days=N] [--seed=N] "
+          "[--write-replay=FILE]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> unit(0, 1);
+  const int64_t total_ticks = days * 24 * 720;
+  const int side = std::ceil(std::sqrt(num_stations));
+  const int regions_per_row = (side + 3) / 4;
+
+  fleet::DetectorOptions options;
+  options.stuck_vane_ms = 12 * 3'600'000;
+  fleet::FleetDetector detector(options);
+
+  std::vector<SimStation> stations(num_stations);
+  std::array<int, 6> injected = {};
+  for (int i = 0; i < num_stations; ++i) {
+    SimStation& s = stations[i];
+    const int row = i / side;
+    const int col = i % side;
+    s.id = "station" + std::to_string(i);
+    auto topic = [&](fleet::Sensor sensor) {
+      return fleet::StateTopicFor("homeassistant", s.id, sensor);
+    };
+    s.topics = {
+        topic(fleet::Sensor::kWindDirection),
+        topic(fleet::Sensor::kWindSpeed),
+        topic(fleet::Sensor::kRain)};
+    s.region = (row / 4) * regions_per_row + col / 4;
+    s.factor = 0.85 + 0.3 * unit(rng);
+    // Roughly 5 km apart.
+    s.detector_index =
+        detector.AddStation(s.id, 45 + row * 0.045, -120 + col * 0.064);
+    const double r = unit(rng);
+    if (r < 0.02) {
+      s.fault = kStuckVane;
+    } else if (r < 0.04) {
+      s.fault = kDeadAnemometer;
+    } else if (r < 0.06) {
+      s.fault = kClogged;
+    } else if (r < 0.08) {
+      s.fault = kDivergent;
+    } else if (r < 0.09) {
+      s.fault = kSilent;
+    }
+    s.fault_tick = unit(rng) * total_ticks / 4;
+    ++injected[s.fault];
+  }
+  detector.ComputeNeighbours(6, 15);
+
+  // [faulty][kind]
+  std::array<std::array<uint64_t, fleet::kAlertKinds>, 2> raised = {};
+  detector.set_alert_handler([&](const fleet::Alert& alert) {
+    if (!alert.raised) return;
+    SimStation& s = stations[alert.station];
+    ++raised[s.fault != kNone][static_cast<int>(alert.kind)];
+    if (s.fault != kNone && alert.kind == AlertFor(s.fault)) s.caught = true;
+  });
+
+  std::vector<std::unique_ptr<tsdb::SyntheticStation>> regions;
+  for (int r = 0; r < regions_per_row * regions_per_row; ++r) {
+    regions.push_back(
+        std::make_unique<tsdb::SyntheticStation>(seed * 1000 + r, kStartMs));
+  }
+  std::vector<tsdb::Sample> weather(regions.size());
+  std::vector<uint32_t> region_rain(regions.size());
+
+  FILE* replay = replay_path ? fopen(replay_path, "w") : nullptr;
+  struct Pending {
+    uint32_t station;
+    fleet::Sensor sensor;
+    char payload[24];
+  };
+  std::vector<Pending> batch;
+  batch.reserve(3 * num_stations);
+  std::chrono::nanoseconds detector_time{0};
+  uint64_t messages = 0;
+
+  for (int64_t tick = 1; tick <= total_ticks; ++tick) {
+    const int64_t t_ms = kStartMs + tick * kTickMs;
+    for (size_t r = 0; r < regions.size(); ++r) {
+      weather[r] = regions[r]->Next();
+      region_rain[r] += weather[r].rain_ticks;
+    }
+    const bool rain_tick = tick % kRainEveryTicks == 0;
+
+    batch.clear();
+    for (int i = 0; i < num_stations; ++i) {
+      SimStation& s = stations[i];
+      const bool faulty = s.fault != kNone && tick >= s.fault_tick;
+      if (faulty && s.fault == kSilent) continue;
+      const tsdb::Sample& w = weather[s.region];
+
+      float wind =
+          std::round(w.wind_mph * s.factor / kMphPerTick) * kMphPerTick;
+      if (faulty && s.fault == kDeadAnemometer) wind = 0;
+      if (faulty && s.fault == kDivergent) wind *= 0.2;
+      const int wobble = unit(rng) < 0.3 ? (unit(rng) < 0.5 ? 15 : 1) : 0;
+      int sector = (w.sector + wobble) % 16;
+      if (faulty && s.fault == kStuckVane) {
+        if (s.frozen_sector < 0) s.frozen_sector = sector;
+        sector = s.frozen_sector;
+      }
+      Pending& dir = batch.emplace_back(
+          Pending{static_cast<uint32_t>(i), fleet::Sensor::kWindDirection});
+      snprintf(
+          dir.payload,
+          sizeof(dir.payload),
+          "%s",
+          tsdb::kSectorNames[sector].data());
+      Pending& speed = batch.emplace_back(
+          Pending{static_cast<uint32_t>(i), fleet::Sensor::kWindSpeed});
+      snprintf(speed.payload, sizeof(speed.payload), "%f", wind);
+
+      if (rain_tick) {
+        // Neighbouring gauges catch slightly different amounts.
+        float rate = region_rain[s.region] * s.factor * kRainInchesPerTick * 6;
+        if (faulty && s.fault == kClogged) {
+          if (rate > 0) s.wet_while_clogged_ms += kRainEveryTicks * kTickMs;
+          rate = 0;
+        }
+        Pending& rain = batch.emplace_back(
+            Pending{static_cast<uint32_t>(i), fleet::Sensor::kRain});
+        snprintf(rain.payload, sizeof(rain.payload), "%f", rate);
+      }
+    }
+    if (rain_tick) std::fill(region_rain.begin(), region_rain.end(), 0);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (const Pending& p : batch) {
+      detector.OnMessage(
+          t_ms,
+          stations[p.station].topics[static_cast<int>(p.sensor)],
+          p.payload);
+    }
+    detector_time += std::chrono::steady_clock::now() - start;
+    messages += batch.size();
+
+    if (replay) {
+      for (const Pending& p : batch) {
+        fprintf(
+            replay,
+            "%" PRId64 " %s %s\n",
+            t_ms,
+            stations[p.station].topics[static_cast<int>(p.sensor)].c_str(),
+            p.payload);
+      }
+    }
+  }
+  if (replay) fclose(replay);
+
+  const double secs = std::chrono::duration<double>(detector_time).count();
+  printf(
+      "%d stations, %d days: %" PRIu64 " messages in %.2f s on one core, "
+      "%.2f Mmsg/s (%.0fx real time)\n",
+      num_stations,
+      days,
+      messages,
+      secs,
+      messages / secs / 1e6,
+      days * 86400.0 / secs);
+  printf(
+      "per-station state %zu bytes\n\n", fleet::FleetDetector::kStateBytes());
+
+  // "observable" excludes clogged gauges that saw too little rain after the
+  // fault to be distinguishable from a dry spell.
+  printf("%-20s %8s %10s %8s\n", "fault", "injected", "observable", "caught");
+  for (int f = kStuckVane; f <= kSilent; ++f) {
+    int caught = 0;
+    int observable = 0;
+    for (const SimStation& s : stations) {
+      if (s.fault != f) continue;
+      caught += s.caught;
+      observable +=
+          f != kClogged || s.wet_while_clogged_ms >= options.clogged_rain_ms;
+    }
+    printf(
+        "%-20s %8d %10d %8d\n",
+        kFaultNames[f],
+        injected[f],
+        observable,
+        caught);
+  }
+  printf("\nalerts raised on healthy stations (false positives):\n");
+  for (int k = 0; k < fleet::kAlertKinds; ++k) {
+    printf(
+        "  %-20s %" PRIu64 "\n",
+        fleet::AlertName(static_cast<fleet::AlertKind>(k)),
+        raised[0][k]);
+  }
+  return 0;
+}
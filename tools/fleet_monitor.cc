@@ -0,0 +1,157 @@
+// Watches station state topics for stuck, flatlined or divergent sensors and
+// prints alerts as JSON lines.
+//
+//   fleet_monitor [--stations=FILE] [--neighbours=6] [--radius-km=50]
+//                 (--mqtt=HOST[:PORT] [--topic=FILTER] [--user=U]
+//                  [--password=P] | --replay=FILE)
+//
+// The stations file has one "ID LAT LON" line per station. A replay file has
+// one "T_MS TOPIC PAYLOAD" line per message, in time order.
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "fleet/anomaly.h"
+#include "mqtt/client.h"
+
+namespace {
+
+int64_t NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+bool LoadStations(const char* path, fleet::FleetDetector& detector) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  char id[256];
+  double lat;
+  double lon;
+  while (fscanf(f, "%255s %lf %lf", id, &lat, &lon) == 3) {
+    detector.AddStation(id, lat, lon);
+  }
+  fclose(f);
+  return true;
+}
+
+int Replay(const char* path, fleet::FleetDetector& detector) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  char line[1024];
+  while (fgets(line, sizeof(line), f)) {
+    std::string_view rest(line);
+    while (!rest.empty() && (rest.back() == '\n' || rest.back() == '\r')) {
+      rest.remove_suffix(1);
+    }
+    const size_t a = rest.find(' ');
+    const size_t b = rest.find(' ', a + 1);
+    if (a == std::string_view::npos || b == std::string_view::npos) continue;
+    const int64_t t_ms = strtoll(line, nullptr, 10);
+    detector.OnMessage(t_ms, rest.substr(a + 1, b - a - 1), rest.substr(b + 1));
+  }
+  fclose(f);
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* stations_path = nullptr;
+  const char* replay_path = nullptr;
+  int neighbours = 6;
+  double radius_km = 50;
+  mqtt::ConnectInfo connect{.client_id = "fleet_monitor"};
+  std::string filter = "homeassistant/#";
+  bool use_mqtt = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg.starts_with("--stations=")) {
+      stations_path = value("--stations=");
+    } else if (arg.starts_with("--replay=")) {
+      replay_path = value("--replay=");
+    } else if (arg.starts_with("--neighbours=")) {
+      neighbours = atoi(value("--neighbours="));
+    } else if (arg.starts_with("--radius-km=")) {
+      radius_km = atof(value("--radius-km="));
+    } else if (arg.starts_with("--mqtt=")) {
+      use_mqtt = true;
+      const std::string_view host = value("--mqtt=");
+      const size_t colon = host.rfind(':');
+      connect.host = host.substr(0, colon);
+      if (colon != std::string_view::npos) {
+        connect.port = atoi(std::string(host.substr(colon + 1)).c_str());
+      }
+    } else if (arg.starts_with("--topic=")) {
+      filter = value("--topic=");
+    } else if (arg.starts_with("--user=")) {
+      connect.user = value("--user=");
+    } else if (arg.starts_with("--password=")) {
+      connect.password = value("--password=");
+    } else {
+      use_mqtt = false;
+      replay_path = nullptr;
+      break;
+    }
+  }
+  if (use_mqtt == (replay_path != nullptr)) {
+    fprintf(
+        stderr,
+        "usage: %s [--stations=FILE] [--neighbours=N] [--radius-km=KM] "
+        "(--mqtt=HOST[:PORT] [--topic=FILTER] [--user=U] [--password=P] | "
+        "--replay=FILE)\n",
+        argv[0]);
+    return 1;
+  }
+
+  fleet::FleetDetector detector;
+  if (stations_path && !LoadStations(stations_path, detector)) return 1;
+  detector.ComputeNeighbours(neighbours, radius_km);
+  detector.set_alert_handler([&](const fleet::Alert& alert) {
+    printf(
+        "{\"t_ms\":%" PRId64
+        ",\"station\":\"%s\",\"alert\":\"%s\",\"state\":\"%s\"}\n",
+        alert.t_ms,
+        detector.station_id(alert.station).c_str(),
+        fleet::AlertName(alert.kind),
+        alert.raised ? "raised" : "cleared");
+    fflush(stdout);
+  });
+
+  if (replay_path) return Replay(replay_path, detector);
+
+  auto client = mqtt::Client::Connect(connect);
+  if (!client) {
+    fprintf(stderr, "%s\n", client.error().c_str());
+    return 1;
+  }
+  if (auto ok = (*client)->Subscribe(filter); !ok) {
+    fprintf(stderr, "%s\n", ok.error().c_str());
+    return 1;
+  }
+  while (true) {
+    auto message = (*client)->Poll(std::chrono::seconds(1));
+    if (!message) {
+      fprintf(stderr, "%s\n", message.error().c_str());
+      return 1;
+    }
+    if (*message) {
+      detector.OnMessage(NowMs(), (*message)->topic, (*message)->payload);
+    } else {
+      // Keep silent-station checks running when nothing arrives.
+      detector.Sweep(NowMs());
+    }
+  }
+}
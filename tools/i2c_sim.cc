@@ -0,0 +1,166 @@
+// Runs the firmware's I2C bus scheduler and sensor drivers (src/i2c_bus.h,
+// bme280.h, sht4x.h) against simulated sensors on a virtual clock, and
+// checks every reading against what the sensor was measuring.
+//
+//   i2c_sim [--hours=1] [--bus-hz=400000] [--bme-period-ms=10000]
+//           [--sht-period-ms=2000] [--nack=0] [--stall=0] [--seed=1]
+//
+// --nack and --stall inject per-transfer faults: a NACK, or a transfer that
+// never completes and has to time out. Exits non-zero if a reading is off,
+// or if a cycle fails with no fault injected.
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numbers>
+#include <string_view>
+
+#include "bme280.h"
+#include "i2c_bus.h"
+#include "i2csim/bus.h"
+#include "sht4x.h"
+
+namespace {
+
+// A day's swing, sped up so an hour's run covers it.
+float Cycle(uint64_t now_us, double period_s, double phase = 0) {
+  return std::sin(2 * std::numbers::pi * (now_us / 1e6 / period_s + phase));
+}
+
+struct Errors {
+  double temperature = 0;
+  double humidity = 0;
+  double pressure = 0;
+};
+
+void PrintStats(const I2cDevice& device, const I2cBusScheduler::Stats& s) {
+  printf(
+      "%-7s %6" PRIu32 " cycles %5" PRIu32 " failed %7" PRIu32
+      " transfers %5" PRIu32 " errors (last %s)\n",
+      device.name().data(),
+      s.cycles,
+      s.failed_cycles,
+      s.transfers,
+      s.transfer_errors,
+      I2cStatusName(s.last_error).data());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  double hours = 1;
+  uint32_t bus_hz = 400'000;
+  uint32_t bme_period_ms = 10'000;
+  uint32_t sht_period_ms = 2'000;
+  i2csim::Faults faults;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg.starts_with("--hours=")) {
+      hours = atof(value("--hours="));
+    } else if (arg.starts_with("--bus-hz=")) {
+      bus_hz = atoi(value("--bus-hz="));
+    } else if (arg.starts_with("--bme-period-ms=")) {
+      bme_period_ms = atoi(value("--bme-period-ms="));
+    } else if (arg.starts_with("--sht-period-ms=")) {
+      sht_period_ms = atoi(value("--sht-period-ms="));
+    } else if (arg.starts_with("--nack=")) {
+      faults.nack_probability = atof(value("--nack="));
+    } else if (arg.starts_with("--stall=")) {
+      faults.stall_probability = atof(value("--stall="));
+    } else if (arg.starts_with("--seed=")) {
+      seed = atoi(value("--seed="));
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--hours=H] [--bus-hz=N] [--bme-period-ms=N] "
+          "[--sht-period-ms=N] [--nack=P] [--stall=P] [--seed=N]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  const i2csim::Weather weather = {
+      .temperature_c = [](uint64_t t) { return 12 + 8 * Cycle(t, 3600); },
+      .humidity_percent = [](uint64_t t) { return 60 - 30 * Cycle(t, 3600); },
+      .pressure_hpa =
+          [](uint64_t t) { return 1005 + 15 * Cycle(t, 1800, 0.25); },
+  };
+  i2csim::Bus bus(bus_hz, faults, seed);
+  i2csim::Bme280Model bme_model(
+      weather, i2csim::Bme280Model::kTypicalCalibration);
+  i2csim::Sht4xModel sht_model(weather);
+  bus.Attach(Bme280::kAddress, bme_model);
+  bus.Attach(Sht4x::kAddress, sht_model);
+
+  Bme280 bme280(Bme280::kAddress, bme_period_ms);
+  Sht4x sht4x(Sht4x::kAddress, sht_period_ms);
+  Errors bme_errors, sht_errors;
+  auto track = [](double& worst, double got, double want) {
+    worst = std::max(worst, std::abs(got - want));
+  };
+  I2cBusScheduler scheduler(bus, [&](I2cDevice& device, bool ok) {
+    if (!ok) return;
+    if (&device == &bme280) {
+      const Bme280::Reading& r = *bme280.reading();
+      track(bme_errors.temperature, r.temperature_c, bme_model.temperature_c());
+      track(
+          bme_errors.humidity,
+          r.humidity_percent,
+          bme_model.humidity_percent());
+      track(bme_errors.pressure, r.pressure_hpa, bme_model.pressure_hpa());
+    } else {
+      const Sht4x::Reading& r = *sht4x.reading();
+      track(sht_errors.temperature, r.temperature_c, sht_model.temperature_c());
+      track(
+          sht_errors.humidity,
+          r.humidity_percent,
+          sht_model.humidity_percent());
+    }
+  });
+  scheduler.Add(bme280, 0);
+  scheduler.Add(sht4x, 0);
+
+  // Wake when the scheduler asks to, or when the bus "interrupts".
+  const uint64_t end_us = hours * 3600e6;
+  uint64_t now_us = 0;
+  uint64_t wakeups = 0;
+  while (now_us < end_us) {
+    bus.set_now_us(now_us);
+    const uint32_t sleep_ms = scheduler.Run(now_us / 1000);
+    ++wakeups;
+    uint64_t wake_us = (now_us / 1000 + std::max<uint32_t>(sleep_ms, 1)) * 1000;
+    if (const auto done = bus.completion_us()) {
+      wake_us = std::min(wake_us, *done);
+    }
+    now_us = std::max(wake_us, now_us + 1);
+  }
+
+  PrintStats(bme280, scheduler.stats(bme280));
+  PrintStats(sht4x, scheduler.stats(sht4x));
+  printf(
+      "bus busy %.3f%% of the time, %" PRIu64 " scheduler wakeups (%.2f/s)\n",
+      100.0 * bus.busy_us() / end_us,
+      wakeups,
+      wakeups / (end_us / 1e6));
+  printf(
+      "worst error: bme280 %.3f C %.3f %%RH %.3f hPa, sht4x %.3f C %.3f %%RH\n",
+      bme_errors.temperature,
+      bme_errors.humidity,
+      bme_errors.pressure,
+      sht_errors.temperature,
+      sht_errors.humidity);
+
+  bool ok = bme_errors.temperature < 0.02 && bme_errors.humidity < 0.05 &&
+            bme_errors.pressure < 0.05 && sht_errors.temperature < 0.01 &&
+            sht_errors.humidity < 0.01;
+  if (faults.nack_probability == 0 && faults.stall_probability == 0) {
+    ok &= scheduler.stats(bme280).failed_cycles == 0 &&
+          scheduler.stats(sht4x).failed_cycles == 0;
+  }
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+#include "i2csim/bus.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "sht4x.h"
+
+namespace i2csim {
+
+namespace {
+
+// The smallest x in [lo, hi) with pred(x), given pred is monotonic.
+int32_t FirstTrue(
+    int32_t lo, int32_t hi, const std::function<bool(int32_t)>& pred) {
+  while (lo < hi) {
+    const int32_t mid = lo + (hi - lo) / 2;
+    if (pred(mid)) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+void PutU16(uint8_t* p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+}  // namespace
+
+std::optional<uint64_t> Bus::completion_us() const {
+  if (!running_ || stalled_) return std::nullopt;
+  return done_us_;
+}
+
+void Bus::Start(I2cTransfer& transfer) {
+  // Start, address and each byte take nine clocks; a read adds a repeated
+  // start and the address again.
+  const int bytes = 1 + transfer.write_len +
+                    (transfer.read_len ? 1 + transfer.read_len : 0);
+  const uint64_t duration_us = (bytes * 9 + 2) * 1'000'000ull / bus_hz_;
+  running_ = true;
+  stalled_ = false;
+  done_us_ = now_us_ + duration_us;
+  busy_us_ += duration_us;
+
+  std::uniform_real_distribution<double> chance(0, 1);
+  const auto it = devices_.find(transfer.address);
+  if (chance(rng_) < faults_.stall_probability) {
+    stalled_ = true;
+  } else if (it == devices_.end() || chance(rng_) < faults_.nack_probability) {
+    status_ = I2cStatus::kNack;
+  } else {
+    Device& device = *it->second;
+    const bool ok =
+        (transfer.write_len == 0 ||
+         device.Write(now_us_, {transfer.write.data(), transfer.write_len})) &&
+        (transfer.read_len == 0 ||
+         device.Read(now_us_, {transfer.read.data(), transfer.read_len}));
+    status_ = ok ? I2cStatus::kOk : I2cStatus::kNack;
+  }
+}
+
+std::optional<I2cStatus> Bus::Finished() {
+  if (!running_ || stalled_ || now_us_ < done_us_) return std::nullopt;
+  running_ = false;
+  return status_;
+}
+
+void Bus::Abort() {
+  running_ = false;
+  stalled_ = false;
+}
+
+bool Sht4xModel::Write(uint64_t now_us, std::span<const uint8_t> bytes) {
+  if (bytes.size() != 1 || bytes[0] != Sht4x::kMeasureHighRepeatability) {
+    return false;
+  }
+  ready_us_ = now_us + kConversionUs;
+  temperature_c_ = weather_.temperature_c(now_us);
+  humidity_percent_ = weather_.humidity_percent(now_us);
+  return true;
+}
+
+bool Sht4xModel::Read(uint64_t now_us, std::span<uint8_t> bytes) {
+  if (!ready_us_ || now_us < *ready_us_ || bytes.size() != 6) return false;
+  ready_us_.reset();
+  const uint16_t words[2] = {
+      static_cast<uint16_t>(std::lround((temperature_c_ + 45) / 175 * 65535)),
+      static_cast<uint16_t>(
+          std::lround((humidity_percent_ + 6) / 125 * 65535))};
+  for (int i = 0; i < 2; ++i) {
+    bytes[i * 3] = words[i] >> 8;
+    bytes[i * 3 + 1] = words[i];
+    bytes[i * 3 + 2] = Sht4x::Crc8(bytes.subspan(i * 3, 2));
+  }
+  return true;
+}
+
+Bme280Model::Bme280Model(
+    const Weather& weather, const Bme280::Calibration& calibration)
+    : weather_(weather), calibration_(calibration) {
+  const Bme280::Calibration& c = calibration_;
+  uint8_t* p = &registers_[Bme280::kRegCalibration1];
+  const uint16_t words[12] = {
+      c.t1,
+      uint16_t(c.t2),
+      uint16_t(c.t3),
+      c.p1,
+      uint16_t(c.p2),
+      uint16_t(c.p3),
+      uint16_t(c.p4),
+      uint16_t(c.p5),
+      uint16_t(c.p6),
+      uint16_t(c.p7),
+      uint16_t(c.p8),
+      uint16_t(c.p9)};
+  for (int i = 0; i < 12; ++i) PutU16(p + 2 * i, words[i]);
+  p[25] = c.h1;
+  uint8_t* h = &registers_[Bme280::kRegCalibration2];
+  PutU16(h, c.h2);
+  h[2] = c.h3;
+  h[3] = c.h4 >> 4;
+  h[4] = (c.h4 & 0x0f) | (c.h5 & 0x0f) << 4;
+  h[5] = c.h5 >> 4;
+  h[6] = c.h6;
+  registers_[Bme280::kRegChipId] = Bme280::kChipId;
+  // Data registers' reset values.
+  const uint8_t reset[8] = {0x80, 0, 0, 0x80, 0, 0, 0x80, 0};
+  std::copy(std::begin(reset), std::end(reset), &registers_[Bme280::kRegData]);
+}
+
+void Bme280Model::FinishConversion(uint64_t now_us) {
+  if (!ready_us_ || now_us < *ready_us_) return;
+  ready_us_.reset();
+  const Bme280::Calibration& c = calibration_;
+  auto compensate = [&](int32_t t, int32_t p, int32_t h) {
+    return Bme280::Compensate(c, t, p, h);
+  };
+  const int32_t adc_t = FirstTrue(0, 1 << 20, [&](int32_t t) {
+    return compensate(t, 0, 0).temperature_c >= temperature_c_;
+  });
+  const int32_t adc_p = FirstTrue(0, 1 << 20, [&](int32_t p) {
+    return compensate(adc_t, p, 0).pressure_hpa <= pressure_hpa_;
+  });
+  const int32_t adc_h = FirstTrue(0, 1 << 16, [&](int32_t h) {
+    return compensate(adc_t, adc_p, h).humidity_percent >= humidity_percent_;
+  });
+  uint8_t* d = &registers_[Bme280::kRegData];
+  d[0] = adc_p >> 12;
+  d[1] = adc_p >> 4;
+  d[2] = (adc_p & 0x0f) << 4;
+  d[3] = adc_t >> 12;
+  d[4] = adc_t >> 4;
+  d[5] = (adc_t & 0x0f) << 4;
+  d[6] = adc_h >> 8;
+  d[7] = adc_h;
+}
+
+bool Bme280Model::Write(uint64_t now_us, std::span<const uint8_t> bytes) {
+  FinishConversion(now_us);
+  if (bytes.empty()) return false;
+  pointer_ = bytes[0];
+  // Register, value pairs.
+  for (size_t i = 0; i + 1 < bytes.size(); i += 2) {
+    registers_[bytes[i]] = bytes[i + 1];
+    if (bytes[i] == Bme280::kRegCtrlMeas && (bytes[i + 1] & 3) != 0) {
+      ready_us_ = now_us + kConversionUs;
+      temperature_c_ = weather_.temperature_c(now_us);
+      humidity_percent_ = weather_.humidity_percent(now_us);
+      pressure_hpa_ = weather_.pressure_hpa(now_us);
+    }
+  }
+  return true;
+}
+
+bool Bme280Model::Read(uint64_t now_us, std::span<uint8_t> bytes) {
+  FinishConversion(now_us);
+  for (uint8_t& b : bytes) b = registers_[pointer_++];
+  return true;
+}
+
+}  // namespace i2csim
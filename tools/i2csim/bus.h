@@ -0,0 +1,141 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <random>
+#include <span>
+
+#include "bme280.h"
+#include "i2c_bus.h"
+
+// A simulated I2C bus and register-level models of the station's sensors,
+// for running the firmware's drivers and bus scheduler (src/i2c_bus.h) on
+// the host against a virtual clock.
+namespace i2csim {
+
+// A device on the bus. Transfers reach it whole; returning false NACKs.
+class Device {
+ public:
+  virtual ~Device() = default;
+  virtual bool Write(uint64_t now_us, std::span<const uint8_t> bytes) = 0;
+  virtual bool Read(uint64_t now_us, std::span<uint8_t> bytes) = 0;
+};
+
+// Conditions the models are measuring, as functions of time.
+struct Weather {
+  std::function<float(uint64_t now_us)> temperature_c;
+  std::function<float(uint64_t now_us)> humidity_percent;
+  std::function<float(uint64_t now_us)> pressure_hpa;
+};
+
+struct Faults {
+  double nack_probability = 0;   // Per transfer.
+  double stall_probability = 0;  // Per transfer; it never completes.
+};
+
+// I2cTransport over simulated devices. A transfer takes its bit time at
+// `bus_hz` and completes when the clock passes that.
+class Bus : public I2cTransport {
+ public:
+  explicit Bus(uint32_t bus_hz = 400'000, Faults faults = {}, uint32_t seed = 1)
+      : bus_hz_(bus_hz), faults_(faults), rng_(seed) {}
+
+  void Attach(uint8_t address, Device& device) { devices_[address] = &device; }
+  void set_now_us(uint64_t now_us) { now_us_ = now_us; }
+  // When the transfer in flight completes, if it will.
+  std::optional<uint64_t> completion_us() const;
+  uint64_t busy_us() const { return busy_us_; }
+
+  void Start(I2cTransfer& transfer) override;
+  std::optional<I2cStatus> Finished() override;
+  void Abort() override;
+
+ private:
+  uint32_t bus_hz_;
+  Faults faults_;
+  std::mt19937 rng_;
+  std::map<uint8_t, Device*> devices_;
+  uint64_t now_us_ = 0;
+  uint64_t busy_us_ = 0;
+  bool running_ = false;
+  bool stalled_ = false;
+  uint64_t done_us_ = 0;
+  I2cStatus status_ = I2cStatus::kOk;
+};
+
+// SHT4x: a measure command, then the 6-byte result once the conversion is
+// done. Reads before then are NACKed, as on the real part.
+class Sht4xModel : public Device {
+ public:
+  static constexpr uint64_t kConversionUs = 8'300;
+
+  explicit Sht4xModel(const Weather& weather) : weather_(weather) {}
+  bool Write(uint64_t now_us, std::span<const uint8_t> bytes) override;
+  bool Read(uint64_t now_us, std::span<uint8_t> bytes) override;
+
+  // What the last measurement saw.
+  float temperature_c() const { return temperature_c_; }
+  float humidity_percent() const { return humidity_percent_; }
+
+ private:
+  const Weather& weather_;
+  std::optional<uint64_t> ready_us_;
+  float temperature_c_ = 0;
+  float humidity_percent_ = 0;
+};
+
+// BME280 register file: chip id, trimming parameters, ctrl_hum and
+// ctrl_meas, and data registers that update when a forced conversion
+// finishes. Raw readings are found by inverting the datasheet compensation
+// for `calibration`.
+class Bme280Model : public Device {
+ public:
+  static constexpr uint64_t kConversionUs = 9'300;
+  // The example trimming from Bosch's datasheet, with typical humidity
+  // parameters.
+  static constexpr Bme280::Calibration kTypicalCalibration = {
+      .t1 = 27504,
+      .t2 = 26435,
+      .t3 = -1000,
+      .p1 = 36477,
+      .p2 = -10685,
+      .p3 = 3024,
+      .p4 = 2855,
+      .p5 = 140,
+      .p6 = -7,
+      .p7 = 15500,
+      .p8 = -14600,
+      .p9 = 6000,
+      .h1 = 75,
+      .h2 = 362,
+      .h3 = 0,
+      .h4 = 313,
+      .h5 = 50,
+      .h6 = 30,
+  };
+
+  Bme280Model(const Weather& weather, const Bme280::Calibration& calibration);
+  bool Write(uint64_t now_us, std::span<const uint8_t> bytes) override;
+  bool Read(uint64_t now_us, std::span<uint8_t> bytes) override;
+
+  float temperature_c() const { return temperature_c_; }
+  float humidity_percent() const { return humidity_percent_; }
+  float pressure_hpa() const { return pressure_hpa_; }
+
+ private:
+  void FinishConversion(uint64_t now_us);
+
+  const Weather& weather_;
+  Bme280::Calibration calibration_;
+  std::array<uint8_t, 256> registers_{};
+  uint8_t pointer_ = 0;
+  std::optional<uint64_t> ready_us_;
+  float temperature_c_ = 0;
+  float humidity_percent_ = 0;
+  float pressure_hpa_ = 0;
+};
+
+}  // namespace i2csim
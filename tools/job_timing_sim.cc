@@ -0,0 +1,374 @@
+// Runs the firmware's periodic-job timing accounting (src/job_timing.h)
+// against the windvane and wind-and-rain loops on a virtual clock, with the
+// scheduling they use on the station and a CPU that lwIP now and then keeps
+// busy, and prints what the station would publish.
+//
+//   job_timing_sim [--hours=24] [--busy-every-s=30] [--busy-ms=40]
+//                  [--stall-s=12] [--seed=1]
+//
+// Busy bursts arrive at random, --busy-every-s apart on average, and last
+// --busy-ms on average; a task due to wake during one wakes at its end, and
+// one running when it starts waits it out. Halfway through, one burst lasts
+// --stall-s, as a Wi-Fi reconnect holding the broker connection would.
+// Exits non-zero if the accounting disagrees with what the simulation did,
+// or if the stall's missed periods don't show up in it. Also checks that a
+// lone stall of the vane loop, alone on the CPU, costs exactly the periods
+// it lasted.
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "job_timing.h"
+
+namespace {
+
+// The loops' periods and work, as on the station.
+constexpr uint64_t kVanePeriodUs = 125'000;
+constexpr uint64_t kWindFlushUs = 5'000'000;
+constexpr uint64_t kRainFlushUs = 600'000'000;
+constexpr uint64_t kVaneWorkUs = 300;
+constexpr uint64_t kSpectraWorkUs = 15'000;  // Every kSpectraSamples.
+constexpr int kSpectraSamples = 256;
+constexpr uint64_t kPublishWorkUs = 2'000;
+// From a timer firing to the task running.
+constexpr uint64_t kWakeLatencyUs = 50;
+
+struct Burst {
+  uint64_t start_us;
+  uint64_t end_us;
+};
+
+// When lwIP has the CPU.
+class Cpu {
+ public:
+  explicit Cpu(std::vector<Burst> bursts) : bursts_(std::move(bursts)) {}
+  Cpu(double hours,
+      double busy_every_s,
+      double busy_ms,
+      double stall_s,
+      uint32_t seed) {
+    std::mt19937_64 rng(seed);
+    std::exponential_distribution<double> gap(1 / (busy_every_s * 1e6));
+    std::exponential_distribution<double> length(1 / (busy_ms * 1e3));
+    const uint64_t end_us = hours * 3600e6;
+    const uint64_t stall_at_us = end_us / 2;
+    bool stalled = stall_s <= 0;
+    for (uint64_t t = gap(rng); t < end_us;) {
+      uint64_t len = length(rng);
+      if (!stalled && t >= stall_at_us) {
+        len = stall_s * 1e6;
+        stalled = true;
+      }
+      bursts_.push_back({t, t + len});
+      t += len + static_cast<uint64_t>(gap(rng));
+    }
+  }
+
+  // When a task asleep until `t` gets to run.
+  uint64_t WakeAt(uint64_t t) const {
+    if (const Burst* b = During(t)) t = b->end_us;
+    return t + kWakeLatencyUs;
+  }
+
+  // When `work_us` of work started at `start_us` finishes, waiting out any
+  // burst that begins meanwhile.
+  uint64_t Run(uint64_t start_us, uint64_t work_us) const {
+    uint64_t finish_us = start_us + work_us;
+    auto it = std::upper_bound(
+        bursts_.begin(),
+        bursts_.end(),
+        start_us,
+        [](uint64_t t, const Burst& b) { return t < b.start_us; });
+    for (; it != bursts_.end() && it->start_us < finish_us; ++it) {
+      finish_us += it->end_us - it->start_us;
+    }
+    return finish_us;
+  }
+
+ private:
+  const Burst* During(uint64_t t) const {
+    auto it = std::upper_bound(
+        bursts_.begin(), bursts_.end(), t, [](uint64_t t, const Burst& b) {
+          return t < b.start_us;
+        });
+    if (it == bursts_.begin()) return nullptr;
+    --it;
+    return t < it->end_us ? &*it : nullptr;
+  }
+
+  std::vector<Burst> bursts_;
+};
+
+// The same accounting done independently, to check JobTiming against. The
+// loops say which of their due times they skipped.
+struct Truth {
+  uint32_t runs = 0;
+  uint32_t missed = 0;
+  uint32_t overruns = 0;
+  uint64_t max_lateness_us = 0;
+  uint64_t max_execution_us = 0;
+
+  void Run(
+      uint64_t period,
+      uint64_t due,
+      uint64_t start,
+      uint64_t finish,
+      uint32_t skipped) {
+    const uint64_t late = start > due ? start - due : 0;
+    ++runs;
+    missed += skipped;
+    if (finish - start > period) ++overruns;
+    max_lateness_us = std::max(max_lateness_us, late);
+    max_execution_us = std::max(max_execution_us, finish - start);
+  }
+};
+
+// Records a run in both.
+void Record(
+    JobTiming& timing,
+    Truth& truth,
+    PeriodicJob job,
+    uint64_t period_us,
+    uint64_t due_us,
+    uint64_t start_us,
+    uint64_t finish_us,
+    uint32_t skipped) {
+  timing.Record(job, due_us, start_us, finish_us);
+  truth.Run(period_us, due_us, start_us, finish_us, skipped);
+}
+
+// wind_direction_task: a fixed grid of samples, each sleeping until the
+// next grid point, or not at all if that has passed. A grid point that came
+// due before the sample ahead of it had started was skipped; its own sample
+// runs late, catching up.
+void RunVane(const Cpu& cpu, uint64_t end_us, JobTiming& timing, Truth& truth) {
+  uint64_t next_sample = 0;
+  uint64_t finish = 0;
+  uint64_t last_start = 0;
+  for (int sample = 0; next_sample < end_us; ++sample) {
+    const bool skipped = sample > 0 && next_sample <= last_start;
+    const uint64_t start =
+        next_sample > finish ? cpu.WakeAt(next_sample) : finish;
+    last_start = start;
+    uint64_t work = kVaneWorkUs;
+    if (sample % kSpectraSamples == kSpectraSamples - 1) work += kSpectraWorkUs;
+    if (sample % 40 == 0) work += kPublishWorkUs;
+    finish = cpu.Run(start, work);
+    Record(
+        timing,
+        truth,
+        PeriodicJob::kVaneSample,
+        kVanePeriodUs,
+        next_sample,
+        start,
+        finish,
+        skipped);
+    next_sample += kVanePeriodUs;
+  }
+}
+
+struct Windows {
+  double min_s = 1e9;
+  double max_s = 0;
+};
+
+// track_wind_and_rain: sleeps until the sooner flush, flushes whichever are
+// past due and schedules each next one a period after it actually ran. The
+// count is scaled by the window it covered, the period plus the lateness.
+// The flushes a late one stands in for were skipped.
+void RunWindAndRain(
+    const Cpu& cpu,
+    uint64_t end_us,
+    JobTiming& timing,
+    Truth& wind_truth,
+    Truth& rain_truth,
+    Windows& windows) {
+  uint64_t next_rain = kRainFlushUs;
+  uint64_t next_wind = kWindFlushUs;
+  uint64_t finish = 0;
+  while (std::min(next_rain, next_wind) < end_us) {
+    const uint64_t wake = std::min(next_rain, next_wind);
+    const uint64_t now = wake > finish ? cpu.WakeAt(wake) : finish;
+    uint64_t done = now;
+    auto skipped = [&](uint64_t due, uint64_t period) {
+      uint32_t n = 0;
+      for (uint64_t t = due + period; t <= now; t += period) ++n;
+      return n;
+    };
+    if (next_rain < now) {
+      const uint64_t due = std::exchange(next_rain, now + kRainFlushUs);
+      done = cpu.Run(done, 3 * kPublishWorkUs);
+      Record(
+          timing,
+          rain_truth,
+          PeriodicJob::kRainFlush,
+          kRainFlushUs,
+          due,
+          now,
+          done,
+          skipped(due, kRainFlushUs));
+    }
+    if (next_wind < now) {
+      const uint64_t due = std::exchange(next_wind, now + kWindFlushUs);
+      done = cpu.Run(done, 4 * kPublishWorkUs);
+      Record(
+          timing,
+          wind_truth,
+          PeriodicJob::kWindFlush,
+          kWindFlushUs,
+          due,
+          now,
+          done,
+          skipped(due, kWindFlushUs));
+      const double window_s = (kWindFlushUs + (now - due)) / 1e6;
+      windows.min_s = std::min(windows.min_s, window_s);
+      windows.max_s = std::max(windows.max_s, window_s);
+    }
+    finish = done;
+  }
+}
+
+bool Check(const JobTiming& timing, PeriodicJob job, const Truth& truth) {
+  const JobTiming::Snapshot s = timing.Read(job);
+  uint32_t histogram = 0;
+  for (uint32_t n : s.lateness) histogram += n;
+  const bool ok = s.runs == truth.runs && s.missed == truth.missed &&
+                  s.overruns == truth.overruns &&
+                  s.max_lateness_us == truth.max_lateness_us &&
+                  s.max_execution_us == truth.max_execution_us &&
+                  histogram == s.runs;
+  if (!ok) {
+    fprintf(
+        stderr,
+        "%s: accounting disagrees with the simulation\n",
+        PeriodicJobName(job).data());
+  }
+  return ok;
+}
+
+void Print(const JobTiming& timing, PeriodicJob job) {
+  const JobTiming::Snapshot s = timing.Read(job);
+  printf(
+      "%-11s %8" PRIu32 " runs %6" PRIu32 " missed %4" PRIu32
+      " overruns, late max %9.1f ms, exec max %8.1f ms, late by bucket",
+      PeriodicJobName(job).data(),
+      s.runs,
+      s.missed,
+      s.overruns,
+      s.max_lateness_us / 1e3,
+      s.max_execution_us / 1e3);
+  for (uint32_t n : s.lateness) printf(" %" PRIu32, n);
+  printf("\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  double hours = 24;
+  double busy_every_s = 30;
+  double busy_ms = 40;
+  double stall_s = 12;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg.starts_with("--hours=")) {
+      hours = atof(value("--hours="));
+    } else if (arg.starts_with("--busy-every-s=")) {
+      busy_every_s = atof(value("--busy-every-s="));
+    } else if (arg.starts_with("--busy-ms=")) {
+      busy_ms = atof(value("--busy-ms="));
+    } else if (arg.starts_with("--stall-s=")) {
+      stall_s = atof(value("--stall-s="));
+    } else if (arg.starts_with("--seed=")) {
+      seed = atoi(value("--seed="));
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--hours=H] [--busy-every-s=S] [--busy-ms=MS] "
+          "[--stall-s=S] [--seed=N]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  const Cpu cpu(hours, busy_every_s, busy_ms, stall_s, seed);
+  const uint64_t end_us = hours * 3600e6;
+  JobTiming timing;
+  timing.Register(PeriodicJob::kVaneSample, kVanePeriodUs);
+  timing.Register(PeriodicJob::kWindFlush, kWindFlushUs);
+  timing.Register(PeriodicJob::kRainFlush, kRainFlushUs);
+  Truth vane, wind, rain;
+  Windows windows;
+  RunVane(cpu, end_us, timing, vane);
+  RunWindAndRain(cpu, end_us, timing, wind, rain, windows);
+
+  printf(
+      "%.0f h, lwIP busy for %.0f ms every %.0f s on average, one %.0f s "
+      "stall\n",
+      hours,
+      busy_ms,
+      busy_every_s,
+      stall_s);
+  printf("lateness buckets end at");
+  for (uint32_t us : JobTiming::kLatenessBucketUs) {
+    if (us != UINT32_MAX) printf(" %g ms", us / 1e3);
+  }
+  printf(", then the rest\n");
+  for (PeriodicJob job :
+       {PeriodicJob::kVaneSample,
+        PeriodicJob::kWindFlush,
+        PeriodicJob::kRainFlush}) {
+    Print(timing, job);
+  }
+  printf(
+      "wind flush windows %.3f-%.3f s, all scaled back to mph without a "
+      "trace\n",
+      windows.min_s,
+      windows.max_s);
+
+  bool ok = Check(timing, PeriodicJob::kVaneSample, vane) &&
+            Check(timing, PeriodicJob::kWindFlush, wind) &&
+            Check(timing, PeriodicJob::kRainFlush, rain);
+  // The stall skips whole periods of both fast jobs.
+  if (stall_s * 1e6 >= 2 * kWindFlushUs &&
+      (timing.Read(PeriodicJob::kWindFlush).missed == 0 ||
+       timing.Read(PeriodicJob::kVaneSample).missed <
+           stall_s * 1e6 / kVanePeriodUs - 1)) {
+    fprintf(stderr, "the stall's missed periods weren't counted\n");
+    ok = false;
+  }
+
+  // A stall of whole vane periods from a grid point, with nothing else
+  // running, skips exactly that many samples, however many runs catch up.
+  constexpr uint64_t kLoneStallPeriods = 96;
+  constexpr uint64_t kLoneStallAtUs = 100 * kVanePeriodUs;
+  const Cpu lone({{
+      kLoneStallAtUs,
+      kLoneStallAtUs + kLoneStallPeriods * kVanePeriodUs,
+  }});
+  JobTiming lone_timing;
+  lone_timing.Register(PeriodicJob::kVaneSample, kVanePeriodUs);
+  Truth lone_truth;
+  RunVane(lone, 2 * kLoneStallAtUs, lone_timing, lone_truth);
+  const uint32_t lone_missed =
+      lone_timing.Read(PeriodicJob::kVaneSample).missed;
+  printf(
+      "lone %" PRIu64 "-period vane stall: %" PRIu32 " missed\n",
+      kLoneStallPeriods,
+      lone_missed);
+  if (lone_missed != kLoneStallPeriods ||
+      !Check(lone_timing, PeriodicJob::kVaneSample, lone_truth)) {
+    fprintf(stderr, "a lone stall's periods were miscounted\n");
+    ok = false;
+  }
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,301 @@
+#include "mqtt/client.h"
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace mqtt {
+namespace {
+
+enum PacketType : uint8_t {
+  kConnect = 1,
+  kConnAck = 2,
+  kPublish = 3,
+  kPubAck = 4,
+  kSubscribe = 8,
+  kSubAck = 9,
+  kUnsubscribe = 10,
+  kPingReq = 12,
+  kPingResp = 13,
+  kDisconnect = 14,
+};
+
+std::string Errno(std::string_view what) {
+  return std::string(what) + ": " + std::strerror(errno);
+}
+
+uint16_t ReadU16(std::string_view s, size_t at) {
+  return (static_cast<uint8_t>(s[at]) << 8) | static_cast<uint8_t>(s[at + 1]);
+}
+
+}  // namespace
+
+void AppendRemainingLength(std::vector<uint8_t>& out, size_t length) {
+  do {
+    uint8_t b = length % 128;
+    length /= 128;
+    if (length > 0) b |= 0x80;
+    out.push_back(b);
+  } while (length > 0);
+}
+
+void AppendString(std::vector<uint8_t>& out, std::string_view s) {
+  out.push_back(s.size() >> 8);
+  out.push_back(s.size() & 0xff);
+  out.insert(out.end(), s.begin(), s.end());
+}
+
+int64_t CompletePacketSize(std::string_view data) {
+  size_t length = 0;
+  size_t multiplier = 1;
+  for (size_t i = 1; i < 5; ++i) {
+    if (i >= data.size()) return 0;
+    const uint8_t b = data[i];
+    length += (b & 0x7f) * multiplier;
+    multiplier *= 128;
+    if ((b & 0x80) == 0) {
+      const size_t total = i + 1 + length;
+      return data.size() >= total ? total : 0;
+    }
+  }
+  return -1;
+}
+
+bool TopicMatches(std::string_view filter, std::string_view topic) {
+  while (true) {
+    const size_t f_end = filter.find('/');
+    const size_t t_end = topic.find('/');
+    const std::string_view f = filter.substr(0, f_end);
+    const std::string_view t = topic.substr(0, t_end);
+    if (f == "#") return true;
+    if (f != "+" && f != t) return false;
+    if (f_end == std::string_view::npos || t_end == std::string_view::npos) {
+      // "a/#" also matches "a".
+      return f_end == t_end || (t_end == std::string_view::npos &&
+                                filter.substr(f_end + 1) == "#");
+    }
+    filter.remove_prefix(f_end + 1);
+    topic.remove_prefix(t_end + 1);
+  }
+}
+
+Client::Client(int fd, uint16_t keepalive_secs)
+    : fd_(fd),
+      keepalive_secs_(keepalive_secs),
+      last_send_(std::chrono::steady_clock::now()) {}
+
+Client::~Client() {
+  Send({kDisconnect << 4, 0});
+  close(fd_);
+}
+
+std::expected<std::unique_ptr<Client>, std::string> Client::Connect(
+    const ConnectInfo& info) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addrs = nullptr;
+  const std::string port = std::to_string(info.port);
+  if (const int rc =
+          getaddrinfo(info.host.c_str(), port.c_str(), &hints, &addrs);
+      rc != 0) {
+    return std::unexpected(info.host + ": " + gai_strerror(rc));
+  }
+  int fd = -1;
+  for (addrinfo* a = addrs; a; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd < 0) continue;
+    if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addrs);
+  if (fd < 0) {
+    return std::unexpected(Errno("connect " + info.host + ":" + port));
+  }
+
+  std::unique_ptr<Client> client(new Client(fd, info.keepalive_secs));
+
+  std::vector<uint8_t> body;
+  AppendString(body, "MQTT");
+  body.push_back(4);  // Protocol level 3.1.1.
+  uint8_t flags = 0x02;  // Clean session.
+  if (!info.user.empty()) flags |= 0x80;
+  if (!info.password.empty()) flags |= 0x40;
+  body.push_back(flags);
+  body.push_back(info.keepalive_secs >> 8);
+  body.push_back(info.keepalive_secs & 0xff);
+  AppendString(body, info.client_id);
+  if (!info.user.empty()) AppendString(body, info.user);
+  if (!info.password.empty()) AppendString(body, info.password);
+
+  std::vector<uint8_t> packet = {kConnect << 4};
+  AppendRemainingLength(packet, body.size());
+  packet.insert(packet.end(), body.begin(), body.end());
+  if (auto sent = client->Send(packet); !sent) {
+    return std::unexpected(sent.error());
+  }
+
+  uint8_t type;
+  std::string reply;
+  auto read = client->ReadPacket(info.connack_timeout, type, reply);
+  if (!read) return std::unexpected(read.error());
+  if (!*read) return std::unexpected("timed out waiting for CONNACK");
+  if ((type >> 4) != kConnAck || reply.size() < 2) {
+    return std::unexpected("expected CONNACK");
+  }
+  if (reply[1] != 0) {
+    return std::unexpected(
+        "connection refused, code " + std::to_string(reply[1]));
+  }
+  return client;
+}
+
+std::expected<void, std::string> Client::Send(
+    const std::vector<uint8_t>& packet) {
+  size_t sent = 0;
+  while (sent < packet.size()) {
+    const ssize_t n = send(
+        fd_, packet.data() + sent, packet.size() - sent, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return std::unexpected(Errno("send"));
+    }
+    sent += n;
+  }
+  last_send_ = std::chrono::steady_clock::now();
+  return {};
+}
+
+std::expected<bool, std::string> Client::ReadPacket(
+    std::chrono::milliseconds timeout, uint8_t& header, std::string& body) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (true) {
+    const std::string_view pending = std::string_view(buffer_).substr(parsed_);
+    const int64_t size = CompletePacketSize(pending);
+    if (size < 0) return std::unexpected("malformed packet length");
+    if (size > 0) {
+      header = static_cast<uint8_t>(pending[0]);
+      size_t header_size = 2;
+      while (static_cast<uint8_t>(pending[header_size - 1]) & 0x80) {
+        ++header_size;
+      }
+      body.assign(pending.substr(header_size, size - header_size));
+      parsed_ += size;
+      return true;
+    }
+    // Drops the parsed packets only once the rest must wait for more bytes,
+    // rather than moving the buffer down after each one.
+    buffer_.erase(0, parsed_);
+    parsed_ = 0;
+
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (left.count() <= 0) return false;
+    pollfd p{.fd = fd_, .events = POLLIN};
+    const int ready = poll(&p, 1, left.count());
+    if (ready < 0 && errno != EINTR) return std::unexpected(Errno("poll"));
+    if (ready <= 0) continue;
+    char chunk[64 * 1024];
+    const ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+    if (n == 0) return std::unexpected("broker closed the connection");
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return std::unexpected(Errno("recv"));
+    }
+    buffer_.append(chunk, n);
+  }
+}
+
+std::expected<void, std::string> Client::Subscribe(
+    std::string_view filter, int qos) {
+  std::vector<uint8_t> body;
+  const uint16_t id = next_packet_id_++;
+  body.push_back(id >> 8);
+  body.push_back(id & 0xff);
+  AppendString(body, filter);
+  body.push_back(qos);
+  std::vector<uint8_t> packet = {(kSubscribe << 4) | 0x02};
+  AppendRemainingLength(packet, body.size());
+  packet.insert(packet.end(), body.begin(), body.end());
+  return Send(packet);
+}
+
+std::expected<void, std::string> Client::Unsubscribe(std::string_view filter) {
+  std::vector<uint8_t> body;
+  const uint16_t id = next_packet_id_++;
+  body.push_back(id >> 8);
+  body.push_back(id & 0xff);
+  AppendString(body, filter);
+  std::vector<uint8_t> packet = {(kUnsubscribe << 4) | 0x02};
+  AppendRemainingLength(packet, body.size());
+  packet.insert(packet.end(), body.begin(), body.end());
+  return Send(packet);
+}
+
+std::expected<void, std::string> Client::Publish(
+    std::string_view topic, std::string_view payload, bool retain) {
+  std::vector<uint8_t> packet = {
+      static_cast<uint8_t>((kPublish << 4) | (retain ? 1 : 0))};
+  AppendRemainingLength(packet, 2 + topic.size() + payload.size());
+  AppendString(packet, topic);
+  packet.insert(packet.end(), payload.begin(), payload.end());
+  return Send(packet);
+}
+
+std::expected<std::optional<Message>, std::string> Client::Poll(
+    std::chrono::milliseconds timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (true) {
+    const auto now = std::chrono::steady_clock::now();
+    if (keepalive_secs_ > 0 &&
+        now - last_send_ > std::chrono::seconds(keepalive_secs_) / 2) {
+      if (auto sent = Send({kPingReq << 4, 0}); !sent) {
+        return std::unexpected(sent.error());
+      }
+    }
+    auto wait =
+        std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+    if (keepalive_secs_ > 0) {
+      wait = std::min<std::chrono::milliseconds>(
+          wait, std::chrono::seconds(keepalive_secs_) / 2);
+    }
+    uint8_t type;
+    std::string body;
+    auto read =
+        ReadPacket(std::max(wait, std::chrono::milliseconds(0)), type, body);
+    if (!read) return std::unexpected(read.error());
+    if (!*read) {
+      if (std::chrono::steady_clock::now() >= deadline) return std::nullopt;
+      continue;
+    }
+    if ((type >> 4) != kPublish) continue;  // CONNACK, SUBACK, PINGRESP...
+
+    const int qos = (type >> 1) & 3;
+    if (body.size() < 2) return std::unexpected("short PUBLISH");
+    const uint16_t topic_len = ReadU16(body, 0);
+    size_t at = 2 + topic_len;
+    if (body.size() < at + (qos > 0 ? 2 : 0)) {
+      return std::unexpected("short PUBLISH");
+    }
+    Message message;
+    message.topic = body.substr(2, topic_len);
+    if (qos > 0) {
+      const uint16_t id = ReadU16(body, at);
+      at += 2;
+      if (auto sent = Send({kPubAck << 4, 2, static_cast<uint8_t>(id >> 8),
+                            static_cast<uint8_t>(id & 0xff)});
+          !sent) {
+        return std::unexpected(sent.error());
+      }
+    }
+    message.payload = body.substr(at);
+    return message;
+  }
+}
+
+}  // namespace mqtt
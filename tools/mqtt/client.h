@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mqtt {
+
+struct ConnectInfo {
+  std::string host = "localhost";
+  int port = 1883;
+  std::string client_id;
+  std::string user;
+  std::string password;
+  uint16_t keepalive_secs = 60;
+  std::chrono::milliseconds connack_timeout = std::chrono::seconds(10);
+};
+
+struct Message {
+  std::string topic;
+  std::string payload;
+};
+
+// A minimal blocking MQTT 3.1.1 client for host tools: QoS 0 publish, QoS 0/1
+// subscriptions, keepalive pings. Not thread-safe.
+class Client {
+ public:
+  static std::expected<std::unique_ptr<Client>, std::string> Connect(
+      const ConnectInfo& info);
+  ~Client();
+
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+
+  std::expected<void, std::string> Subscribe(
+      std::string_view filter, int qos = 0);
+  std::expected<void, std::string> Unsubscribe(std::string_view filter);
+  std::expected<void, std::string> Publish(
+      std::string_view topic, std::string_view payload, bool retain = false);
+
+  // Waits up to `timeout` for the next PUBLISH from the broker. Returns
+  // nullopt on timeout. Sends keepalive pings as needed.
+  std::expected<std::optional<Message>, std::string> Poll(
+      std::chrono::milliseconds timeout);
+
+ private:
+  explicit Client(int fd, uint16_t keepalive_secs);
+
+  std::expected<void, std::string> Send(const std::vector<uint8_t>& packet);
+  // Reads one complete packet, waiting at most `timeout`. `header` gets the
+  // first byte (type and flags). Returns false on timeout.
+  std::expected<bool, std::string> ReadPacket(
+      std::chrono::milliseconds timeout, uint8_t& header, std::string& body);
+
+  int fd_;
+  uint16_t keepalive_secs_;
+  uint16_t next_packet_id_ = 1;
+  std::chrono::steady_clock::time_point last_send_;
+  std::string buffer_;  // Received bytes, parsed up to parsed_.
+  size_t parsed_ = 0;
+};
+
+// Packet framing helpers.
+void AppendRemainingLength(std::vector<uint8_t>& out, size_t length);
+void AppendString(std::vector<uint8_t>& out, std::string_view s);
+// Parses a fixed header from the front of `data`. Returns the total packet
+// size, or 0 if `data` doesn't hold a complete packet yet (or -1 if the
+// length field is malformed).
+int64_t CompletePacketSize(std::string_view data);
+
+// True if `topic` matches the subscription `filter` (with + and #).
+bool TopicMatches(std::string_view filter, std::string_view topic);
+
+}  // namespace mqtt
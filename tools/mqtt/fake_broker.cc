@@ -0,0 +1,343 @@
+#include "mqtt/fake_broker.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "mqtt/client.h"
+
+namespace mqtt {
+namespace {
+
+constexpr uint8_t kConnect = 1;
+constexpr uint8_t kConnAck = 2;
+constexpr uint8_t kPublish = 3;
+constexpr uint8_t kPubAck = 4;
+constexpr uint8_t kSubscribe = 8;
+constexpr uint8_t kSubAck = 9;
+constexpr uint8_t kUnsubscribe = 10;
+constexpr uint8_t kUnsubAck = 11;
+constexpr uint8_t kPingReq = 12;
+constexpr uint8_t kPingResp = 13;
+constexpr uint8_t kDisconnect = 14;
+
+std::string Errno(std::string_view what) {
+  return std::string(what) + ": " + std::strerror(errno);
+}
+
+uint16_t ReadU16(std::string_view s, size_t at) {
+  return (static_cast<uint8_t>(s[at]) << 8) | static_cast<uint8_t>(s[at + 1]);
+}
+
+template <size_t N>
+std::string_view Bytes(const uint8_t (&bytes)[N]) {
+  return {reinterpret_cast<const char*>(bytes), N};
+}
+
+struct Connection {
+  std::string buffer;
+  // When the CONNACK is due, once the CONNECT is in.
+  std::optional<std::chrono::steady_clock::time_point> connack_at;
+  // Bytes queued for the client, sent up to `sent`.
+  std::string out;
+  size_t sent = 0;
+  std::vector<std::string> filters;
+};
+
+struct StringHash {
+  using is_transparent = void;
+  size_t operator()(std::string_view s) const {
+    return std::hash<std::string_view>()(s);
+  }
+};
+
+// Subscribers by filter: exact topics by hash, wildcard filters by scan.
+class Subscriptions {
+ public:
+  void Add(int fd, const std::string& filter) {
+    if (filter.find_first_of("+#") == std::string::npos) {
+      std::vector<int>& fds = exact_[filter];
+      if (std::ranges::find(fds, fd) == fds.end()) fds.push_back(fd);
+    } else if (std::ranges::find(wildcard_, std::pair{filter, fd}) ==
+               wildcard_.end()) {
+      wildcard_.emplace_back(filter, fd);
+    }
+  }
+
+  void Remove(int fd, std::string_view filter) {
+    if (auto it = exact_.find(filter); it != exact_.end()) {
+      std::erase(it->second, fd);
+      if (it->second.empty()) exact_.erase(it);
+    }
+    std::erase_if(wildcard_, [&](const auto& w) {
+      return w.second == fd && w.first == filter;
+    });
+  }
+
+  // Each subscriber to `topic` once, however many of its filters match.
+  void Match(std::string_view topic, std::vector<int>& fds) const {
+    fds.clear();
+    if (auto it = exact_.find(topic); it != exact_.end()) fds = it->second;
+    for (const auto& [filter, fd] : wildcard_) {
+      if (TopicMatches(filter, topic)) fds.push_back(fd);
+    }
+    std::ranges::sort(fds);
+    fds.erase(std::unique(fds.begin(), fds.end()), fds.end());
+  }
+
+ private:
+  std::unordered_map<std::string, std::vector<int>, StringHash, std::equal_to<>>
+      exact_;
+  std::vector<std::pair<std::string, int>> wildcard_;
+};
+
+}  // namespace
+
+FakeBroker::FakeBroker(std::chrono::milliseconds connack_delay, Mode mode)
+    : connack_delay_(connack_delay), mode_(mode) {}
+
+std::expected<std::unique_ptr<FakeBroker>, std::string> FakeBroker::Start(
+    std::chrono::milliseconds connack_delay, Mode mode) {
+  std::unique_ptr<FakeBroker> broker(new FakeBroker(connack_delay, mode));
+  if (auto started = broker->Restart(); !started) {
+    return std::unexpected(started.error());
+  }
+  return broker;
+}
+
+FakeBroker::~FakeBroker() { Stop(); }
+
+std::expected<void, std::string> FakeBroker::Listen() {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) return std::unexpected(Errno("socket"));
+  const int on = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port_);
+  socklen_t len = sizeof(addr);
+  if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+      listen(listen_fd_, 16) != 0 ||
+      getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+    const std::string error = Errno("listen");
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return std::unexpected(error);
+  }
+  port_ = ntohs(addr.sin_port);
+  return {};
+}
+
+std::expected<void, std::string> FakeBroker::Restart() {
+  if (thread_.joinable()) return {};
+  if (auto listening = Listen(); !listening) return listening;
+  if (pipe(wake_fds_) != 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return std::unexpected(Errno("pipe"));
+  }
+  thread_ = std::thread([this] { Serve(); });
+  return {};
+}
+
+void FakeBroker::Stop() {
+  if (!thread_.joinable()) return;
+  const char stop = 0;
+  (void)write(wake_fds_[1], &stop, 1);
+  thread_.join();
+  close(wake_fds_[0]);
+  close(wake_fds_[1]);
+  close(listen_fd_);
+  listen_fd_ = -1;
+}
+
+void FakeBroker::Serve() {
+  std::unordered_map<int, Connection> connections;
+  Subscriptions subscriptions;
+  std::vector<int> targets;
+
+  auto queue = [&](Connection& c, std::string_view bytes) {
+    if (c.out.size() - c.sent + bytes.size() > kMaxQueuedBytes) {
+      ++dropped_;
+      return;
+    }
+    c.out.append(bytes);
+  };
+  auto flush = [](int fd, Connection& c) {
+    while (c.sent < c.out.size()) {
+      const ssize_t n = send(
+          fd, c.out.data() + c.sent, c.out.size() - c.sent,
+          MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (n <= 0) break;
+      c.sent += n;
+    }
+    if (c.sent == c.out.size()) {
+      c.out.clear();
+      c.sent = 0;
+    }
+  };
+  auto disconnect = [&](int fd) {
+    for (const std::string& filter : connections[fd].filters) {
+      subscriptions.Remove(fd, filter);
+    }
+    close(fd);
+    connections.erase(fd);
+  };
+
+  // Handles one complete packet; returns false to drop the connection.
+  auto handle = [&](int fd, Connection& c, std::string_view packet,
+                    std::chrono::steady_clock::time_point now) {
+    const uint8_t type = static_cast<uint8_t>(packet[0]) >> 4;
+    size_t header_size = 2;
+    while (static_cast<uint8_t>(packet[header_size - 1]) & 0x80) ++header_size;
+    const std::string_view body = packet.substr(header_size);
+    switch (type) {
+      case kConnect:
+        ++connects_;
+        if (mode_ == Mode::kUp) c.connack_at = now + connack_delay_;
+        return true;
+      case kPingReq: {
+        const uint8_t pingresp[] = {kPingResp << 4, 0};
+        queue(c, Bytes(pingresp));
+        return true;
+      }
+      case kSubscribe:
+      case kUnsubscribe: {
+        if (body.size() < 2) return false;
+        std::string ack = {
+            static_cast<char>((type == kSubscribe ? kSubAck : kUnsubAck) << 4)};
+        std::vector<uint8_t> length;
+        std::string granted;
+        for (size_t at = 2; at + 2 <= body.size();) {
+          const uint16_t n = ReadU16(body, at);
+          if (at + 2 + n > body.size()) return false;
+          std::string filter(body.substr(at + 2, n));
+          at += 2 + n;
+          if (type == kSubscribe) {
+            ++at;  // Requested QoS; everything is delivered at 0.
+            granted.push_back(0);
+            subscriptions.Add(fd, filter);
+            c.filters.push_back(std::move(filter));
+          } else {
+            subscriptions.Remove(fd, filter);
+            std::erase(c.filters, filter);
+          }
+        }
+        AppendRemainingLength(length, 2 + granted.size());
+        ack.append(length.begin(), length.end());
+        ack.append(body.substr(0, 2));
+        ack += granted;
+        queue(c, ack);
+        return true;
+      }
+      case kPublish: {
+        ++published_;
+        const int qos = (packet[0] >> 1) & 3;
+        if (body.size() < 2) return false;
+        const uint16_t topic_len = ReadU16(body, 0);
+        const size_t at = 2 + topic_len + (qos > 0 ? 2 : 0);
+        if (body.size() < at) return false;
+        const std::string_view topic = body.substr(2, topic_len);
+        std::string forward;
+        if (qos > 0) {
+          const uint8_t puback[] = {
+              kPubAck << 4, 2, static_cast<uint8_t>(body[2 + topic_len]),
+              static_cast<uint8_t>(body[3 + topic_len])};
+          queue(c, Bytes(puback));
+          // Forwarded at QoS 0, without the packet id.
+          std::vector<uint8_t> header = {
+              static_cast<uint8_t>((kPublish << 4) | (packet[0] & 1))};
+          AppendRemainingLength(header, body.size() - 2);
+          forward.assign(header.begin(), header.end());
+          forward.append(body.substr(0, 2 + topic_len));
+          forward.append(body.substr(at));
+        }
+        subscriptions.Match(topic, targets);
+        for (int target : targets) {
+          queue(connections[target], qos > 0 ? forward : packet);
+          ++delivered_;
+        }
+        return true;
+      }
+      case kDisconnect:
+        return false;
+      default:
+        return true;
+    }
+  };
+
+  while (true) {
+    auto now = std::chrono::steady_clock::now();
+    int timeout_ms = -1;
+    for (auto& [fd, c] : connections) {
+      if (!c.connack_at) continue;
+      if (*c.connack_at <= now) {
+        const uint8_t connack[] = {kConnAck << 4, 2, 0, 0};
+        queue(c, Bytes(connack));
+        c.connack_at.reset();
+        continue;
+      }
+      const auto wait = std::chrono::ceil<std::chrono::milliseconds>(
+          *c.connack_at - now);
+      timeout_ms = timeout_ms < 0 ? wait.count()
+                                  : std::min<int>(timeout_ms, wait.count());
+    }
+    for (auto& [fd, c] : connections) flush(fd, c);
+
+    std::vector<pollfd> fds = {
+        {.fd = wake_fds_[0], .events = POLLIN},
+        {.fd = listen_fd_, .events = POLLIN},
+    };
+    for (const auto& [fd, c] : connections) {
+      const short events = c.out.empty() ? POLLIN : POLLIN | POLLOUT;
+      fds.push_back({.fd = fd, .events = events});
+    }
+    if (poll(fds.data(), fds.size(), timeout_ms) < 0 && errno != EINTR) break;
+    if (fds[0].revents) break;
+    if (fds[1].revents & POLLIN) {
+      if (const int fd = accept(listen_fd_, nullptr, nullptr); fd >= 0) {
+        connections[fd];
+      }
+    }
+
+    now = std::chrono::steady_clock::now();
+    for (size_t i = 2; i < fds.size(); ++i) {
+      if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+      const int fd = fds[i].fd;
+      Connection& c = connections[fd];
+      char chunk[64 * 1024];
+      const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+      if (n <= 0) {
+        disconnect(fd);
+        continue;
+      }
+      c.buffer.append(chunk, n);
+      size_t parsed = 0;
+      bool ok = true;
+      while (ok) {
+        const std::string_view rest = std::string_view(c.buffer).substr(parsed);
+        const int64_t size = CompletePacketSize(rest);
+        if (size < 0) ok = false;
+        if (size <= 0) break;
+        ok = handle(fd, c, rest.substr(0, size), now);
+        parsed += size;
+      }
+      c.buffer.erase(0, parsed);
+      if (!ok) disconnect(fd);
+    }
+  }
+  for (const auto& [fd, c] : connections) close(fd);
+}
+
+}  // namespace mqtt
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace mqtt {
+
+// A local stand-in for a broker, for tests: it answers CONNECTs after a set
+// delay, or never, and can go down and come back on the same port. It routes
+// PUBLISHes to matching subscriptions at QoS 0, without retained messages,
+// queueing up to kMaxQueuedBytes for a subscriber that falls behind and
+// dropping what doesn't fit, as a real broker's queue limit does.
+class FakeBroker {
+ public:
+  static constexpr size_t kMaxQueuedBytes = 16 << 20;
+
+  enum class Mode {
+    kUp,
+    kBlackhole,  // Accepts connections but never sends a CONNACK.
+  };
+
+  // Listens on an ephemeral port on 127.0.0.1.
+  static std::expected<std::unique_ptr<FakeBroker>, std::string> Start(
+      std::chrono::milliseconds connack_delay, Mode mode = Mode::kUp);
+  ~FakeBroker();
+
+  FakeBroker(const FakeBroker&) = delete;
+  FakeBroker& operator=(const FakeBroker&) = delete;
+
+  int port() const { return port_; }
+  // CONNECTs received.
+  int connects() const { return connects_.load(); }
+  // PUBLISHes received, copies sent on to subscribers, and copies dropped
+  // because a subscriber's queue was full.
+  uint64_t published() const { return published_.load(); }
+  uint64_t delivered() const { return delivered_.load(); }
+  uint64_t dropped() const { return dropped_.load(); }
+
+  // Closes the listener and every connection: clients see the broker close
+  // theirs, and new connections are refused.
+  void Stop();
+  // Listens on the same port again.
+  std::expected<void, std::string> Restart();
+
+ private:
+  FakeBroker(std::chrono::milliseconds connack_delay, Mode mode);
+
+  std::expected<void, std::string> Listen();
+  void Serve();
+
+  const std::chrono::milliseconds connack_delay_;
+  const Mode mode_;
+  int port_ = 0;
+  int listen_fd_ = -1;
+  int wake_fds_[2] = {-1, -1};  // Stop() writes to [1] to end Serve().
+  std::thread thread_;
+  std::atomic<int> connects_{0};
+  std::atomic<uint64_t> published_{0};
+  std::atomic<uint64_t> delivered_{0};
+  std::atomic<uint64_t> dropped_{0};
+};
+
+}  // namespace mqtt
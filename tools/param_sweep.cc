@@ -0,0 +1,364 @@
+// Tunes the station's wind and rain acquisition: runs the firmware's reed
+// switch counters and estimators (tools/tuning/pipeline.h) over a trace with
+// ground truth for a grid, or a random sample, of parameters, on every core,
+// and reports the Pareto front of accuracy, latency and messages per hour.
+//
+//   param_sweep [--days=30] [--seed=1] [--trace=FILE] [--save-trace=FILE]
+//               [--random=N] [--threads=N] [--rows=40]
+//
+// Without --trace, the trace is synthetic (tuning::Synthesize), --days long.
+// With --random, N configurations are drawn log-uniformly from the grid's
+// ranges instead. Wind, direction and rain share no state, so each runs once
+// for each distinct set of the parameters it depends on, and the grid's
+// thousands of configurations cost a few hundred runs.
+//
+// A configuration's error is the mean of its wind, direction and rain RMSEs,
+// each relative to the station's own parameters' (tuning::Params::Station),
+// so the station scores 1. The front is over that error, the wind speed's
+// latency, and messages per hour; the station's row is printed first.
+// Configurations that score the same, because they differ only in
+// parameters the trace doesn't exercise, share a row. Past --rows rows (0
+// for all), an even spread of the front is printed.
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "query/work_stealing_pool.h"
+#include "tuning/pipeline.h"
+#include "tuning/trace.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using tuning::Params;
+
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// The grid, with the station's values among them.
+const std::vector<uint32_t> kAnemometerDebounceUs = {
+    1'000, 3'000, 6'000, 10'000, Params::Station().anemometer_debounce_us,
+    25'000, 35'000};
+const std::vector<uint32_t> kRainGaugeDebounceUs = {
+    100'000, 1'000'000, Params::Station().rain_gauge_debounce_us, 15'000'000};
+const std::vector<uint32_t> kWindReportSecs = {1, 2, 5, 10, 30, 60};
+const std::vector<uint32_t> kRainReportSecs = {60, 300, 600, 1800};
+const std::vector<uint32_t> kDirectionWindowSecs = {60, 300, 600, 1800};
+const std::vector<float> kWindDeadbandMph = {0, 0.5, 1, 2};
+
+std::vector<Params> Grid() {
+  std::vector<Params> grid;
+  for (uint32_t anemometer : kAnemometerDebounceUs) {
+    for (uint32_t rain_gauge : kRainGaugeDebounceUs) {
+      for (uint32_t wind_report : kWindReportSecs) {
+        for (uint32_t rain_report : kRainReportSecs) {
+          for (uint32_t direction : kDirectionWindowSecs) {
+            for (float deadband : kWindDeadbandMph) {
+              grid.push_back({
+                  .anemometer_debounce_us = anemometer,
+                  .rain_gauge_debounce_us = rain_gauge,
+                  .wind_report_secs = wind_report,
+                  .rain_report_secs = rain_report,
+                  .direction_window_secs = direction,
+                  .wind_deadband_mph = deadband,
+              });
+            }
+          }
+        }
+      }
+    }
+  }
+  return grid;
+}
+
+template <typename T>
+T LogUniform(const std::vector<T>& range, std::mt19937_64& rng) {
+  const auto [lo, hi] = std::minmax_element(range.begin(), range.end());
+  std::uniform_real_distribution<double> u(
+      std::log(std::max<double>(*lo, 1)), std::log(*hi));
+  return std::exp(u(rng));
+}
+
+std::vector<Params> Random(int n, uint32_t seed) {
+  std::mt19937_64 rng(seed);
+  std::vector<Params> configs;
+  for (int i = 0; i < n; ++i) {
+    configs.push_back({
+        .anemometer_debounce_us = LogUniform(kAnemometerDebounceUs, rng),
+        .rain_gauge_debounce_us = LogUniform(kRainGaugeDebounceUs, rng),
+        .wind_report_secs = LogUniform(kWindReportSecs, rng),
+        .rain_report_secs = LogUniform(kRainReportSecs, rng),
+        .direction_window_secs = LogUniform(kDirectionWindowSecs, rng),
+        .wind_deadband_mph = std::uniform_real_distribution<float>(
+            0, kWindDeadbandMph.back())(rng),
+    });
+  }
+  return configs;
+}
+
+// What each subsystem depends on.
+using WindKey = std::tuple<uint32_t, uint32_t, float>;
+using DirectionKey = std::tuple<uint32_t, uint32_t>;
+using RainKey = std::tuple<uint32_t, uint32_t>;
+WindKey KeyOfWind(const Params& p) {
+  return {p.anemometer_debounce_us, p.wind_report_secs, p.wind_deadband_mph};
+}
+DirectionKey KeyOfDirection(const Params& p) {
+  return {p.wind_report_secs, p.direction_window_secs};
+}
+RainKey KeyOfRain(const Params& p) {
+  return {p.rain_gauge_debounce_us, p.rain_report_secs};
+}
+
+struct Result {
+  Params params;
+  tuning::WindScore wind;
+  tuning::DirectionScore direction;
+  tuning::RainScore rain;
+  double error = 0;
+  double messages_per_hour = 0;
+};
+
+// Whether `a` is at least as good as `b` on every objective and better on
+// one.
+bool Dominates(const Result& a, const Result& b) {
+  const double av[] = {a.error, a.wind.latency_s, a.messages_per_hour};
+  const double bv[] = {b.error, b.wind.latency_s, b.messages_per_hour};
+  bool better = false;
+  for (int i = 0; i < 3; ++i) {
+    if (av[i] > bv[i]) return false;
+    better |= av[i] < bv[i];
+  }
+  return better;
+}
+
+void PrintHeader() {
+  printf(
+      "%8s %7s %6s %6s %6s %5s | %7s %7s %7s %7s %8s %7s %6s\n",
+      "anem_ms",
+      "gauge_s",
+      "wind_s",
+      "rain_s",
+      "dir_s",
+      "dband",
+      "wind",
+      "bias",
+      "late_s",
+      "dir",
+      "rain",
+      "msg/h",
+      "error");
+}
+
+void Print(const Result& r, const char* note = "") {
+  const Params& p = r.params;
+  printf(
+      "%8.1f %7.2f %6" PRIu32 " %6" PRIu32 " %6" PRIu32
+      " %5.2f | %7.3f %7.3f %7.1f %7.2f %8.4f %7.1f %6.3f%s\n",
+      p.anemometer_debounce_us / 1e3,
+      p.rain_gauge_debounce_us / 1e6,
+      p.wind_report_secs,
+      p.rain_report_secs,
+      p.direction_window_secs,
+      p.wind_deadband_mph,
+      r.wind.rmse_mph,
+      r.wind.bias_mph,
+      r.wind.latency_s,
+      r.direction.rmse_deg,
+      r.rain.rmse_in_per_hour,
+      r.messages_per_hour,
+      r.error,
+      note);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  tuning::SyntheticOptions synthetic;
+  std::string trace_path;
+  std::string save_path;
+  int random = 0;
+  size_t rows = 40;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg.starts_with("--days=")) {
+      synthetic.days = atoi(value("--days="));
+    } else if (arg.starts_with("--seed=")) {
+      synthetic.seed = atoi(value("--seed="));
+    } else if (arg.starts_with("--trace=")) {
+      trace_path = value("--trace=");
+    } else if (arg.starts_with("--save-trace=")) {
+      save_path = value("--save-trace=");
+    } else if (arg.starts_with("--random=")) {
+      random = atoi(value("--random="));
+    } else if (arg.starts_with("--rows=")) {
+      rows = atoi(value("--rows="));
+    } else if (arg.starts_with("--threads=")) {
+      threads = std::max(1, atoi(value("--threads=")));
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--days=N] [--seed=N] [--trace=FILE] [--save-trace=FILE] "
+          "[--random=N] [--threads=N] [--rows=N]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  Clock::time_point start = Clock::now();
+  tuning::Trace trace;
+  if (!trace_path.empty()) {
+    auto loaded = tuning::Load(trace_path);
+    if (!loaded) {
+      fprintf(stderr, "%s\n", loaded.error().c_str());
+      return 1;
+    }
+    trace = std::move(*loaded);
+  } else {
+    trace = tuning::Synthesize(synthetic);
+  }
+  if (!save_path.empty()) {
+    if (auto saved = tuning::Save(trace, save_path); !saved) {
+      fprintf(stderr, "%s\n", saved.error().c_str());
+      return 1;
+    }
+  }
+  printf(
+      "trace: %.1f days, %zu anemometer and %zu rain gauge edges, %.1f s\n",
+      trace.seconds / 86'400.0,
+      trace.anemometer.size(),
+      trace.rain_gauge.size(),
+      SecondsSince(start));
+
+  std::vector<Params> configs = random > 0 ? Random(random, synthetic.seed)
+                                           : Grid();
+  configs.insert(configs.begin(), Params::Station());
+
+  // One run per distinct key, each writing only its own map entry.
+  std::map<WindKey, tuning::WindScore> wind;
+  std::map<DirectionKey, tuning::DirectionScore> direction;
+  std::map<RainKey, tuning::RainScore> rain;
+  for (const Params& p : configs) {
+    wind.try_emplace(KeyOfWind(p));
+    direction.try_emplace(KeyOfDirection(p));
+    rain.try_emplace(KeyOfRain(p));
+  }
+  std::vector<query::WorkStealingPool::Task> tasks;
+  for (auto& [key, score] : wind) {
+    Params p = Params::Station();
+    std::tie(
+        p.anemometer_debounce_us, p.wind_report_secs, p.wind_deadband_mph) =
+        key;
+    tasks.push_back([&trace, p, &score] { score = tuning::RunWind(trace, p); });
+  }
+  for (auto& [key, score] : direction) {
+    Params p = Params::Station();
+    std::tie(p.wind_report_secs, p.direction_window_secs) = key;
+    tasks.push_back(
+        [&trace, p, &score] { score = tuning::RunDirection(trace, p); });
+  }
+  for (auto& [key, score] : rain) {
+    Params p = Params::Station();
+    std::tie(p.rain_gauge_debounce_us, p.rain_report_secs) = key;
+    tasks.push_back([&trace, p, &score] { score = tuning::RunRain(trace, p); });
+  }
+  const size_t runs = tasks.size();
+  start = Clock::now();
+  {
+    query::WorkStealingPool pool(threads);
+    pool.Run(std::move(tasks));
+  }
+  const double sweep_s = SecondsSince(start);
+
+  std::vector<Result> results;
+  for (const Params& p : configs) {
+    results.push_back({
+        .params = p,
+        .wind = wind[KeyOfWind(p)],
+        .direction = direction[KeyOfDirection(p)],
+        .rain = rain[KeyOfRain(p)],
+    });
+  }
+  const Result station = results.front();
+  // A subsystem the trace never exercises scores 0 everywhere; leave it out.
+  auto relative = [](double value, double baseline) {
+    return baseline > 0 ? value / baseline : 0;
+  };
+  for (Result& r : results) {
+    r.error =
+        (relative(r.wind.rmse_mph, station.wind.rmse_mph) +
+         relative(r.direction.rmse_deg, station.direction.rmse_deg) +
+         relative(
+             r.rain.rmse_in_per_hour, station.rain.rmse_in_per_hour)) /
+        3;
+    r.messages_per_hour = r.wind.messages_per_hour +
+                          r.direction.messages_per_hour +
+                          r.rain.messages_per_hour;
+  }
+
+  std::vector<const Result*> front;
+  int dominating_station = 0;
+  for (const Result& r : results) {
+    if (Dominates(r, results.front())) ++dominating_station;
+    if (&r != &results.front() &&
+        std::none_of(results.begin(), results.end(), [&](const Result& o) {
+          return Dominates(o, r);
+        })) {
+      front.push_back(&r);
+    }
+  }
+  auto objectives = [](const Result* r) {
+    return std::tuple(r->messages_per_hour, r->wind.latency_s, r->error);
+  };
+  std::sort(front.begin(), front.end(), [&](const Result* a, const Result* b) {
+    return objectives(a) < objectives(b);
+  });
+  front.erase(
+      std::unique(
+          front.begin(),
+          front.end(),
+          [&](const Result* a, const Result* b) {
+            return objectives(a) == objectives(b);
+          }),
+      front.end());
+  std::vector<const Result*> shown = front;
+  if (rows > 1 && front.size() > rows) {
+    shown.clear();
+    for (size_t i = 0; i < rows; ++i) {
+      shown.push_back(front[i * (front.size() - 1) / (rows - 1)]);
+    }
+  }
+
+  printf(
+      "%zu configurations, %zu pipeline runs on %zu threads in %.1f s "
+      "(%.1f runs/s)\n\n",
+      configs.size(),
+      runs,
+      threads,
+      sweep_s,
+      runs / sweep_s);
+  PrintHeader();
+  Print(results.front(), "  station");
+  printf(
+      "\nPareto front, %zu distinct scores%s; %d configurations dominate the "
+      "station's\n",
+      front.size(),
+      shown.size() < front.size() ? ", a spread of them" : "",
+      dominating_station);
+  for (const Result* r : shown) Print(*r);
+  return 0;
+}
@@ -0,0 +1,226 @@
+#include "query/aggregate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <numbers>
+
+namespace query {
+namespace {
+
+struct SectorTrig {
+  std::array<double, 16> sin;
+  std::array<double, 16> cos;
+};
+
+const SectorTrig& Trig() {
+  static const SectorTrig trig = [] {
+    SectorTrig t;
+    for (int i = 0; i < 16; ++i) {
+      const double radians = i * 2 * std::numbers::pi / 16;
+      t.sin[i] = std::sin(radians);
+      t.cos[i] = std::cos(radians);
+    }
+    return t;
+  }();
+  return trig;
+}
+
+std::vector<Bucket> MakeBuckets(const AggregateQuery& q) {
+  const int64_t n = (q.t_end - q.t_begin + q.bucket_ms - 1) / q.bucket_ms;
+  std::vector<Bucket> buckets(std::max<int64_t>(n, 0));
+  for (int64_t i = 0; i < n; ++i) {
+    buckets[i].start_ms = q.t_begin + i * q.bucket_ms;
+    buckets[i].wind_min = std::numeric_limits<float>::infinity();
+    buckets[i].wind_max = -std::numeric_limits<float>::infinity();
+  }
+  return buckets;
+}
+
+void FinishBuckets(std::vector<Bucket>& buckets) {
+  for (Bucket& b : buckets) {
+    if (b.count == 0) b.wind_min = b.wind_max = 0;
+  }
+}
+
+void MergeIndex(const tsdb::BlockIndex& index, Bucket& b) {
+  b.count += index.count;
+  b.wind_sum += index.wind_sum;
+  b.wind_min = std::min(b.wind_min, index.wind_min);
+  b.wind_max = std::max(b.wind_max, index.wind_max);
+  b.rain_ticks += index.rain_sum;
+  for (int s = 0; s < 16; ++s) b.sector_counts[s] += index.sector_counts[s];
+}
+
+// Calls fn(bucket, begin, end) for each run of decoded samples [begin, end)
+// that falls in a single bucket. Timestamps within a block are sorted, so
+// each run is found with a binary search and handed to the kernels whole.
+template <typename Fn>
+void ForEachBucketRun(
+    const AggregateQuery& q, const int64_t* ts, size_t count, Fn&& fn) {
+  size_t i = std::lower_bound(ts, ts + count, q.t_begin) - ts;
+  const size_t end = std::lower_bound(ts + i, ts + count, q.t_end) - ts;
+  while (i < end) {
+    const int64_t bucket = (ts[i] - q.t_begin) / q.bucket_ms;
+    const int64_t next_start = q.t_begin + (bucket + 1) * q.bucket_ms;
+    const size_t j = std::lower_bound(ts + i, ts + end, next_start) - ts;
+    fn(bucket, i, j);
+    i = j;
+  }
+}
+
+}  // namespace
+
+std::optional<double> Bucket::direction_mean_degrees() const {
+  const SectorTrig& trig = Trig();
+  double s = 0;
+  double c = 0;
+  for (int i = 0; i < 16; ++i) {
+    s += sector_counts[i] * trig.sin[i];
+    c += sector_counts[i] * trig.cos[i];
+  }
+  if (std::hypot(s, c) < 1e-9) return std::nullopt;
+  double degrees = std::atan2(s, c) * 180 / std::numbers::pi;
+  if (degrees < 0) degrees += 360;
+  return degrees;
+}
+
+std::vector<Bucket> Aggregate(
+    const tsdb::Store& store, const AggregateQuery& q, const Kernels& kernels,
+    ScanStats* stats) {
+  std::vector<Bucket> buckets = MakeBuckets(q);
+  if (buckets.empty()) return buckets;
+  ScanStats local;
+  auto columns = std::make_unique<tsdb::Columns>();
+
+  store.ForEachBlock(
+      q.t_begin,
+      q.t_end - 1,
+      [&](const tsdb::BlockIndex& index, std::span<const uint8_t> data) {
+        if (index.t_min >= q.t_begin && index.t_max < q.t_end &&
+            (index.t_min - q.t_begin) / q.bucket_ms ==
+                (index.t_max - q.t_begin) / q.bucket_ms) {
+          MergeIndex(index, buckets[(index.t_min - q.t_begin) / q.bucket_ms]);
+          ++local.blocks_from_index;
+          return;
+        }
+        if (!tsdb::DecodeBlock(data, *columns)) return;
+        ++local.blocks_decoded;
+        const tsdb::Columns& c = *columns;
+        if (c.rollup) {
+          // Rows stand for many samples each, so the kernels don't apply.
+          ForEachBucketRun(
+              q,
+              c.timestamp_ms.data(),
+              c.count,
+              [&](int64_t bucket, size_t i, size_t j) {
+                Bucket& b = buckets[bucket];
+                for (size_t k = i; k < j; ++k) {
+                  b.count += c.samples[k];
+                  b.wind_sum +=
+                      static_cast<double>(c.wind_mph[k]) * c.samples[k];
+                  b.wind_min = std::min(b.wind_min, c.wind_mph[k]);
+                  b.wind_max = std::max(b.wind_max, c.gust_mph[k]);
+                  b.rain_ticks += c.rain_ticks[k];
+                  b.sector_counts[c.sector[k]] += c.samples[k];
+                }
+                local.values_scanned += 6 * (j - i);
+              });
+          return;
+        }
+        ForEachBucketRun(
+            q,
+            c.timestamp_ms.data(),
+            c.count,
+            [&](int64_t bucket, size_t i, size_t j) {
+              Bucket& b = buckets[bucket];
+              const size_t n = j - i;
+              b.count += n;
+              b.wind_sum += kernels.sum_f32(&c.wind_mph[i], n);
+              b.wind_min =
+                  std::min(b.wind_min, kernels.min_f32(&c.wind_mph[i], n));
+              b.wind_max =
+                  std::max(b.wind_max, kernels.max_f32(&c.wind_mph[i], n));
+              b.rain_ticks += kernels.sum_u32(&c.rain_ticks[i], n);
+              for (size_t k = i; k < j; ++k) ++b.sector_counts[c.sector[k]];
+              local.values_scanned += 4 * n;
+            });
+      });
+
+  FinishBuckets(buckets);
+  if (stats) *stats += local;
+  return buckets;
+}
+
+std::vector<std::vector<Bucket>> AggregateStations(
+    std::span<const tsdb::Store* const> stations, const AggregateQuery& query,
+    WorkStealingPool& pool, const Kernels& kernels, ScanStats* stats) {
+  std::vector<std::vector<Bucket>> results(stations.size());
+  std::vector<ScanStats> station_stats(stations.size());
+  std::vector<WorkStealingPool::Task> tasks;
+  tasks.reserve(stations.size());
+  for (size_t i = 0; i < stations.size(); ++i) {
+    tasks.push_back([&, i] {
+      results[i] = Aggregate(*stations[i], query, kernels, &station_stats[i]);
+    });
+  }
+  pool.Run(std::move(tasks));
+  if (stats) {
+    for (const ScanStats& s : station_stats) *stats += s;
+  }
+  return results;
+}
+
+std::vector<Bucket> FindGusts(
+    const tsdb::Store& store, const AggregateQuery& q, float threshold_mph,
+    const Kernels& kernels, ScanStats* stats) {
+  std::vector<Bucket> buckets = MakeBuckets(q);
+  ScanStats local;
+  std::vector<int64_t> timestamps(tsdb::kBlockSamples);
+  std::vector<float> wind(tsdb::kBlockSamples);
+  std::vector<uint32_t> samples(tsdb::kBlockSamples);
+
+  store.ForEachBlock(
+      q.t_begin,
+      q.t_end - 1,
+      [&](const tsdb::BlockIndex& index, std::span<const uint8_t> data) {
+        if (index.wind_max < threshold_mph) {
+          ++local.blocks_skipped;
+          return;
+        }
+        tsdb::BlockView view;
+        if (!tsdb::ParseBlock(data, view)) return;
+        ++local.blocks_decoded;
+        // Only the two columns this query needs are decoded.
+        tsdb::DecodeTimestamps(view, timestamps.data());
+        tsdb::DecodeGusts(view, wind.data());
+        if (view.rollup && !tsdb::DecodeSampleCounts(view, samples.data())) {
+          return;
+        }
+        ForEachBucketRun(
+            q,
+            timestamps.data(),
+            view.count,
+            [&](int64_t bucket, size_t i, size_t j) {
+              Bucket& b = buckets[bucket];
+              if (view.rollup) {
+                for (size_t k = i; k < j; ++k) b.count += samples[k];
+              } else {
+                b.count += j - i;
+              }
+              b.wind_max =
+                  std::max(b.wind_max, kernels.max_f32(&wind[i], j - i));
+              local.values_scanned += 2 * (j - i);
+            });
+      });
+
+  std::erase_if(buckets, [&](const Bucket& b) {
+    return b.count == 0 || b.wind_max < threshold_mph;
+  });
+  for (Bucket& b : buckets) b.wind_min = 0;
+  if (stats) *stats += local;
+  return buckets;
+}
+
+}  // namespace query
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "query/kernels.h"
+#include "query/work_stealing_pool.h"
+#include "tsdb/store.h"
+
+namespace query {
+
+// Time-bucketed aggregates of one station, e.g. hourly mean wind, max gust and
+// rain total.
+struct Bucket {
+  int64_t start_ms = 0;
+  uint64_t count = 0;
+  double wind_sum = 0;
+  float wind_min = 0;
+  float wind_max = 0;
+  uint64_t rain_ticks = 0;
+  std::array<uint32_t, 16> sector_counts = {};
+
+  double wind_mean() const { return count ? wind_sum / count : 0; }
+  // Circular mean of the vane sectors in degrees clockwise from north, or
+  // nullopt if the directions cancel out (or there are none).
+  std::optional<double> direction_mean_degrees() const;
+};
+
+struct AggregateQuery {
+  int64_t t_begin;  // Inclusive, ms.
+  int64_t t_end;    // Exclusive, ms.
+  int64_t bucket_ms;
+};
+
+struct ScanStats {
+  uint64_t blocks_decoded = 0;
+  // Blocks that fell entirely inside one bucket and were answered from the
+  // block index without decoding.
+  uint64_t blocks_from_index = 0;
+  // Blocks pruned by the wind_max index in FindGusts.
+  uint64_t blocks_skipped = 0;
+  uint64_t values_scanned = 0;
+
+  ScanStats& operator+=(const ScanStats& o) {
+    blocks_decoded += o.blocks_decoded;
+    blocks_from_index += o.blocks_from_index;
+    blocks_skipped += o.blocks_skipped;
+    values_scanned += o.values_scanned;
+    return *this;
+  }
+};
+
+// Returns one bucket per query.bucket_ms step in [t_begin, t_end), including
+// empty ones. Compacted history counts in whole rollup rows, by their start:
+// buckets finer than its resolution get all of a row or none of it.
+std::vector<Bucket> Aggregate(
+    const tsdb::Store& store, const AggregateQuery& query,
+    const Kernels& kernels = BestKernels(), ScanStats* stats = nullptr);
+
+// Aggregate() for many stations at once, one pool task per station.
+std::vector<std::vector<Bucket>> AggregateStations(
+    std::span<const tsdb::Store* const> stations, const AggregateQuery& query,
+    WorkStealingPool& pool, const Kernels& kernels = BestKernels(),
+    ScanStats* stats = nullptr);
+
+// Returns only the buckets whose max wind reaches `threshold_mph`, with
+// start_ms and wind_max filled in. Blocks whose indexed max is below the
+// threshold are never decoded.
+std::vector<Bucket> FindGusts(
+    const tsdb::Store& store, const AggregateQuery& query, float threshold_mph,
+    const Kernels& kernels = BestKernels(), ScanStats* stats = nullptr);
+
+}  // namespace query
@@ -0,0 +1,183 @@
+#include "query/kernels.h"
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QUERY_X86 1
+#endif
+
+namespace query {
+namespace {
+
+// The scalar kernels are deliberately written as plain loops; they are the
+// reference the SIMD versions must match.
+double ScalarSumF32(const float* v, size_t n) {
+  double sum = 0;
+  for (size_t i = 0; i < n; ++i) sum += v[i];
+  return sum;
+}
+
+float ScalarMinF32(const float* v, size_t n) {
+  float m = std::numeric_limits<float>::infinity();
+  for (size_t i = 0; i < n; ++i) m = std::min(m, v[i]);
+  return m;
+}
+
+float ScalarMaxF32(const float* v, size_t n) {
+  float m = -std::numeric_limits<float>::infinity();
+  for (size_t i = 0; i < n; ++i) m = std::max(m, v[i]);
+  return m;
+}
+
+uint64_t ScalarSumU32(const uint32_t* v, size_t n) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < n; ++i) sum += v[i];
+  return sum;
+}
+
+#ifdef QUERY_X86
+
+__attribute__((target("sse2"))) double Sse2SumF32(const float* v, size_t n) {
+  __m128d a = _mm_setzero_pd();
+  __m128d b = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 x = _mm_loadu_ps(v + i);
+    a = _mm_add_pd(a, _mm_cvtps_pd(x));
+    b = _mm_add_pd(b, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+  }
+  a = _mm_add_pd(a, b);
+  double lanes[2];
+  _mm_storeu_pd(lanes, a);
+  return lanes[0] + lanes[1] + ScalarSumF32(v + i, n - i);
+}
+
+__attribute__((target("sse2"))) float Sse2MinF32(const float* v, size_t n) {
+  __m128 m = _mm_set1_ps(std::numeric_limits<float>::infinity());
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) m = _mm_min_ps(m, _mm_loadu_ps(v + i));
+  float lanes[4];
+  _mm_storeu_ps(lanes, m);
+  return std::min(
+      {lanes[0], lanes[1], lanes[2], lanes[3], ScalarMinF32(v + i, n - i)});
+}
+
+__attribute__((target("sse2"))) float Sse2MaxF32(const float* v, size_t n) {
+  __m128 m = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) m = _mm_max_ps(m, _mm_loadu_ps(v + i));
+  float lanes[4];
+  _mm_storeu_ps(lanes, m);
+  return std::max(
+      {lanes[0], lanes[1], lanes[2], lanes[3], ScalarMaxF32(v + i, n - i)});
+}
+
+__attribute__((target("sse2"))) uint64_t Sse2SumU32(
+    const uint32_t* v, size_t n) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sum = zero;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i));
+    sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(x, zero));
+    sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(x, zero));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+  return lanes[0] + lanes[1] + ScalarSumU32(v + i, n - i);
+}
+
+__attribute__((target("avx2"))) double Avx2SumF32(const float* v, size_t n) {
+  __m256d a = _mm256_setzero_pd();
+  __m256d b = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 x = _mm256_loadu_ps(v + i);
+    a = _mm256_add_pd(a, _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+    b = _mm256_add_pd(b, _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+  }
+  a = _mm256_add_pd(a, b);
+  double lanes[4];
+  _mm256_storeu_pd(lanes, a);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         ScalarSumF32(v + i, n - i);
+}
+
+__attribute__((target("avx2"))) float Avx2MinF32(const float* v, size_t n) {
+  __m256 m = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) m = _mm256_min_ps(m, _mm256_loadu_ps(v + i));
+  float lanes[8];
+  _mm256_storeu_ps(lanes, m);
+  return std::min(
+      *std::min_element(lanes, lanes + 8), ScalarMinF32(v + i, n - i));
+}
+
+__attribute__((target("avx2"))) float Avx2MaxF32(const float* v, size_t n) {
+  __m256 m = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) m = _mm256_max_ps(m, _mm256_loadu_ps(v + i));
+  float lanes[8];
+  _mm256_storeu_ps(lanes, m);
+  return std::max(
+      *std::max_element(lanes, lanes + 8), ScalarMaxF32(v + i, n - i));
+}
+
+__attribute__((target("avx2"))) uint64_t Avx2SumU32(
+    const uint32_t* v, size_t n) {
+  __m256i sum = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256i x =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i));
+    sum = _mm256_add_epi64(
+        sum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(x)));
+    sum = _mm256_add_epi64(
+        sum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(x, 1)));
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         ScalarSumU32(v + i, n - i);
+}
+
+#endif  // QUERY_X86
+
+}  // namespace
+
+const Kernels& ScalarKernels() {
+  static const Kernels kernels{
+      "scalar", ScalarSumF32, ScalarMinF32, ScalarMaxF32, ScalarSumU32};
+  return kernels;
+}
+
+const Kernels* Sse2Kernels() {
+#ifdef QUERY_X86
+  static const Kernels kernels{
+      "sse2", Sse2SumF32, Sse2MinF32, Sse2MaxF32, Sse2SumU32};
+  if (__builtin_cpu_supports("sse2")) return &kernels;
+#endif
+  return nullptr;
+}
+
+const Kernels* Avx2Kernels() {
+#ifdef QUERY_X86
+  static const Kernels kernels{
+      "avx2", Avx2SumF32, Avx2MinF32, Avx2MaxF32, Avx2SumU32};
+  if (__builtin_cpu_supports("avx2")) return &kernels;
+#endif
+  return nullptr;
+}
+
+const Kernels& BestKernels() {
+  static const Kernels& best = [&]() -> const Kernels& {
+    if (const Kernels* k = Avx2Kernels()) return *k;
+    if (const Kernels* k = Sse2Kernels()) return *k;
+    return ScalarKernels();
+  }();
+  return best;
+}
+
+}  // namespace query
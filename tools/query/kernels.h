@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace query {
+
+// Column reduction kernels. Each instruction set gets its own table so the
+// benchmark can compare them; BestKernels() picks one at runtime.
+struct Kernels {
+  const char* name;
+  // Float sums accumulate in double lanes so a year of samples doesn't drift.
+  double (*sum_f32)(const float* values, size_t n);
+  float (*min_f32)(const float* values, size_t n);
+  float (*max_f32)(const float* values, size_t n);
+  uint64_t (*sum_u32)(const uint32_t* values, size_t n);
+};
+
+const Kernels& ScalarKernels();
+// These return nullptr if the CPU (or target) lacks the instruction set.
+const Kernels* Sse2Kernels();
+const Kernels* Avx2Kernels();
+
+// The widest kernels the running CPU supports.
+const Kernels& BestKernels();
+
+}  // namespace query
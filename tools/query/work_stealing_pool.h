@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace query {
+
+// A fixed set of workers, each with its own task deque. Run() deals tasks out
+// round-robin; a worker pops from the back of its own deque and, once that is
+// empty, steals from the front of the others. This keeps stations with long
+// histories from leaving cores idle at the end of a query.
+class WorkStealingPool {
+ public:
+  using Task = std::function<void()>;
+
+  explicit WorkStealingPool(
+      size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+      : queues_(threads) {
+    for (auto& q : queues_) q = std::make_unique<Queue>();
+    for (size_t i = 0; i < threads; ++i) {
+      threads_.emplace_back([this, i] { Worker(i); });
+    }
+  }
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard lock(mu_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : threads_) t.join();
+  }
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  size_t size() const { return threads_.size(); }
+
+  // The index of the worker running the calling task, for indexing
+  // per-thread state. Only meaningful inside a task.
+  static size_t CurrentWorker() { return current_worker_; }
+
+  // Runs every task and returns once all have finished. Not reentrant.
+  void Run(std::vector<Task> tasks) {
+    if (tasks.empty()) return;
+    // Counted before any is queued: a worker still draining the last Run()
+    // may take one of these as soon as it is.
+    {
+      std::lock_guard lock(mu_);
+      remaining_ = tasks.size();
+    }
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      Queue& q = *queues_[i % queues_.size()];
+      std::lock_guard lock(q.mu);
+      q.tasks.push_back(std::move(tasks[i]));
+    }
+    {
+      std::lock_guard lock(mu_);
+      ++generation_;
+    }
+    wake_.notify_all();
+    std::unique_lock lock(mu_);
+    done_.wait(lock, [&] { return remaining_ == 0; });
+  }
+
+ private:
+  struct Queue {
+    std::mutex mu;
+    std::deque<Task> tasks;
+  };
+
+  std::optional<Task> Take(size_t self) {
+    {
+      Queue& own = *queues_[self];
+      std::lock_guard lock(own.mu);
+      if (!own.tasks.empty()) {
+        Task task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        return task;
+      }
+    }
+    for (size_t i = 1; i < queues_.size(); ++i) {
+      Queue& victim = *queues_[(self + i) % queues_.size()];
+      std::lock_guard lock(victim.mu);
+      if (!victim.tasks.empty()) {
+        Task task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return task;
+      }
+    }
+    return std::nullopt;
+  }
+
+  void Worker(size_t self) {
+    current_worker_ = self;
+    uint64_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock lock(mu_);
+        wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_) return;
+        seen = generation_;
+      }
+      while (std::optional<Task> task = Take(self)) {
+        (*task)();
+        std::lock_guard lock(mu_);
+        if (--remaining_ == 0) done_.notify_all();
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mu_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  uint64_t generation_ = 0;
+  size_t remaining_ = 0;
+  bool stop_ = false;
+
+  static inline thread_local size_t current_worker_ = 0;
+};
+
+}  // namespace query
@@ -0,0 +1,182 @@
+// Benchmarks the query engine: first the bare column kernels for each
+// instruction set, then bucketed queries over many synthetic stations.
+//
+//   query_bench [--stations=50] [--days=30] [--threads=N] [--dir=PATH]
+
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "query/aggregate.h"
+#include "query/kernels.h"
+#include "query/work_stealing_pool.h"
+#include "tsdb/store.h"
+#include "tsdb/synthetic.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+constexpr int64_t kStartMs = 1'700'000'000'000;
+constexpr int64_t kHourMs = 60 * 60 * 1000;
+
+void BenchKernels() {
+  constexpr size_t kValues = 1 << 22;
+  constexpr int kRounds = 20;
+  std::vector<float> wind(kValues);
+  std::vector<uint32_t> rain(kValues);
+  tsdb::SyntheticStation station(7, kStartMs);
+  for (size_t i = 0; i < kValues; ++i) {
+    const tsdb::Sample s = station.Next();
+    wind[i] = s.wind_mph;
+    rain[i] = s.rain_ticks;
+  }
+
+  const query::Kernels& scalar = query::ScalarKernels();
+  const double want_sum = scalar.sum_f32(wind.data(), kValues);
+  const uint64_t want_rain = scalar.sum_u32(rain.data(), kValues);
+  const float want_max = scalar.max_f32(wind.data(), kValues);
+
+  printf("kernels (%zu values x %d rounds, single core):\n", kValues, kRounds);
+  for (const query::Kernels* k :
+       {&scalar, query::Sse2Kernels(), query::Avx2Kernels()}) {
+    if (!k) continue;
+    double sum = 0;
+    uint64_t rain_sum = 0;
+    float mx = 0;
+    float mn = 0;
+    auto start = Clock::now();
+    for (int r = 0; r < kRounds; ++r) {
+      sum = k->sum_f32(wind.data(), kValues);
+      mn = k->min_f32(wind.data(), kValues);
+      mx = k->max_f32(wind.data(), kValues);
+      rain_sum = k->sum_u32(rain.data(), kValues);
+    }
+    const double secs = SecondsSince(start);
+    const bool ok = std::abs(sum - want_sum) < 1e-6 * std::abs(want_sum) &&
+                    rain_sum == want_rain && mx == want_max && mn >= 0;
+    printf(
+        "  %-7s %8.0f Mvalues/s %s\n",
+        k->name,
+        4.0 * kValues * kRounds / secs / 1e6,
+        ok ? "" : "MISMATCH");
+  }
+}
+
+void RunQuery(
+    const char* name, std::span<const tsdb::Store* const> stations,
+    const query::AggregateQuery& q, query::WorkStealingPool& pool,
+    uint64_t samples) {
+  query::ScanStats stats;
+  auto start = Clock::now();
+  const auto results = query::AggregateStations(
+      stations, q, pool, query::BestKernels(), &stats);
+  const double secs = SecondsSince(start);
+  printf(
+      "  %-8s %6.3f s  %8.1f Msamples/s  %8.1f Mvalues/s/core decoded  "
+      "blocks decoded %" PRIu64 " from index %" PRIu64 "\n",
+      name,
+      secs,
+      samples / secs / 1e6,
+      stats.values_scanned / secs / pool.size() / 1e6,
+      stats.blocks_decoded,
+      stats.blocks_from_index);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int num_stations = 50;
+  int days = 30;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  std::filesystem::path dir = "/tmp/query_bench";
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--stations=")) {
+      num_stations = atoi(argv[i] + strlen("--stations="));
+    } else if (arg.starts_with("--days=")) {
+      days = atoi(argv[i] + strlen("--days="));
+    } else if (arg.starts_with("--threads=")) {
+      threads = atoi(argv[i] + strlen("--threads="));
+    } else if (arg.starts_with("--dir=")) {
+      dir = argv[i] + strlen("--dir=");
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--stations=N] [--days=N] [--threads=N] [--dir=PATH]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  BenchKernels();
+
+  std::filesystem::remove_all(dir);
+  const size_t per_station = static_cast<size_t>(days) * 24 * 720;
+  std::vector<std::unique_ptr<tsdb::Store>> stores;
+  for (int s = 0; s < num_stations; ++s) {
+    char name[32];
+    snprintf(name, sizeof(name), "station-%03d", s);
+    auto store = tsdb::Store::Open(dir / name);
+    if (!store) {
+      fprintf(stderr, "%s\n", store.error().c_str());
+      return 1;
+    }
+    tsdb::SyntheticStation station(s + 1, kStartMs);
+    for (size_t i = 0; i < per_station; ++i) {
+      if (auto ok = (*store)->Append(station.Next()); !ok) {
+        fprintf(stderr, "%s\n", ok.error().c_str());
+        return 1;
+      }
+    }
+    if (auto ok = (*store)->Seal(); !ok) {
+      fprintf(stderr, "%s\n", ok.error().c_str());
+      return 1;
+    }
+    stores.push_back(*std::move(store));
+  }
+  std::vector<const tsdb::Store*> stations;
+  for (const auto& s : stores) stations.push_back(s.get());
+  const uint64_t samples = per_station * num_stations;
+
+  query::WorkStealingPool pool(threads);
+  printf(
+      "%d stations x %d days (%" PRIu64 " samples), %zu threads, %s kernels:\n",
+      num_stations,
+      days,
+      samples,
+      pool.size(),
+      query::BestKernels().name);
+  const int64_t end = kStartMs + days * 24 * kHourMs + kHourMs;
+  RunQuery("hourly", stations, {kStartMs, end, kHourMs}, pool, samples);
+  RunQuery("daily", stations, {kStartMs, end, 24 * kHourMs}, pool, samples);
+
+  query::ScanStats stats;
+  auto start = Clock::now();
+  size_t gusty = 0;
+  for (const tsdb::Store* s : stations) {
+    const auto gusts = query::FindGusts(
+        *s, {kStartMs, end, kHourMs}, 25, query::BestKernels(), &stats);
+    gusty += gusts.size();
+  }
+  printf(
+      "  gusts>25 %6.3f s  %zu hours found, blocks decoded %" PRIu64
+      " skipped by index %" PRIu64 "\n",
+      SecondsSince(start),
+      gusty,
+      stats.blocks_decoded,
+      stats.blocks_skipped);
+  return 0;
+}
@@ -0,0 +1,419 @@
+// Load-tests query_service's HTTP API in process: synthetic stations' history
+// in tsdb stores, their messages still arriving, and clients on keep-alive
+// connections asking for the dashboards' queries, first past the result
+// cache and then through it. Reports queries/s and latency percentiles of
+// each.
+//
+//   query_load_test [--stations=4] [--days=30] [--clients=8] [--seconds=3]
+//                   [--ingest-hz=100] [--dir=/tmp/query_load_test]
+//
+// Most queries are the last 24 hours hourly, the rest the last week hourly
+// and the last 30 days daily, of a random station. Ingest runs at ingest-hz
+// ticks of every station per second, moving the clock on by five seconds a
+// tick. Afterwards every query is asked with and without the cache and must
+// get the same answer, and the raw blocks of a day must hold the samples the
+// aggregate counted. Exits non-zero on any mismatch or failed request.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "api/http.h"
+#include "api/service.h"
+#include "fleet/topics.h"
+#include "tsdb/block.h"
+#include "tsdb/store.h"
+#include "tsdb/synthetic.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int64_t kStartMs = 1'700'006'400'000;
+constexpr int64_t kTickMs = 5000;
+constexpr int64_t kHourMs = 3'600'000;
+constexpr int64_t kDayMs = 24 * kHourMs;
+constexpr int kRainEveryTicks = 120;
+constexpr double kRainInchesPerTick = 0.011;
+
+// A dashboard's query, less the station: 24 hours and 7 days hourly, and
+// 30 days daily.
+struct Shape {
+  int64_t bucket_ms;
+  int64_t last_ms;
+  int weight;
+};
+constexpr Shape kShapes[] = {
+    {kHourMs, kDayMs, 70},
+    {kHourMs, 7 * kDayMs, 20},
+    {kDayMs, 30 * kDayMs, 10},
+};
+
+std::string StationName(int s) { return "station" + std::to_string(s); }
+
+std::string AggregatePath(int station, const Shape& shape, bool cache) {
+  return "/v1/aggregate?station=" + StationName(station) +
+         "&bucket=" + std::to_string(shape.bucket_ms) +
+         "&last=" + std::to_string(shape.last_ms) + (cache ? "" : "&cache=0");
+}
+
+// A blocking HTTP/1.1 client on one keep-alive connection.
+class HttpClient {
+ public:
+  explicit HttpClient(int port) {
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+    const int on = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+  ~HttpClient() {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  // Returns the status, or 0 if the connection failed.
+  int Get(const std::string& path, std::string& body) {
+    if (fd_ < 0) return 0;
+    const std::string request =
+        "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    if (send(fd_, request.data(), request.size(), MSG_NOSIGNAL) !=
+        static_cast<ssize_t>(request.size())) {
+      return 0;
+    }
+    size_t end;
+    while ((end = buffer_.find("\r\n\r\n")) == std::string::npos) {
+      if (!Read()) return 0;
+    }
+    const std::string_view head = std::string_view(buffer_).substr(0, end);
+    constexpr std::string_view kLength = "Content-Length: ";
+    const size_t at = head.find(kLength);
+    if (head.size() < 12 || at == std::string_view::npos) return 0;
+    const int status = atoi(buffer_.c_str() + 9);
+    const size_t length =
+        strtoull(buffer_.c_str() + at + kLength.size(), nullptr, 10);
+    while (buffer_.size() < end + 4 + length) {
+      if (!Read()) return 0;
+    }
+    body.assign(buffer_, end + 4, length);
+    buffer_.erase(0, end + 4 + length);
+    return status;
+  }
+
+ private:
+  bool Read() {
+    char chunk[64 * 1024];
+    const ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+    if (n <= 0) return false;
+    buffer_.append(chunk, n);
+    return true;
+  }
+
+  int fd_ = -1;
+  std::string buffer_;
+};
+
+struct PhaseResult {
+  uint64_t queries = 0;
+  uint64_t failures = 0;
+  double seconds = 0;
+  std::vector<double> latencies_us;
+};
+
+// Runs `clients` threads asking random dashboard queries for `seconds`.
+PhaseResult RunPhase(
+    int port, int clients, double seconds, int stations, bool cache) {
+  std::vector<PhaseResult> results(clients);
+  std::vector<std::thread> threads;
+  const auto start = Clock::now();
+  const auto deadline = start + std::chrono::duration_cast<Clock::duration>(
+                                    std::chrono::duration<double>(seconds));
+  for (int c = 0; c < clients; ++c) {
+    threads.emplace_back([&, c] {
+      PhaseResult& r = results[c];
+      HttpClient client(port);
+      std::mt19937 rng(c + 1);
+      std::discrete_distribution<int> shape(
+          {kShapes[0].weight, kShapes[1].weight, kShapes[2].weight});
+      std::uniform_int_distribution<int> station(0, stations - 1);
+      std::string body;
+      while (Clock::now() < deadline) {
+        const std::string path =
+            AggregatePath(station(rng), kShapes[shape(rng)], cache);
+        const auto sent = Clock::now();
+        const int status = client.Get(path, body);
+        r.latencies_us.push_back(
+            std::chrono::duration<double, std::micro>(Clock::now() - sent)
+                .count());
+        ++r.queries;
+        if (status != 200) {
+          ++r.failures;
+          if (status == 0) break;
+        }
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  PhaseResult total;
+  total.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  for (const PhaseResult& r : results) {
+    total.queries += r.queries;
+    total.failures += r.failures;
+    total.latencies_us.insert(
+        total.latencies_us.end(), r.latencies_us.begin(), r.latencies_us.end());
+  }
+  std::ranges::sort(total.latencies_us);
+  return total;
+}
+
+void PrintPhase(const char* label, const PhaseResult& r) {
+  auto percentile = [&](double p) {
+    if (r.latencies_us.empty()) return 0.0;
+    const size_t n = r.latencies_us.size();
+    return r.latencies_us[std::min<size_t>(n - 1, p * n)];
+  };
+  printf(
+      "%-8s %8" PRIu64
+      " queries  %9.0f q/s  p50 %8.1f us  p99 %8.1f us  max %8.1f us\n",
+      label,
+      r.queries,
+      r.queries / r.seconds,
+      percentile(0.50),
+      percentile(0.99),
+      r.latencies_us.empty() ? 0.0 : r.latencies_us.back());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int num_stations = 4;
+  int days = 30;
+  int clients = 8;
+  double seconds = 3;
+  double ingest_hz = 100;
+  std::filesystem::path dir = "/tmp/query_load_test";
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--stations=")) {
+      num_stations = atoi(argv[i] + strlen("--stations="));
+    } else if (arg.starts_with("--days=")) {
+      days = atoi(argv[i] + strlen("--days="));
+    } else if (arg.starts_with("--clients=")) {
+      clients = atoi(argv[i] + strlen("--clients="));
+    } else if (arg.starts_with("--seconds=")) {
+      seconds = atof(argv[i] + strlen("--seconds="));
+    } else if (arg.starts_with("--ingest-hz=")) {
+      ingest_hz = atof(argv[i] + strlen("--ingest-hz="));
+    } else if (arg.starts_with("--dir=")) {
+      dir = argv[i] + strlen("--dir=");
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--stations=N] [--days=N] [--clients=N] [--seconds=S] "
+          "[--ingest-hz=X] [--dir=PATH]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  std::filesystem::remove_all(dir);
+
+  // History up to now, and generators to go on from there.
+  std::vector<tsdb::SyntheticStation> generators;
+  const int64_t history_ticks = int64_t{days} * kDayMs / kTickMs;
+  for (int s = 0; s < num_stations; ++s) {
+    generators.emplace_back(s + 1, kStartMs);
+    auto store = tsdb::Store::Open(dir / StationName(s));
+    if (!store) {
+      fprintf(stderr, "%s\n", store.error().c_str());
+      return 1;
+    }
+    for (int64_t i = 0; i < history_ticks; ++i) {
+      if (auto ok = (*store)->Append(generators[s].Next()); !ok) {
+        fprintf(stderr, "%s\n", ok.error().c_str());
+        return 1;
+      }
+    }
+    if (auto sealed = (*store)->Seal(); !sealed) {
+      fprintf(stderr, "%s\n", sealed.error().c_str());
+      return 1;
+    }
+  }
+  printf(
+      "%d stations, %d days of history, %d clients, ingest %.0f ticks/s\n",
+      num_stations,
+      days,
+      clients,
+      ingest_hz);
+
+  std::atomic<int64_t> now_ms = kStartMs + history_ticks * kTickMs;
+  api::ServiceOptions options{
+      .dir = dir, .now_ms = [&] { return now_ms.load(); }};
+  auto service = api::QueryService::Open(options);
+  if (!service) {
+    fprintf(stderr, "%s\n", service.error().c_str());
+    return 1;
+  }
+  auto server = api::HttpServer::Start(
+      "127.0.0.1",
+      0,
+      [&](const api::HttpRequest& request, api::HttpResponse& response) {
+        (*service)->Handle(request, response);
+      });
+  if (!server) {
+    fprintf(stderr, "%s\n", server.error().c_str());
+    return 1;
+  }
+
+  // The stations keep publishing as the clients query.
+  std::atomic<bool> ingesting = true;
+  std::thread ingest([&] {
+    std::vector<uint32_t> rain(num_stations);
+    auto next = Clock::now();
+    const auto period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1 / ingest_hz));
+    for (int64_t tick = history_ticks; ingesting; ++tick) {
+      std::this_thread::sleep_until(next);
+      next += period;
+      const int64_t t_ms = kStartMs + tick * kTickMs;
+      for (int s = 0; s < num_stations; ++s) {
+        const tsdb::Sample sample = generators[s].Next();
+        const std::string station = StationName(s);
+        auto topic = [&](fleet::Sensor sensor) {
+          return fleet::StateTopicFor("homeassistant", station, sensor);
+        };
+        rain[s] += sample.rain_ticks;
+        std::vector<std::pair<std::string, std::string>> messages = {
+            {topic(fleet::Sensor::kWindDirection),
+             std::string(tsdb::kSectorNames[sample.sector])},
+            {topic(fleet::Sensor::kWindSpeed),
+             std::to_string(sample.wind_mph)},
+        };
+        if ((tick + 1) % kRainEveryTicks == 0) {
+          messages.emplace_back(
+              topic(fleet::Sensor::kRain),
+              std::to_string(
+                  std::exchange(rain[s], 0) * kRainInchesPerTick * kHourMs /
+                  (kRainEveryTicks * kTickMs)));
+        }
+        (*server)->Post([&, t_ms, messages = std::move(messages)] {
+          for (const auto& [topic, payload] : messages) {
+            (*service)->OnMessage(t_ms, topic, payload);
+          }
+          now_ms = std::max<int64_t>(now_ms, t_ms);
+        });
+      }
+    }
+  });
+
+  const int port = (*server)->port();
+  const PhaseResult uncached =
+      RunPhase(port, clients, seconds, num_stations, false);
+  PrintPhase("no cache", uncached);
+  const api::CacheStats before = (*service)->cache_stats();
+  const PhaseResult cached =
+      RunPhase(port, clients, seconds, num_stations, true);
+  PrintPhase("cache", cached);
+  ingesting = false;
+  ingest.join();
+
+  // Waits for the last posted messages, then compares.
+  HttpClient client(port);
+  std::string body;
+  client.Get("/v1/stations", body);
+  const api::CacheStats after = (*service)->cache_stats();
+  const uint64_t lookups =
+      after.hits + after.misses - before.hits - before.misses;
+  printf(
+      "cache: %.1f%% of buckets hit, %" PRIu64 " invalidated by %" PRIu64
+      " samples ingested, %" PRIu64 " held\n",
+      lookups ? 100.0 * (after.hits - before.hits) / lookups : 0.0,
+      after.invalidated,
+      (*service)->stats().samples,
+      after.buckets);
+  printf(
+      "speedup: %.1fx queries/s\n",
+      (cached.queries / cached.seconds) /
+          (uncached.queries / uncached.seconds));
+
+  bool ok = uncached.failures == 0 && cached.failures == 0 &&
+            (*service)->stats().rejected == 0;
+  uint64_t mismatched = 0;
+  for (int s = 0; s < num_stations; ++s) {
+    for (const Shape& shape : kShapes) {
+      std::string with, without;
+      const int a = client.Get(AggregatePath(s, shape, true), with);
+      const int b = client.Get(AggregatePath(s, shape, false), without);
+      if (a != 200 || b != 200 || with != without) ++mismatched;
+    }
+  }
+  if (mismatched > 0) printf("%" PRIu64 " cached answers differ\n", mismatched);
+
+  // The raw blocks of the last day hold the samples its hours counted.
+  const int64_t to = now_ms / kHourMs * kHourMs + kHourMs;
+  const int64_t from = to - kDayMs;
+  std::string hourly, blocks;
+  client.Get(
+      "/v1/aggregate?station=station0&bucket=" + std::to_string(kHourMs) +
+          "&from=" + std::to_string(from) + "&to=" + std::to_string(to),
+      hourly);
+  client.Get(
+      "/v1/blocks?station=station0&from=" + std::to_string(from) +
+          "&to=" + std::to_string(to),
+      blocks);
+  uint64_t counted = 0;
+  for (size_t at = 0;
+       (at = hourly.find("\"count\":", at)) != std::string::npos;) {
+    at += strlen("\"count\":");
+    counted += strtoull(hourly.c_str() + at, nullptr, 10);
+  }
+  uint64_t in_blocks = 0;
+  auto columns = std::make_unique<tsdb::Columns>();
+  for (size_t at = 0; at + sizeof(tsdb::BlockIndex) <= blocks.size();) {
+    tsdb::BlockIndex index;
+    memcpy(&index, blocks.data() + at, sizeof(index));
+    at += sizeof(index);
+    const auto block = std::span(
+        reinterpret_cast<const uint8_t*>(blocks.data()) + at, index.length);
+    at += index.length;
+    if (at > blocks.size() || !tsdb::DecodeBlock(block, *columns)) {
+      ok = false;
+      break;
+    }
+    for (size_t i = 0; i < columns->count; ++i) {
+      in_blocks +=
+          columns->timestamp_ms[i] >= from && columns->timestamp_ms[i] < to;
+    }
+  }
+  printf(
+      "last day of station0: %zu bytes of blocks, %" PRIu64 " samples, %" PRIu64
+      " counted hourly\n",
+      blocks.size(),
+      in_blocks,
+      counted);
+  ok = ok && mismatched == 0 && counted > 0 && in_blocks == counted;
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+// Records station state topics into a tsdb store per station and serves
+// range queries over them as HTTP/JSON, from a result cache where it can
+// (see api/service.h for the endpoints).
+//
+//   query_service --dir=DIR [--port=8080] [--bind=0.0.0.0]
+//                 [--cache-buckets=262144]
+//                 [--mqtt=HOST[:PORT] [--topic=FILTER] [--user=U]
+//                  [--password=P]]
+//                 [--compact [--tiers=30:60,365:3600] [--io-mb-s=16]
+//                  [--cpu-share=0.25] [--segment-mb=8]]
+//
+// Without --mqtt it serves the stores already under DIR. With --compact the
+// stores are compacted in the background: history older than each tier's
+// days is downsampled to its resolution in seconds (--tiers= for none), and
+// small segments are merged. For example, the last day of station ws in
+// hours:
+//
+//   curl 'localhost:8080/v1/aggregate?station=ws&bucket=3600000&last=86400000'
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "api/http.h"
+#include "api/service.h"
+#include "mqtt/client.h"
+#include "tsdb/compaction.h"
+
+namespace {
+
+// How often the stores' head logs are flushed to the OS.
+constexpr auto kFlushInterval = std::chrono::seconds(10);
+
+int64_t NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// "DAYS:SECONDS,..." as compaction tiers, coarsest last.
+std::optional<std::vector<tsdb::CompactionTier>> ParseTiers(
+    std::string_view spec) {
+  std::vector<tsdb::CompactionTier> tiers;
+  while (!spec.empty()) {
+    const std::string_view tier = spec.substr(0, spec.find(','));
+    spec.remove_prefix(std::min(spec.size(), tier.size() + 1));
+    int64_t days = 0;
+    uint32_t seconds = 0;
+    const char* end = tier.data() + tier.size();
+    auto [colon, ec] = std::from_chars(tier.data(), end, days);
+    if (ec != std::errc() || colon == end || *colon != ':') return std::nullopt;
+    auto [rest, ec2] = std::from_chars(colon + 1, end, seconds);
+    if (ec2 != std::errc() || rest != end || days < 0 || seconds == 0 ||
+        (!tiers.empty() && tiers.back().age_ms >= days * 86'400'000)) {
+      return std::nullopt;
+    }
+    tiers.push_back({days * 86'400'000, seconds * 1000});
+  }
+  return tiers;
+}
+
+// Logs the compaction jobs done, and any failure, since `last`.
+void ReportCompaction(
+    const tsdb::CompactionStats& stats, tsdb::CompactionStats& last) {
+  if (stats.merges != last.merges || stats.downsamples != last.downsamples) {
+    fprintf(
+        stderr,
+        "compaction: %" PRIu64 " merges, %" PRIu64 " downsamples, %" PRIu64
+        " segments replaced, %" PRIu64 " MB read, %" PRIu64 " MB written\n",
+        stats.merges,
+        stats.downsamples,
+        stats.segments_replaced,
+        stats.bytes_read >> 20,
+        stats.bytes_written >> 20);
+  }
+  if (stats.failures != last.failures) {
+    fprintf(stderr, "compaction failed: %s\n", stats.last_error.c_str());
+  }
+  last = stats;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  api::ServiceOptions options;
+  std::string bind = "0.0.0.0";
+  int port = 8080;
+  mqtt::ConnectInfo connect{.client_id = "query_service"};
+  std::string filter = "homeassistant/#";
+  bool use_mqtt = false;
+  tsdb::CompactionOptions compaction;
+  bool compact = false;
+  bool bad = false;
+  for (int i = 1; i < argc && !bad; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg.starts_with("--dir=")) {
+      options.dir = value("--dir=");
+    } else if (arg.starts_with("--port=")) {
+      port = atoi(value("--port="));
+    } else if (arg.starts_with("--bind=")) {
+      bind = value("--bind=");
+    } else if (arg.starts_with("--cache-buckets=")) {
+      options.cache_buckets = atoll(value("--cache-buckets="));
+    } else if (arg.starts_with("--mqtt=")) {
+      use_mqtt = true;
+      const std::string_view host = value("--mqtt=");
+      const size_t colon = host.rfind(':');
+      connect.host = host.substr(0, colon);
+      if (colon != std::string_view::npos) {
+        connect.port = atoi(std::string(host.substr(colon + 1)).c_str());
+      }
+    } else if (arg.starts_with("--topic=")) {
+      filter = value("--topic=");
+    } else if (arg.starts_with("--user=")) {
+      connect.user = value("--user=");
+    } else if (arg.starts_with("--password=")) {
+      connect.password = value("--password=");
+    } else if (arg == "--compact") {
+      compact = true;
+    } else if (arg.starts_with("--tiers=")) {
+      auto tiers = ParseTiers(value("--tiers="));
+      bad = !tiers;
+      if (tiers) compaction.tiers = *std::move(tiers);
+    } else if (arg.starts_with("--io-mb-s=")) {
+      compaction.io_bytes_per_s = atof(value("--io-mb-s=")) * (1 << 20);
+    } else if (arg.starts_with("--cpu-share=")) {
+      compaction.cpu_share = atof(value("--cpu-share="));
+    } else if (arg.starts_with("--segment-mb=")) {
+      compaction.target_segment_bytes =
+          atof(value("--segment-mb=")) * (1 << 20);
+    } else {
+      bad = true;
+    }
+  }
+  if (bad || options.dir.empty()) {
+    fprintf(
+        stderr,
+        "usage: %s --dir=DIR [--port=N] [--bind=ADDR] [--cache-buckets=N] "
+        "[--mqtt=HOST[:PORT] [--topic=FILTER] [--user=U] [--password=P]] "
+        "[--compact [--tiers=DAYS:SECONDS,...] [--io-mb-s=N] "
+        "[--cpu-share=X] [--segment-mb=N]]\n",
+        argv[0]);
+    return 1;
+  }
+  if (compact) options.compaction = std::move(compaction);
+
+  auto service = api::QueryService::Open(options);
+  if (!service) {
+    fprintf(stderr, "%s\n", service.error().c_str());
+    return 1;
+  }
+  auto server = api::HttpServer::Start(
+      bind,
+      port,
+      [&](const api::HttpRequest& request, api::HttpResponse& response) {
+        (*service)->Handle(request, response);
+      });
+  if (!server) {
+    fprintf(stderr, "%s\n", server.error().c_str());
+    return 1;
+  }
+  fprintf(
+      stderr,
+      "serving %s on %s:%d\n",
+      options.dir.c_str(),
+      bind.c_str(),
+      (*server)->port());
+
+  std::unique_ptr<mqtt::Client> client;
+  if (use_mqtt) {
+    auto connected = mqtt::Client::Connect(connect);
+    if (!connected) {
+      fprintf(stderr, "%s\n", connected.error().c_str());
+      return 1;
+    }
+    client = *std::move(connected);
+    if (auto ok = client->Subscribe(filter); !ok) {
+      fprintf(stderr, "%s\n", ok.error().c_str());
+      return 1;
+    }
+  }
+  // Messages are recorded on the server's thread, between requests.
+  auto next_flush = std::chrono::steady_clock::now() + kFlushInterval;
+  tsdb::CompactionStats compaction_reported;
+  while (true) {
+    if (!client) {
+      std::this_thread::sleep_until(next_flush);
+    } else if (auto message = client->Poll(std::chrono::seconds(1)); !message) {
+      fprintf(stderr, "%s\n", message.error().c_str());
+      return 1;
+    } else if (*message) {
+      (*server)->Post([&, t_ms = NowMs(), m = **std::move(message)] {
+        (*service)->OnMessage(t_ms, m.topic, m.payload);
+      });
+    }
+    if (std::chrono::steady_clock::now() >= next_flush) {
+      (*server)->Post([&] { (*service)->Flush(); });
+      next_flush += kFlushInterval;
+      if (auto stats = (*service)->compaction_stats()) {
+        ReportCompaction(*stats, compaction_reported);
+      }
+    }
+  }
+}
@@ -0,0 +1,209 @@
+// Fits the tipping-bucket correction curve (src/tipping_bucket.h) to
+// calibration rig runs and prints a TipCurve to paste in.
+//
+//   rain_gauge_fit [--nominal-in=0.011] [--name=kMyGaugeTipCurve] RUNS.csv
+//   rain_gauge_fit [--nominal-in=0.011] --synthetic=TIP_SECONDS
+//
+// Each run feeds the gauge a known constant intensity and counts tips:
+//
+//   reference_in_per_hour,duration_s,tips
+//
+// Lines starting with '#' are ignored. --synthetic instead simulates runs of
+// a bucket that loses everything arriving during a tip of TIP_SECONDS, with
+// a little rig noise, to show what a fit looks like.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tipping_bucket.h"
+
+namespace {
+
+struct Run {
+  double reference_in_h;
+  double duration_s;
+  int tips;
+};
+
+bool ReadRuns(const char* path, std::vector<Run>& runs) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  char line[256];
+  int line_no = 0;
+  while (fgets(line, sizeof(line), f)) {
+    ++line_no;
+    if (line[0] == '#' || line[0] == '\n') continue;
+    Run run;
+    const int fields = sscanf(
+        line, "%lf,%lf,%d", &run.reference_in_h, &run.duration_s, &run.tips);
+    if (fields != 3) {
+      fprintf(
+          stderr,
+          "%s:%d: expected reference_in_per_hour,duration_s,tips\n",
+          path,
+          line_no);
+      fclose(f);
+      return false;
+    }
+    if (run.tips > 0 && run.duration_s > 0 && run.reference_in_h > 0) {
+      runs.push_back(run);
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+// Tips a bucket of `nominal_in` makes in `duration_s` at `in_h` if
+// everything that arrives during a `tip_s` tip is lost.
+std::vector<Run> SyntheticRuns(double nominal_in, double tip_s) {
+  std::mt19937 rng(1);
+  std::normal_distribution<double> rig_noise(1, 0.01);
+  std::vector<Run> runs;
+  for (double in_h : {0.25, 0.5, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0}) {
+    const double duration_s = 3600;
+    const double fill_s = nominal_in / (in_h / 3600);
+    const double tips = duration_s / (fill_s + tip_s) * rig_noise(rng);
+    runs.push_back({in_h, duration_s, static_cast<int>(std::lround(tips))});
+  }
+  return runs;
+}
+
+double MeasuredInH(const Run& run, double nominal_in) {
+  return run.tips * nominal_in * 3600 / run.duration_s;
+}
+
+// Relative rms error of the intensity `curve` reports for each run.
+double RmsError(const std::vector<Run>& runs, const TipCurve& curve) {
+  double sum = 0;
+  for (const Run& run : runs) {
+    const float interval_s = run.duration_s / run.tips;
+    const double corrected_in_h =
+        TipInches(curve, interval_s) * 3600 / interval_s;
+    const double err = corrected_in_h / run.reference_in_h - 1;
+    sum += err * err;
+  }
+  return std::sqrt(sum / runs.size());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  double nominal_in = kSen15901TipCurve.nominal_in;
+  std::string name = "kMyGaugeTipCurve";
+  const char* path = nullptr;
+  double synthetic_tip_s = -1;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg.starts_with("--nominal-in=")) {
+      nominal_in = atof(value("--nominal-in="));
+    } else if (arg.starts_with("--name=")) {
+      name = value("--name=");
+    } else if (arg.starts_with("--synthetic=")) {
+      synthetic_tip_s = atof(value("--synthetic="));
+    } else if (!arg.starts_with("--") && !path) {
+      path = argv[i];
+    } else {
+      path = nullptr;
+      synthetic_tip_s = -1;
+      break;
+    }
+  }
+  if ((path != nullptr) == (synthetic_tip_s >= 0)) {
+    fprintf(
+        stderr,
+        "usage: %s [--nominal-in=IN] [--name=NAME] "
+        "(RUNS.csv | --synthetic=TIP_SECONDS)\n",
+        argv[0]);
+    return 1;
+  }
+
+  std::vector<Run> runs;
+  if (path) {
+    if (!ReadRuns(path, runs)) return 1;
+  } else {
+    runs = SyntheticRuns(nominal_in, synthetic_tip_s);
+  }
+  if (runs.size() < 2) {
+    fprintf(stderr, "need at least two runs with tips\n");
+    return 1;
+  }
+
+  // Weighted least squares of log(I) = log(a) + b log(Im). Runs with more
+  // tips have less counting error and get more weight.
+  double sw = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (const Run& run : runs) {
+    const double w = run.tips;
+    const double x = std::log(MeasuredInH(run, nominal_in));
+    const double y = std::log(run.reference_in_h);
+    sw += w;
+    sx += w * x;
+    sy += w * y;
+    sxx += w * x * x;
+    sxy += w * x * y;
+  }
+  const double denom = sw * sxx - sx * sx;
+  if (denom <= 0) {
+    fprintf(stderr, "runs need at least two different intensities\n");
+    return 1;
+  }
+  const double b = (sw * sxy - sx * sy) / denom;
+  const double a = std::exp((sy - b * sx) / sw);
+
+  // Cap the correction a little above the largest one the runs support.
+  double max_factor = 1;
+  for (const Run& run : runs) {
+    max_factor = std::max(
+        max_factor, run.reference_in_h / MeasuredInH(run, nominal_in));
+  }
+  max_factor = std::ceil(max_factor * 1.1 * 100) / 100;
+
+  const TipCurve fitted = {
+      .nominal_in = static_cast<float>(nominal_in),
+      .a = static_cast<float>(a),
+      .b = static_cast<float>(b),
+      .max_factor = static_cast<float>(max_factor)};
+  const TipCurve uncorrected = {
+      .nominal_in = fitted.nominal_in, .a = 1, .b = 1, .max_factor = 1};
+
+  printf(
+      "%-10s %10s %10s %10s\n", "reference", "measured", "corrected", "error");
+  for (const Run& run : runs) {
+    const float interval_s = run.duration_s / run.tips;
+    const double corrected = TipInches(fitted, interval_s) * 3600 / interval_s;
+    printf(
+        "%10.2f %10.2f %10.2f %9.1f%%\n",
+        run.reference_in_h,
+        MeasuredInH(run, nominal_in),
+        corrected,
+        (corrected / run.reference_in_h - 1) * 100);
+  }
+  printf(
+      "\nrms error %.1f%% uncorrected, %.1f%% corrected\n\n",
+      RmsError(runs, uncorrected) * 100,
+      RmsError(runs, fitted) * 100);
+  printf(
+      "// Fitted by tools/rain_gauge_fit from %zu runs.\n"
+      "inline constexpr TipCurve %s = {\n"
+      "    .nominal_in = %.4g,\n"
+      "    .a = %.4f,\n"
+      "    .b = %.4f,\n"
+      "    .max_factor = %.2f,\n"
+      "};\n",
+      runs.size(),
+      name.c_str(),
+      nominal_in,
+      a,
+      b,
+      max_factor);
+  return 0;
+}
@@ -0,0 +1,466 @@
+#include "recorder/import.h"
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <string_view>
+#include <vector>
+
+#include "fleet/topics.h"
+#include "query/work_stealing_pool.h"
+#include "tsdb/store.h"
+
+namespace recorder {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::string_view kSensorDomain = "sensor.";
+// Readings read back from a run file at a time.
+constexpr size_t kRunBufferReadings = 4096;
+
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Reading {
+  int64_t t_ms;
+  float value;  // NaN while the station was offline.
+};
+
+// One sensor's readings: the sorted runs spilled so far, then those since.
+struct Series {
+  fleet::Sensor sensor;
+  std::vector<Reading> buffer;
+  std::vector<std::filesystem::path> runs;
+};
+
+struct CloseDb {
+  void operator()(sqlite3* db) const { sqlite3_close(db); }
+};
+struct FinalizeStatement {
+  void operator()(sqlite3_stmt* stmt) const { sqlite3_finalize(stmt); }
+};
+using Db = std::unique_ptr<sqlite3, CloseDb>;
+using Statement = std::unique_ptr<sqlite3_stmt, FinalizeStatement>;
+
+std::expected<Statement, std::string> Prepare(sqlite3* db, const char* sql) {
+  sqlite3_stmt* stmt = nullptr;
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+    return std::unexpected(sqlite3_errmsg(db));
+  }
+  return Statement(stmt);
+}
+
+// The column's text in SQLite's own buffer, valid until the next step.
+std::string_view Text(sqlite3_stmt* stmt, int column) {
+  const auto* text =
+      reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+  if (!text) return {};
+  return {text, static_cast<size_t>(sqlite3_column_bytes(stmt, column))};
+}
+
+// Removes the run files' directory, if it was made, however the import ends.
+struct RunDir {
+  ~RunDir() {
+    std::error_code ec;
+    if (made) std::filesystem::remove_all(path, ec);
+  }
+
+  std::filesystem::path path;
+  bool made = false;
+};
+
+// Sorts every series' buffered readings by time, keeping rows of one
+// timestamp in table order, and writes them out as a run.
+std::expected<void, std::string> Spill(
+    std::vector<Series>& series, RunDir& dir, ImportStats& stats) {
+  if (!dir.made) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir.path, ec);
+    if (ec) return std::unexpected(dir.path.string() + ": " + ec.message());
+    dir.made = true;
+  }
+  for (size_t i = 0; i < series.size(); ++i) {
+    std::vector<Reading>& buffer = series[i].buffer;
+    if (buffer.empty()) continue;
+    std::ranges::stable_sort(buffer, {}, &Reading::t_ms);
+    const std::filesystem::path path =
+        dir.path / ("run-" + std::to_string(i) + "-" +
+                    std::to_string(series[i].runs.size()));
+    FILE* f = fopen(path.c_str(), "wb");
+    const bool written =
+        f && fwrite(buffer.data(), sizeof(Reading), buffer.size(), f) ==
+                 buffer.size();
+    if (!f || fclose(f) != 0 || !written) {
+      return std::unexpected("write " + path.string() + " failed");
+    }
+    series[i].runs.push_back(path);
+    buffer.clear();
+    ++stats.runs_spilled;
+  }
+  return {};
+}
+
+// A series' readings in time order, merged from its runs and in-memory tail.
+// Of readings with one timestamp only the last row's is kept: the recorder
+// wrote it last.
+class SortedSeries {
+ public:
+  static std::expected<std::unique_ptr<SortedSeries>, std::string> Open(
+      Series& series, uint64_t* duplicates) {
+    std::unique_ptr<SortedSeries> sorted(new SortedSeries(duplicates));
+    for (const auto& run : series.runs) {
+      FILE* f = fopen(run.c_str(), "rb");
+      if (!f) return std::unexpected("open " + run.string() + " failed");
+      sorted->sources_.push_back({.file = f});
+    }
+    std::ranges::stable_sort(series.buffer, {}, &Reading::t_ms);
+    sorted->sources_.push_back({.buffer = std::move(series.buffer)});
+    for (size_t i = 0; i < sorted->sources_.size(); ++i) sorted->Next(i);
+    sorted->Advance();
+    return sorted;
+  }
+
+  ~SortedSeries() {
+    for (const Source& s : sources_) {
+      if (s.file) fclose(s.file);
+    }
+  }
+
+  // The next reading, or null at the end.
+  const Reading* Peek() const { return next_ ? &*next_ : nullptr; }
+  void Pop() { Advance(); }
+
+ private:
+  struct Source {
+    FILE* file = nullptr;
+    std::vector<Reading> buffer;
+    size_t pos = 0;
+  };
+  struct Head {
+    Reading reading;
+    size_t source;
+
+    // Earliest first, and of one timestamp the earliest written.
+    bool operator>(const Head& o) const {
+      return reading.t_ms != o.reading.t_ms ? reading.t_ms > o.reading.t_ms
+                                            : source > o.source;
+    }
+  };
+
+  explicit SortedSeries(uint64_t* duplicates) : duplicates_(duplicates) {}
+
+  // Queues source i's next reading, if it has one.
+  void Next(size_t i) {
+    Source& s = sources_[i];
+    if (s.pos == s.buffer.size() && s.file) {
+      s.buffer.resize(kRunBufferReadings);
+      s.buffer.resize(
+          fread(s.buffer.data(), sizeof(Reading), s.buffer.size(), s.file));
+      s.pos = 0;
+    }
+    if (s.pos < s.buffer.size()) heads_.push({s.buffer[s.pos++], i});
+  }
+
+  Head Take() {
+    const Head head = heads_.top();
+    heads_.pop();
+    Next(head.source);
+    return head;
+  }
+
+  void Advance() {
+    if (heads_.empty()) {
+      next_.reset();
+      return;
+    }
+    Reading reading = Take().reading;
+    while (!heads_.empty() && heads_.top().reading.t_ms == reading.t_ms) {
+      reading = Take().reading;
+      ++*duplicates_;
+    }
+    next_ = reading;
+  }
+
+  uint64_t* const duplicates_;
+  std::vector<Source> sources_;
+  std::priority_queue<Head, std::vector<Head>, std::greater<>> heads_;
+  std::optional<Reading> next_;
+};
+
+// How many times the station published a reading the recorder kept once: at
+// every period until the next report, which arrives about a period after
+// the last repeat, or until it went offline, up to the hold limit.
+int64_t Repeats(
+    const Reading& reading,
+    const Reading* next,
+    int64_t period_ms,
+    int64_t max_hold_ms) {
+  if (!next) return 1;
+  const int64_t gap_ms = next->t_ms - reading.t_ms;
+  const int64_t periods = std::isnan(next->value)
+                              ? (gap_ms + period_ms - 1) / period_ms
+                              : (gap_ms + period_ms / 2) / period_ms;
+  return std::clamp<int64_t>(
+      periods, 1, std::max<int64_t>(1, max_hold_ms / period_ms));
+}
+
+// Rebuilds one station's samples from its sorted sensor readings, and
+// encodes and writes them a batch of segments at a time.
+class StationWriter {
+ public:
+  StationWriter(
+      const ImportOptions& options, tsdb::Store& store,
+      query::WorkStealingPool& pool, ImportStats& stats)
+      : options_(options), store_(store), pool_(pool), stats_(stats) {
+    batch_.reserve(pool_.size() * kSegmentSamples);
+  }
+
+  std::expected<void, std::string> Write(
+      SortedSeries& wind, SortedSeries* vane, SortedSeries* rain) {
+    const int64_t period_ms = options_.wind_period_ms;
+    while (const Reading* next = wind.Peek()) {
+      const Reading reading = *next;
+      wind.Pop();
+      if (std::isnan(reading.value)) continue;
+      const int64_t repeats =
+          Repeats(reading, wind.Peek(), period_ms, options_.max_hold_ms);
+      for (int64_t k = 0; k < repeats; ++k) {
+        // A sample goes with the vane and rain messages sent at the same
+        // tick, which may have arrived either side of it.
+        const int64_t t_ms = reading.t_ms + k * period_ms;
+        if (vane) AdvanceVane(*vane, t_ms + period_ms / 2);
+        if (rain) AdvanceRain(*rain, t_ms + period_ms / 2);
+        const double ticks = std::clamp(
+            std::floor(rain_ticks_ + 0.5),
+            0.0,
+            static_cast<double>(std::numeric_limits<uint16_t>::max()));
+        rain_ticks_ -= ticks;
+        batch_.push_back(tsdb::Sample{
+            .timestamp_ms = t_ms,
+            .wind_mph = reading.value,
+            .sector = sector_,
+            .rain_ticks = static_cast<uint16_t>(ticks),
+        });
+        if (batch_.size() == batch_.capacity()) {
+          if (auto flushed = Flush(); !flushed) return flushed;
+        }
+      }
+    }
+    return Flush();
+  }
+
+ private:
+  static constexpr size_t kSegmentSamples =
+      tsdb::StoreOptions{}.blocks_per_segment * tsdb::kBlockSamples;
+
+  // Takes the vane's sector as of t_ms. Offline, it keeps the last one.
+  void AdvanceVane(SortedSeries& vane, int64_t t_ms) {
+    for (const Reading* r; (r = vane.Peek()) && r->t_ms <= t_ms; vane.Pop()) {
+      if (!std::isnan(r->value)) sector_ = static_cast<uint8_t>(r->value);
+    }
+  }
+
+  // Adds the ticks of every rain report up to t_ms, repeats included.
+  void AdvanceRain(SortedSeries& rain, int64_t t_ms) {
+    const int64_t period_ms = options_.rain_period_ms;
+    const double ticks_per_in_per_h =
+        period_ms / 3'600'000.0 / options_.rain_inches_per_tick;
+    while (true) {
+      if (rain_repeats_ == 0) {
+        const Reading* r = rain.Peek();
+        if (!r || r->t_ms > t_ms) return;
+        rain_ = *r;
+        rain.Pop();
+        rain_repeats_ =
+            std::isnan(rain_.value)
+                ? 0
+                : Repeats(rain_, rain.Peek(), period_ms, options_.max_hold_ms);
+        continue;
+      }
+      if (rain_.t_ms > t_ms) return;
+      rain_ticks_ += rain_.value * ticks_per_in_per_h;
+      rain_.t_ms += period_ms;
+      --rain_repeats_;
+    }
+  }
+
+  // Encodes the batch a segment per task, then writes the segments in order.
+  std::expected<void, std::string> Flush() {
+    struct Encoded {
+      std::vector<uint8_t> data;
+      std::vector<tsdb::BlockIndex> index;
+    };
+    std::vector<Encoded> segments(
+        (batch_.size() + kSegmentSamples - 1) / kSegmentSamples);
+    std::vector<query::WorkStealingPool::Task> tasks;
+    for (size_t i = 0; i < segments.size(); ++i) {
+      tasks.push_back([&, i] {
+        const size_t begin = i * kSegmentSamples;
+        const std::span<const tsdb::Sample> samples = std::span(batch_).subspan(
+            begin, std::min(kSegmentSamples, batch_.size() - begin));
+        for (size_t j = 0; j < samples.size(); j += tsdb::kBlockSamples) {
+          const size_t n = std::min(tsdb::kBlockSamples, samples.size() - j);
+          segments[i].index.push_back(
+              tsdb::EncodeBlock(samples.subspan(j, n), segments[i].data));
+        }
+      });
+    }
+    pool_.Run(std::move(tasks));
+    for (const Encoded& s : segments) {
+      if (auto appended = store_.AppendSegment(s.data, s.index); !appended) {
+        return std::unexpected(store_.dir().string() + ": " + appended.error());
+      }
+    }
+    stats_.samples += batch_.size();
+    stats_.segments += segments.size();
+    batch_.clear();
+    return {};
+  }
+
+  const ImportOptions& options_;
+  tsdb::Store& store_;
+  query::WorkStealingPool& pool_;
+  ImportStats& stats_;
+
+  std::vector<tsdb::Sample> batch_;
+  uint8_t sector_ = 0;
+  // The rain report being repeated, and the ticks not yet put on a sample.
+  Reading rain_ = {};
+  int64_t rain_repeats_ = 0;
+  double rain_ticks_ = 0;
+};
+
+}  // namespace
+
+std::expected<ImportStats, std::string> ImportRecorder(
+    const std::filesystem::path& db_path, const std::filesystem::path& out_dir,
+    const ImportOptions& options) {
+  auto fail = [&](std::string_view what) {
+    return std::unexpected(db_path.string() + ": " + std::string(what));
+  };
+  sqlite3* raw_db = nullptr;
+  const int opened = sqlite3_open_v2(
+      db_path.c_str(), &raw_db, SQLITE_OPEN_READONLY, nullptr);
+  const Db db(raw_db);
+  if (opened != SQLITE_OK) return fail(sqlite3_errstr(opened));
+  // Reads through a mapping rather than copies into the page cache.
+  sqlite3_exec(
+      db.get(),
+      "PRAGMA mmap_size = 1099511627776",
+      nullptr,
+      nullptr,
+      nullptr);
+
+  // The stations' sensors, by metadata_id.
+  std::vector<Series> series;
+  std::vector<int32_t> series_of;
+  std::map<std::string, std::array<int32_t, 3>, std::less<>> stations;
+  {
+    auto meta =
+        Prepare(db.get(), "SELECT metadata_id, entity_id FROM states_meta");
+    if (!meta) return fail(meta.error() + " (recorder schema before 2023.4?)");
+    int rc;
+    while ((rc = sqlite3_step(meta->get())) == SQLITE_ROW) {
+      const int64_t id = sqlite3_column_int64(meta->get(), 0);
+      const std::string_view entity_id = Text(meta->get(), 1);
+      if (id < 0 || !entity_id.starts_with(kSensorDomain)) continue;
+      const auto topic =
+          fleet::ParseObjectId(entity_id.substr(kSensorDomain.size()));
+      if (!topic) continue;
+      auto [station, inserted] =
+          stations.try_emplace(std::string(topic->station));
+      if (inserted) station->second.fill(-1);
+      if (series_of.size() <= static_cast<size_t>(id)) {
+        series_of.resize(id + 1, -1);
+      }
+      series_of[id] = series.size();
+      station->second[static_cast<size_t>(topic->sensor)] = series.size();
+      series.push_back({.sensor = topic->sensor});
+    }
+    if (rc != SQLITE_DONE) return fail(sqlite3_errmsg(db.get()));
+  }
+
+  ImportStats stats;
+  RunDir run_dir{
+      options.tmp_dir.empty() ? out_dir / ".import-runs" : options.tmp_dir};
+  const auto scan_start = Clock::now();
+  {
+    // A full scan in table order, never by index, filtering here.
+    auto scan = Prepare(
+        db.get(),
+        "SELECT metadata_id, state, last_updated_ts FROM states NOT INDEXED");
+    if (!scan) return fail(scan.error());
+    sqlite3_stmt* stmt = scan->get();
+    uint64_t buffered = 0;
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+      ++stats.rows_scanned;
+      const int64_t id = sqlite3_column_int64(stmt, 0);
+      if (id < 0 || static_cast<size_t>(id) >= series_of.size() ||
+          series_of[id] < 0) {
+        continue;
+      }
+      Series& s = series[series_of[id]];
+      ++stats.rows_read;
+      const std::string_view state = Text(stmt, 1);
+      float value;
+      if (const auto parsed = fleet::ParsePayload(s.sensor, state)) {
+        value = *parsed;
+      } else if (state == "unavailable" || state == "unknown") {
+        value = std::numeric_limits<float>::quiet_NaN();
+        ++stats.rows_unavailable;
+      } else {
+        ++stats.rows_unparsed;
+        continue;
+      }
+      const int64_t t_ms = std::llround(sqlite3_column_double(stmt, 2) * 1e3);
+      s.buffer.push_back({t_ms, value});
+      if (++buffered == options.memory_readings) {
+        if (auto spilled = Spill(series, run_dir, stats); !spilled) {
+          return std::unexpected(spilled.error());
+        }
+        buffered = 0;
+      }
+    }
+    if (rc != SQLITE_DONE) return fail(sqlite3_errmsg(db.get()));
+  }
+  stats.scan_s = SecondsSince(scan_start);
+
+  const auto write_start = Clock::now();
+  query::WorkStealingPool pool(std::max<size_t>(1, options.threads));
+  for (const auto& [name, ids] : stations) {
+    std::array<std::unique_ptr<SortedSeries>, 3> sorted;
+    for (size_t i = 0; i < ids.size(); ++i) {
+      if (ids[i] < 0) continue;
+      auto opened = SortedSeries::Open(series[ids[i]], &stats.duplicates);
+      if (!opened) return std::unexpected(opened.error());
+      sorted[i] = *std::move(opened);
+    }
+    auto& wind = sorted[static_cast<size_t>(fleet::Sensor::kWindSpeed)];
+    if (!wind) continue;
+    auto store = tsdb::Store::Open(out_dir / name);
+    if (!store) return std::unexpected(store.error());
+    StationWriter writer(options, **store, pool, stats);
+    auto written = writer.Write(
+        *wind,
+        sorted[static_cast<size_t>(fleet::Sensor::kWindDirection)].get(),
+        sorted[static_cast<size_t>(fleet::Sensor::kRain)].get());
+    if (!written) return std::unexpected(written.error());
+    ++stats.stations;
+  }
+  stats.write_s = SecondsSince(write_start);
+  return stats;
+}
+
+}  // namespace recorder
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <string>
+
+namespace recorder {
+
+struct ImportOptions {
+  // Readings buffered across all sensors before they are sorted and spilled
+  // to run files; at 16 bytes each the default takes 256 MB.
+  uint64_t memory_readings = 16 << 20;
+  // Where the run files go; a directory under the output if empty.
+  std::filesystem::path tmp_dir;
+  // Threads encoding blocks.
+  size_t threads = 1;
+  // The firmware's publishing periods (kWindReportPeriodSecs and
+  // kRainReportPeriodSecs).
+  int64_t wind_period_ms = 5'000;
+  int64_t rain_period_ms = 10 * 60'000;
+  // The rain gauge's kRainGaugeInchesPerTick.
+  double rain_inches_per_tick = 0.011;
+  // The recorder keeps a state only when it changes, so a reading stands for
+  // the repeats after it until the next row, but never for longer than this.
+  int64_t max_hold_ms = 6 * 3'600'000;
+};
+
+struct ImportStats {
+  uint64_t rows_scanned = 0;
+  // Rows of the stations' wind direction, wind speed and rain sensors.
+  uint64_t rows_read = 0;
+  // "unavailable" and "unknown": the station was offline.
+  uint64_t rows_unavailable = 0;
+  uint64_t rows_unparsed = 0;
+  // Rows with the timestamp of a later one of the same sensor.
+  uint64_t duplicates = 0;
+  uint64_t runs_spilled = 0;
+  uint64_t stations = 0;
+  uint64_t samples = 0;
+  uint64_t segments = 0;
+  double scan_s = 0;
+  double write_s = 0;
+};
+
+// Imports the wind and rain history of every station in a Home Assistant
+// recorder database (schema 2023.4 or later) into a tsdb::Store per station
+// under `out_dir`, named by the station prefix of its entity ids (see
+// fleet/topics.h), e.g. "weatherstation" for sensor.weatherstation_anemometer.
+//
+// The states table is read in one sequential scan, and each sensor's
+// readings are sorted by time, in memory or by merging spilled runs, with
+// repeats of a timestamp reduced to the last row. Each wind speed reading
+// then becomes the samples the firmware published until the next row, with
+// the vane's sector at the time, and the rain rates become gauge ticks on
+// the samples that follow them. Blocks are encoded on `threads` threads and
+// written out as segments.
+std::expected<ImportStats, std::string> ImportRecorder(
+    const std::filesystem::path& db_path, const std::filesystem::path& out_dir,
+    const ImportOptions& options = {});
+
+}  // namespace recorder
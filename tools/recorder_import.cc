@@ -0,0 +1,81 @@
+// Imports the wind and rain history of the stations in a Home Assistant
+// recorder database into a tsdb store per station, for query_bench,
+// wind_survey and the compactor to work on.
+//
+//   recorder_import [--threads=N] [--memory-mb=256] [--tmp=DIR]
+//                   [--max-hold-h=6] DB OUT_DIR
+//
+// DB is home-assistant_v2.db, which can be read while Home Assistant runs.
+// Each station gets OUT_DIR/<station>, named by its entity ids' prefix.
+// Importing into stores that already hold as recent samples fails rather
+// than duplicate them.
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "recorder/import.h"
+
+int main(int argc, char** argv) {
+  recorder::ImportOptions options;
+  options.threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<const char*> paths;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--threads=")) {
+      options.threads = atoi(argv[i] + strlen("--threads="));
+    } else if (arg.starts_with("--memory-mb=")) {
+      options.memory_readings =
+          atoll(argv[i] + strlen("--memory-mb=")) * (1 << 20) / 16;
+    } else if (arg.starts_with("--tmp=")) {
+      options.tmp_dir = argv[i] + strlen("--tmp=");
+    } else if (arg.starts_with("--max-hold-h=")) {
+      options.max_hold_ms = atof(argv[i] + strlen("--max-hold-h=")) * 3'600'000;
+    } else if (!arg.starts_with("--")) {
+      paths.push_back(argv[i]);
+    } else {
+      paths.clear();
+      break;
+    }
+  }
+  if (paths.size() != 2 || options.memory_readings == 0) {
+    fprintf(
+        stderr,
+        "usage: %s [--threads=N] [--memory-mb=N] [--tmp=DIR] [--max-hold-h=H] "
+        "DB OUT_DIR\n",
+        argv[0]);
+    return 1;
+  }
+
+  auto stats = recorder::ImportRecorder(paths[0], paths[1], options);
+  if (!stats) {
+    fprintf(stderr, "%s\n", stats.error().c_str());
+    return 1;
+  }
+  printf(
+      "scanned %" PRIu64 " rows in %.2f s (%.2f Mrows/s): %" PRIu64
+      " of station sensors, %" PRIu64 " unavailable, %" PRIu64
+      " unparsed, %" PRIu64 " duplicates, %" PRIu64 " runs spilled\n",
+      stats->rows_scanned,
+      stats->scan_s,
+      stats->rows_scanned / stats->scan_s / 1e6,
+      stats->rows_read,
+      stats->rows_unavailable,
+      stats->rows_unparsed,
+      stats->duplicates,
+      stats->runs_spilled);
+  printf(
+      "wrote %" PRIu64 " samples of %" PRIu64 " stations in %" PRIu64
+      " segments in %.2f s (%.2f Msamples/s)\n",
+      stats->samples,
+      stats->stations,
+      stats->segments,
+      stats->write_s,
+      stats->samples / stats->write_s / 1e6);
+  return 0;
+}
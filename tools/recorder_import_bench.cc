@@ -0,0 +1,357 @@
+// Writes a Home Assistant recorder database holding synthetic stations'
+// history as the recorder would have kept it, imports it, and checks the
+// imported samples against what the stations published. Reports the import's
+// rows/s.
+//
+//   recorder_import_bench [--stations=2] [--days=60] [--memory-mb=8]
+//                         [--threads=N] [--dir=/tmp/recorder_import_bench]
+//
+// The recorder keeps a state only when it changes, and each message arrives
+// up to 400 ms after its tick. A small memory budget makes the importer spill
+// and merge runs. Once a month a station is offline for three hours, and
+// some rows are written twice. Another entity's states are mixed in. Exits
+// non-zero if any sample's time, speed or sector is off, if samples are
+// missing or made up, or if the rain total differs.
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "fleet/topics.h"
+#include "recorder/import.h"
+#include "tsdb/store.h"
+#include "tsdb/synthetic.h"
+
+namespace {
+
+constexpr int64_t kStartMs = 1'700'006'400'000;
+constexpr int64_t kTickMs = 5000;
+constexpr int kRainEveryTicks = 120;
+constexpr double kRainInchesPerTick = 0.011;
+constexpr int64_t kOutageTicks = 3 * 3'600'000 / kTickMs;
+constexpr int64_t kOutageEveryTicks = 30 * 86'400'000LL / kTickMs;
+constexpr int64_t kMaxDelayMs = 400;
+constexpr double kDuplicateRate = 0.001;
+
+// What a station published at one tick.
+struct Expected {
+  int64_t tick_ms;
+  float wind_mph;  // As parsed back from the payload.
+  uint8_t sector;
+};
+
+bool Exec(sqlite3* db, const char* sql) {
+  char* error = nullptr;
+  if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+    fprintf(stderr, "%s: %s\n", sql, error);
+    sqlite3_free(error);
+    return false;
+  }
+  return true;
+}
+
+// The recorder's tables as of 2023.4, less the columns it leaves empty.
+constexpr char kSchema[] = R"(
+CREATE TABLE states_meta (
+  metadata_id INTEGER NOT NULL, entity_id VARCHAR(255),
+  PRIMARY KEY (metadata_id));
+CREATE TABLE states (
+  state_id INTEGER NOT NULL, state VARCHAR(255), last_changed_ts FLOAT,
+  last_updated_ts FLOAT, old_state_id INTEGER, attributes_id INTEGER,
+  origin_idx SMALLINT, context_id_bin BLOB, metadata_id INTEGER,
+  PRIMARY KEY (state_id));
+)";
+
+// Writes states rows the way the recorder does: only changes, each linked to
+// the entity's previous row.
+class Recorder {
+ public:
+  explicit Recorder(sqlite3* db) : db_(db) {
+    sqlite3_prepare_v2(
+        db_,
+        "INSERT INTO states (state, last_updated_ts, old_state_id, "
+        "attributes_id, origin_idx, context_id_bin, metadata_id) "
+        "VALUES (?, ?, ?, 1, 0, ?, ?)",
+        -1,
+        &insert_,
+        nullptr);
+  }
+  ~Recorder() { sqlite3_finalize(insert_); }
+
+  int AddEntity(const std::string& entity_id) {
+    const int id = entities_.size() + 1;
+    const std::string sql = "INSERT INTO states_meta VALUES (" +
+                            std::to_string(id) + ", '" + entity_id + "')";
+    Exec(db_, sql.c_str());
+    entities_.push_back({});
+    return id;
+  }
+
+  // Writes a row, twice if asked, unless the entity's state is unchanged.
+  void Record(
+      int id, int64_t t_ms, std::string_view state, bool twice = false) {
+    Entity& e = entities_[id - 1];
+    if (e.state == state) return;
+    e.state = state;
+    for (int i = 0; i < (twice ? 2 : 1); ++i) {
+      uint64_t context[2] = {rng_(), rng_()};
+      sqlite3_bind_text(insert_, 1, state.data(), state.size(), SQLITE_STATIC);
+      sqlite3_bind_double(insert_, 2, t_ms / 1e3);
+      if (e.last_row) {
+        sqlite3_bind_int64(insert_, 3, e.last_row);
+      } else {
+        sqlite3_bind_null(insert_, 3);
+      }
+      sqlite3_bind_blob(insert_, 4, context, sizeof(context), SQLITE_STATIC);
+      sqlite3_bind_int(insert_, 5, id);
+      sqlite3_step(insert_);
+      sqlite3_reset(insert_);
+      e.last_row = sqlite3_last_insert_rowid(db_);
+      ++rows_;
+    }
+  }
+
+  uint64_t rows() const { return rows_; }
+
+ private:
+  struct Entity {
+    std::string state;
+    int64_t last_row = 0;
+  };
+
+  sqlite3* const db_;
+  sqlite3_stmt* insert_ = nullptr;
+  std::vector<Entity> entities_;
+  std::mt19937_64 rng_{1};
+  uint64_t rows_ = 0;
+};
+
+bool Offline(int64_t tick) {
+  return tick % kOutageEveryTicks >= kOutageEveryTicks - kOutageTicks;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int num_stations = 2;
+  int days = 60;
+  uint64_t memory_mb = 8;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  std::filesystem::path dir = "/tmp/recorder_import_bench";
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--stations=")) {
+      num_stations = atoi(argv[i] + strlen("--stations="));
+    } else if (arg.starts_with("--days=")) {
+      days = atoi(argv[i] + strlen("--days="));
+    } else if (arg.starts_with("--memory-mb=")) {
+      memory_mb = atoll(argv[i] + strlen("--memory-mb="));
+    } else if (arg.starts_with("--threads=")) {
+      threads = atoi(argv[i] + strlen("--threads="));
+    } else if (arg.starts_with("--dir=")) {
+      dir = argv[i] + strlen("--dir=");
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--stations=N] [--days=N] [--memory-mb=N] [--threads=N] "
+          "[--dir=PATH]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  const std::filesystem::path db_path = dir / "home-assistant_v2.db";
+
+  // Every tick's messages in the order they arrive, with the rows the
+  // recorder makes of them.
+  const int64_t ticks = int64_t{days} * 86'400'000 / kTickMs;
+  std::vector<std::vector<Expected>> expected(num_stations);
+  uint64_t expected_rain = 0;
+  const auto generate_start = std::chrono::steady_clock::now();
+  {
+    sqlite3* db = nullptr;
+    if (sqlite3_open(db_path.c_str(), &db) != SQLITE_OK) {
+      fprintf(stderr, "%s: %s\n", db_path.c_str(), sqlite3_errmsg(db));
+      return 1;
+    }
+    if (!Exec(db, "PRAGMA journal_mode = OFF; PRAGMA synchronous = OFF") ||
+        !Exec(db, kSchema) || !Exec(db, "BEGIN")) {
+      return 1;
+    }
+    Recorder recorder(db);
+    const int kitchen = recorder.AddEntity("sensor.kitchen_temperature");
+    struct Station {
+      tsdb::SyntheticStation synthetic;
+      int wind, vane, rain;
+      uint32_t rain_ticks = 0;
+    };
+    std::vector<Station> stations;
+    for (int s = 0; s < num_stations; ++s) {
+      const std::string name = "sensor.station" + std::to_string(s);
+      stations.push_back({
+          tsdb::SyntheticStation(s + 1, kStartMs),
+          recorder.AddEntity(name + std::string(fleet::kWindSpeedSuffix)),
+          recorder.AddEntity(name + std::string(fleet::kWindDirectionSuffix)),
+          recorder.AddEntity(name + std::string(fleet::kRainSuffix)),
+      });
+    }
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int64_t> delay(1, kMaxDelayMs);
+    std::bernoulli_distribution duplicate(kDuplicateRate);
+    for (int64_t i = 0; i < ticks; ++i) {
+      const int64_t tick_ms = kStartMs + i * kTickMs;
+      if (i % 12 == 0) {
+        recorder.Record(kitchen, tick_ms, std::to_string(20 + (i / 720) % 5));
+      }
+      for (int s = 0; s < num_stations; ++s) {
+        Station& st = stations[s];
+        const tsdb::Sample sample = st.synthetic.Next();
+        if (Offline(i)) {
+          for (int id : {st.wind, st.vane, st.rain}) {
+            recorder.Record(id, tick_ms, "unavailable");
+          }
+          st.rain_ticks = 0;
+          continue;
+        }
+        const std::string wind = std::to_string(sample.wind_mph);
+        recorder.Record(st.wind, tick_ms + delay(rng), wind, duplicate(rng));
+        recorder.Record(
+            st.vane,
+            tick_ms + delay(rng),
+            tsdb::kSectorNames[sample.sector],
+            duplicate(rng));
+        expected[s].push_back(
+            {tick_ms,
+             *fleet::ParsePayload(fleet::Sensor::kWindSpeed, wind),
+             sample.sector});
+        st.rain_ticks += sample.rain_ticks;
+        if ((i + 1) % kRainEveryTicks == 0) {
+          const double in_per_h = st.rain_ticks * kRainInchesPerTick *
+                                  3'600'000 / (kRainEveryTicks * kTickMs);
+          recorder.Record(
+              st.rain, tick_ms + delay(rng), std::to_string(in_per_h));
+          expected_rain += st.rain_ticks;
+          st.rain_ticks = 0;
+        }
+      }
+    }
+    // Goes offline at the end, so that the last readings' repeats count.
+    for (const Station& st : stations) {
+      for (int id : {st.wind, st.vane, st.rain}) {
+        recorder.Record(id, kStartMs + ticks * kTickMs, "unavailable");
+      }
+    }
+    if (!Exec(db, "COMMIT") ||
+        !Exec(
+            db,
+            "CREATE INDEX ix_states_metadata_id_last_updated_ts ON states "
+            "(metadata_id, last_updated_ts)")) {
+      return 1;
+    }
+    printf(
+        "%d stations, %d days: %" PRIu64
+        " recorder rows, %.1f MB, written in %.2f s\n",
+        num_stations,
+        days,
+        recorder.rows(),
+        std::filesystem::file_size(db_path) / 1e6,
+        std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - generate_start)
+            .count());
+    // Closes once the recorder has finalized its statement.
+    sqlite3_close_v2(db);
+  }
+
+  recorder::ImportOptions options;
+  options.memory_readings = memory_mb * (1 << 20) / 16;
+  options.threads = threads;
+  auto stats = recorder::ImportRecorder(db_path, dir / "tsdb", options);
+  if (!stats) {
+    fprintf(stderr, "%s\n", stats.error().c_str());
+    return 1;
+  }
+  const double total_s = stats->scan_s + stats->write_s;
+  printf(
+      "scan  %.2f s  %6.2f Mrows/s  (%" PRIu64 " station rows, %" PRIu64
+      " unavailable, %" PRIu64 " duplicates, %" PRIu64 " runs spilled)\n",
+      stats->scan_s,
+      stats->rows_scanned / stats->scan_s / 1e6,
+      stats->rows_read,
+      stats->rows_unavailable,
+      stats->duplicates,
+      stats->runs_spilled);
+  printf(
+      "write %.2f s  %6.2f Msamples/s  (%" PRIu64 " samples, %" PRIu64
+      " segments, %zu threads)\n",
+      stats->write_s,
+      stats->samples / stats->write_s / 1e6,
+      stats->samples,
+      stats->segments,
+      threads);
+  printf(
+      "total %.2f s  %6.2f Mrows/s\n",
+      total_s,
+      stats->rows_scanned / total_s / 1e6);
+
+  bool ok = stats->stations == static_cast<uint64_t>(num_stations) &&
+            stats->rows_unparsed == 0;
+  uint64_t rain = 0;
+  uint64_t mismatched = 0;
+  for (int s = 0; s < num_stations; ++s) {
+    auto store =
+        tsdb::Store::Open(dir / "tsdb" / ("station" + std::to_string(s)));
+    if (!store) {
+      fprintf(stderr, "%s\n", store.error().c_str());
+      return 1;
+    }
+    const std::vector<Expected>& want = expected[s];
+    size_t n = 0;
+    auto columns = std::make_unique<tsdb::Columns>();
+    (*store)->ForEachBlock(
+        INT64_MIN,
+        INT64_MAX,
+        [&](const tsdb::BlockIndex&, std::span<const uint8_t> block) {
+          if (!tsdb::DecodeBlock(block, *columns)) {
+            ok = false;
+            return;
+          }
+          for (size_t i = 0; i < columns->count; ++i, ++n) {
+            rain += columns->rain_ticks[i];
+            if (n >= want.size()) {
+              ++mismatched;
+              continue;
+            }
+            const int64_t late_ms = columns->timestamp_ms[i] - want[n].tick_ms;
+            if (late_ms <= 0 || late_ms > kMaxDelayMs ||
+                columns->wind_mph[i] != want[n].wind_mph ||
+                columns->sector[i] != want[n].sector) {
+              ++mismatched;
+            }
+          }
+        });
+    if (n != want.size()) {
+      printf("station%d: %zu samples, want %zu\n", s, n, want.size());
+      ok = false;
+    }
+  }
+  if (mismatched > 0) printf("%" PRIu64 " samples differ\n", mismatched);
+  if (rain != expected_rain) {
+    printf("rain %" PRIu64 " ticks, want %" PRIu64 "\n", rain, expected_rain);
+  }
+  ok = ok && mismatched == 0 && rain == expected_rain;
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,286 @@
+#include "rollup/rollup.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace rollup {
+namespace {
+
+constexpr int64_t kMinuteMs = kLevelMs[0];
+
+int64_t Floor(int64_t t_ms, int64_t size_ms) {
+  return t_ms - ((t_ms % size_ms) + size_ms) % size_ms;
+}
+
+struct SectorTrig {
+  std::array<double, 16> sin;
+  std::array<double, 16> cos;
+};
+
+const SectorTrig& Trig() {
+  static const SectorTrig trig = [] {
+    SectorTrig t;
+    for (int i = 0; i < 16; ++i) {
+      const double radians = i * 2 * std::numbers::pi / 16;
+      t.sin[i] = std::sin(radians);
+      t.cos[i] = std::cos(radians);
+    }
+    return t;
+  }();
+  return trig;
+}
+
+}  // namespace
+
+const char* LevelName(Level level) {
+  switch (level) {
+    case Level::kMinute:
+      return "1m";
+    case Level::kHour:
+      return "1h";
+    case Level::kDay:
+      return "1d";
+  }
+  return "?";
+}
+
+bool Rollup::empty() const {
+  return wind_count == 0 && rain_count == 0 &&
+         std::ranges::all_of(sector_counts, [](uint32_t n) { return n == 0; });
+}
+
+std::optional<double> Rollup::direction_mean_degrees() const {
+  const SectorTrig& trig = Trig();
+  double s = 0;
+  double c = 0;
+  for (int i = 0; i < 16; ++i) {
+    s += sector_counts[i] * trig.sin[i];
+    c += sector_counts[i] * trig.cos[i];
+  }
+  if (std::hypot(s, c) < 1e-9) return std::nullopt;
+  double degrees = std::atan2(s, c) * 180 / std::numbers::pi;
+  if (degrees < 0) degrees += 360;
+  return degrees;
+}
+
+void Rollup::Merge(const Rollup& other) {
+  wind_count += other.wind_count;
+  wind_sum += other.wind_sum;
+  gust_mph = std::max(gust_mph, other.gust_mph);
+  for (int i = 0; i < 16; ++i) sector_counts[i] += other.sector_counts[i];
+  rain_count += other.rain_count;
+  rain_in += other.rain_in;
+}
+
+RollupStore::RollupStore(RollupOptions options) : options_(options) {}
+
+bool RollupStore::OnMessage(
+    int64_t t_ms, std::string_view topic, std::string_view payload) {
+  const auto state = fleet::ParseStateTopic(topic);
+  if (!state) return false;
+  const auto value = fleet::ParsePayload(state->sensor, payload);
+  if (!value || !std::isfinite(*value)) return false;
+  OnReading(t_ms, state->station, state->sensor, *value);
+  return true;
+}
+
+void RollupStore::OnReading(
+    int64_t t_ms, std::string_view station, fleet::Sensor sensor,
+    float value) {
+  ++stats_.readings;
+  Station& s = StationFor(station);
+
+  const int64_t minute = Floor(t_ms, kMinuteMs);
+  const bool late =
+      s.latest_ms != INT64_MIN && minute < Floor(s.latest_ms, kMinuteMs);
+  if (late && minute < s.latest_ms - options_.late_window_ms) {
+    ++stats_.too_late;
+    return;
+  }
+
+  std::vector<Reading>* held = s.open_readings;
+  if (!held || s.open_minute != minute) {
+    held = &s.readings[minute];
+    if (!late) {
+      s.open_readings = held;
+      s.open_minute = minute;
+    }
+  }
+  for (Reading& r : *held) {
+    if (r.t_ms == t_ms && r.sensor == sensor) {
+      ++stats_.duplicates;
+      if (r.value == value) return;
+      ++stats_.corrections;
+      r.value = value;
+      s.dirty_minutes.insert(minute);
+      return;
+    }
+  }
+  const Reading reading{t_ms, sensor, value};
+  held->push_back(reading);
+  if (late) {
+    ++stats_.late;
+    s.dirty_minutes.insert(minute);
+    return;
+  }
+  s.latest_ms = std::max(s.latest_ms, t_ms);
+  for (int l = 0; l < kLevels; ++l) {
+    const int64_t start = Floor(t_ms, kLevelMs[l]);
+    Rollup*& open = s.open[l];
+    if (!open || open->start_ms != start) {
+      open = &s.levels[l][start];
+      open->start_ms = start;
+      s.changed[l].insert(start);
+    }
+    Add(reading, *open);
+  }
+}
+
+void RollupStore::Import(std::string_view station, const Rollup& minute) {
+  ++stats_.imported;
+  Station& s = StationFor(station);
+  const int64_t start = Floor(minute.start_ms, kMinuteMs);
+  Rollup& imported = s.imported[start];
+  imported.start_ms = start;
+  imported.Merge(minute);
+  for (int l = 0; l < kLevels; ++l) {
+    const int64_t level_start = Floor(start, kLevelMs[l]);
+    Rollup& rollup = s.levels[l][level_start];
+    rollup.start_ms = level_start;
+    rollup.Merge(minute);
+    s.changed[l].insert(level_start);
+  }
+}
+
+RollupStore::Station& RollupStore::StationFor(std::string_view station) {
+  auto it = stations_.find(station);
+  if (it == stations_.end()) {
+    it = stations_.emplace(std::string(station), Station()).first;
+  }
+  return it->second;
+}
+
+void RollupStore::Add(const Reading& reading, Rollup& rollup) const {
+  switch (reading.sensor) {
+    case fleet::Sensor::kWindSpeed:
+      ++rollup.wind_count;
+      rollup.wind_sum += reading.value;
+      rollup.gust_mph = std::max(rollup.gust_mph, reading.value);
+      break;
+    case fleet::Sensor::kWindDirection:
+      ++rollup.sector_counts[static_cast<int>(reading.value) & 15];
+      break;
+    case fleet::Sensor::kRain:
+      ++rollup.rain_count;
+      rollup.rain_in += reading.value * options_.rain_period_ms / 3'600'000.0;
+      break;
+  }
+}
+
+void RollupStore::Recompute(Station& s) {
+  // Each level from the one below, for just the buckets over dirty minutes.
+  std::set<int64_t> dirty = std::move(s.dirty_minutes);
+  s.dirty_minutes.clear();
+  for (int l = 0; l < kLevels; ++l) {
+    std::set<int64_t> parents;
+    for (int64_t start : dirty) {
+      Rollup rollup;
+      rollup.start_ms = start;
+      if (l == 0) {
+        if (auto it = s.imported.find(start); it != s.imported.end()) {
+          rollup = it->second;
+        }
+        for (const Reading& r : s.readings[start]) Add(r, rollup);
+      } else {
+        const auto& children = s.levels[l - 1];
+        for (auto it = children.lower_bound(start);
+             it != children.end() && it->first < start + kLevelMs[l]; ++it) {
+          rollup.Merge(it->second);
+        }
+      }
+      s.levels[l][start] = rollup;
+      s.changed[l].insert(start);
+      ++stats_.recomputed[l];
+      if (l + 1 < kLevels) parents.insert(Floor(start, kLevelMs[l + 1]));
+    }
+    dirty = std::move(parents);
+  }
+}
+
+void RollupStore::Refresh(const ChangedFn& changed) {
+  for (auto& [id, s] : stations_) {
+    if (!s.dirty_minutes.empty()) Recompute(s);
+    for (int l = 0; l < kLevels; ++l) {
+      if (changed) {
+        for (int64_t start : s.changed[l]) {
+          changed(id, static_cast<Level>(l), s.levels[l].at(start));
+        }
+      }
+      s.changed[l].clear();
+      s.open[l] = nullptr;
+    }
+    s.open_readings = nullptr;
+    if (s.latest_ms == INT64_MIN) continue;
+    const int64_t keep_from = s.latest_ms - options_.late_window_ms;
+    while (!s.readings.empty() &&
+           s.readings.begin()->first + kMinuteMs <= keep_from) {
+      s.readings.erase(s.readings.begin());
+    }
+    while (!s.imported.empty() &&
+           s.imported.begin()->first + kMinuteMs <= keep_from) {
+      s.imported.erase(s.imported.begin());
+    }
+  }
+}
+
+std::vector<Rollup> RollupStore::Rows(
+    std::string_view station, Level level, int64_t t_begin,
+    int64_t t_end) const {
+  std::vector<Rollup> rows;
+  const auto it = stations_.find(station);
+  if (it == stations_.end()) return rows;
+  const auto& buckets = it->second.levels[static_cast<int>(level)];
+  for (auto b = buckets.lower_bound(t_begin);
+       b != buckets.end() && b->first < t_end; ++b) {
+    rows.push_back(b->second);
+  }
+  return rows;
+}
+
+std::optional<std::vector<Rollup>> RollupStore::Query(
+    std::string_view station, int64_t t_begin, int64_t t_end,
+    int64_t bucket_ms, QueryStats* stats) const {
+  if (bucket_ms <= 0 || t_end < t_begin) return std::nullopt;
+  int level = kLevels - 1;
+  auto tiles = [&](int64_t size_ms) {
+    return bucket_ms % size_ms == 0 && Floor(t_begin, size_ms) == t_begin &&
+           Floor(t_end, size_ms) == t_end;
+  };
+  while (level >= 0 && !tiles(kLevelMs[level])) --level;
+  if (level < 0) return std::nullopt;
+
+  const int64_t n = (t_end - t_begin + bucket_ms - 1) / bucket_ms;
+  std::vector<Rollup> buckets(n);
+  for (int64_t i = 0; i < n; ++i) buckets[i].start_ms = t_begin + i * bucket_ms;
+  QueryStats local{.level = static_cast<Level>(level)};
+  if (const auto it = stations_.find(station); it != stations_.end()) {
+    const auto& rows = it->second.levels[level];
+    for (auto row = rows.lower_bound(t_begin);
+         row != rows.end() && row->first < t_end; ++row) {
+      buckets[(row->first - t_begin) / bucket_ms].Merge(row->second);
+      ++local.rows_read;
+    }
+  }
+  if (stats) *stats = local;
+  return buckets;
+}
+
+std::vector<std::string> RollupStore::stations() const {
+  std::vector<std::string> ids;
+  for (const auto& [id, s] : stations_) ids.push_back(id);
+  std::ranges::sort(ids);
+  return ids;
+}
+
+}  // namespace rollup
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "fleet/topics.h"
+
+namespace rollup {
+
+// Materialised bucket sizes, finest first. Buckets are aligned to the Unix
+// epoch, so days run midnight to midnight UTC.
+enum class Level : uint8_t { kMinute, kHour, kDay };
+inline constexpr int kLevels = 3;
+inline constexpr std::array<int64_t, kLevels> kLevelMs = {
+    60'000, 3'600'000, 86'400'000};
+const char* LevelName(Level level);
+
+// One bucket of one station's readings. Every field merges by sum or max, so
+// a bucket is the merge of the buckets it contains.
+struct Rollup {
+  int64_t start_ms = 0;
+  uint32_t wind_count = 0;
+  double wind_sum = 0;
+  float gust_mph = 0;  // The highest published speed.
+  std::array<uint32_t, 16> sector_counts = {};
+  uint32_t rain_count = 0;
+  double rain_in = 0;
+
+  bool empty() const;
+  double wind_mean() const { return wind_count ? wind_sum / wind_count : 0; }
+  // Circular mean of the vane sectors in degrees clockwise from north, or
+  // nullopt if the directions cancel out (or there are none).
+  std::optional<double> direction_mean_degrees() const;
+  void Merge(const Rollup& other);
+};
+
+struct RollupOptions {
+  // The station publishes rain as a rate over this period, ending at the
+  // message, so each rain reading adds rate * period to the total.
+  int64_t rain_period_ms = 10 * 60'000;
+  // Readings are kept this far behind a station's latest, so that late ones
+  // can be merged exactly. Later ones than that are dropped.
+  int64_t late_window_ms = 48 * 3'600'000;
+};
+
+struct RollupStats {
+  uint64_t readings = 0;
+  // Readings for a minute before the station's latest: they invalidate their
+  // buckets rather than being merged into them.
+  uint64_t late = 0;
+  uint64_t too_late = 0;
+  // Redeliveries of a reading already held; those with a new value replace
+  // the old one, which invalidates its buckets too.
+  uint64_t duplicates = 0;
+  uint64_t corrections = 0;
+  uint64_t imported = 0;
+  std::array<uint64_t, kLevels> recomputed = {};
+};
+
+struct QueryStats {
+  Level level = Level::kMinute;
+  uint64_t rows_read = 0;
+};
+
+// Maintains minute, hour and day rollups of every station's state topics.
+// A reading for the station's current minute or later is merged into its
+// three buckets as it arrives. A late one marks its minute dirty instead,
+// and Refresh() recomputes each dirty minute from the readings held for it,
+// then only the hours and days containing those minutes from their children.
+class RollupStore {
+ public:
+  explicit RollupStore(RollupOptions options = {});
+
+  // Returns false if the message isn't a parseable station state message.
+  bool OnMessage(
+      int64_t t_ms, std::string_view topic, std::string_view payload);
+  void OnReading(
+      int64_t t_ms, std::string_view station, fleet::Sensor sensor,
+      float value);
+
+  // Merges a minute bucket built elsewhere, such as another collector's
+  // share of the station, into the station's buckets. Late readings for the
+  // minute are merged with it when it is recomputed.
+  void Import(std::string_view station, const Rollup& minute);
+
+  // Recomputes the buckets late readings invalidated, calls `changed` (if
+  // set) with every bucket that changed since the last refresh, and drops
+  // readings that have fallen out of the late window. Queries don't see
+  // late readings until it has run.
+  using ChangedFn =
+      std::function<void(std::string_view station, Level, const Rollup&)>;
+  void Refresh(const ChangedFn& changed = {});
+
+  // The stored buckets of `level` starting in [t_begin, t_end).
+  std::vector<Rollup> Rows(
+      std::string_view station, Level level, int64_t t_begin,
+      int64_t t_end) const;
+
+  // One bucket per bucket_ms step in [t_begin, t_end), including empty ones,
+  // merged from the coarsest level whose buckets tile them. Returns nullopt
+  // if the range and bucket size aren't whole minutes.
+  std::optional<std::vector<Rollup>> Query(
+      std::string_view station, int64_t t_begin, int64_t t_end,
+      int64_t bucket_ms, QueryStats* stats = nullptr) const;
+
+  std::vector<std::string> stations() const;
+  const RollupStats& stats() const { return stats_; }
+
+ private:
+  struct Reading {
+    int64_t t_ms;
+    fleet::Sensor sensor;
+    float value;
+  };
+  struct Station {
+    int64_t latest_ms = INT64_MIN;
+    // Readings by minute, back to the late window.
+    std::map<int64_t, std::vector<Reading>> readings;
+    std::array<std::map<int64_t, Rollup>, kLevels> levels;
+    // Imported minutes, back to the late window.
+    std::map<int64_t, Rollup> imported;
+    std::set<int64_t> dirty_minutes;
+    std::array<std::set<int64_t>, kLevels> changed;
+    // The latest minute's readings and the latest bucket of each level, so
+    // that in-order readings skip the lookups. Cleared by Refresh().
+    std::vector<Reading>* open_readings = nullptr;
+    int64_t open_minute = 0;
+    std::array<Rollup*, kLevels> open = {};
+  };
+  struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const {
+      return std::hash<std::string_view>()(s);
+    }
+  };
+
+  Station& StationFor(std::string_view station);
+  void Add(const Reading& reading, Rollup& rollup) const;
+  void Recompute(Station& s);
+
+  const RollupOptions options_;
+  std::unordered_map<std::string, Station, StringHash, std::equal_to<>>
+      stations_;
+  RollupStats stats_;
+};
+
+}  // namespace rollup
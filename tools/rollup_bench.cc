@@ -0,0 +1,352 @@
+// Feeds a synthetic year of one station's state messages through RollupStore
+// out of order, the way a broker and a flaky link deliver them, and checks
+// its rollups against a store fed in order and against scans of the raw
+// readings. Reports ingest throughput, how much late data was recomputed,
+// and what long-range queries cost from the rollups against the raw scan.
+//
+//   rollup_bench [--days=365] [--seed=1] [--late=0.02] [--max-delay-h=6]
+//                [--duplicates=0.001] [--corrections=0.0002]
+//
+// A `late` fraction of messages arrives up to max-delay-h after it was sent,
+// a few are redelivered, some of those with a corrected value, and once a
+// month the station is offline for three hours and then sends everything it
+// held at once. Exits non-zero on any mismatch.
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "rollup/rollup.h"
+#include "tsdb/synthetic.h"
+
+namespace {
+
+// Midnight UTC, so that days line up with the station's.
+constexpr int64_t kStartMs = 1'700'006'400'000;
+constexpr int64_t kTickMs = 5000;
+constexpr int kRainEveryTicks = 120;  // Ten minutes.
+constexpr float kRainInchesPerTick = 0.011;
+constexpr int64_t kOutageMs = 3 * 3'600'000;
+constexpr int64_t kOutageEveryMs = 30 * 86'400'000LL;
+constexpr std::string_view kStation = "bench";
+
+// The station's readings as columns, one per five-second tick, with the
+// rain rate it published at the end of every ten minutes.
+struct Raw {
+  std::vector<float> wind_mph;
+  std::vector<uint8_t> sector;
+  std::vector<float> rain_in_per_hour;  // One per kRainEveryTicks.
+};
+
+Raw Generate(uint32_t seed, size_t ticks) {
+  Raw raw;
+  raw.wind_mph.reserve(ticks);
+  raw.sector.reserve(ticks);
+  tsdb::SyntheticStation station(seed, kStartMs);
+  uint32_t rain_ticks = 0;
+  for (size_t i = 0; i < ticks; ++i) {
+    const tsdb::Sample s = station.Next();
+    raw.wind_mph.push_back(s.wind_mph);
+    raw.sector.push_back(s.sector);
+    rain_ticks += s.rain_ticks;
+    if ((i + 1) % kRainEveryTicks == 0) {
+      raw.rain_in_per_hour.push_back(
+          rain_ticks * kRainInchesPerTick * 3'600'000 /
+          (kRainEveryTicks * kTickMs));
+      rain_ticks = 0;
+    }
+  }
+  return raw;
+}
+
+int64_t TickMs(size_t i) { return kStartMs + i * kTickMs; }
+
+// Calls fn(t_ms, sensor, value) for every message, in the order sent.
+template <typename Fn>
+void ForEachMessage(const Raw& raw, Fn&& fn) {
+  for (size_t i = 0; i < raw.wind_mph.size(); ++i) {
+    fn(TickMs(i), fleet::Sensor::kWindSpeed, raw.wind_mph[i]);
+    fn(TickMs(i), fleet::Sensor::kWindDirection, raw.sector[i]);
+    if ((i + 1) % kRainEveryTicks == 0) {
+      fn(TickMs(i),
+         fleet::Sensor::kRain,
+         raw.rain_in_per_hour[i / kRainEveryTicks]);
+    }
+  }
+}
+
+// What the dashboards would do without rollups: every reading in range.
+std::vector<rollup::Rollup> ScanRaw(
+    const Raw& raw, const rollup::RollupOptions& options, int64_t t_begin,
+    int64_t t_end, int64_t bucket_ms, uint64_t* rows_read) {
+  std::vector<rollup::Rollup> buckets(
+      (t_end - t_begin + bucket_ms - 1) / bucket_ms);
+  for (size_t b = 0; b < buckets.size(); ++b) {
+    buckets[b].start_ms = t_begin + b * bucket_ms;
+  }
+  auto tick_at = [&](int64_t t_ms) {
+    return std::clamp<int64_t>(
+        (t_ms - kStartMs + kTickMs - 1) / kTickMs, 0, raw.wind_mph.size());
+  };
+  const size_t first = tick_at(t_begin);
+  const size_t last = tick_at(t_end);
+  uint64_t rows = 0;
+  for (size_t i = first; i < last; ++i) {
+    rollup::Rollup& b = buckets[(TickMs(i) - t_begin) / bucket_ms];
+    ++b.wind_count;
+    b.wind_sum += raw.wind_mph[i];
+    b.gust_mph = std::max(b.gust_mph, raw.wind_mph[i]);
+    ++b.sector_counts[raw.sector[i]];
+    rows += 2;
+    if ((i + 1) % kRainEveryTicks == 0) {
+      ++b.rain_count;
+      b.rain_in += raw.rain_in_per_hour[i / kRainEveryTicks] *
+                   options.rain_period_ms / 3'600'000.0;
+      ++rows;
+    }
+  }
+  *rows_read = rows;
+  return buckets;
+}
+
+bool Close(double a, double b) {
+  return std::abs(a - b) <= 1e-9 * std::max(1.0, std::abs(b));
+}
+
+bool Same(const rollup::Rollup& a, const rollup::Rollup& b) {
+  return a.start_ms == b.start_ms && a.wind_count == b.wind_count &&
+         Close(a.wind_sum, b.wind_sum) && a.gust_mph == b.gust_mph &&
+         a.sector_counts == b.sector_counts && a.rain_count == b.rain_count &&
+         Close(a.rain_in, b.rain_in);
+}
+
+// Best of five, in microseconds.
+double TimeUs(const std::function<void()>& fn) {
+  double best = INFINITY;
+  for (int i = 0; i < 5; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    best = std::min(
+        best,
+        std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+  }
+  return best;
+}
+
+struct Delivery {
+  int64_t arrival_ms;
+  int64_t t_ms;
+  fleet::Sensor sensor;
+  float value;
+  bool operator>(const Delivery& o) const { return arrival_ms > o.arrival_ms; }
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int days = 365;
+  uint32_t seed = 1;
+  double late = 0.02;
+  double max_delay_h = 6;
+  double duplicates = 0.001;
+  double corrections = 0.0002;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg.starts_with("--days=")) {
+      days = atoi(value("--days="));
+    } else if (arg.starts_with("--seed=")) {
+      seed = atoi(value("--seed="));
+    } else if (arg.starts_with("--late=")) {
+      late = atof(value("--late="));
+    } else if (arg.starts_with("--max-delay-h=")) {
+      max_delay_h = atof(value("--max-delay-h="));
+    } else if (arg.starts_with("--duplicates=")) {
+      duplicates = atof(value("--duplicates="));
+    } else if (arg.starts_with("--corrections=")) {
+      corrections = atof(value("--corrections="));
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--days=N] [--seed=N] [--late=P] [--max-delay-h=H] "
+          "[--duplicates=P] [--corrections=P]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  if (days < 1) days = 1;
+
+  const rollup::RollupOptions options;
+  const Raw raw = Generate(seed, days * 86'400'000LL / kTickMs);
+  const int64_t end_ms = TickMs(raw.wind_mph.size());
+
+  // In order, once.
+  rollup::RollupStore in_order(options);
+  const auto in_order_start = std::chrono::steady_clock::now();
+  ForEachMessage(raw, [&](int64_t t_ms, fleet::Sensor sensor, float value) {
+    in_order.OnReading(t_ms, kStation, sensor, value);
+  });
+  in_order.Refresh();
+  const double in_order_s =
+      std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - in_order_start)
+          .count();
+
+  // Out of order, with redeliveries and outages, refreshing every minute of
+  // arrival time as the service does.
+  rollup::RollupStore store(options);
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> unit(0, 1);
+  std::uniform_int_distribution<int64_t> delay(
+      kTickMs, max_delay_h * 3'600'000);
+  std::priority_queue<Delivery, std::vector<Delivery>, std::greater<>> pending;
+  int64_t next_refresh_ms = kStartMs + 60'000;
+  uint64_t refreshes = 0;
+  uint64_t changed = 0;
+  auto deliver_until = [&](int64_t now_ms) {
+    while (!pending.empty() && pending.top().arrival_ms <= now_ms) {
+      const Delivery& d = pending.top();
+      store.OnReading(d.t_ms, kStation, d.sensor, d.value);
+      pending.pop();
+    }
+    if (now_ms >= next_refresh_ms) {
+      store.Refresh(
+          [&](std::string_view, rollup::Level, const rollup::Rollup&) {
+            ++changed;
+          });
+      ++refreshes;
+      next_refresh_ms = now_ms + 60'000;
+    }
+  };
+  const auto start = std::chrono::steady_clock::now();
+  int64_t now_ms = kStartMs;
+  ForEachMessage(raw, [&](int64_t t_ms, fleet::Sensor sensor, float value) {
+    if (t_ms != now_ms) deliver_until(now_ms = t_ms);
+    int64_t arrival_ms = t_ms;
+    const int64_t since_outage = (t_ms - kStartMs) % kOutageEveryMs;
+    if (t_ms - since_outage > kStartMs && since_outage < kOutageMs) {
+      arrival_ms = t_ms - since_outage + kOutageMs;
+    } else if (unit(rng) < late) {
+      arrival_ms += delay(rng);
+    }
+    if (unit(rng) < corrections) {
+      // First a wrong value, then the right one.
+      const float wrong = sensor == fleet::Sensor::kWindDirection
+                              ? static_cast<int>(value + 1) & 15
+                              : value + 1;
+      pending.push({arrival_ms, t_ms, sensor, wrong});
+      arrival_ms += delay(rng);
+    } else if (unit(rng) < duplicates) {
+      pending.push({arrival_ms + delay(rng), t_ms, sensor, value});
+    }
+    if (arrival_ms == t_ms) {
+      store.OnReading(t_ms, kStation, sensor, value);
+    } else {
+      pending.push({arrival_ms, t_ms, sensor, value});
+    }
+  });
+  deliver_until(INT64_MAX);
+  const double ingest_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  bool ok = true;
+  auto expect = [&](bool condition, const char* what) {
+    if (!condition) {
+      fprintf(stderr, "%s\n", what);
+      ok = false;
+    }
+  };
+
+  const rollup::RollupStats& stats = store.stats();
+  printf(
+      "%d days, %" PRIu64 " readings delivered: %" PRIu64 " late, %" PRIu64
+      " too late, %" PRIu64 " duplicates (%" PRIu64 " corrections)\n",
+      days,
+      stats.readings,
+      stats.late,
+      stats.too_late,
+      stats.duplicates,
+      stats.corrections);
+  printf(
+      "ingest: %.2f M readings/s in order, %.2f M/s out of order with %" PRIu64
+      " refreshes reporting %" PRIu64 " changed buckets\n",
+      in_order.stats().readings / in_order_s / 1e6,
+      stats.readings / ingest_s / 1e6,
+      refreshes,
+      changed);
+  expect(stats.too_late == 0, "readings inside the late window were dropped");
+
+  for (int l = 0; l < rollup::kLevels; ++l) {
+    const auto level = static_cast<rollup::Level>(l);
+    const auto got = store.Rows(kStation, level, kStartMs, end_ms);
+    const auto want = in_order.Rows(kStation, level, kStartMs, end_ms);
+    printf(
+        "%s: %zu buckets, %" PRIu64 " recomputed for late readings\n",
+        rollup::LevelName(level),
+        got.size(),
+        stats.recomputed[l]);
+    expect(
+        std::ranges::equal(got, want, Same),
+        "out-of-order rollups differ from in-order ones");
+  }
+
+  struct Case {
+    const char* name;
+    int64_t bucket_ms;
+  };
+  for (const Case& c : {Case{"hourly", 3'600'000},
+                        Case{"daily", 86'400'000},
+                        Case{"weekly", 7 * 86'400'000LL}}) {
+    // Whole buckets of the coarsest level that tiles them.
+    rollup::QueryStats query_stats;
+    const int64_t day_end = kStartMs + days * 86'400'000LL;
+    const auto rolled =
+        store.Query(kStation, kStartMs, day_end, c.bucket_ms, &query_stats);
+    uint64_t raw_rows = 0;
+    const auto scanned =
+        ScanRaw(raw, options, kStartMs, day_end, c.bucket_ms, &raw_rows);
+    if (!rolled) {
+      expect(false, "query refused an aligned range");
+      continue;
+    }
+    const double rollup_us = TimeUs([&] {
+      store.Query(kStation, kStartMs, day_end, c.bucket_ms);
+    });
+    uint64_t rows;
+    const double raw_us = TimeUs([&] {
+      ScanRaw(raw, options, kStartMs, day_end, c.bucket_ms, &rows);
+    });
+    printf(
+        "%-6s over %d days: %zu buckets from %" PRIu64 " %s rows in %.0f us, "
+        "raw scan %" PRIu64 " rows in %.0f us (%.0fx)\n",
+        c.name,
+        days,
+        rolled->size(),
+        query_stats.rows_read,
+        rollup::LevelName(query_stats.level),
+        rollup_us,
+        raw_rows,
+        raw_us,
+        raw_us / rollup_us);
+    expect(
+        std::ranges::equal(*rolled, scanned, Same),
+        "rollup query differs from the raw scan");
+    expect(
+        query_stats.rows_read * 100 < raw_rows,
+        "rollup query read too many rows");
+  }
+  printf("%s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+// Maintains minute, hour and day rollups of station state topics and prints
+// every bucket that changes as a JSON line, for a dashboard's store to upsert
+// by (station, level, start_ms).
+//
+//   rollup_service [--levels=1h,1d] [--refresh-s=60] [--late-window-h=48]
+//                  [--rain-period-s=600]
+//                  (--mqtt=HOST[:PORT] [--topic=FILTER] [--user=U]
+//                   [--password=P] | --replay=FILE)
+//
+// Buckets are printed every refresh while they fill, and again whenever a
+// late reading lands in one. A replay file has one "T_MS TOPIC PAYLOAD" line
+// per message, and needn't be in time order.
+
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "mqtt/client.h"
+#include "rollup/rollup.h"
+
+namespace {
+
+int64_t NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+class Printer {
+ public:
+  explicit Printer(std::array<bool, rollup::kLevels> levels)
+      : levels_(levels) {}
+
+  void operator()(
+      std::string_view station, rollup::Level level,
+      const rollup::Rollup& r) const {
+    if (!levels_[static_cast<int>(level)]) return;
+    char direction[16] = "null";
+    if (auto degrees = r.direction_mean_degrees()) {
+      snprintf(direction, sizeof(direction), "%.1f", *degrees);
+    }
+    printf(
+        "{\"station\":\"%.*s\",\"level\":\"%s\",\"start_ms\":%" PRId64
+        ",\"wind_mean_mph\":%.2f,\"gust_mph\":%.2f,\"direction_deg\":%s,"
+        "\"rain_in\":%.3f,\"wind_readings\":%" PRIu32 "}\n",
+        static_cast<int>(station.size()),
+        station.data(),
+        rollup::LevelName(level),
+        r.start_ms,
+        r.wind_mean(),
+        r.gust_mph,
+        direction,
+        r.rain_in,
+        r.wind_count);
+  }
+
+ private:
+  const std::array<bool, rollup::kLevels> levels_;
+};
+
+bool ParseLevels(
+    std::string_view list, std::array<bool, rollup::kLevels>& levels) {
+  levels = {};
+  while (!list.empty()) {
+    const size_t comma = list.find(',');
+    const std::string_view name = list.substr(0, comma);
+    bool found = false;
+    for (int l = 0; l < rollup::kLevels; ++l) {
+      if (name == rollup::LevelName(static_cast<rollup::Level>(l))) {
+        levels[l] = found = true;
+      }
+    }
+    if (!found) return false;
+    list = comma == std::string_view::npos ? "" : list.substr(comma + 1);
+  }
+  return true;
+}
+
+int Replay(
+    const char* path, int64_t refresh_ms, rollup::RollupStore& store,
+    const Printer& print) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  int64_t next_refresh_ms = INT64_MIN;
+  char line[1024];
+  while (fgets(line, sizeof(line), f)) {
+    std::string_view rest(line);
+    while (!rest.empty() && (rest.back() == '\n' || rest.back() == '\r')) {
+      rest.remove_suffix(1);
+    }
+    const size_t a = rest.find(' ');
+    const size_t b = rest.find(' ', a + 1);
+    if (a == std::string_view::npos || b == std::string_view::npos) continue;
+    const int64_t t_ms = strtoll(line, nullptr, 10);
+    // Refreshes on the replay's clock, which late lines don't move back.
+    if (next_refresh_ms == INT64_MIN) next_refresh_ms = t_ms + refresh_ms;
+    if (t_ms >= next_refresh_ms) {
+      store.Refresh(print);
+      next_refresh_ms = t_ms + refresh_ms;
+    }
+    store.OnMessage(t_ms, rest.substr(a + 1, b - a - 1), rest.substr(b + 1));
+  }
+  fclose(f);
+  store.Refresh(print);
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* replay_path = nullptr;
+  std::array<bool, rollup::kLevels> levels = {false, true, true};
+  int64_t refresh_ms = 60'000;
+  rollup::RollupOptions options;
+  mqtt::ConnectInfo connect{.client_id = "rollup_service"};
+  std::string filter = "homeassistant/#";
+  bool use_mqtt = false;
+  bool bad = false;
+  for (int i = 1; i < argc && !bad; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg.starts_with("--levels=")) {
+      bad = !ParseLevels(value("--levels="), levels);
+    } else if (arg.starts_with("--refresh-s=")) {
+      refresh_ms = atof(value("--refresh-s=")) * 1000;
+    } else if (arg.starts_with("--late-window-h=")) {
+      options.late_window_ms = atof(value("--late-window-h=")) * 3'600'000;
+    } else if (arg.starts_with("--rain-period-s=")) {
+      options.rain_period_ms = atof(value("--rain-period-s=")) * 1000;
+    } else if (arg.starts_with("--replay=")) {
+      replay_path = value("--replay=");
+    } else if (arg.starts_with("--mqtt=")) {
+      use_mqtt = true;
+      const std::string_view host = value("--mqtt=");
+      const size_t colon = host.rfind(':');
+      connect.host = host.substr(0, colon);
+      if (colon != std::string_view::npos) {
+        connect.port = atoi(std::string(host.substr(colon + 1)).c_str());
+      }
+    } else if (arg.starts_with("--topic=")) {
+      filter = value("--topic=");
+    } else if (arg.starts_with("--user=")) {
+      connect.user = value("--user=");
+    } else if (arg.starts_with("--password=")) {
+      connect.password = value("--password=");
+    } else {
+      bad = true;
+    }
+  }
+  if (bad || use_mqtt == (replay_path != nullptr)) {
+    fprintf(
+        stderr,
+        "usage: %s [--levels=1m,1h,1d] [--refresh-s=S] [--late-window-h=H] "
+        "[--rain-period-s=S] (--mqtt=HOST[:PORT] [--topic=FILTER] [--user=U] "
+        "[--password=P] | --replay=FILE)\n",
+        argv[0]);
+    return 1;
+  }
+
+  rollup::RollupStore store(options);
+  const Printer print(levels);
+  if (replay_path) {
+    const int status = Replay(replay_path, refresh_ms, store, print);
+    const rollup::RollupStats& s = store.stats();
+    fprintf(
+        stderr,
+        "%" PRIu64 " readings, %" PRIu64 " late, %" PRIu64
+        " too late, %" PRIu64 " duplicates (%" PRIu64
+        " corrections); recomputed %" PRIu64 " minutes, %" PRIu64
+        " hours, %" PRIu64 " days\n",
+        s.readings,
+        s.late,
+        s.too_late,
+        s.duplicates,
+        s.corrections,
+        s.recomputed[0],
+        s.recomputed[1],
+        s.recomputed[2]);
+    return status;
+  }
+
+  auto client = mqtt::Client::Connect(connect);
+  if (!client) {
+    fprintf(stderr, "%s\n", client.error().c_str());
+    return 1;
+  }
+  if (auto ok = (*client)->Subscribe(filter); !ok) {
+    fprintf(stderr, "%s\n", ok.error().c_str());
+    return 1;
+  }
+  int64_t next_refresh_ms = NowMs() + refresh_ms;
+  while (true) {
+    auto message = (*client)->Poll(std::chrono::seconds(1));
+    if (!message) {
+      fprintf(stderr, "%s\n", message.error().c_str());
+      return 1;
+    }
+    if (*message) {
+      store.OnMessage(NowMs(), (*message)->topic, (*message)->payload);
+    }
+    if (NowMs() >= next_refresh_ms) {
+      store.Refresh(print);
+      fflush(stdout);
+      next_refresh_ms = NowMs() + refresh_ms;
+    }
+  }
+}
@@ -0,0 +1,46 @@
+#include "telemetry/decoder.h"
+
+#include "telemetry_frame.h"
+
+namespace telemetry {
+
+std::expected<void, std::string> DecodeFrame(
+    std::string_view payload, Frame& frame) {
+  const auto* p = reinterpret_cast<const uint8_t*>(payload.data());
+  const auto* end = p + payload.size();
+  if (payload.size() < kTelemetryHeaderBytes) {
+    return std::unexpected("frame shorter than its header");
+  }
+  if (p[0] != kTelemetryFrameVersion) {
+    return std::unexpected("unknown frame version " + std::to_string(p[0]));
+  }
+  const int count = p[1];
+  frame.sequence = p[2] | p[3] << 8;
+  uint32_t t_ms =
+      p[4] | p[5] << 8 | p[6] << 16 | static_cast<uint32_t>(p[7]) << 24;
+  p += kTelemetryHeaderBytes;
+
+  frame.samples.resize(count);
+  for (Sample& sample : frame.samples) {
+    uint32_t delta = 0;
+    for (int shift = 0;; shift += 7) {
+      if (p == end || shift > 28) {
+        return std::unexpected("truncated or bad varint");
+      }
+      delta |= static_cast<uint32_t>(*p & 0x7f) << shift;
+      if (!(*p++ & 0x80)) break;
+    }
+    if (end - p < 2) return std::unexpected("truncated sample");
+    const uint16_t packed = p[0] | p[1] << 8;
+    p += 2;
+    t_ms += delta;
+    sample = {
+        .t_ms = t_ms,
+        .mph = static_cast<float>(packed >> 4) / kTelemetrySpeedPerMph,
+        .compass_index = packed & 15};
+  }
+  if (p != end) return std::unexpected("trailing bytes after the last sample");
+  return {};
+}
+
+}  // namespace telemetry
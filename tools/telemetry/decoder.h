@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace telemetry {
+
+// Decodes the firmware's high-rate wind frames (see src/telemetry_frame.h
+// for the layout).
+
+struct Sample {
+  uint32_t t_ms;  // Since the station booted.
+  float mph;
+  int compass_index;  // 0 for N, clockwise in 22.5 degree steps.
+
+  float degrees() const { return compass_index * 22.5f; }
+};
+
+struct Frame {
+  uint16_t sequence = 0;
+  std::vector<Sample> samples;
+};
+
+// Replaces `frame`'s contents, reusing its storage, so a long capture
+// decodes without allocating per frame.
+std::expected<void, std::string> DecodeFrame(
+    std::string_view payload, Frame& frame);
+
+// Frames lost between two consecutive sequence numbers. A station that
+// rebooted restarts at 0 and its timestamps go backwards.
+inline int MissedFrames(uint16_t previous, uint16_t next) {
+  return static_cast<uint16_t>(next - previous - 1);
+}
+
+}  // namespace telemetry
@@ -0,0 +1,153 @@
+// Round-trips synthetic high-rate wind through the firmware's frame writer
+// (src/telemetry_frame.h) and the host decoder, and compares its size and
+// message rate with publishing each sample as text sensor states.
+//
+//   telemetry_bench [--hours=24] [--hz=1] [--frame-secs=5]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "telemetry/decoder.h"
+#include "telemetry_frame.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+constexpr std::string_view kSectorNames[16] = {
+    "N", "NNE", "NE", "ENE", "E", "ESE", "SE", "SSE",
+    "S", "SSW", "SW", "WSW", "W", "WNW", "NW", "NNW"};
+
+// MQTT PUBLISH at QoS 0: fixed header, topic length and topic.
+size_t PublishBytes(std::string_view topic, size_t payload) {
+  const size_t remaining = 2 + topic.size() + payload;
+  return 1 + (remaining < 128 ? 1 : remaining < 16384 ? 2 : 3) + remaining;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  double hours = 24;
+  int hz = 1;
+  int frame_secs = 5;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--hours=")) {
+      hours = atof(argv[i] + strlen("--hours="));
+    } else if (arg.starts_with("--hz=")) {
+      hz = atoi(argv[i] + strlen("--hz="));
+    } else if (arg.starts_with("--frame-secs=")) {
+      frame_secs = atoi(argv[i] + strlen("--frame-secs="));
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--hours=H] [--hz=N] [--frame-secs=N]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  const int per_frame = hz * frame_secs;
+  if (hz < 1 || hz > 1000 || per_frame < 1 ||
+      per_frame > TelemetryFrameWriter::kMaxSamples) {
+    fprintf(
+        stderr,
+        "need 1 <= hz * frame-secs <= %d\n",
+        TelemetryFrameWriter::kMaxSamples);
+    return 1;
+  }
+
+  // Gusty wind: a mean-reverting speed and a wandering direction.
+  std::mt19937 rng(1);
+  std::normal_distribution<float> gust(0, 0.6);
+  std::normal_distribution<float> veer(0, 0.3);
+  const size_t n = hours * 3600 * hz;
+  std::vector<telemetry::Sample> samples(n);
+  float mph = 8, direction = 4;
+  for (size_t i = 0; i < n; ++i) {
+    mph = std::max(0.0f, mph + 0.02f * (8 - mph) + gust(rng));
+    direction += veer(rng);
+    samples[i] = {
+        .t_ms = static_cast<uint32_t>(i * 1000 / hz),
+        .mph = mph,
+        .compass_index = static_cast<int>(std::lround(direction)) & 15};
+  }
+
+  auto start = Clock::now();
+  TelemetryFrameWriter writer;
+  std::vector<std::string> frames;
+  for (const telemetry::Sample& s : samples) {
+    writer.Add(s.t_ms, s.mph, s.compass_index);
+    if (writer.samples() == per_frame) {
+      frames.emplace_back(writer.frame());
+      writer.Clear();
+    }
+  }
+  if (writer.samples() > 0) frames.emplace_back(writer.frame());
+  const double encode_secs = SecondsSince(start);
+
+  start = Clock::now();
+  telemetry::Frame frame;
+  size_t decoded = 0, mismatches = 0;
+  for (size_t f = 0; f < frames.size(); ++f) {
+    if (auto ok = telemetry::DecodeFrame(frames[f], frame); !ok) {
+      fprintf(stderr, "frame %zu: %s\n", f, ok.error().c_str());
+      return 1;
+    }
+    for (const telemetry::Sample& s : frame.samples) {
+      const telemetry::Sample& want = samples[decoded++];
+      mismatches += s.t_ms != want.t_ms ||
+                    s.compass_index != want.compass_index ||
+                    std::abs(s.mph - want.mph) > 0.51f / kTelemetrySpeedPerMph;
+    }
+  }
+  const double decode_secs = SecondsSince(start);
+
+  constexpr std::string_view kFrameTopic = "weatherstation/telemetry/wind";
+  constexpr std::string_view kSpeedTopic =
+      "homeassistant/sensor/weatherstation_anemometer/state";
+  constexpr std::string_view kDirectionTopic =
+      "homeassistant/sensor/weatherstation_wind_dir/state";
+  size_t payload_bytes = 0, binary_wire = 0, text_wire = 0;
+  for (const std::string& f : frames) {
+    payload_bytes += f.size();
+    binary_wire += PublishBytes(kFrameTopic, f.size());
+  }
+  for (const telemetry::Sample& s : samples) {
+    char speed[32];
+    const int speed_len = snprintf(speed, sizeof(speed), "%f", s.mph);
+    text_wire += PublishBytes(kSpeedTopic, speed_len);
+    text_wire +=
+        PublishBytes(kDirectionTopic, kSectorNames[s.compass_index].size());
+  }
+
+  const double total_bytes = payload_bytes;
+  printf("%zu samples at %d Hz in %zu frames\n", n, hz, frames.size());
+  printf(
+      "binary %6.2f B/sample payload, %6.2f B/sample on the wire, %.2f msg/s\n",
+      total_bytes / n,
+      static_cast<double>(binary_wire) / n,
+      1.0 / frame_secs);
+  printf(
+      "text          %6.2f B/sample on the wire, %.2f msg/s\n",
+      static_cast<double>(text_wire) / n,
+      2.0 * hz);
+  printf(
+      "encode %8.1f Msamples/s, decode %8.1f Msamples/s (%.0f MB/s)\n",
+      n / encode_secs / 1e6,
+      n / decode_secs / 1e6,
+      total_bytes / decode_secs / 1e6);
+  printf(
+      "%zu of %zu samples differ after the round trip\n", mismatches, decoded);
+  return mismatches == 0 && decoded == n ? 0 : 1;
+}
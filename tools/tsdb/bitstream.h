@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tsdb {
+
+// Appends bits MSB-first to a byte vector.
+class BitWriter {
+ public:
+  explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+  // Writes the low `bits` bits of `value`. `bits` may be 0..64.
+  void Write(uint64_t value, int bits) {
+    while (bits > 0) {
+      if (used_ == 0) out_.push_back(0);
+      const int space = 8 - used_;
+      const int take = bits < space ? bits : space;
+      const uint8_t chunk = (value >> (bits - take)) & ((1u << take) - 1);
+      out_.back() |= chunk << (space - take);
+      used_ = (used_ + take) & 7;
+      bits -= take;
+    }
+  }
+
+  void WriteBit(bool bit) { Write(bit ? 1 : 0, 1); }
+
+ private:
+  std::vector<uint8_t>& out_;
+  int used_ = 0;  // Bits already used in out_.back().
+};
+
+// Reads bits MSB-first. Reading past the end yields zeros.
+class BitReader {
+ public:
+  BitReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  uint64_t Read(int bits) {
+    uint64_t value = 0;
+    while (bits > 0) {
+      const size_t byte = pos_ >> 3;
+      const int avail = 8 - static_cast<int>(pos_ & 7);
+      const int take = bits < avail ? bits : avail;
+      const uint8_t b = byte < size_ ? data_[byte] : 0;
+      value = (value << take) | ((b >> (avail - take)) & ((1u << take) - 1));
+      pos_ += take;
+      bits -= take;
+    }
+    return value;
+  }
+
+  bool ReadBit() {
+    const size_t byte = pos_ >> 3;
+    const uint8_t b = byte < size_ ? data_[byte] : 0;
+    const bool bit = (b >> (7 - (pos_ & 7))) & 1;
+    ++pos_;
+    return bit;
+  }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_ = 0;
+};
+
+inline uint64_t ZigZag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t UnZigZag(uint64_t v) {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+inline void PutVarint(std::vector<uint8_t>& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<uint8_t>(v) | 0x80);
+    v >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+// Returns false if the varint runs past `end`.
+inline bool GetVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+  v = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    const uint8_t b = *p++;
+    v |= static_cast<uint64_t>(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) return true;
+  }
+  return false;
+}
+
+}  // namespace tsdb
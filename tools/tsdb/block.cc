@@ -0,0 +1,349 @@
+#include "tsdb/block.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+
+#include "tsdb/bitstream.h"
+
+namespace tsdb {
+namespace {
+
+// The column encoders take the row count and a function returning row i's
+// value, so that samples and rollup rows share them.
+
+template <typename Get>
+void EncodeTimestamps(size_t n, Get get, std::vector<uint8_t>& out) {
+  BitWriter w(out);
+  w.Write(static_cast<uint64_t>(get(0)), 64);
+  int64_t prev = get(0);
+  int64_t prev_delta = 0;
+  for (size_t i = 1; i < n; ++i) {
+    const int64_t delta = get(i) - prev;
+    const uint64_t dod = ZigZag(delta - prev_delta);
+    if (dod == 0) {
+      w.WriteBit(0);
+    } else if (dod < (1u << 7)) {
+      w.Write(0b10, 2);
+      w.Write(dod, 7);
+    } else if (dod < (1u << 9)) {
+      w.Write(0b110, 3);
+      w.Write(dod, 9);
+    } else if (dod < (1u << 12)) {
+      w.Write(0b1110, 4);
+      w.Write(dod, 12);
+    } else if (dod < (uint64_t{1} << 32)) {
+      w.Write(0b11110, 5);
+      w.Write(dod, 32);
+    } else {
+      w.Write(0b11111, 5);
+      w.Write(dod, 64);
+    }
+    prev = get(i);
+    prev_delta = delta;
+  }
+}
+
+template <typename Get>
+void EncodeFloats(size_t n, Get get, std::vector<uint8_t>& out) {
+  BitWriter w(out);
+  uint32_t prev = std::bit_cast<uint32_t>(get(0));
+  w.Write(prev, 32);
+  int prev_leading = -1;
+  int prev_trailing = 0;
+  for (size_t i = 1; i < n; ++i) {
+    const uint32_t bits = std::bit_cast<uint32_t>(get(i));
+    const uint32_t x = bits ^ prev;
+    prev = bits;
+    if (x == 0) {
+      w.WriteBit(0);
+      continue;
+    }
+    w.WriteBit(1);
+    const int leading = std::min(std::countl_zero(x), 31);
+    const int trailing = std::countr_zero(x);
+    if (prev_leading >= 0 && leading >= prev_leading &&
+        trailing >= prev_trailing) {
+      // The meaningful bits fit in the previous window; reuse it.
+      w.WriteBit(0);
+      w.Write(x >> prev_trailing, 32 - prev_leading - prev_trailing);
+    } else {
+      const int meaningful = 32 - leading - trailing;
+      w.WriteBit(1);
+      w.Write(leading, 5);
+      w.Write(meaningful - 1, 5);
+      w.Write(x >> trailing, meaningful);
+      prev_leading = leading;
+      prev_trailing = trailing;
+    }
+  }
+}
+
+template <typename Get>
+void EncodeSectors(size_t n, Get get, std::vector<uint8_t>& out) {
+  for (size_t i = 0; i < n; i += 2) {
+    uint8_t b = (get(i) & 0xf) << 4;
+    if (i + 1 < n) b |= get(i + 1) & 0xf;
+    out.push_back(b);
+  }
+}
+
+// (run length, zig-zag delta) varint pairs.
+template <typename Get>
+void EncodeRuns(size_t n, Get get, std::vector<uint8_t>& out) {
+  uint32_t prev = 0;
+  uint64_t run = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const uint32_t value = get(i);
+    if (value == prev) {
+      ++run;
+      continue;
+    }
+    PutVarint(out, run);
+    PutVarint(out, ZigZag(static_cast<int64_t>(value) - prev));
+    prev = value;
+    run = 0;
+  }
+  if (run > 0) PutVarint(out, run);
+}
+
+bool DecodeRuns(std::span<const uint8_t> data, uint32_t count, uint32_t* out) {
+  const uint8_t* p = data.data();
+  const uint8_t* end = p + data.size();
+  uint32_t prev = 0;
+  uint32_t i = 0;
+  while (i < count) {
+    uint64_t run;
+    if (!GetVarint(p, end, run) || run > count - i) return false;
+    std::fill_n(out + i, run, prev);
+    i += run;
+    if (i == count) break;
+    uint64_t zz;
+    if (!GetVarint(p, end, zz)) return false;
+    prev += UnZigZag(zz);
+    out[i++] = prev;
+  }
+  return true;
+}
+
+void DecodeFloats(std::span<const uint8_t> data, uint32_t count, float* out) {
+  BitReader r(data.data(), data.size());
+  uint32_t prev = r.Read(32);
+  int leading = 0;
+  int trailing = 0;
+  out[0] = std::bit_cast<float>(prev);
+  for (uint32_t i = 1; i < count; ++i) {
+    if (r.ReadBit()) {
+      if (r.ReadBit()) {
+        leading = r.Read(5);
+        const int meaningful = r.Read(5) + 1;
+        trailing = 32 - leading - meaningful;
+      }
+      prev ^= static_cast<uint32_t>(r.Read(32 - leading - trailing))
+              << trailing;
+    }
+    out[i] = std::bit_cast<float>(prev);
+  }
+}
+
+}  // namespace
+
+BlockIndex EncodeBlock(
+    std::span<const Sample> samples, std::vector<uint8_t>& out) {
+  BlockIndex index{};
+  index.offset = out.size();
+  index.count = samples.size();
+  index.t_min = samples.front().timestamp_ms;
+  index.t_max = samples.back().timestamp_ms;
+  index.wind_min = std::numeric_limits<float>::infinity();
+  index.wind_max = -std::numeric_limits<float>::infinity();
+  index.rain_min = std::numeric_limits<uint32_t>::max();
+  for (const Sample& s : samples) {
+    index.wind_min = std::min(index.wind_min, s.wind_mph);
+    index.wind_max = std::max(index.wind_max, s.wind_mph);
+    index.wind_sum += s.wind_mph;
+    index.rain_min = std::min<uint32_t>(index.rain_min, s.rain_ticks);
+    index.rain_max = std::max<uint32_t>(index.rain_max, s.rain_ticks);
+    index.rain_sum += s.rain_ticks;
+    ++index.sector_counts[s.sector & 0xf];
+  }
+
+  const size_t header_at = out.size();
+  out.resize(out.size() + sizeof(BlockHeader));
+  BlockHeader header{.count = static_cast<uint32_t>(samples.size())};
+  const size_t n = samples.size();
+
+  size_t start = out.size();
+  EncodeTimestamps(n, [&](size_t i) { return samples[i].timestamp_ms; }, out);
+  header.timestamp_bytes = out.size() - start;
+  start = out.size();
+  EncodeFloats(n, [&](size_t i) { return samples[i].wind_mph; }, out);
+  header.wind_bytes = out.size() - start;
+  start = out.size();
+  EncodeSectors(n, [&](size_t i) { return samples[i].sector; }, out);
+  header.sector_bytes = out.size() - start;
+  start = out.size();
+  EncodeRuns(n, [&](size_t i) { return uint32_t{samples[i].rain_ticks}; }, out);
+  header.rain_bytes = out.size() - start;
+
+  std::memcpy(out.data() + header_at, &header, sizeof(header));
+  index.length = out.size() - index.offset;
+  return index;
+}
+
+BlockIndex EncodeRollupBlock(
+    std::span<const RollupRow> rows, std::vector<uint8_t>& out) {
+  BlockIndex index{};
+  index.offset = out.size();
+  index.t_min = rows.front().timestamp_ms;
+  index.t_max = rows.back().timestamp_ms;
+  index.wind_min = std::numeric_limits<float>::infinity();
+  index.wind_max = -std::numeric_limits<float>::infinity();
+  index.rain_min = std::numeric_limits<uint32_t>::max();
+  for (const RollupRow& r : rows) {
+    index.count += r.samples;
+    index.wind_min = std::min(index.wind_min, r.wind_mph);
+    index.wind_max = std::max(index.wind_max, r.gust_mph);
+    index.wind_sum += static_cast<double>(r.wind_mph) * r.samples;
+    index.rain_min = std::min(index.rain_min, r.rain_ticks);
+    index.rain_max = std::max(index.rain_max, r.rain_ticks);
+    index.rain_sum += r.rain_ticks;
+    index.sector_counts[r.sector & 0xf] += r.samples;
+  }
+
+  const size_t header_at = out.size();
+  out.resize(out.size() + sizeof(BlockHeader) + sizeof(RollupHeader));
+  BlockHeader header{
+      .count = static_cast<uint32_t>(rows.size()) | kRollupBlock};
+  RollupHeader rollup{};
+  const size_t n = rows.size();
+
+  size_t start = out.size();
+  EncodeTimestamps(n, [&](size_t i) { return rows[i].timestamp_ms; }, out);
+  header.timestamp_bytes = out.size() - start;
+  start = out.size();
+  EncodeFloats(n, [&](size_t i) { return rows[i].wind_mph; }, out);
+  header.wind_bytes = out.size() - start;
+  start = out.size();
+  EncodeSectors(n, [&](size_t i) { return rows[i].sector; }, out);
+  header.sector_bytes = out.size() - start;
+  start = out.size();
+  EncodeRuns(n, [&](size_t i) { return rows[i].rain_ticks; }, out);
+  header.rain_bytes = out.size() - start;
+  start = out.size();
+  EncodeRuns(n, [&](size_t i) { return rows[i].samples; }, out);
+  rollup.samples_bytes = out.size() - start;
+  start = out.size();
+  EncodeFloats(n, [&](size_t i) { return rows[i].gust_mph; }, out);
+  rollup.gust_bytes = out.size() - start;
+
+  std::memcpy(out.data() + header_at, &header, sizeof(header));
+  std::memcpy(out.data() + header_at + sizeof(header), &rollup, sizeof(rollup));
+  index.length = out.size() - index.offset;
+  return index;
+}
+
+bool ParseBlock(std::span<const uint8_t> data, BlockView& view) {
+  BlockHeader header;
+  if (data.size() < sizeof(header)) return false;
+  std::memcpy(&header, data.data(), sizeof(header));
+  size_t at = sizeof(header);
+  RollupHeader rollup{};
+  view.rollup = header.count & kRollupBlock;
+  if (view.rollup) {
+    if (data.size() < at + sizeof(rollup)) return false;
+    std::memcpy(&rollup, data.data() + at, sizeof(rollup));
+    at += sizeof(rollup);
+    header.count &= ~kRollupBlock;
+  }
+  const uint64_t total = uint64_t{header.timestamp_bytes} + header.wind_bytes +
+                         header.sector_bytes + header.rain_bytes +
+                         rollup.samples_bytes + rollup.gust_bytes;
+  if (header.count == 0 || header.count > kBlockSamples ||
+      total > data.size() - at ||
+      header.sector_bytes != (header.count + 1) / 2) {
+    return false;
+  }
+  view.count = header.count;
+  view.timestamps = data.subspan(at, header.timestamp_bytes);
+  at += header.timestamp_bytes;
+  view.wind = data.subspan(at, header.wind_bytes);
+  at += header.wind_bytes;
+  view.sectors = data.subspan(at, header.sector_bytes);
+  at += header.sector_bytes;
+  view.rain = data.subspan(at, header.rain_bytes);
+  at += header.rain_bytes;
+  view.samples = data.subspan(at, rollup.samples_bytes);
+  at += rollup.samples_bytes;
+  view.gusts = data.subspan(at, rollup.gust_bytes);
+  return true;
+}
+
+void DecodeTimestamps(const BlockView& view, int64_t* out) {
+  BitReader r(view.timestamps.data(), view.timestamps.size());
+  int64_t prev = static_cast<int64_t>(r.Read(64));
+  int64_t delta = 0;
+  out[0] = prev;
+  for (uint32_t i = 1; i < view.count; ++i) {
+    int bits;
+    if (!r.ReadBit()) {
+      bits = 0;
+    } else if (!r.ReadBit()) {
+      bits = 7;
+    } else if (!r.ReadBit()) {
+      bits = 9;
+    } else if (!r.ReadBit()) {
+      bits = 12;
+    } else {
+      bits = r.ReadBit() ? 64 : 32;
+    }
+    if (bits > 0) delta += UnZigZag(r.Read(bits));
+    prev += delta;
+    out[i] = prev;
+  }
+}
+
+void DecodeWind(const BlockView& view, float* out) {
+  DecodeFloats(view.wind, view.count, out);
+}
+
+void DecodeSectors(const BlockView& view, uint8_t* out) {
+  for (uint32_t i = 0; i < view.count; ++i) {
+    const uint8_t b = view.sectors[i / 2];
+    out[i] = (i & 1) ? (b & 0xf) : (b >> 4);
+  }
+}
+
+bool DecodeRain(const BlockView& view, uint32_t* out) {
+  return DecodeRuns(view.rain, view.count, out);
+}
+
+void DecodeGusts(const BlockView& view, float* out) {
+  DecodeFloats(view.rollup ? view.gusts : view.wind, view.count, out);
+}
+
+bool DecodeSampleCounts(const BlockView& view, uint32_t* out) {
+  if (!view.rollup) {
+    std::fill_n(out, view.count, 1);
+    return true;
+  }
+  return DecodeRuns(view.samples, view.count, out);
+}
+
+bool DecodeBlock(std::span<const uint8_t> data, Columns& columns) {
+  BlockView view;
+  if (!ParseBlock(data, view)) return false;
+  columns.count = view.count;
+  columns.rollup = view.rollup;
+  DecodeTimestamps(view, columns.timestamp_ms.data());
+  DecodeWind(view, columns.wind_mph.data());
+  DecodeSectors(view, columns.sector.data());
+  if (view.rollup) {
+    DecodeGusts(view, columns.gust_mph.data());
+    if (!DecodeSampleCounts(view, columns.samples.data())) return false;
+  }
+  return DecodeRain(view, columns.rain_ticks.data());
+}
+
+}  // namespace tsdb
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace tsdb {
+
+// One row of station history: what track_wind_and_rain and
+// wind_direction_task publish every kWindReportPeriodSecs.
+struct Sample {
+  int64_t timestamp_ms;
+  float wind_mph;
+  uint8_t sector;  // 0 = N, 1 = NNE, ... 15 = NNW.
+  uint16_t rain_ticks;
+};
+static_assert(std::is_trivially_copyable_v<Sample>);
+
+// Downsampled history: one row per bucket of the segment's resolution,
+// standing for the samples that fell in it. The max gust and the rain total
+// are exact; the mean wind is rounded to a float, and the direction reduced
+// to the prevailing sector.
+struct RollupRow {
+  int64_t timestamp_ms;  // Start of the bucket.
+  uint32_t samples;
+  float wind_mph;  // Mean.
+  float gust_mph;  // Max.
+  uint8_t sector;
+  uint32_t rain_ticks;  // Total.
+};
+
+// The windvane's sixteen positions in compass order, as published.
+inline constexpr std::array<std::string_view, 16> kSectorNames = {
+    "N", "NNE", "NE", "ENE", "E", "ESE", "SE", "SSE",
+    "S", "SSW", "SW", "WSW", "W", "WNW", "NW", "NNW"};
+
+// Blocks hold a fixed number of samples (the last block of a segment may be
+// short). 1024 five-second samples is a little under an hour and a half.
+constexpr size_t kBlockSamples = 1024;
+
+// Per-block summary stored in each segment's index. Queries use this to skip
+// or answer blocks without decoding them. All files are host-endian. For a
+// rollup block, count is the samples its rows stand for, wind_min the least
+// row mean, and wind_max the max gust.
+struct BlockIndex {
+  int64_t t_min;
+  int64_t t_max;
+  uint64_t offset;  // Of the block within its segment.
+  uint32_t length;  // Encoded bytes.
+  uint32_t count;
+  float wind_min;
+  float wind_max;
+  double wind_sum;
+  uint32_t rain_min;
+  uint32_t rain_max;
+  uint64_t rain_sum;
+  uint16_t sector_counts[16];
+};
+static_assert(std::is_trivially_copyable_v<BlockIndex>);
+
+// Encoded block layout: BlockHeader, then the timestamp, wind, sector and rain
+// columns back to back so a reader can decode only the columns it needs.
+//   timestamps: first value raw, then delta-of-delta in a bucketed prefix code.
+//   wind:       Gorilla XOR float coding.
+//   sector:     4-bit nibbles, two per byte.
+//   rain:       (run length, zig-zag delta) varint pairs.
+struct BlockHeader {
+  uint32_t count;
+  uint32_t timestamp_bytes;
+  uint32_t wind_bytes;
+  uint32_t sector_bytes;
+  uint32_t rain_bytes;
+};
+
+// Set in BlockHeader::count of a rollup block, which has a RollupHeader after
+// the BlockHeader, and the rows' sample counts (coded like rain) and gusts
+// (coded like wind) after the other columns. Its rain column holds totals.
+inline constexpr uint32_t kRollupBlock = 1u << 31;
+
+struct RollupHeader {
+  uint32_t samples_bytes;
+  uint32_t gust_bytes;
+};
+
+// A rollup block may stand for at most this many samples, so that its
+// index's sector counts can't overflow.
+inline constexpr uint32_t kMaxRollupBlockSamples = UINT16_MAX;
+
+// Decoded columns of a single block.
+struct Columns {
+  size_t count = 0;
+  std::array<int64_t, kBlockSamples> timestamp_ms;
+  std::array<float, kBlockSamples> wind_mph;
+  std::array<uint8_t, kBlockSamples> sector;
+  std::array<uint32_t, kBlockSamples> rain_ticks;
+  // A rollup block's rows, with their mean wind in wind_mph and total rain in
+  // rain_ticks, and these filled in.
+  bool rollup = false;
+  std::array<uint32_t, kBlockSamples> samples;
+  std::array<float, kBlockSamples> gust_mph;
+};
+
+// Typed views of the column byte ranges inside an encoded block.
+struct BlockView {
+  uint32_t count = 0;
+  std::span<const uint8_t> timestamps;
+  std::span<const uint8_t> wind;
+  std::span<const uint8_t> sectors;
+  std::span<const uint8_t> rain;
+  bool rollup = false;
+  std::span<const uint8_t> samples;
+  std::span<const uint8_t> gusts;
+};
+
+// Appends the encoding of `samples` (at most kBlockSamples, in time order) to
+// `out` and returns its index entry with offset set to the old out.size().
+BlockIndex EncodeBlock(
+    std::span<const Sample> samples, std::vector<uint8_t>& out);
+// The same for rollup rows, at most kBlockSamples of them standing for at
+// most kMaxRollupBlockSamples samples.
+BlockIndex EncodeRollupBlock(
+    std::span<const RollupRow> rows, std::vector<uint8_t>& out);
+
+// Returns false if `data` is not a well-formed block.
+bool ParseBlock(std::span<const uint8_t> data, BlockView& view);
+
+void DecodeTimestamps(const BlockView& view, int64_t* out);
+void DecodeWind(const BlockView& view, float* out);
+void DecodeSectors(const BlockView& view, uint8_t* out);
+// Returns false on a corrupt rain column.
+bool DecodeRain(const BlockView& view, uint32_t* out);
+// Each row's max wind: a rollup's gust column, or a raw block's wind.
+void DecodeGusts(const BlockView& view, float* out);
+// Samples per row, all 1 in a raw block. Returns false on a corrupt column.
+bool DecodeSampleCounts(const BlockView& view, uint32_t* out);
+
+// Decodes every column. Returns false on a corrupt block.
+bool DecodeBlock(std::span<const uint8_t> data, Columns& columns);
+
+}  // namespace tsdb
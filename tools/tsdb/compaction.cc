@@ -0,0 +1,365 @@
+#include "tsdb/compaction.h"
+
+#include <time.h>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+namespace tsdb {
+namespace {
+
+// A run of small segments is merged once it is this long, even if short of
+// half the target size, so that a daily seal isn't rewritten daily.
+constexpr size_t kMinMergeRun = 4;
+// Segments downsampled in one job, by input bytes, as multiples of the target
+// size: the output is many times smaller.
+constexpr uint64_t kDownsampleInputTargets = 4;
+
+int64_t Floor(int64_t t_ms, int64_t size_ms) {
+  return t_ms - ((t_ms % size_ms) + size_ms) % size_ms;
+}
+
+int64_t ThreadCpuNs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return int64_t{ts.tv_sec} * 1'000'000'000 + ts.tv_nsec;
+}
+
+// Folds samples, or finer rows, in time order into rollup rows and encodes
+// them into blocks.
+class Downsampler {
+ public:
+  Downsampler(
+      uint32_t resolution_ms, std::vector<uint8_t>& data,
+      std::vector<BlockIndex>& index)
+      : resolution_ms_(resolution_ms), data_(data), index_(index) {}
+
+  void Add(
+      int64_t t_ms, uint32_t samples, float wind_mph, float gust_mph,
+      uint8_t sector, uint32_t rain_ticks) {
+    const int64_t start = Floor(t_ms, resolution_ms_);
+    if (start != bucket_.timestamp_ms) EndBucket(start);
+    bucket_.samples += samples;
+    wind_sum_ += static_cast<double>(wind_mph) * samples;
+    bucket_.gust_mph = std::max(bucket_.gust_mph, gust_mph);
+    sectors_[sector & 0xf] += samples;
+    rain_ += rain_ticks;
+  }
+
+  void Finish() {
+    EndBucket(INT64_MIN);
+    Flush();
+  }
+
+ private:
+  void EndBucket(int64_t next_start) {
+    if (bucket_.samples > 0) {
+      bucket_.wind_mph = wind_sum_ / bucket_.samples;
+      bucket_.sector =
+          std::max_element(sectors_.begin(), sectors_.end()) - sectors_.begin();
+      bucket_.rain_ticks =
+          std::min<uint64_t>(rain_, std::numeric_limits<uint32_t>::max());
+      if (rows_.size() == kBlockSamples ||
+          rows_samples_ + bucket_.samples > kMaxRollupBlockSamples) {
+        Flush();
+      }
+      rows_.push_back(bucket_);
+      rows_samples_ += bucket_.samples;
+    }
+    bucket_ = {
+        .timestamp_ms = next_start,
+        .gust_mph = -std::numeric_limits<float>::infinity(),
+    };
+    wind_sum_ = 0;
+    sectors_ = {};
+    rain_ = 0;
+  }
+
+  void Flush() {
+    if (rows_.empty()) return;
+    index_.push_back(EncodeRollupBlock(rows_, data_));
+    rows_.clear();
+    rows_samples_ = 0;
+  }
+
+  const int64_t resolution_ms_;
+  std::vector<uint8_t>& data_;
+  std::vector<BlockIndex>& index_;
+
+  RollupRow bucket_ = {.timestamp_ms = INT64_MIN};
+  double wind_sum_ = 0;
+  std::array<uint64_t, 16> sectors_ = {};
+  uint64_t rain_ = 0;
+
+  std::vector<RollupRow> rows_;
+  uint64_t rows_samples_ = 0;
+};
+
+}  // namespace
+
+Compactor::Compactor(std::vector<Store*> stores, CompactionOptions options)
+    : options_(std::move(options)), stores_(std::move(stores)) {}
+
+Compactor::~Compactor() { Stop(); }
+
+void Compactor::AddStore(Store* store) {
+  std::lock_guard lock(mutex_);
+  stores_.push_back(store);
+}
+
+void Compactor::Start() {
+  stop_ = false;
+  thread_ = std::thread([this] {
+    while (!stop_) {
+      std::optional<Job> job = NextJob();
+      if (job) {
+        auto ran = Run(*job);
+        if (ran || stop_) continue;
+        std::lock_guard lock(mutex_);
+        ++stats_.failures;
+        stats_.last_error = ran.error();
+      }
+      std::unique_lock lock(mutex_);
+      cv_.wait_for(lock, options_.idle_interval, [&] { return stop_.load(); });
+    }
+  });
+}
+
+void Compactor::Stop() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) thread_.join();
+}
+
+std::expected<void, std::string> Compactor::RunUntilIdle() {
+  while (std::optional<Job> job = NextJob()) {
+    if (auto ran = Run(*job); !ran) return ran;
+  }
+  return {};
+}
+
+bool Compactor::HasWork() const {
+  const int64_t now_ms = NowMs();
+  return std::ranges::any_of(stores(), [&](Store* store) {
+    return PlanJob(*store, now_ms).has_value();
+  });
+}
+
+CompactionStats Compactor::stats() const {
+  std::lock_guard lock(mutex_);
+  return stats_;
+}
+
+int64_t Compactor::NowMs() const {
+  if (options_.now_ms) return options_.now_ms();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+std::vector<Store*> Compactor::stores() const {
+  std::lock_guard lock(mutex_);
+  return stores_;
+}
+
+std::optional<Compactor::Job> Compactor::NextJob() {
+  const int64_t now_ms = NowMs();
+  const std::vector<Store*> stores = this->stores();
+  for (size_t i = 0; i < stores.size(); ++i) {
+    next_store_ %= stores.size();
+    Store& store = *stores[next_store_++];
+    if (auto job = PlanJob(store, now_ms)) return job;
+  }
+  return std::nullopt;
+}
+
+std::optional<Compactor::Job> Compactor::PlanJob(
+    Store& store, int64_t now_ms) const {
+  const std::shared_ptr<const SegmentList> segments = store.segments();
+  const SegmentList& s = *segments;
+  // The resolution each segment's age calls for.
+  std::vector<uint32_t> want(s.size());
+  for (size_t i = 0; i < s.size(); ++i) {
+    want[i] = s[i]->info().resolution_ms;
+    for (const CompactionTier& tier : options_.tiers) {
+      if (now_ms - s[i]->info().last_ms >= tier.age_ms) {
+        want[i] = std::max(want[i], tier.resolution_ms);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (want[i] == s[i]->info().resolution_ms) continue;
+    Job job{&store, {}, want[i]};
+    const uint64_t max_bytes =
+        kDownsampleInputTargets * options_.target_segment_bytes;
+    uint64_t bytes = 0;
+    for (size_t j = i; j < s.size() && want[j] == want[i] &&
+                       s[j]->info().resolution_ms < want[i] &&
+                       (job.inputs.empty() ||
+                        bytes + s[j]->file_bytes() <= max_bytes);
+         ++j) {
+      job.inputs.push_back(s[j]);
+      bytes += s[j]->file_bytes();
+    }
+    return job;
+  }
+
+  auto small = [&](size_t i) {
+    return want[i] == s[i]->info().resolution_ms &&
+           s[i]->file_bytes() < options_.target_segment_bytes / 2;
+  };
+  for (size_t i = 0; i < s.size();) {
+    Job job{&store, {}, s[i]->info().resolution_ms};
+    uint64_t bytes = 0;
+    size_t j = i;
+    for (; j < s.size() && small(j) &&
+           s[j]->info().resolution_ms == job.resolution_ms &&
+           bytes + s[j]->file_bytes() <= options_.target_segment_bytes;
+         ++j) {
+      job.inputs.push_back(s[j]);
+      bytes += s[j]->file_bytes();
+    }
+    if (job.inputs.size() >= 2 &&
+        (job.inputs.size() >= kMinMergeRun ||
+         bytes >= options_.target_segment_bytes / 2)) {
+      return job;
+    }
+    i = std::max(i + 1, j);
+  }
+  return std::nullopt;
+}
+
+void Compactor::Charge(uint64_t bytes) {
+  const double cpu_s = (ThreadCpuNs() - charged_cpu_ns_) / 1e9;
+  double need_s = 0;
+  if (options_.cpu_share > 0 && options_.cpu_share < 1) {
+    need_s = cpu_s / options_.cpu_share;
+  }
+  if (options_.io_bytes_per_s > 0) {
+    need_s = std::max(
+        need_s, static_cast<double>(bytes) / options_.io_bytes_per_s);
+  }
+  const auto now = std::chrono::steady_clock::now();
+  const double elapsed_s =
+      std::chrono::duration<double>(now - charged_at_).count();
+  std::unique_lock lock(mutex_);
+  if (need_s > elapsed_s) {
+    cv_.wait_for(
+        lock,
+        std::chrono::duration<double>(need_s - elapsed_s),
+        [&] { return stop_.load(); });
+    stats_.throttled_ms +=
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - now)
+            .count();
+  }
+  charged_at_ = std::chrono::steady_clock::now();
+  charged_cpu_ns_ = ThreadCpuNs();
+}
+
+std::expected<void, std::string> Compactor::Run(const Job& job) {
+  charged_at_ = std::chrono::steady_clock::now();
+  charged_cpu_ns_ = ThreadCpuNs();
+
+  SegmentInfo info{
+      .resolution_ms = job.resolution_ms,
+      .first_ms = std::numeric_limits<int64_t>::max(),
+      .last_ms = std::numeric_limits<int64_t>::min(),
+  };
+  for (const auto& input : job.inputs) {
+    info.generation = std::max(info.generation, input->info().generation + 1);
+    info.first_ms = std::min(info.first_ms, input->info().first_ms);
+    info.last_ms = std::max(info.last_ms, input->info().last_ms);
+  }
+
+  std::vector<uint8_t> data;
+  std::vector<BlockIndex> index;
+  Downsampler downsampler(
+      std::max<uint32_t>(job.resolution_ms, 1), data, index);
+  std::vector<Sample> pending;
+  uint64_t read = 0;
+  auto columns = std::make_unique<Columns>();
+  for (const auto& input : job.inputs) {
+    for (size_t i = 0; i < input->index().size(); ++i) {
+      if (stop_) return std::unexpected("stopped");
+      const BlockIndex& b = input->index()[i];
+      const std::span<const uint8_t> block = input->block(i);
+      if (job.resolution_ms == 0 && pending.empty() &&
+          b.count == kBlockSamples) {
+        // A full block of samples goes across as it is.
+        BlockIndex copied = b;
+        copied.offset = data.size();
+        data.insert(data.end(), block.begin(), block.end());
+        index.push_back(copied);
+        read += block.size();
+        Charge(block.size());
+        continue;
+      }
+      if (!DecodeBlock(block, *columns)) {
+        return std::unexpected(input->path().string() + ": corrupt block");
+      }
+      const Columns& c = *columns;
+      for (size_t k = 0; k < c.count; ++k) {
+        if (job.resolution_ms == 0) {
+          pending.push_back(Sample{
+              .timestamp_ms = c.timestamp_ms[k],
+              .wind_mph = c.wind_mph[k],
+              .sector = c.sector[k],
+              .rain_ticks = static_cast<uint16_t>(c.rain_ticks[k]),
+          });
+          if (pending.size() == kBlockSamples) {
+            index.push_back(EncodeBlock(pending, data));
+            pending.clear();
+          }
+        } else if (c.rollup) {
+          downsampler.Add(
+              c.timestamp_ms[k],
+              c.samples[k],
+              c.wind_mph[k],
+              c.gust_mph[k],
+              c.sector[k],
+              c.rain_ticks[k]);
+        } else {
+          downsampler.Add(
+              c.timestamp_ms[k],
+              1,
+              c.wind_mph[k],
+              c.wind_mph[k],
+              c.sector[k],
+              c.rain_ticks[k]);
+        }
+      }
+      read += block.size();
+      Charge(block.size());
+    }
+  }
+  if (!pending.empty()) index.push_back(EncodeBlock(pending, data));
+  if (job.resolution_ms != 0) downsampler.Finish();
+
+  if (auto replaced =
+          job.store->ReplaceSegments(job.inputs, data, index, info);
+      !replaced) {
+    return replaced;
+  }
+  const uint64_t written = data.size() + index.size() * sizeof(BlockIndex);
+  {
+    std::lock_guard lock(mutex_);
+    const bool downsampled =
+        std::ranges::any_of(job.inputs, [&](const auto& s) {
+          return s->info().resolution_ms != job.resolution_ms;
+        });
+    ++(downsampled ? stats_.downsamples : stats_.merges);
+    stats_.segments_replaced += job.inputs.size();
+    stats_.bytes_read += read;
+    stats_.bytes_written += written;
+  }
+  Charge(written);
+  return {};
+}
+
+}  // namespace tsdb
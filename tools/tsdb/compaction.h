@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tsdb/store.h"
+
+namespace tsdb {
+
+// History whose newest sample is older than age_ms is kept as rollup rows
+// resolution_ms long.
+struct CompactionTier {
+  int64_t age_ms;
+  uint32_t resolution_ms;
+};
+
+struct CompactionOptions {
+  // Runs of neighbouring segments of one resolution, each under half this
+  // size, are merged up to this size once there are four of them or they
+  // add up to half of it.
+  uint64_t target_segment_bytes = 8 << 20;
+  std::vector<CompactionTier> tiers = {
+      {int64_t{30} * 86'400'000, 60'000},
+      {int64_t{365} * 86'400'000, 3'600'000},
+  };
+  // Segment bytes read plus written per second (0 for no limit), and the
+  // share of a core the compacting thread may use.
+  uint64_t io_bytes_per_s = 16 << 20;
+  double cpu_share = 0.25;
+  // How long the background thread waits when it finds no work.
+  std::chrono::milliseconds idle_interval = std::chrono::seconds(60);
+  // Ages are measured from this clock; the system clock if empty.
+  std::function<int64_t()> now_ms;
+};
+
+struct CompactionStats {
+  uint64_t merges = 0;
+  uint64_t downsamples = 0;
+  uint64_t segments_replaced = 0;
+  uint64_t bytes_read = 0;
+  uint64_t bytes_written = 0;
+  // Time spent sleeping to stay within the budgets.
+  uint64_t throttled_ms = 0;
+  uint64_t failures = 0;
+  std::string last_error;
+};
+
+// Compacts stores' sealed segments, one job at a time: downsamples segments
+// that have aged into a coarser tier, then merges runs of small segments of
+// one resolution (a head sealed at every restart leaves many) into large
+// ones. Merging samples is lossless. Downsampling keeps each bucket's max
+// gust and rain total exactly (see RollupRow).
+//
+// Outputs replace their inputs atomically (Store::ReplaceSegments), and
+// readers carry on with the segments they started with.
+class Compactor {
+ public:
+  explicit Compactor(
+      std::vector<Store*> stores, CompactionOptions options = {});
+  ~Compactor();
+
+  Compactor(const Compactor&) = delete;
+  Compactor& operator=(const Compactor&) = delete;
+
+  // Adds a store to compact, from any thread. It must outlive the Compactor.
+  void AddStore(Store* store);
+
+  // Compacts on a background thread until Stop(), which returns once the job
+  // in hand is done or abandoned.
+  void Start();
+  void Stop();
+
+  // Runs jobs on the calling thread until none is left.
+  std::expected<void, std::string> RunUntilIdle();
+  // Whether the stores have segments left to compact.
+  bool HasWork() const;
+
+  CompactionStats stats() const;
+
+ private:
+  struct Job {
+    Store* store;
+    SegmentList inputs;
+    uint32_t resolution_ms;
+  };
+
+  std::vector<Store*> stores() const;
+  std::optional<Job> NextJob();
+  std::optional<Job> PlanJob(Store& store, int64_t now_ms) const;
+  std::expected<void, std::string> Run(const Job& job);
+  // Accounts for `bytes` of I/O and the CPU time used since the last call,
+  // then sleeps as long as the budgets need.
+  void Charge(uint64_t bytes);
+  int64_t NowMs() const;
+
+  const CompactionOptions options_;
+  size_t next_store_ = 0;
+
+  std::thread thread_;
+  std::atomic<bool> stop_{false};
+  mutable std::mutex mutex_;  // For cv_, stores_ and stats_.
+  std::condition_variable cv_;
+  std::vector<Store*> stores_;
+  CompactionStats stats_;
+
+  // Throttle state of the compacting thread.
+  std::chrono::steady_clock::time_point charged_at_;
+  int64_t charged_cpu_ns_ = 0;
+};
+
+}  // namespace tsdb
@@ -0,0 +1,165 @@
+#include "tsdb/segment.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace tsdb {
+namespace {
+
+std::string Errno(std::string_view what, const std::filesystem::path& path) {
+  return std::string(what) + " " + path.string() + ": " + std::strerror(errno);
+}
+
+bool WriteAll(int fd, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    const ssize_t n = write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+}  // namespace
+
+std::expected<void, std::string> WriteSegment(
+    const std::filesystem::path& path, std::span<const uint8_t> data,
+    std::span<const BlockIndex> index, const SegmentInfo& info) {
+  if (index.empty()) return std::unexpected("refusing to write empty segment");
+
+  std::filesystem::path tmp = path;
+  tmp += ".tmp";
+  const int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return std::unexpected(Errno("open", tmp));
+
+  SegmentHeader header{};
+  std::memcpy(header.magic, kSegmentMagic, sizeof(header.magic));
+  header.version = kSegmentVersion;
+  header.block_samples = kBlockSamples;
+
+  // Index offsets in the file are relative to the start of the file.
+  constexpr size_t kDataOffset = sizeof(header) + sizeof(info);
+  std::vector<BlockIndex> file_index(index.begin(), index.end());
+  for (BlockIndex& b : file_index) b.offset += kDataOffset;
+
+  // Pad so the index can be used in place from the mapping.
+  const size_t misalignment =
+      (kDataOffset + data.size()) % alignof(BlockIndex);
+  const size_t padding =
+      (alignof(BlockIndex) - misalignment) % alignof(BlockIndex);
+  const uint8_t zeros[alignof(BlockIndex)] = {};
+
+  SegmentFooter footer{};
+  footer.index_offset = kDataOffset + data.size() + padding;
+  footer.block_count = file_index.size();
+  std::memcpy(footer.magic, kSegmentMagic, sizeof(footer.magic));
+
+  const bool ok = WriteAll(fd, &header, sizeof(header)) &&
+                  WriteAll(fd, &info, sizeof(info)) &&
+                  WriteAll(fd, data.data(), data.size()) &&
+                  WriteAll(fd, zeros, padding) &&
+                  WriteAll(
+                      fd,
+                      file_index.data(),
+                      file_index.size() * sizeof(BlockIndex)) &&
+                  WriteAll(fd, &footer, sizeof(footer)) && fsync(fd) == 0;
+  if (!ok) {
+    std::string error = Errno("write", tmp);
+    close(fd);
+    unlink(tmp.c_str());
+    return std::unexpected(std::move(error));
+  }
+  close(fd);
+
+  if (rename(tmp.c_str(), path.c_str()) != 0) {
+    std::string error = Errno("rename", tmp);
+    unlink(tmp.c_str());
+    return std::unexpected(std::move(error));
+  }
+  // Make the rename itself durable.
+  const int dir = open(path.parent_path().c_str(), O_RDONLY | O_DIRECTORY);
+  if (dir >= 0) {
+    fsync(dir);
+    close(dir);
+  }
+  return {};
+}
+
+std::expected<std::unique_ptr<Segment>, std::string> Segment::Open(
+    const std::filesystem::path& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return std::unexpected(Errno("open", path));
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    std::string error = Errno("stat", path);
+    close(fd);
+    return std::unexpected(std::move(error));
+  }
+  const size_t size = st.st_size;
+  if (size < sizeof(SegmentHeader) + sizeof(SegmentFooter)) {
+    close(fd);
+    return std::unexpected(path.string() + ": truncated segment");
+  }
+  void* base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) return std::unexpected(Errno("mmap", path));
+
+  std::unique_ptr<Segment> segment(
+      new Segment(path, static_cast<const uint8_t*>(base), size));
+
+  SegmentHeader header;
+  SegmentFooter footer;
+  std::memcpy(&header, segment->base_, sizeof(header));
+  std::memcpy(&footer, segment->base_ + size - sizeof(footer), sizeof(footer));
+  if (std::memcmp(header.magic, kSegmentMagic, sizeof(kSegmentMagic)) != 0 ||
+      std::memcmp(footer.magic, kSegmentMagic, sizeof(kSegmentMagic)) != 0 ||
+      header.version < 2 || header.version > kSegmentVersion ||
+      header.block_samples != kBlockSamples) {
+    return std::unexpected(path.string() + ": bad segment header");
+  }
+  size_t data_offset = sizeof(header);
+  if (header.version >= 3) {
+    if (size < data_offset + sizeof(SegmentInfo) + sizeof(footer)) {
+      return std::unexpected(path.string() + ": truncated segment");
+    }
+    std::memcpy(
+        &segment->info_, segment->base_ + data_offset, sizeof(SegmentInfo));
+    data_offset += sizeof(SegmentInfo);
+  }
+  const uint64_t index_bytes = footer.block_count * sizeof(BlockIndex);
+  if (footer.block_count == 0 || footer.index_offset < data_offset ||
+      footer.index_offset + index_bytes != size - sizeof(footer) ||
+      footer.index_offset % alignof(BlockIndex) != 0) {
+    return std::unexpected(path.string() + ": bad segment footer");
+  }
+  segment->index_ = {
+      reinterpret_cast<const BlockIndex*>(segment->base_ + footer.index_offset),
+      footer.block_count};
+  for (const BlockIndex& b : segment->index_) {
+    if (b.offset + b.length > footer.index_offset) {
+      return std::unexpected(path.string() + ": block index out of range");
+    }
+  }
+  if (header.version < 3) {
+    // Sealed from a head, before compaction existed.
+    segment->info_.first_ms = segment->t_min();
+    segment->info_.last_ms = segment->t_max();
+  }
+  return segment;
+}
+
+Segment::Segment(std::filesystem::path path, const uint8_t* base, size_t size)
+    : path_(std::move(path)), base_(base), size_(size) {}
+
+Segment::~Segment() { munmap(const_cast<uint8_t*>(base_), size_); }
+
+}  // namespace tsdb
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "tsdb/block.h"
+
+namespace tsdb {
+
+// Segment file layout:
+//   SegmentHeader
+//   SegmentInfo (from version 3)
+//   encoded blocks
+//   BlockIndex[block_count]
+//   SegmentFooter
+inline constexpr char kSegmentMagic[8] = {
+    'W', 'X', 'T', 'S', 'D', 'B', '0', '1'};
+// Version 2 added BlockIndex::sector_counts, version 3 SegmentInfo and
+// rollup blocks. Version 2 segments are still read.
+inline constexpr uint32_t kSegmentVersion = 3;
+
+struct SegmentHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t block_samples;
+};
+
+struct SegmentInfo {
+  // 0 if the blocks hold samples, else the bucket of their rollup rows.
+  uint32_t resolution_ms = 0;
+  // 0 when sealed from the head, and one more than the highest of its inputs
+  // when written by compaction.
+  uint32_t generation = 0;
+  // The span of sample timestamps the segment accounts for: a compacted
+  // segment replaces every segment of a lower generation within it.
+  int64_t first_ms = 0;
+  int64_t last_ms = 0;
+};
+
+struct SegmentFooter {
+  uint64_t index_offset;
+  uint64_t block_count;
+  char magic[8];
+};
+
+// Writes blocks (encoded back to back in `data`, offsets relative to the start
+// of `data`) to `path` atomically: the file is written under a temporary name,
+// fsynced and renamed into place.
+std::expected<void, std::string> WriteSegment(
+    const std::filesystem::path& path, std::span<const uint8_t> data,
+    std::span<const BlockIndex> index, const SegmentInfo& info);
+
+// A sealed, immutable segment mapped read-only into memory.
+class Segment {
+ public:
+  static std::expected<std::unique_ptr<Segment>, std::string> Open(
+      const std::filesystem::path& path);
+  ~Segment();
+
+  Segment(const Segment&) = delete;
+  Segment& operator=(const Segment&) = delete;
+
+  const std::filesystem::path& path() const { return path_; }
+  std::span<const BlockIndex> index() const { return index_; }
+  const SegmentInfo& info() const { return info_; }
+  size_t file_bytes() const { return size_; }
+  int64_t t_min() const { return index_.front().t_min; }
+  int64_t t_max() const { return index_.back().t_max; }
+
+  std::span<const uint8_t> block(size_t i) const {
+    return {base_ + index_[i].offset, index_[i].length};
+  }
+
+ private:
+  Segment(std::filesystem::path path, const uint8_t* base, size_t size);
+
+  std::filesystem::path path_;
+  const uint8_t* base_;
+  size_t size_;
+  SegmentInfo info_;
+  std::span<const BlockIndex> index_;
+};
+
+}  // namespace tsdb
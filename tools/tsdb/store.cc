@@ -0,0 +1,312 @@
+#include "tsdb/store.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+
+namespace tsdb {
+namespace {
+
+constexpr char kHeadLogName[] = "head.log";
+constexpr char kSegmentExtension[] = ".wseg";
+
+std::string Errno(std::string_view what, const std::filesystem::path& path) {
+  return std::string(what) + " " + path.string() + ": " + std::strerror(errno);
+}
+
+// Segment names sort in time order. Compaction's outputs carry their
+// generation, so that one never takes the name of a segment it replaces.
+std::filesystem::path SegmentName(const SegmentInfo& info) {
+  char name[64];
+  if (info.generation == 0) {
+    snprintf(
+        name,
+        sizeof(name),
+        "seg-%020" PRId64 "%s",
+        info.first_ms,
+        kSegmentExtension);
+  } else {
+    snprintf(
+        name,
+        sizeof(name),
+        "seg-%020" PRId64 "-g%" PRIu32 "%s",
+        info.first_ms,
+        info.generation,
+        kSegmentExtension);
+  }
+  return name;
+}
+
+// Whether compaction wrote `by` to replace `s`, and then stopped before
+// unlinking it.
+bool Supersedes(const Segment& by, const Segment& s) {
+  return by.info().generation > s.info().generation &&
+         by.info().first_ms <= s.info().first_ms &&
+         s.info().last_ms <= by.info().last_ms;
+}
+
+}  // namespace
+
+Store::Store(std::filesystem::path dir, StoreOptions options)
+    : dir_(std::move(dir)),
+      options_(options),
+      segments_(std::make_shared<SegmentList>()) {}
+
+Store::~Store() {
+  if (head_log_) fclose(head_log_);
+}
+
+std::expected<std::unique_ptr<Store>, std::string> Store::Open(
+    const std::filesystem::path& dir, StoreOptions options) {
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) return std::unexpected(dir.string() + ": " + ec.message());
+
+  std::unique_ptr<Store> store(new Store(dir, options));
+
+  std::vector<std::filesystem::path> names;
+  for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+    if (entry.path().extension() == kSegmentExtension) {
+      names.push_back(entry.path());
+    }
+  }
+  std::sort(names.begin(), names.end());
+  SegmentList segments;
+  for (const auto& name : names) {
+    auto segment = Segment::Open(name);
+    if (!segment) return std::unexpected(segment.error());
+    segments.push_back(*std::move(segment));
+  }
+  // Finishes a compaction that stopped short of unlinking its inputs.
+  SegmentList live;
+  for (const auto& s : segments) {
+    const bool superseded = std::ranges::any_of(
+        segments, [&](const auto& by) { return Supersedes(*by, *s); });
+    if (superseded) {
+      std::filesystem::remove(s->path(), ec);
+    } else {
+      live.push_back(s);
+    }
+  }
+  segments = std::move(live);
+  std::ranges::sort(
+      segments, {}, [](const auto& s) { return s->info().first_ms; });
+  for (const auto& segment : segments) {
+    store->last_timestamp_ms_ =
+        std::max(store->last_timestamp_ms_, segment->info().last_ms);
+  }
+  store->segments_ = std::make_shared<const SegmentList>(std::move(segments));
+
+  if (auto replayed = store->ReplayHeadLog(); !replayed) {
+    return std::unexpected(replayed.error());
+  }
+  store->head_log_ = fopen((dir / kHeadLogName).c_str(), "ab");
+  if (!store->head_log_) {
+    return std::unexpected(Errno("open", dir / kHeadLogName));
+  }
+  if (store->head_index_.size() >= options.blocks_per_segment) {
+    if (auto sealed = store->Seal(); !sealed) {
+      return std::unexpected(sealed.error());
+    }
+  }
+  return store;
+}
+
+std::expected<void, std::string> Store::ReplayHeadLog() {
+  const std::filesystem::path path = dir_ / kHeadLogName;
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) return {};
+  // A crash between sealing and truncating the log leaves samples that are
+  // already in a segment; skip them.
+  const int64_t sealed_through = last_timestamp_ms_;
+  const bool sealed = !segments_->empty();
+  Sample sample;
+  while (fread(&sample, sizeof(sample), 1, f) == 1) {
+    if (sealed && sample.timestamp_ms <= sealed_through) continue;
+    last_timestamp_ms_ = sample.timestamp_ms;
+    pending_.push_back(sample);
+    if (pending_.size() == kBlockSamples) {
+      head_index_.push_back(EncodeBlock(pending_, head_data_));
+      pending_.clear();
+    }
+  }
+  fclose(f);
+  // Drop a torn trailing record so later appends stay aligned.
+  std::error_code ec;
+  const uint64_t size = std::filesystem::file_size(path, ec);
+  if (!ec && size % sizeof(Sample) != 0) {
+    std::filesystem::resize_file(path, size - size % sizeof(Sample), ec);
+  }
+  return {};
+}
+
+std::expected<void, std::string> Store::Append(const Sample& sample) {
+  if (sample.timestamp_ms < last_timestamp_ms_) {
+    return std::unexpected("sample out of order");
+  }
+  if (fwrite(&sample, sizeof(sample), 1, head_log_) != 1) {
+    return std::unexpected(Errno("write", dir_ / kHeadLogName));
+  }
+  last_timestamp_ms_ = sample.timestamp_ms;
+  pending_.push_back(sample);
+  if (pending_.size() < kBlockSamples) return {};
+  head_index_.push_back(EncodeBlock(pending_, head_data_));
+  pending_.clear();
+  if (head_index_.size() < options_.blocks_per_segment) return {};
+  return Seal();
+}
+
+std::expected<void, std::string> Store::Seal() {
+  if (!pending_.empty()) {
+    head_index_.push_back(EncodeBlock(pending_, head_data_));
+    pending_.clear();
+  }
+  if (head_index_.empty()) return {};
+
+  if (auto published = Publish(head_data_, head_index_); !published) {
+    return published;
+  }
+  head_data_.clear();
+  head_index_.clear();
+
+  if (head_log_) {
+    if (fflush(head_log_) != 0 || ftruncate(fileno(head_log_), 0) != 0) {
+      return std::unexpected(Errno("truncate", dir_ / kHeadLogName));
+    }
+  }
+  return {};
+}
+
+std::expected<void, std::string> Store::AppendSegment(
+    std::span<const uint8_t> data, std::span<const BlockIndex> index) {
+  if (!pending_.empty() || !head_index_.empty()) {
+    return std::unexpected("head not empty");
+  }
+  if (index.empty()) return {};
+  if (index.front().t_min < last_timestamp_ms_) {
+    return std::unexpected("segment out of order");
+  }
+  if (auto published = Publish(data, index); !published) return published;
+  last_timestamp_ms_ = index.back().t_max;
+  return {};
+}
+
+std::expected<void, std::string> Store::Publish(
+    std::span<const uint8_t> data, std::span<const BlockIndex> index) {
+  const SegmentInfo info{
+      .first_ms = index.front().t_min,
+      .last_ms = index.back().t_max,
+  };
+  const std::filesystem::path path = dir_ / SegmentName(info);
+  if (auto written = WriteSegment(path, data, index, info); !written) {
+    return written;
+  }
+  auto segment = Segment::Open(path);
+  if (!segment) return std::unexpected(segment.error());
+  std::lock_guard lock(segments_mutex_);
+  auto segments = std::make_shared<SegmentList>(*segments_);
+  segments->push_back(*std::move(segment));
+  segments_ = std::move(segments);
+  return {};
+}
+
+std::expected<void, std::string> Store::Flush() {
+  if (fflush(head_log_) != 0) {
+    return std::unexpected(Errno("flush", dir_ / kHeadLogName));
+  }
+  return {};
+}
+
+std::shared_ptr<const SegmentList> Store::segments() const {
+  std::lock_guard lock(segments_mutex_);
+  return segments_;
+}
+
+std::expected<void, std::string> Store::ReplaceSegments(
+    const SegmentList& inputs, std::span<const uint8_t> data,
+    std::span<const BlockIndex> index, const SegmentInfo& info) {
+  if (inputs.empty()) return std::unexpected("nothing to replace");
+  const std::filesystem::path path = dir_ / SegmentName(info);
+  if (auto written = WriteSegment(path, data, index, info); !written) {
+    return written;
+  }
+  auto segment = Segment::Open(path);
+  if (!segment) return std::unexpected(segment.error());
+  {
+    std::lock_guard lock(segments_mutex_);
+    const auto first = std::ranges::find(*segments_, inputs.front());
+    if (first == segments_->end() ||
+        segments_->end() - first < static_cast<ptrdiff_t>(inputs.size()) ||
+        !std::equal(inputs.begin(), inputs.end(), first)) {
+      std::filesystem::remove(path);
+      return std::unexpected("segments replaced meanwhile");
+    }
+    auto segments = std::make_shared<SegmentList>(segments_->begin(), first);
+    segments->push_back(*std::move(segment));
+    segments->insert(segments->end(), first + inputs.size(), segments_->end());
+    segments_ = std::move(segments);
+  }
+  // Readers that started before keep the files mapped.
+  for (const auto& input : inputs) {
+    if (unlink(input->path().c_str()) != 0) {
+      return std::unexpected(Errno("unlink", input->path()));
+    }
+  }
+  return {};
+}
+
+void Store::ForEachBlock(
+    int64_t t_begin, int64_t t_end, const BlockVisitor& visitor) const {
+  auto overlaps = [&](const BlockIndex& b) {
+    return b.t_max >= t_begin && b.t_min <= t_end;
+  };
+  const std::shared_ptr<const SegmentList> segments = this->segments();
+  for (const auto& segment : *segments) {
+    if (segment->t_max() < t_begin || segment->t_min() > t_end) continue;
+    const auto index = segment->index();
+    for (size_t i = 0; i < index.size(); ++i) {
+      if (overlaps(index[i])) visitor(index[i], segment->block(i));
+    }
+  }
+  ForEachHeadBlock(t_begin, t_end, visitor);
+}
+
+void Store::ForEachHeadBlock(
+    int64_t t_begin, int64_t t_end, const BlockVisitor& visitor) const {
+  auto overlaps = [&](const BlockIndex& b) {
+    return b.t_max >= t_begin && b.t_min <= t_end;
+  };
+  for (const BlockIndex& b : head_index_) {
+    if (overlaps(b)) visitor(b, {head_data_.data() + b.offset, b.length});
+  }
+  if (!pending_.empty()) {
+    std::vector<uint8_t> scratch;
+    const BlockIndex b = EncodeBlock(pending_, scratch);
+    if (overlaps(b)) visitor(b, scratch);
+  }
+}
+
+uint64_t Store::sample_count() const {
+  uint64_t count = pending_.size();
+  const std::shared_ptr<const SegmentList> segments = this->segments();
+  for (const auto& segment : *segments) {
+    for (const BlockIndex& b : segment->index()) count += b.count;
+  }
+  for (const BlockIndex& b : head_index_) count += b.count;
+  return count;
+}
+
+uint64_t Store::disk_bytes() const {
+  uint64_t bytes = 0;
+  const std::shared_ptr<const SegmentList> segments = this->segments();
+  for (const auto& segment : *segments) bytes += segment->file_bytes();
+  std::error_code ec;
+  const uint64_t log = std::filesystem::file_size(dir_ / kHeadLogName, ec);
+  if (!ec) bytes += log;
+  return bytes;
+}
+
+}  // namespace tsdb
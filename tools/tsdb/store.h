@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <expected>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "tsdb/block.h"
+#include "tsdb/segment.h"
+
+namespace tsdb {
+
+struct StoreOptions {
+  // The head is sealed into a segment once it holds this many full blocks.
+  size_t blocks_per_segment = 256;
+};
+
+// Called with each block's index entry and its encoded bytes.
+using BlockVisitor =
+    std::function<void(const BlockIndex&, std::span<const uint8_t>)>;
+
+// Sealed segments in time order.
+using SegmentList = std::vector<std::shared_ptr<const Segment>>;
+
+// A single station's history in one directory.
+//
+// Appends go to the head: samples accumulate until a block is full, which is
+// then encoded in memory. Every appended sample is also written to head.log so
+// an unsealed head survives a restart. When the head reaches
+// blocks_per_segment blocks it is written out as an immutable segment file and
+// memory-mapped read-only, and head.log is truncated.
+//
+// Appends and reads belong to one thread. Compaction (see tsdb/compaction.h)
+// may replace segments from another: readers keep the segments they started
+// with mapped until they finish, and a replaced file is unlinked, not
+// rewritten in place.
+class Store {
+ public:
+  static std::expected<std::unique_ptr<Store>, std::string> Open(
+      const std::filesystem::path& dir, StoreOptions options = {});
+  ~Store();
+
+  Store(const Store&) = delete;
+  Store& operator=(const Store&) = delete;
+
+  // Samples must arrive in non-decreasing timestamp order.
+  std::expected<void, std::string> Append(const Sample& sample);
+
+  // Writes the whole head, including a partial block, out as a segment.
+  std::expected<void, std::string> Seal();
+
+  // Writes blocks encoded elsewhere straight out as a segment, bypassing the
+  // head and its log, for bulk loads. The head must be empty, and the blocks
+  // in order and no earlier than anything already held.
+  std::expected<void, std::string> AppendSegment(
+      std::span<const uint8_t> data, std::span<const BlockIndex> index);
+
+  // Flushes head.log to the OS.
+  std::expected<void, std::string> Flush();
+
+  // Visits every block overlapping [t_begin, t_end] in time order. Pending
+  // samples that have not yet filled a block are encoded on the fly.
+  void ForEachBlock(
+      int64_t t_begin, int64_t t_end, const BlockVisitor& visitor) const;
+  // Just the blocks not yet sealed, which ForEachBlock() visits last. Their
+  // bytes are only valid until the next append.
+  void ForEachHeadBlock(
+      int64_t t_begin, int64_t t_end, const BlockVisitor& visitor) const;
+
+  // A snapshot, which stays valid as segments are sealed and replaced.
+  std::shared_ptr<const SegmentList> segments() const;
+
+  // Writes `data` and `index` out as a segment covering exactly the
+  // consecutive segments `inputs`, and puts it in their place. Fails if
+  // they have been replaced meanwhile.
+  std::expected<void, std::string> ReplaceSegments(
+      const SegmentList& inputs, std::span<const uint8_t> data,
+      std::span<const BlockIndex> index, const SegmentInfo& info);
+
+  const std::filesystem::path& dir() const { return dir_; }
+  uint64_t sample_count() const;
+  // Bytes on disk across segments and the head log.
+  uint64_t disk_bytes() const;
+
+ private:
+  Store(std::filesystem::path dir, StoreOptions options);
+
+  std::expected<void, std::string> ReplayHeadLog();
+  // Writes a segment and adds it after the others.
+  std::expected<void, std::string> Publish(
+      std::span<const uint8_t> data, std::span<const BlockIndex> index);
+
+  const std::filesystem::path dir_;
+  const StoreOptions options_;
+  mutable std::mutex segments_mutex_;
+  std::shared_ptr<const SegmentList> segments_;  // Guarded by segments_mutex_.
+
+  std::vector<uint8_t> head_data_;
+  std::vector<BlockIndex> head_index_;
+  std::vector<Sample> pending_;
+  int64_t last_timestamp_ms_ = INT64_MIN;
+
+  FILE* head_log_ = nullptr;
+};
+
+}  // namespace tsdb
@@ -0,0 +1,69 @@
+#include "tsdb/synthetic.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace tsdb {
+namespace {
+
+// Matches kAnemometerSpeedPerTick and kWindReportPeriodSecs in the firmware.
+constexpr double kMphPerTick = 1.73;
+constexpr double kReportSecs = 5;
+constexpr int64_t kPeriodMs = kReportSecs * 1000;
+
+}  // namespace
+
+SyntheticStation::SyntheticStation(uint32_t seed, int64_t start_ms)
+    : rng_(seed), t_ms_(start_ms), sector_(seed % 16) {}
+
+Sample SyntheticStation::Next() {
+  std::uniform_real_distribution<double> unit(0, 1);
+  std::normal_distribution<double> normal(0, 1);
+
+  // Publishes are usually on the dot, occasionally late by a few ms.
+  t_ms_ += kPeriodMs;
+  const int64_t jitter =
+      unit(rng_) < 0.05 ? std::uniform_int_distribution<int>(1, 40)(rng_) : 0;
+  const int64_t t = t_ms_ + jitter;
+
+  const double hour = std::fmod(t_ms_ / 3.6e6, 24);
+  const double diurnal =
+      6 + 4 * std::sin(2 * std::numbers::pi * (hour - 9) / 24);
+  turbulence_ = 0.995 * turbulence_ + 0.3 * normal(rng_);
+  const double speed =
+      std::max(0.0, diurnal + turbulence_ + 0.8 * normal(rng_));
+  const int ticks =
+      std::poisson_distribution<int>(speed * kReportSecs / kMphPerTick)(rng_);
+
+  if (unit(rng_) < 0.02) sector_ = (sector_ + (unit(rng_) < 0.5 ? 15 : 1)) % 16;
+
+  uint16_t rain = 0;
+  if (storm_samples_left_ > 0) {
+    --storm_samples_left_;
+    rain = std::poisson_distribution<int>(storm_ticks_per_sample_)(rng_);
+  } else if (unit(rng_) < 1.0 / (7 * 24 * 720)) {
+    // About one storm a week, lasting a few hours.
+    storm_samples_left_ =
+        std::exponential_distribution<double>(1.0 / 2000)(rng_);
+    storm_ticks_per_sample_ =
+        std::uniform_real_distribution<double>(0.02, 0.6)(rng_);
+  }
+
+  return Sample{
+      .timestamp_ms = t,
+      .wind_mph = static_cast<float>(ticks * kMphPerTick / kReportSecs),
+      .sector = static_cast<uint8_t>(sector_),
+      .rain_ticks = rain,
+  };
+}
+
+std::vector<Sample> GenerateStation(
+    uint32_t seed, int64_t start_ms, size_t count) {
+  SyntheticStation station(seed, start_ms);
+  std::vector<Sample> samples(count);
+  for (Sample& s : samples) s = station.Next();
+  return samples;
+}
+
+}  // namespace tsdb
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "tsdb/block.h"
+
+namespace tsdb {
+
+// Generates plausible five-second station history: a diurnal wind cycle with
+// AR(1) turbulence quantized the way the anemometer counts ticks, a slowly
+// wandering vane, and sparse rain storms.
+class SyntheticStation {
+ public:
+  SyntheticStation(uint32_t seed, int64_t start_ms);
+
+  Sample Next();
+
+ private:
+  std::mt19937 rng_;
+  int64_t t_ms_;
+  double turbulence_ = 0;
+  int sector_;
+  int storm_samples_left_ = 0;
+  double storm_ticks_per_sample_ = 0;
+};
+
+std::vector<Sample> GenerateStation(
+    uint32_t seed, int64_t start_ms, size_t count);
+
+// Five-second samples in a (non-leap) year.
+constexpr size_t kSamplesPerYear = 365 * 24 * 60 * 60 / 5;
+
+}  // namespace tsdb
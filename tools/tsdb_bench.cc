@@ -0,0 +1,193 @@
+// Compares the tsdb segment format against raw CSV for synthetic station
+// history: bytes on disk, append throughput and full-scan throughput.
+//
+//   tsdb_bench [--days=365] [--dir=/tmp/tsdb_bench]
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+
+#include "tsdb/block.h"
+#include "tsdb/store.h"
+#include "tsdb/synthetic.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Totals {
+  uint64_t count = 0;
+  double wind = 0;
+  uint64_t rain = 0;
+  uint64_t sectors = 0;
+};
+
+void Report(
+    const char* name, uint64_t bytes, double append_secs, double scan_secs,
+    uint64_t samples) {
+  printf(
+      "%-6s %12" PRIu64 " bytes %6.2f B/sample  append %8.2f Msamples/s  "
+      "scan %8.2f Msamples/s\n",
+      name,
+      bytes,
+      static_cast<double>(bytes) / samples,
+      samples / append_secs / 1e6,
+      samples / scan_secs / 1e6);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int days = 365;
+  std::filesystem::path dir = "/tmp/tsdb_bench";
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--days=")) {
+      days = atoi(argv[i] + strlen("--days="));
+    } else if (arg.starts_with("--dir=")) {
+      dir = argv[i] + strlen("--dir=");
+    } else {
+      fprintf(stderr, "usage: %s [--days=N] [--dir=PATH]\n", argv[0]);
+      return 1;
+    }
+  }
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+
+  const size_t count = static_cast<size_t>(days) * 24 * 60 * 60 / 5;
+  const std::vector<tsdb::Sample> samples =
+      tsdb::GenerateStation(1, 1'700'000'000'000, count);
+  printf("%zu samples (%d days at 5 s)\n", count, days);
+
+  // CSV, one row per reading, the way we archive topics today.
+  const std::filesystem::path csv_path = dir / "raw.csv";
+  auto start = Clock::now();
+  {
+    FILE* f = fopen(csv_path.c_str(), "w");
+    if (!f) {
+      perror("fopen");
+      return 1;
+    }
+    for (const tsdb::Sample& s : samples) {
+      fprintf(
+          f,
+          "%" PRId64 ",%.3f,%s,%u\n",
+          s.timestamp_ms,
+          s.wind_mph,
+          tsdb::kSectorNames[s.sector].data(),
+          s.rain_ticks);
+    }
+    fclose(f);
+  }
+  const double csv_append = SecondsSince(start);
+
+  start = Clock::now();
+  Totals csv;
+  {
+    FILE* f = fopen(csv_path.c_str(), "r");
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+      char* p = line;
+      strtoll(p, &p, 10);
+      csv.wind += strtof(p + 1, &p);
+      char* sector = p + 1;
+      p = strchr(sector, ',');
+      *p = '\0';
+      for (size_t i = 0; i < tsdb::kSectorNames.size(); ++i) {
+        if (tsdb::kSectorNames[i] == sector) {
+          csv.sectors += i;
+          break;
+        }
+      }
+      csv.rain += strtoul(p + 1, nullptr, 10);
+      ++csv.count;
+    }
+    fclose(f);
+  }
+  const double csv_scan = SecondsSince(start);
+  Report(
+      "csv",
+      std::filesystem::file_size(csv_path),
+      csv_append,
+      csv_scan,
+      count);
+
+  start = Clock::now();
+  {
+    auto store = tsdb::Store::Open(dir / "store");
+    if (!store) {
+      fprintf(stderr, "%s\n", store.error().c_str());
+      return 1;
+    }
+    for (const tsdb::Sample& s : samples) {
+      if (auto appended = (*store)->Append(s); !appended) {
+        fprintf(stderr, "%s\n", appended.error().c_str());
+        return 1;
+      }
+    }
+    if (auto sealed = (*store)->Seal(); !sealed) {
+      fprintf(stderr, "%s\n", sealed.error().c_str());
+      return 1;
+    }
+  }
+  const double store_append = SecondsSince(start);
+
+  // Reopen so the scan reads from the mapped segments.
+  auto store = tsdb::Store::Open(dir / "store");
+  if (!store) {
+    fprintf(stderr, "%s\n", store.error().c_str());
+    return 1;
+  }
+  start = Clock::now();
+  Totals tsdb_totals;
+  bool mismatch = false;
+  size_t at = 0;
+  auto columns = std::make_unique<tsdb::Columns>();
+  (*store)->ForEachBlock(
+      INT64_MIN,
+      INT64_MAX,
+      [&](const tsdb::BlockIndex&, std::span<const uint8_t> data) {
+        if (!tsdb::DecodeBlock(data, *columns)) {
+          mismatch = true;
+          return;
+        }
+        for (size_t i = 0; i < columns->count; ++i) {
+          tsdb_totals.wind += columns->wind_mph[i];
+          tsdb_totals.sectors += columns->sector[i];
+          tsdb_totals.rain += columns->rain_ticks[i];
+        }
+        tsdb_totals.count += columns->count;
+        // Verify the round trip is lossless.
+        for (size_t i = 0; i < columns->count && at + i < samples.size(); ++i) {
+          const tsdb::Sample& s = samples[at + i];
+          if (s.timestamp_ms != columns->timestamp_ms[i] ||
+              s.wind_mph != columns->wind_mph[i] ||
+              s.sector != columns->sector[i] ||
+              s.rain_ticks != columns->rain_ticks[i]) {
+            mismatch = true;
+          }
+        }
+        at += columns->count;
+      });
+  const double store_scan = SecondsSince(start);
+  Report("tsdb", (*store)->disk_bytes(), store_append, store_scan, count);
+
+  printf(
+      "compression ratio %.1fx\n",
+      static_cast<double>(std::filesystem::file_size(csv_path)) /
+          (*store)->disk_bytes());
+  if (mismatch || tsdb_totals.count != count || csv.count != count ||
+      tsdb_totals.rain != csv.rain || tsdb_totals.sectors != csv.sectors) {
+    fprintf(stderr, "round trip mismatch\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,159 @@
+#include "tuning/pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <utility>
+
+#include "derived_metrics.h"
+#include "rain_event.h"
+#include "reed_counter.h"
+#include "tipping_bucket.h"
+#include "yamartino.h"
+
+namespace tuning {
+namespace {
+
+// Sums a published value's error against the truth, each second it stands.
+struct ErrorSum {
+  double sum = 0;
+  double sum_sq = 0;
+  uint64_t n = 0;
+
+  void Add(double error) {
+    sum += error;
+    sum_sq += error * error;
+    ++n;
+  }
+  double rmse() const { return n ? std::sqrt(sum_sq / n) : 0; }
+  double mean() const { return n ? sum / n : 0; }
+};
+
+double PerHour(double messages, const Trace& trace) {
+  return trace.seconds ? messages * 3600 / trace.seconds : 0;
+}
+
+}  // namespace
+
+Params Params::Station() {
+  return {
+      .anemometer_debounce_us = kAnemometerUpdateUs,
+      .rain_gauge_debounce_us = kRainGaugeUpdateUs,
+      .wind_report_secs = 5,
+      .rain_report_secs = 10 * 60,
+      .direction_window_secs = 10 * 60,
+      .wind_deadband_mph = 0,
+  };
+}
+
+WindScore RunWind(const Trace& trace, const Params& params) {
+  RateLimitedCounter counter{.update_period = params.anemometer_debounce_us};
+  EdgeTrace::Cursor edges(trace.anemometer);
+  DerivedMetrics derived;
+  ErrorSum error, age;
+  std::optional<float> published;
+  double published_mid_s = 0;
+  double messages = 0;
+  for (uint32_t s = 0; s < trace.seconds; ++s) {
+    if (published) {
+      error.Add(*published - trace.wind_mph[s]);
+      age.Add(s + 0.5 - published_mid_s);
+    }
+    const uint64_t end_us = (s + 1) * 1'000'000ull;
+    while (const auto t_us = edges.NextBefore(end_us)) counter.Inc(*t_us);
+    if ((s + 1) % params.wind_report_secs != 0) continue;
+
+    const float mph =
+        counter.Flush() * kAnemometerSpeedPerTick / params.wind_report_secs;
+    if (!published ||
+        std::abs(mph - *published) >= params.wind_deadband_mph) {
+      published = mph;
+      published_mid_s = s + 1 - params.wind_report_secs / 2.0;
+      ++messages;
+    }
+    const DerivedMetrics::WindChanges changes =
+        derived.OnWind(mph, params.wind_report_secs);
+    messages += changes.wind_run_miles.has_value() +
+                changes.beaufort.has_value() +
+                changes.gust_factor.has_value();
+  }
+  return {
+      .rmse_mph = error.rmse(),
+      .bias_mph = error.mean(),
+      .latency_s = age.mean(),
+      .messages_per_hour = PerHour(messages, trace),
+  };
+}
+
+DirectionScore RunDirection(const Trace& trace, const Params& params) {
+  YamartinoWindow window;
+  uint32_t readings = 0;
+  ErrorSum error;
+  std::optional<float> published;
+  double messages = 0;
+  for (uint32_t s = 0; s < trace.seconds; ++s) {
+    if (published) {
+      const double diff = std::fmod(
+          std::abs(*published - trace.direction_deg[s]), 360.0);
+      error.Add(std::min(diff, 360 - diff));
+    }
+    if ((s + 1) % params.wind_report_secs != 0) continue;
+
+    // The sector goes out with every wind report, and one reading in each
+    // goes into the statistics.
+    window.Add(trace.vane_index[s]);
+    ++messages;
+    if (++readings * params.wind_report_secs < params.direction_window_secs) {
+      continue;
+    }
+    readings = 0;
+    if (const auto stats = window.Finish()) {
+      published = stats->mean_degrees;
+      messages += 2;
+    }
+  }
+  return {
+      .rmse_deg = error.rmse(),
+      .messages_per_hour = PerHour(messages, trace),
+  };
+}
+
+RainScore RunRain(const Trace& trace, const Params& params) {
+  RateLimitedCounter counter{.update_period = params.rain_gauge_debounce_us};
+  EdgeTrace::Cursor edges(trace.rain_gauge);
+  RainEventTracker events({});
+  DerivedMetrics derived;
+  std::optional<uint64_t> last_tip_us;
+  double inches = 0;
+  ErrorSum error;
+  std::optional<float> published;
+  double messages = 0;
+  for (uint32_t s = 0; s < trace.seconds; ++s) {
+    if (published) error.Add(*published - trace.rain_in_per_hour[s]);
+    const uint64_t end_us = (s + 1) * 1'000'000ull;
+    while (const auto t_us = edges.NextBefore(end_us)) {
+      if (!counter.Inc(*t_us)) continue;
+      const float tip_in = TipInches(
+          kRainGaugeCurve, last_tip_us ? (*t_us - *last_tip_us) / 1e6f : 0);
+      last_tip_us = *t_us;
+      inches += tip_in;
+      // An event's summary and its end, then its start.
+      if (events.Poll(*t_us)) messages += 2;
+      if (events.OnTip(*t_us, tip_in)) ++messages;
+    }
+    if ((s + 1) % params.rain_report_secs != 0) continue;
+
+    if (events.Poll(end_us)) messages += 2;
+    const double in_per_hour =
+        std::exchange(inches, 0) / params.rain_report_secs * 3600;
+    published = in_per_hour;
+    ++messages;
+    if (derived.OnRainRate(in_per_hour)) ++messages;
+  }
+  return {
+      .rmse_in_per_hour = error.rmse(),
+      .messages_per_hour = PerHour(messages, trace),
+  };
+}
+
+}  // namespace tuning
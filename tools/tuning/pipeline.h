@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+#include "tuning/trace.h"
+
+namespace tuning {
+
+// The station's tunable wind and rain acquisition parameters.
+struct Params {
+  // RateLimitedCounter periods.
+  uint32_t anemometer_debounce_us;
+  uint32_t rain_gauge_debounce_us;
+  // Counter flushes, and so publishes, of each sensor.
+  uint32_t wind_report_secs;
+  uint32_t rain_report_secs;
+  // Yamartino statistics, over one vane reading per wind report.
+  uint32_t direction_window_secs;
+  // Wind speed is only published once it has moved this far from the last
+  // published value. The station publishes every report, which is 0.
+  float wind_deadband_mph;
+
+  // What the station runs (see src/reed_counter.h and src/main.cc).
+  static Params Station();
+};
+
+// Each subsystem's result, on its own, as they share no state: a sweep can
+// run each only for the parameters that affect it.
+struct WindScore {
+  // The published speed, as held between publishes, against the truth each
+  // second.
+  double rmse_mph = 0;
+  double bias_mph = 0;
+  // Mean age of the published speed: from the middle of the window it
+  // covers to each second it stands.
+  double latency_s = 0;
+  // Wind speed and derived wind metric publishes.
+  double messages_per_hour = 0;
+};
+struct DirectionScore {
+  // The published mean direction against the true direction each second.
+  double rmse_deg = 0;
+  // Vane sector and direction statistics publishes.
+  double messages_per_hour = 0;
+};
+struct RainScore {
+  // The published rain rate against the true rate each second.
+  double rmse_in_per_hour = 0;
+  // Rain rate, intensity and event publishes.
+  double messages_per_hour = 0;
+};
+
+// Runs the firmware's counters and estimators over the trace, as the wind
+// and rain task and the windvane task would with `params`.
+WindScore RunWind(const Trace& trace, const Params& params);
+DirectionScore RunDirection(const Trace& trace, const Params& params);
+RainScore RunRain(const Trace& trace, const Params& params);
+
+}  // namespace tuning
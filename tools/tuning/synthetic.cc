@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <random>
+
+#include "reed_counter.h"
+#include "tipping_bucket.h"
+#include "tuning/trace.h"
+
+namespace tuning {
+namespace {
+
+constexpr double kSecondsPerDay = 86'400;
+// Below this the cups don't turn.
+constexpr double kStartingMph = 0.8;
+
+// Wind speed: a log-speed that reverts over ten minutes towards a level set
+// by the day's cycle and the weather, which changes over days, times gusts
+// that come and go over seconds.
+class Wind {
+ public:
+  Wind(double mean_mph, std::mt19937_64& rng)
+      : rng_(rng), log_mean_(std::log(mean_mph)), log_speed_(log_mean_) {}
+
+  double Next(uint32_t s) {
+    weather_ += -weather_ / (2 * kSecondsPerDay) + 0.0015 * normal_(rng_);
+    const double day = std::sin(
+        2 * std::numbers::pi * (s / kSecondsPerDay - 0.375));
+    const double level = log_mean_ + weather_ + 0.35 * day;
+    log_speed_ += (level - log_speed_) / 600 + 0.012 * normal_(rng_);
+    gust_ += -gust_ / 5 + 0.12 * normal_(rng_);
+    return std::max(0.0, std::exp(log_speed_) * (1 + gust_));
+  }
+
+ private:
+  std::mt19937_64& rng_;
+  std::normal_distribution<double> normal_;
+  const double log_mean_;
+  double log_speed_;
+  double weather_ = 0;
+  double gust_ = 0;
+};
+
+// Wind direction: veers about a heading that itself drifts over hours.
+class Direction {
+ public:
+  explicit Direction(std::mt19937_64& rng) : rng_(rng) {}
+
+  double Next() {
+    heading_ += 0.15 * normal_(rng_);
+    deg_ += (heading_ - deg_) / 30 + 4 * normal_(rng_);
+    return deg_;
+  }
+
+ private:
+  std::mt19937_64& rng_;
+  std::normal_distribution<double> normal_;
+  double heading_ = 225;
+  double deg_ = 225;
+};
+
+// Rain: events arrive at random and last hours, their intensity wandering
+// over minutes about a level drawn for each, now and then a heavy one.
+class Rain {
+ public:
+  Rain(double days_between, std::mt19937_64& rng)
+      : rng_(rng), gap_(1 / (days_between * kSecondsPerDay)) {
+    next_start_ = gap_(rng_);
+  }
+
+  double Next(uint32_t s) {
+    if (s >= end_ && s >= next_start_) {
+      std::exponential_distribution<double> length(1 / (3 * 3600.0));
+      end_ = s + std::clamp(length(rng_), 600.0, 12 * 3600.0);
+      std::lognormal_distribution<double> level(std::log(0.08), 0.8);
+      level_ = level(rng_);
+      next_start_ = end_ + gap_(rng_);
+    }
+    if (s >= end_) return 0;
+    wander_ += -wander_ / 300 + 0.06 * normal_(rng_);
+    return level_ * std::exp(wander_);
+  }
+
+ private:
+  std::mt19937_64& rng_;
+  std::exponential_distribution<double> gap_;
+  std::normal_distribution<double> normal_;
+  double next_start_ = 0;
+  double end_ = 0;
+  double level_ = 0;
+  double wander_ = 0;
+};
+
+// A closure, and with probability `bounce` one to `max_bounces` more
+// falling edges within `max_bounce_us` after it.
+void Close(
+    uint64_t t_us,
+    double bounce,
+    int max_bounces,
+    double max_bounce_us,
+    std::mt19937_64& rng,
+    EdgeTrace& edges) {
+  edges.Add(t_us);
+  if (std::uniform_real_distribution<double>()(rng) >= bounce) return;
+  const int n = std::uniform_int_distribution<int>(1, max_bounces)(rng);
+  std::uniform_real_distribution<double> step(
+      0.1 * max_bounce_us / n, max_bounce_us / n);
+  for (int i = 0; i < n; ++i) {
+    t_us += step(rng);
+    edges.Add(t_us);
+  }
+}
+
+}  // namespace
+
+Trace Synthesize(const SyntheticOptions& options) {
+  std::mt19937_64 rng(options.seed);
+  Wind wind(options.mean_wind_mph, rng);
+  Direction direction(rng);
+  Rain rain(options.days_between_rain, rng);
+  std::normal_distribution<double> vane_noise(0, 4);
+  std::uniform_real_distribution<double> uniform;
+
+  Trace trace;
+  trace.seconds = options.days * kSecondsPerDay;
+  trace.wind_mph.reserve(trace.seconds);
+  trace.direction_deg.reserve(trace.seconds);
+  trace.rain_in_per_hour.reserve(trace.seconds);
+  trace.vane_index.reserve(trace.seconds);
+
+  // Cup revolutions, in closures, and bucket fill, in inches.
+  double closures = 0;
+  double bucket_in = 0;
+  for (uint32_t s = 0; s < trace.seconds; ++s) {
+    const double mph = wind.Next(s);
+    trace.wind_mph.push_back(mph);
+    const double rate = mph < kStartingMph ? 0 : mph / kAnemometerSpeedPerTick;
+    // Closures fall where the cups' phase crosses a whole number.
+    for (double next = std::floor(closures) + 1; next < closures + rate;
+         ++next) {
+      const uint64_t t_us = (s + (next - closures) / rate) * 1e6;
+      Close(t_us, options.anemometer_bounce, 3, 2'000, rng, trace.anemometer);
+    }
+    closures += rate;
+
+    const double deg = direction.Next();
+    trace.direction_deg.push_back(std::fmod(std::fmod(deg, 360) + 360, 360));
+    int index = std::lround((deg + vane_noise(rng)) / 22.5);
+    if (uniform(rng) < options.vane_misread) {
+      index += uniform(rng) < 0.5 ? 1 : -1;
+    }
+    trace.vane_index.push_back(index & 15);
+
+    const double in_per_hour = rain.Next(s);
+    trace.rain_in_per_hour.push_back(in_per_hour);
+    // Water lost while the bucket tips makes a tip hold more than nominal
+    // at high intensity, as the dynamic calibration has it.
+    const double tip_in = TipInches(
+        kRainGaugeCurve,
+        in_per_hour > 0 ? kRainGaugeCurve.nominal_in * 3600 / in_per_hour
+                        : 0);
+    const double fill_in = in_per_hour / 3600;
+    if (bucket_in + fill_in >= tip_in) {
+      const uint64_t t_us = (s + (tip_in - bucket_in) / fill_in) * 1e6;
+      Close(t_us, options.rain_gauge_bounce, 4, 80'000, rng, trace.rain_gauge);
+      bucket_in -= tip_in;
+    }
+    bucket_in += fill_in;
+  }
+  return trace;
+}
+
+}  // namespace tuning
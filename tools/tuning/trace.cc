@@ -0,0 +1,84 @@
+#include "tuning/trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+namespace tuning {
+namespace {
+
+constexpr char kMagic[8] = {'W', 'S', 'T', 'R', 'A', 'C', 'E', '1'};
+
+struct FileCloser {
+  void operator()(FILE* f) const { fclose(f); }
+};
+using File = std::unique_ptr<FILE, FileCloser>;
+
+template <typename T>
+bool Write(FILE* f, const std::vector<T>& v) {
+  return fwrite(v.data(), sizeof(T), v.size(), f) == v.size();
+}
+
+template <typename T>
+bool Read(FILE* f, std::vector<T>& v, size_t n) {
+  v.resize(n);
+  return fread(v.data(), sizeof(T), n, f) == n;
+}
+
+}  // namespace
+
+void EdgeTrace::Add(uint64_t t_us) {
+  t_us = std::max(t_us, last_us_);
+  uint64_t delta = t_us - last_us_;
+  for (; delta >= kGap; delta -= kGap) deltas_.push_back(kGap);
+  deltas_.push_back(delta);
+  last_us_ = t_us;
+}
+
+std::expected<void, std::string> Save(
+    const Trace& trace, const std::string& path) {
+  File f(fopen(path.c_str(), "wb"));
+  if (!f) return std::unexpected(path + ": " + std::strerror(errno));
+  bool ok = fwrite(kMagic, sizeof(kMagic), 1, f.get()) == 1 &&
+            fwrite(&trace.seconds, sizeof(trace.seconds), 1, f.get()) == 1 &&
+            Write(f.get(), trace.wind_mph) &&
+            Write(f.get(), trace.direction_deg) &&
+            Write(f.get(), trace.rain_in_per_hour) &&
+            Write(f.get(), trace.vane_index);
+  for (const EdgeTrace* edges : {&trace.anemometer, &trace.rain_gauge}) {
+    const uint64_t n = edges->size();
+    ok = ok && fwrite(&n, sizeof(n), 1, f.get()) == 1 &&
+         Write(f.get(), edges->deltas());
+  }
+  if (!ok || fflush(f.get()) != 0) {
+    return std::unexpected(path + ": write failed");
+  }
+  return {};
+}
+
+std::expected<Trace, std::string> Load(const std::string& path) {
+  File f(fopen(path.c_str(), "rb"));
+  if (!f) return std::unexpected(path + ": " + std::strerror(errno));
+  char magic[sizeof(kMagic)];
+  Trace trace;
+  if (fread(magic, sizeof(magic), 1, f.get()) != 1 ||
+      memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+      fread(&trace.seconds, sizeof(trace.seconds), 1, f.get()) != 1) {
+    return std::unexpected(path + ": not a trace file");
+  }
+  bool ok = Read(f.get(), trace.wind_mph, trace.seconds) &&
+            Read(f.get(), trace.direction_deg, trace.seconds) &&
+            Read(f.get(), trace.rain_in_per_hour, trace.seconds) &&
+            Read(f.get(), trace.vane_index, trace.seconds);
+  for (EdgeTrace* edges : {&trace.anemometer, &trace.rain_gauge}) {
+    uint64_t n = 0;
+    ok = ok && fread(&n, sizeof(n), 1, f.get()) == 1 &&
+         Read(f.get(), edges->deltas(), n);
+  }
+  if (!ok) return std::unexpected(path + ": truncated trace file");
+  return trace;
+}
+
+}  // namespace tuning
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace tuning {
+
+// Reed switch falling edges, as microseconds since the previous edge (the
+// first since the trace start). An entry of kGap adds that long without an
+// edge, for gaps too long for 32 bits. Four bytes an edge keeps a month of
+// anemometer edges in memory once for every thread of a sweep.
+class EdgeTrace {
+ public:
+  static constexpr uint32_t kGap = UINT32_MAX;
+
+  // An edge before the last one is taken as coinciding with it.
+  void Add(uint64_t t_us);
+
+  class Cursor {
+   public:
+    explicit Cursor(const EdgeTrace& trace) : deltas_(trace.deltas_) {}
+    // The next edge before `end_us`, if there is one.
+    std::optional<uint64_t> NextBefore(uint64_t end_us) {
+      while (at_ < deltas_.size()) {
+        const uint32_t delta = deltas_[at_];
+        if (t_us_ + delta >= end_us) return std::nullopt;
+        t_us_ += delta;
+        ++at_;
+        if (delta != kGap) return t_us_;
+      }
+      return std::nullopt;
+    }
+
+   private:
+    const std::vector<uint32_t>& deltas_;
+    size_t at_ = 0;
+    uint64_t t_us_ = 0;
+  };
+
+  size_t size() const { return deltas_.size(); }
+  std::vector<uint32_t>& deltas() { return deltas_; }
+  const std::vector<uint32_t>& deltas() const { return deltas_; }
+
+ private:
+  std::vector<uint32_t> deltas_;
+  uint64_t last_us_ = 0;
+};
+
+// What the station's wind and rain sensors produced over a stretch of time,
+// with what was really happening, one value a second.
+struct Trace {
+  uint32_t seconds = 0;
+
+  // Ground truth.
+  std::vector<float> wind_mph;
+  std::vector<float> direction_deg;  // Clockwise from north.
+  std::vector<float> rain_in_per_hour;
+
+  // Sensor output: the vane's compass index as the ADC read it each second
+  // (0 for N, clockwise in 22.5 degree steps), and each reed switch's
+  // falling edges, bounces and all.
+  std::vector<uint8_t> vane_index;
+  EdgeTrace anemometer;
+  EdgeTrace rain_gauge;
+};
+
+// A trace file is "WSTRACE1", the second count as a u32, the three truth
+// arrays as f32s, the vane indexes as bytes, and each edge trace as a u64
+// entry count followed by its u32 deltas, all in the host's byte order. A
+// recording from a rig can be converted to it.
+std::expected<void, std::string> Save(
+    const Trace& trace, const std::string& path);
+std::expected<Trace, std::string> Load(const std::string& path);
+
+struct SyntheticOptions {
+  uint32_t days = 30;
+  uint32_t seed = 1;
+  float mean_wind_mph = 8;
+  // Rain events start this many days apart on average.
+  float days_between_rain = 2.5;
+  // Chances that a closure bounces, and that the vane reads a neighbouring
+  // sector.
+  float anemometer_bounce = 0.3;
+  float rain_gauge_bounce = 0.8;
+  float vane_misread = 0.02;
+};
+
+// A month, by default, of gusty wind with a daily cycle, a wandering vane
+// and showers, through sensors that bounce and misread.
+Trace Synthesize(const SyntheticOptions& options);
+
+}  // namespace tuning
@@ -0,0 +1,318 @@
+// Site-survey batch job: wind roses, per-sector Weibull fits, direction
+// persistence and hourly/seasonal breakdowns over station history.
+//
+//   wind_survey [--threads=N] [--chunk-days=30] [--utc-offset-hours=0] PATH...
+//
+// Each PATH is either a tsdb store directory or a CSV file with rows of
+// timestamp_ms,wind_mph,SECTOR,rain_ticks (the format tsdb_bench writes).
+// Stores are split into time chunks that run in parallel; each worker
+// accumulates its own WindStats, and the partials are merged at the end.
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "analytics/wind_rose.h"
+#include "query/work_stealing_pool.h"
+#include "tsdb/block.h"
+#include "tsdb/store.h"
+
+namespace {
+
+using analytics::Persistence;
+using analytics::WindStats;
+
+constexpr int64_t kDayMs = 24 * 60 * 60 * 1000;
+constexpr const char* kSeasonNames[] = {"DJF", "MAM", "JJA", "SON"};
+
+struct Source {
+  std::filesystem::path path;
+  std::unique_ptr<tsdb::Store> store;  // Null for CSV files.
+};
+
+// A stretch of one source processed by a single task.
+struct Chunk {
+  const Source* source;
+  int64_t t_begin;
+  int64_t t_end;  // Exclusive.
+  Persistence persistence;
+  std::string error;
+};
+
+bool ParseCsvLine(char* line, tsdb::Sample& s) {
+  char* p = line;
+  s.timestamp_ms = strtoll(p, &p, 10);
+  if (*p != ',') return false;
+  s.wind_mph = strtof(p + 1, &p);
+  if (*p != ',') return false;
+  char* name = p + 1;
+  p = strchr(name, ',');
+  if (!p) return false;
+  const std::string_view sector(name, p - name);
+  const auto it =
+      std::find(tsdb::kSectorNames.begin(), tsdb::kSectorNames.end(), sector);
+  if (it == tsdb::kSectorNames.end()) return false;
+  s.sector = it - tsdb::kSectorNames.begin();
+  s.rain_ticks = strtoul(p + 1, nullptr, 10);
+  return true;
+}
+
+void RunChunk(Chunk& chunk, WindStats& stats, int64_t utc_offset_ms) {
+  auto add = [&](const tsdb::Sample& s) {
+    stats.Add(s, utc_offset_ms);
+    chunk.persistence.Add(s);
+  };
+  if (!chunk.source->store) {
+    FILE* f = fopen(chunk.source->path.c_str(), "r");
+    if (!f) {
+      chunk.error = chunk.source->path.string() + ": " + strerror(errno);
+      return;
+    }
+    char line[256];
+    tsdb::Sample s{};
+    while (fgets(line, sizeof(line), f)) {
+      if (ParseCsvLine(line, s)) add(s);
+    }
+    fclose(f);
+    return;
+  }
+
+  auto columns = std::make_unique<tsdb::Columns>();
+  chunk.source->store->ForEachBlock(
+      chunk.t_begin,
+      chunk.t_end - 1,
+      [&](const tsdb::BlockIndex&, std::span<const uint8_t> data) {
+        if (!tsdb::DecodeBlock(data, *columns)) {
+          chunk.error = chunk.source->path.string() + ": corrupt block";
+          return;
+        }
+        const tsdb::Columns& c = *columns;
+        for (size_t i = 0; i < c.count; ++i) {
+          if (c.timestamp_ms[i] < chunk.t_begin ||
+              c.timestamp_ms[i] >= chunk.t_end) {
+            continue;
+          }
+          if (!c.rollup) {
+            add({c.timestamp_ms[i],
+                 c.wind_mph[i],
+                 c.sector[i],
+                 static_cast<uint16_t>(c.rain_ticks[i])});
+            continue;
+          }
+          // Compacted history: the row's mean and prevailing sector stand in
+          // for each of its samples, and its rain for the first.
+          uint32_t rain = c.rain_ticks[i];
+          for (uint32_t k = 0; k < c.samples[i]; ++k) {
+            const uint16_t ticks = std::min<uint32_t>(rain, UINT16_MAX);
+            add({c.timestamp_ms[i], c.wind_mph[i], c.sector[i], ticks});
+            rain -= ticks;
+          }
+        }
+      });
+}
+
+int Prevailing(const std::array<uint64_t, 16>& sectors) {
+  return std::max_element(sectors.begin(), sectors.end()) - sectors.begin();
+}
+
+void PrintWeibull(const analytics::SpeedHistogram& speeds) {
+  if (auto w = analytics::FitWeibull(speeds)) {
+    printf("  k %5.2f  c %5.1f", w->k, w->c);
+  } else {
+    printf("  k     -  c     -");
+  }
+}
+
+void PrintReport(const WindStats& stats, const Persistence& persistence) {
+  if (stats.samples == 0) return;
+  const double n = stats.samples;
+  uint64_t calm = 0;
+  for (const auto& row : stats.rose) calm += row[0];
+  printf(
+      "\n%" PRIu64 " samples, mean %.1f mph, calm %.1f%%\n",
+      stats.samples,
+      stats.speed_sum / n,
+      100 * calm / n);
+
+  printf("\nwind rose (%% of samples per sector and speed class, mph)\n");
+  printf("%-4s %6s", "", "<1");
+  for (size_t b = 1; b < analytics::kRoseSpeedEdges.size(); ++b) {
+    printf(
+        " %2.0f-%-3.0f",
+        analytics::kRoseSpeedEdges[b - 1],
+        analytics::kRoseSpeedEdges[b]);
+  }
+  printf("  %3.0f+   total  weibull\n", analytics::kRoseSpeedEdges.back());
+  for (int s = 0; s < 16; ++s) {
+    uint64_t total = 0;
+    printf("%-4s", tsdb::kSectorNames[s].data());
+    for (int b = 0; b < analytics::kRoseSpeedBins; ++b) {
+      printf(" %6.2f", 100 * stats.rose[s][b] / n);
+      total += stats.rose[s][b];
+    }
+    printf(" %6.2f", 100 * total / n);
+    PrintWeibull(stats.sector_speeds[s]);
+    printf("\n");
+  }
+
+  printf(
+      "\ndirection persistence\n%-4s %10s %12s %12s\n",
+      "",
+      "runs",
+      "mean (min)",
+      "longest (h)");
+  for (int s = 0; s < 16; ++s) {
+    const uint64_t runs = persistence.runs[s];
+    printf(
+        "%-4s %10" PRIu64 " %12.1f %12.1f\n",
+        tsdb::kSectorNames[s].data(),
+        runs,
+        runs ? 5.0 * persistence.run_samples[s] / runs / 60 : 0,
+        persistence.longest_ms[s] / 3.6e6);
+  }
+
+  printf("\nhour  samples   mean  prevailing\n");
+  for (int h = 0; h < 24; ++h) {
+    const analytics::HourStats& hs = stats.hours[h];
+    if (hs.samples == 0) continue;
+    printf(
+        "%02d   %8" PRIu64 "  %5.1f  %s\n",
+        h,
+        hs.samples,
+        hs.speed_sum / hs.samples,
+        tsdb::kSectorNames[Prevailing(hs.sectors)].data());
+  }
+
+  printf("\nseason  samples   mean  prevailing\n");
+  for (int i = 0; i < 4; ++i) {
+    const analytics::SeasonStats& ss = stats.seasons[i];
+    if (ss.samples == 0) continue;
+    printf(
+        "%-6s %8" PRIu64 "  %5.1f  %-4s",
+        kSeasonNames[i],
+        ss.samples,
+        ss.speed_sum / ss.samples,
+        tsdb::kSectorNames[Prevailing(ss.sectors)].data());
+    PrintWeibull(ss.speeds);
+    printf("\n");
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  int chunk_days = 30;
+  double utc_offset_hours = 0;
+  std::vector<Source> sources;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--threads=")) {
+      threads = atoi(argv[i] + strlen("--threads="));
+    } else if (arg.starts_with("--chunk-days=")) {
+      chunk_days = std::max(1, atoi(argv[i] + strlen("--chunk-days=")));
+    } else if (arg.starts_with("--utc-offset-hours=")) {
+      utc_offset_hours = atof(argv[i] + strlen("--utc-offset-hours="));
+    } else if (arg.starts_with("--")) {
+      sources.clear();
+      break;
+    } else {
+      sources.push_back({argv[i], nullptr});
+    }
+  }
+  if (sources.empty()) {
+    fprintf(
+        stderr,
+        "usage: %s [--threads=N] [--chunk-days=N] [--utc-offset-hours=H] "
+        "PATH...\n",
+        argv[0]);
+    return 1;
+  }
+
+  // Plan chunks. Store chunks are contiguous time ranges listed in order, so
+  // each source's persistence partials can be stitched back in sequence.
+  std::vector<std::unique_ptr<Chunk>> chunks;
+  for (Source& source : sources) {
+    if (!std::filesystem::is_directory(source.path)) {
+      chunks.push_back(
+          std::make_unique<Chunk>(Chunk{&source, INT64_MIN, INT64_MAX}));
+      continue;
+    }
+    auto store = tsdb::Store::Open(source.path);
+    if (!store) {
+      fprintf(stderr, "%s\n", store.error().c_str());
+      return 1;
+    }
+    source.store = *std::move(store);
+    int64_t first = INT64_MAX;
+    int64_t last = INT64_MIN;
+    source.store->ForEachBlock(
+        INT64_MIN,
+        INT64_MAX,
+        [&](const tsdb::BlockIndex& b, std::span<const uint8_t>) {
+          first = std::min(first, b.t_min);
+          last = std::max(last, b.t_max);
+        });
+    for (int64_t t = first; t <= last; t += chunk_days * kDayMs) {
+      chunks.push_back(std::make_unique<Chunk>(
+          Chunk{&source, t, std::min(t + chunk_days * kDayMs, last + 1)}));
+    }
+  }
+
+  query::WorkStealingPool pool(threads);
+  std::vector<std::unique_ptr<WindStats>> partials(pool.size());
+  for (auto& p : partials) p = std::make_unique<WindStats>();
+  const int64_t utc_offset_ms = utc_offset_hours * 3.6e6;
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<query::WorkStealingPool::Task> tasks;
+  for (auto& chunk : chunks) {
+    tasks.push_back([&, c = chunk.get()] {
+      RunChunk(
+          *c,
+          *partials[query::WorkStealingPool::CurrentWorker()],
+          utc_offset_ms);
+    });
+  }
+  pool.Run(std::move(tasks));
+
+  WindStats total;
+  for (const auto& p : partials) total.Merge(*p);
+  Persistence persistence;
+  for (size_t i = 0; i < chunks.size();) {
+    // Stitch one source's chunks in time order, then close its edge runs.
+    Persistence station;
+    const Source* source = chunks[i]->source;
+    for (; i < chunks.size() && chunks[i]->source == source; ++i) {
+      if (!chunks[i]->error.empty()) {
+        fprintf(stderr, "%s\n", chunks[i]->error.c_str());
+        return 1;
+      }
+      station.Merge(chunks[i]->persistence);
+    }
+    station.Finish();
+    persistence.Merge(station);
+  }
+  const double secs = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+
+  printf(
+      "%zu sources, %zu chunks, %zu threads: %.2f s, %.1f Msamples/s\n",
+      sources.size(),
+      chunks.size(),
+      pool.size(),
+      secs,
+      total.samples / secs / 1e6);
+  PrintReport(total, persistence);
+  return 0;
+}
@@ -0,0 +1,223 @@
+#include "windvane/divider.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+namespace windvane {
+namespace {
+
+constexpr int kE24[] = {10, 11, 12, 13, 15, 16, 18, 20, 22, 24, 27, 30,
+                        33, 36, 39, 43, 47, 51, 56, 62, 68, 75, 82, 91};
+constexpr int kE96[] = {
+    100, 102, 105, 107, 110, 113, 115, 118, 121, 124, 127, 130, 133, 137,
+    140, 143, 147, 150, 154, 158, 162, 165, 169, 174, 178, 182, 187, 191,
+    196, 200, 205, 210, 215, 221, 226, 232, 237, 243, 249, 255, 261, 267,
+    274, 280, 287, 294, 301, 309, 316, 324, 332, 340, 348, 357, 365, 374,
+    383, 392, 402, 412, 422, 432, 442, 453, 464, 475, 487, 499, 511, 523,
+    536, 549, 562, 576, 590, 604, 619, 634, 649, 665, 681, 698, 715, 732,
+    750, 768, 787, 806, 825, 845, 866, 887, 909, 931, 953, 976};
+
+double Parallel(double a, double b) { return a * b / (a + b); }
+
+double LevelFor(double vane_ohms, double divider_ohms, int adc_bits) {
+  return std::ldexp(vane_ohms / (vane_ohms + divider_ohms), adc_bits);
+}
+
+std::string FormatOhms(double ohms) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.0f", ohms);
+  return buf;
+}
+
+}  // namespace
+
+std::array<Position, 16> VanePositions() {
+  constexpr double kNE = 8200;
+  constexpr double kE = 1000;
+  constexpr double kSE = 2200;
+  constexpr double kS = 3900;
+  constexpr double kSW = 16000;
+  constexpr double kW = 120000;
+  constexpr double kNW = 64900;
+  constexpr double kN = 33000;
+  return {{
+      {"N", kN},
+      {"NNE", Parallel(kN, kNE)},
+      {"NE", kNE},
+      {"ENE", Parallel(kNE, kE)},
+      {"E", kE},
+      {"ESE", Parallel(kE, kSE)},
+      {"SE", kSE},
+      {"SSE", Parallel(kSE, kS)},
+      {"S", kS},
+      {"SSW", Parallel(kS, kSW)},
+      {"SW", kSW},
+      {"WSW", Parallel(kSW, kW)},
+      {"W", kW},
+      {"WNW", Parallel(kW, kNW)},
+      {"NW", kNW},
+      {"NNW", Parallel(kNW, kN)},
+  }};
+}
+
+std::vector<double> SeriesValues(Series series) {
+  const std::span<const int> mantissas =
+      series == Series::kE24 ? std::span<const int>(kE24)
+                             : std::span<const int>(kE96);
+  // E24 mantissas have two digits, E96 three.
+  const double scale = series == Series::kE24 ? 10 : 1;
+  std::vector<double> values;
+  for (double decade = 1; decade <= 1000; decade *= 10) {
+    for (int m : mantissas) values.push_back(m * scale * decade);
+  }
+  values.push_back(1'000'000);
+  return values;
+}
+
+std::string Divider::Describe() const {
+  if (r2 == 0) return FormatOhms(r1) + " ohm";
+  return FormatOhms(r1) + " || " + FormatOhms(r2) + " ohm (" +
+         FormatOhms(ohms()) + " ohm)";
+}
+
+Calibration Evaluate(
+    const Divider& divider,
+    std::span<const Position> positions,
+    const NoiseModel& noise) {
+  Calibration c;
+  c.divider = divider;
+  const double rd = divider.ohms();
+  const double vt = noise.vane_tolerance;
+  const double dt = noise.divider_tolerance;
+  for (size_t i = 0; i < positions.size() && i < c.levels.size(); ++i) {
+    const double rv = positions[i].ohms;
+    c.levels[i] = {
+        positions[i].name,
+        static_cast<int>(i),
+        LevelFor(rv, rd, noise.adc_bits),
+        LevelFor(rv * (1 - vt), rd * (1 + dt), noise.adc_bits),
+        LevelFor(rv * (1 + vt), rd * (1 - dt), noise.adc_bits)};
+  }
+  std::sort(
+      c.levels.begin(), c.levels.end(), [](const Level& a, const Level& b) {
+        return a.nominal < b.nominal;
+      });
+  c.min_gap_lsb = std::numeric_limits<double>::infinity();
+  for (size_t i = 0; i < c.boundaries.size(); ++i) {
+    const double gap = c.levels[i + 1].low - c.levels[i].high;
+    c.boundaries[i] = (c.levels[i].high + c.levels[i + 1].low) / 2;
+    c.min_gap_lsb = std::min(c.min_gap_lsb, gap);
+  }
+  c.min_margin_sigma = c.min_gap_lsb / 2 / noise.sigma_lsb;
+  return c;
+}
+
+std::vector<Calibration> Search(
+    Series series,
+    std::span<const Position> positions,
+    const NoiseModel& noise,
+    size_t keep) {
+  const std::vector<double> values = SeriesValues(series);
+  std::vector<Calibration> results;
+  auto consider = [&](const Divider& d) {
+    Calibration c = Evaluate(d, positions, noise);
+    // Many pairs land within an ohm of each other; keep the first (the
+    // single resistor, or the pair with the smallest parts).
+    for (const Calibration& r : results) {
+      if (std::abs(r.divider.ohms() - d.ohms()) < 0.5) return;
+    }
+    results.push_back(c);
+  };
+  for (double r : values) consider({r, 0});
+  for (size_t i = 0; i < values.size(); ++i) {
+    for (size_t j = i; j < values.size(); ++j) consider({values[i], values[j]});
+  }
+  // Near the optimum the gap is flat, so differences under 0.1 LSB don't
+  // count; stable_sort then keeps single resistors ahead of pairs.
+  auto score = [](const Calibration& c) {
+    return std::floor(c.min_gap_lsb * 10);
+  };
+  std::stable_sort(
+      results.begin(),
+      results.end(),
+      [&](const Calibration& a, const Calibration& b) {
+        return score(a) > score(b);
+      });
+  if (results.size() > keep) results.resize(keep);
+  return results;
+}
+
+double WorstMisreadProbability(const Calibration& calibration) {
+  return 0.5 * std::erfc(calibration.min_margin_sigma / std::sqrt(2.0));
+}
+
+std::string GenerateHeader(const Calibration& c, const NoiseModel& noise) {
+  std::string out;
+  char line[256];
+  auto add = [&](const char* format, auto... args) {
+    snprintf(line, sizeof(line), format, args...);
+    out += line;
+  };
+  out += "// Generated by tools/windvane_calibrate. Do not edit.\n//\n";
+  add("// Divider: %s.\n", c.divider.Describe().c_str());
+  add(
+      "// Tolerances: vane %.1f%%, divider %.1f%%. ADC noise %.1f LSB rms at "
+      "%d bits.\n",
+      noise.vane_tolerance * 100,
+      noise.divider_tolerance * 100,
+      noise.sigma_lsb,
+      noise.adc_bits);
+  add(
+      "// Tightest pair: %.1f LSB apart at worst case, %.1f sigma to the "
+      "boundary (%.1e misreads per reading).\n",
+      c.min_gap_lsb,
+      c.min_margin_sigma,
+      WorstMisreadProbability(c));
+  out +=
+      "#pragma once\n\n"
+      "#include <array>\n"
+      "#include <cstdint>\n"
+      "#include <string_view>\n"
+      "#include <utility>\n\n"
+      "namespace windvane {\n\n";
+  add("inline constexpr int32_t kDividerOhms = %.0f;\n\n", c.divider.ohms());
+  out += "// Nominal ADC level of each vane position.\n";
+  out +=
+      "inline constexpr std::array<std::pair<std::string_view, int32_t>, 16> "
+      "kAdcTargets{{\n";
+  for (const Level& level : c.levels) {
+    add(
+        "    {\"%.*s\", %.0f},\n",
+        static_cast<int>(level.name.size()),
+        level.name.data(),
+        std::round(level.nominal));
+  }
+  out += "}};\n\n";
+  out +=
+      "// Positions in ascending level order. A reading r is "
+      "kSectorsByLevel[i]\n"
+      "// for the first i with r < kBoundaries[i], or the last position.\n"
+      "inline constexpr std::array<std::string_view, 16> kSectorsByLevel{\n";
+  for (const Level& level : c.levels) {
+    add(
+        "    \"%.*s\",\n",
+        static_cast<int>(level.name.size()),
+        level.name.data());
+  }
+  out += "};\n";
+  out +=
+      "// Compass index of each of kSectorsByLevel: 0 for N, clockwise in "
+      "22.5\n"
+      "// degree steps.\n"
+      "inline constexpr std::array<uint8_t, 16> kCompassIndexByLevel{\n";
+  for (const Level& level : c.levels) add("    %d,\n", level.compass_index);
+  out += "};\n";
+  out += "inline constexpr std::array<int32_t, 15> kBoundaries{\n";
+  for (double b : c.boundaries) add("    %.0f,\n", std::round(b));
+  out += "};\n\n}  // namespace windvane\n";
+  return out;
+}
+
+}  // namespace windvane
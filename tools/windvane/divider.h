@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace windvane {
+
+// The vane switches one or two of eight resistors to ground; where two reed
+// switches close at once the resistors are in parallel. The ADC sits between
+// the divider resistor (to 3V3, which is also the ADC reference) and the vane.
+struct Position {
+  std::string_view name;
+  double ohms;
+};
+// In compass order, N first.
+std::array<Position, 16> VanePositions();
+
+enum class Series { kE24, kE96 };
+// Standard values of `series` from 100 ohm to 1 Mohm.
+std::vector<double> SeriesValues(Series series);
+
+// A divider built from one resistor or two in parallel.
+struct Divider {
+  double r1 = 0;
+  double r2 = 0;  // Zero when r1 is used alone.
+  double ohms() const { return r2 == 0 ? r1 : r1 * r2 / (r1 + r2); }
+  std::string Describe() const;
+};
+
+struct NoiseModel {
+  int adc_bits = 12;
+  // Gaussian read noise. The RP2040 ADC manages about 8.7 effective bits,
+  // which is roughly 3 LSB rms at 12 bits.
+  double sigma_lsb = 3;
+  // Resistor tolerances; levels are placed at their worst-case corners.
+  double vane_tolerance = 0.01;
+  double divider_tolerance = 0.01;
+};
+
+struct Level {
+  std::string_view name;
+  int compass_index;  // 0 for N, clockwise in 22.5 degree steps.
+  double nominal;
+  double low;   // Worst case over resistor tolerances.
+  double high;
+};
+
+struct Calibration {
+  Divider divider;
+  // Ascending by nominal level.
+  std::array<Level, 16> levels;
+  // boundaries[i] separates levels[i] and levels[i + 1]: the midpoint of the
+  // gap between their tolerance bands.
+  std::array<double, 15> boundaries;
+  // Smallest gap between adjacent tolerance bands, in LSB, and the same gap
+  // measured from the boundary in noise sigmas.
+  double min_gap_lsb;
+  double min_margin_sigma;
+};
+
+Calibration Evaluate(
+    const Divider& divider,
+    std::span<const Position> positions,
+    const NoiseModel& noise);
+
+// Tries every single value and parallel pair of `series` and returns the
+// `keep` best by min_gap_lsb (to 0.1 LSB), preferring a single resistor on
+// ties.
+std::vector<Calibration> Search(
+    Series series,
+    std::span<const Position> positions,
+    const NoiseModel& noise,
+    size_t keep);
+
+// Probability that a reading at a tolerance corner lands across the nearest
+// boundary, for the tightest pair.
+double WorstMisreadProbability(const Calibration& calibration);
+
+// The header the firmware includes for LevelToDirection.
+std::string GenerateHeader(
+    const Calibration& calibration, const NoiseModel& noise);
+
+}  // namespace windvane
@@ -0,0 +1,141 @@
+// Picks the windvane divider resistor and generates the ADC level table the
+// firmware's LevelToDirection uses.
+//
+//   windvane_calibrate [--series=E96] [--divider=auto|OHMS|OHMS,OHMS]
+//                      [--sigma-lsb=3] [--vane-tolerance=0.01]
+//                      [--divider-tolerance=0.01] [--top=10] [--out=FILE]
+//
+// With --divider=auto every single resistor and parallel pair of the series
+// is tried and the one with the widest worst-case gap between adjacent levels
+// wins. Otherwise the given (fitted) divider is evaluated. --out writes the
+// header, leaving the file untouched if it wouldn't change so the firmware
+// isn't rebuilt needlessly.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "windvane/divider.h"
+
+namespace {
+
+void PrintCalibration(const windvane::Calibration& c) {
+  printf(
+      "%-32s min gap %6.1f LSB, margin %4.1f sigma, P(misread) %.1e\n",
+      c.divider.Describe().c_str(),
+      c.min_gap_lsb,
+      c.min_margin_sigma,
+      windvane::WorstMisreadProbability(c));
+}
+
+bool WriteIfChanged(const char* path, const std::string& contents) {
+  {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream existing;
+    existing << in.rdbuf();
+    if (in && existing.str() == contents) return true;
+  }
+  const std::string tmp = std::string(path) + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  if (!f) {
+    perror(tmp.c_str());
+    return false;
+  }
+  const bool ok =
+      fwrite(contents.data(), 1, contents.size(), f) == contents.size();
+  if (fclose(f) != 0 || !ok) {
+    perror(tmp.c_str());
+    return false;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    fprintf(stderr, "%s: %s\n", path, ec.message().c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  windvane::Series series = windvane::Series::kE96;
+  windvane::NoiseModel noise;
+  std::string_view divider_arg = "auto";
+  size_t top = 10;
+  const char* out_path = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    auto value = [&](std::string_view flag) { return argv[i] + flag.size(); };
+    if (arg == "--series=E24") {
+      series = windvane::Series::kE24;
+    } else if (arg == "--series=E96") {
+      series = windvane::Series::kE96;
+    } else if (arg.starts_with("--divider=")) {
+      divider_arg = value("--divider=");
+    } else if (arg.starts_with("--sigma-lsb=")) {
+      noise.sigma_lsb = atof(value("--sigma-lsb="));
+    } else if (arg.starts_with("--vane-tolerance=")) {
+      noise.vane_tolerance = atof(value("--vane-tolerance="));
+    } else if (arg.starts_with("--divider-tolerance=")) {
+      noise.divider_tolerance = atof(value("--divider-tolerance="));
+    } else if (arg.starts_with("--top=")) {
+      top = atoi(value("--top="));
+    } else if (arg.starts_with("--out=")) {
+      out_path = value("--out=");
+    } else {
+      fprintf(
+          stderr,
+          "usage: %s [--series=E24|E96] [--divider=auto|OHMS|OHMS,OHMS] "
+          "[--sigma-lsb=X] [--vane-tolerance=X] [--divider-tolerance=X] "
+          "[--top=N] [--out=FILE]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  const auto positions = windvane::VanePositions();
+  windvane::Calibration chosen;
+  if (divider_arg == "auto") {
+    const std::vector<windvane::Calibration> best =
+        windvane::Search(series, positions, noise, std::max<size_t>(top, 1));
+    if (!out_path) {
+      for (const windvane::Calibration& c : best) PrintCalibration(c);
+    }
+    chosen = best.front();
+  } else {
+    char* end;
+    windvane::Divider divider;
+    divider.r1 = strtod(divider_arg.data(), &end);
+    if (*end == ',') divider.r2 = strtod(end + 1, &end);
+    if (*end != '\0' || divider.r1 <= 0 || divider.r2 < 0) {
+      fprintf(stderr, "bad --divider: %s\n", divider_arg.data());
+      return 1;
+    }
+    chosen = windvane::Evaluate(divider, positions, noise);
+    if (!out_path) PrintCalibration(chosen);
+  }
+
+  if (!out_path) {
+    printf("\n%s", windvane::GenerateHeader(chosen, noise).c_str());
+    return 0;
+  }
+  if (chosen.min_gap_lsb <= 0) {
+    fprintf(
+        stderr,
+        "windvane: %s leaves overlapping levels\n",
+        chosen.divider.Describe().c_str());
+    return 1;
+  }
+  printf("windvane: ");
+  PrintCalibration(chosen);
+  const std::string header = windvane::GenerateHeader(chosen, noise);
+  return WriteIfChanged(out_path, header) ? 0 : 1;
+}